@@ -0,0 +1,675 @@
+#include "autosave.h"
+#include "mainwindow.h"
+#include "undojournal.h"
+#include "layeritem.h"
+#include "primitivebatch.h"
+#include "shapeitem.h"
+#include "strokeitem.h"
+#include "chbdocument.h"
+#include "binarycodec.h"
+#include "selector.h"
+#include <QApplication>
+#include <QGraphicsScene>
+#include <QDir>
+#include <QTimer>
+#include <QMutexLocker>
+#include <QtEndian>
+#include <QtMath>
+#include <QtGlobal>
+#include <cstring>
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char Magic[4] = { 'C', 'H', 'B', 'J' };
+const int HeaderSize = 12;               // 魔数 + u16 版本 + u16 保留 + u32 代
+const int FrameHeaderSize = 6;           // u32 长度 + u16 校验
+const int SnapshotEntries = 500;         // 超过这么多条记录后在空闲时重新做快照
+const qint64 SnapshotBytes = qint64(32) * 1024 * 1024; // 或者数据量超过这么多
+const int IdleMilliseconds = 2000;       // 输入停止这么久才做快照
+const int RetryMilliseconds = 250;       // 正在绘制时推迟快照的间隔
+
+// 写到磁盘：先交给系统，再要求落盘
+bool syncFile(QFile &file) {
+    if (!file.flush()) return false;
+#if defined(Q_OS_WIN)
+    return FlushFileBuffers(reinterpret_cast<HANDLE>(_get_osfhandle(file.handle()))) != 0;
+#else
+    return ::fsync(file.handle()) == 0;
+#endif
+}
+
+// 改名后目录项也要落盘，否则崩溃后可能看不到新文件（Windows 不需要）
+void syncDirectory(const QString &path) {
+#if !defined(Q_OS_WIN)
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY);
+    if (fd < 0) return;
+    ::fsync(fd);
+    ::close(fd);
+#else
+    Q_UNUSED(path);
+#endif
+}
+
+// 记录帧：u32 长度 | u16 校验 | u8 类型 | 数据（长度和校验都覆盖类型和数据）
+QByteArray frame(quint8 type, const QByteArray &payload) {
+    QByteArray content;
+    content.reserve(payload.size() + 1);
+    content.append(char(type));
+    content.append(payload);
+    QByteArray framed(FrameHeaderSize, Qt::Uninitialized);
+    qToLittleEndian(quint32(content.size()), reinterpret_cast<uchar*>(framed.data()));
+    qToLittleEndian(quint16(qChecksum(content.constData(), uint(content.size()))),
+                    reinterpret_cast<uchar*>(framed.data() + 4));
+    framed.append(content);
+    return framed;
+}
+
+// 文件名中的代：snapshot-12.chb、journal-12.log、snapshot-12.chb.tmp，不是自动保存文件时为 0
+quint32 generationOf(const QString &fileName) {
+    const int dash = fileName.indexOf('-');
+    const int dot = fileName.indexOf('.');
+    if (dash < 0 || dot <= dash) return 0;
+    return fileName.mid(dash + 1, dot - dash - 1).toUInt();
+}
+
+QString snapshotName(quint32 generation) {
+    return QString("snapshot-%1.chb").arg(generation);
+}
+
+QString journalName(quint32 generation) {
+    return QString("journal-%1.log").arg(generation);
+}
+
+QStringList autosaveFiles(const QDir &dir) {
+    return dir.entryList(QStringList() << "snapshot-*" << "journal-*", QDir::Files);
+}
+
+}
+
+AutosaveWriter::AutosaveWriter(const QString &directory, QObject *parent)
+    : QThread(parent),
+      directory(directory),
+      stopping(false),
+      written(0),
+      syncs(0) {
+}
+
+AutosaveWriter::~AutosaveWriter() {
+    stop();
+}
+
+void AutosaveWriter::startGeneration(quint32 generation, const QVector<ChbDocument::DeferredRecord> &snapshot,
+                                     const QByteArray &base) {
+    Task task;
+    task.generation = generation;
+    task.snapshot = snapshot;
+    task.base = base;
+    QMutexLocker locker(&mutex);
+    queue.append(task);
+    wake.wakeOne();
+}
+
+void AutosaveWriter::append(const QList<AutosaveAction> &actions) {
+    Task task;
+    task.actions = actions;
+    QMutexLocker locker(&mutex);
+    queue.append(task);
+    wake.wakeOne();
+}
+
+void AutosaveWriter::stop() {
+    {
+        QMutexLocker locker(&mutex);
+        stopping = true;
+        wake.wakeOne();
+    }
+    wait();
+}
+
+quint64 AutosaveWriter::bytesWritten() const {
+    QMutexLocker locker(&mutex);
+    return written;
+}
+
+quint64 AutosaveWriter::syncCount() const {
+    QMutexLocker locker(&mutex);
+    return syncs;
+}
+
+// 每次醒来取走队列中的全部任务，合并成一次写入和一次 fsync：
+// fsync 期间新到的记录自然攒成下一批，写入频率随磁盘速度自动调节
+void AutosaveWriter::run() {
+    QFile log;
+    forever {
+        QList<Task> tasks;
+        bool last;
+        {
+            QMutexLocker locker(&mutex);
+            while (queue.isEmpty() && !stopping) wake.wait(&mutex);
+            tasks.swap(queue);
+            last = stopping;
+        }
+        QByteArray batch;
+        foreach (const Task &task, tasks) {
+            if (task.generation != 0) {
+                if (!batch.isEmpty() && log.isOpen()) {
+                    log.write(batch);
+                    syncFile(log);
+                }
+                batch.clear();
+                beginGeneration(task, log);
+            } else if (log.isOpen()) {
+                batch.append(frame(AutosaveLog::Entry, encodeEntry(task.actions)));
+            }
+        }
+        if (!batch.isEmpty() && log.isOpen()) {
+            log.write(batch);
+            syncFile(log);
+            QMutexLocker locker(&mutex);
+            written += batch.size();
+            ++syncs;
+        }
+        if (last) break;
+    }
+    log.close();
+}
+
+// 快照先写成临时文件、落盘后改名，再建新日志；都落盘之后才删除旧的一代，任何时刻崩溃都至少有一代完整
+bool AutosaveWriter::beginGeneration(const Task &task, QFile &log) {
+    QDir dir(directory);
+    log.close();
+    const QString snapshotPath = dir.filePath(snapshotName(task.generation));
+    QFile snapshot(snapshotPath + ".tmp");
+    if (!snapshot.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+    const bool ok = ChbDocument::writeDeferred(&snapshot, task.snapshot, nullptr) && syncFile(snapshot);
+    snapshot.close();
+    QFile::remove(snapshotPath);
+    if (!ok || !snapshot.rename(snapshotPath)) {
+        snapshot.remove();
+        return false;
+    }
+
+    log.setFileName(dir.filePath(journalName(task.generation)));
+    if (!log.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+    QByteArray header(Magic, 4);
+    BinaryWriter out(&header);
+    out.u16(AutosaveLog::Version);
+    out.u16(0);
+    out.u32(task.generation);
+    header.append(frame(AutosaveLog::Base, task.base));
+    if (log.write(header) != header.size() || !syncFile(log)) {
+        log.close();
+        return false;
+    }
+    syncDirectory(directory);
+
+    foreach (const QString &name, autosaveFiles(dir)) {
+        if (generationOf(name) < task.generation) dir.remove(name);
+    }
+    return true;
+}
+
+// 笔刷瓦片和栅格像素在这里才压缩成 PNG，格式与文档中的笔刷记录体相同
+QByteArray AutosaveWriter::encodeEntry(const QList<AutosaveAction> &actions) {
+    QByteArray payload;
+    BinaryWriter out(&payload);
+    out.varint(quint64(actions.size()));
+    foreach (const AutosaveAction &action, actions) {
+        out.u8(action.kind);
+        switch (action.kind) {
+        case AutosaveLog::AddItem: {
+            out.varint(action.id);
+            out.varint(quint64(action.layer));
+            out.svarint(action.z);
+            out.point(action.vector);
+            out.u8(action.tag);
+            QByteArray body = action.body;
+            if (action.tag == ChbDocument::BrushRecord) {
+                BinaryWriter bodyOut(&body);
+                ChbDocument::encodeTiles(action.tiles, bodyOut);
+            }
+            out.bytes(body);
+            break;
+        }
+        case AutosaveLog::RemoveItem:
+            out.varint(action.id);
+            break;
+        case AutosaveLog::MoveItem:
+            out.varint(action.id);
+            out.point(action.vector);
+            break;
+        case AutosaveLog::StyleItem:
+            out.varint(action.id);
+            out.bytes(action.body);
+            break;
+        case AutosaveLog::ClearTiles:
+        case AutosaveLog::RestoreTiles:
+            out.varint(quint64(action.layer));
+            ChbDocument::encodeTiles(action.tiles, out);
+            break;
+        case AutosaveLog::BakeItems:
+            out.varint(quint64(action.layer));
+            out.varint(quint64(action.ids.size()));
+            foreach (quint32 id, action.ids) out.varint(id);
+            break;
+        }
+    }
+    return payload;
+}
+
+Autosave::Autosave(DrawingView *view, UndoJournal *journal, const QString &directory, QObject *parent)
+    : QObject(parent),
+      view(view),
+      journal(journal),
+      directory(directory),
+      lock(QDir(directory).filePath("autosave.lock")),
+      writerThread(new AutosaveWriter(directory, this)),
+      idleTimer(new QTimer(this)),
+      nextId(1),
+      generation(0),
+      entriesSinceSnapshot(0),
+      bytesSinceSnapshot(0),
+      started(false),
+      suspended(false),
+      stale(false),
+      snapshots(0) {
+    idleTimer->setSingleShot(true);
+    connect(idleTimer, &QTimer::timeout, this, &Autosave::trySnapshot);
+}
+
+Autosave::~Autosave() {
+    writerThread->stop();
+    if (started) {
+        QDir dir(directory);
+        foreach (const QString &name, autosaveFiles(dir)) dir.remove(name);
+    }
+    lock.unlock();
+}
+
+// 锁文件记录持有者的进程号，上次崩溃留下的锁会被识别为过期并接管
+bool Autosave::open(QString *error) {
+    if (!QDir().mkpath(directory)) {
+        if (error) *error = QString("无法创建目录 %1").arg(directory);
+        return false;
+    }
+    if (!lock.tryLock(0)) {
+        if (error) *error = "自动保存目录正被另一个窗口使用";
+        return false;
+    }
+    return true;
+}
+
+int Autosave::latestGeneration() const {
+    int latest = 0;
+    foreach (const QString &name, QDir(directory).entryList(QStringList() << "snapshot-*.chb", QDir::Files)) {
+        latest = qMax(latest, int(generationOf(name)));
+    }
+    return latest;
+}
+
+bool Autosave::hasRecovery() const {
+    return latestGeneration() > 0;
+}
+
+void Autosave::discardRecovery() {
+    QDir dir(directory);
+    foreach (const QString &name, autosaveFiles(dir)) dir.remove(name);
+}
+
+// 恢复：加载快照，按 Base 记录还原层叠次序，再逐条重放日志。日志末尾写了一半的记录（长度越界或校验不符）丢弃。
+// 批量层中的图元恢复为独立形状；历史不恢复
+bool Autosave::recover(QString *error, int *replayed) {
+    const int latest = latestGeneration();
+    if (latest == 0) {
+        if (error) *error = "没有可恢复的内容";
+        return false;
+    }
+    QDir dir(directory);
+    QGraphicsScene *scene = view->scene();
+
+    QVector<QGraphicsItem*> records;
+    DocumentLoader loader(scene);
+    connect(&loader, &DocumentLoader::recordCreated, [&records](int record, QGraphicsItem *item) {
+        records[record] = item;
+    });
+    if (!loader.open(dir.filePath(snapshotName(latest)), error)) return false;
+    records.fill(nullptr, loader.recordCount());
+    loader.start(view->reserveZ(loader.recordCount()), QRectF());
+    loader.finish();
+    const QList<LayerItem*> layers = LayerItem::layers(scene);
+
+    QHash<quint32, QGraphicsItem*> items;
+    for (int i = 0; i < records.size(); ++i) {
+        if (records[i]) items.insert(quint32(i + 1), records[i]);
+    }
+    qreal maxZ = 0;
+    int entries = 0;
+
+    QFile file(dir.filePath(journalName(latest)));
+    QByteArray data;
+    if (file.open(QIODevice::ReadOnly)) data = file.readAll();
+    const uchar *bytes = reinterpret_cast<const uchar*>(data.constData());
+    if (data.size() >= HeaderSize && std::memcmp(bytes, Magic, 4) == 0
+        && qFromLittleEndian<quint16>(bytes + 4) <= AutosaveLog::Version
+        && qFromLittleEndian<quint32>(bytes + 8) == quint32(latest)) {
+        int offset = HeaderSize;
+        while (offset + FrameHeaderSize < data.size()) {
+            const quint32 length = qFromLittleEndian<quint32>(bytes + offset);
+            const quint16 checksum = qFromLittleEndian<quint16>(bytes + offset + 4);
+            const int start = offset + FrameHeaderSize;
+            if (length == 0 || length > quint32(data.size() - start)
+                || qChecksum(data.constData() + start, length) != checksum) {
+                break;
+            }
+            offset = start + int(length);
+            BinaryReader in(bytes + start + 1, length - 1);
+            const quint8 type = bytes[start];
+
+            if (type == AutosaveLog::Base) {
+                const quint64 count = in.varint();
+                qint64 z = 0;
+                for (quint64 i = 0; i < count && in.isOk(); ++i) {
+                    z += in.svarint();
+                    if (QGraphicsItem *item = items.value(quint32(i + 1))) {
+                        item->setZValue(z);
+                        maxZ = qMax(maxZ, qreal(z));
+                    }
+                }
+                continue;
+            }
+            if (type != AutosaveLog::Entry) continue;
+
+            const quint64 count = in.varint();
+            for (quint64 n = 0; n < count && in.isOk(); ++n) {
+                const quint8 kind = in.u8();
+                if (kind == AutosaveLog::AddItem) {
+                    const quint32 id = quint32(in.varint());
+                    const int layer = int(in.varint());
+                    const qint64 z = in.svarint();
+                    const QPointF pos = in.point();
+                    const quint8 tag = in.u8();
+                    const QByteArray body = in.bytes();
+                    if (!in.isOk() || layer >= layers.size()) break;
+                    BinaryReader bodyIn(reinterpret_cast<const uchar*>(body.constData()), quint32(body.size()));
+                    QGraphicsItem *item = ChbDocument::decodeItem(tag, bodyIn);
+                    if (!item) continue;
+                    item->setPos(pos);
+                    item->setZValue(z);
+                    maxZ = qMax(maxZ, qreal(z));
+                    layers[layer]->adopt(item);
+                    if (QGraphicsItem *old = items.value(id)) {
+                        scene->removeItem(old);
+                        delete old;
+                    }
+                    items.insert(id, item);
+                } else if (kind == AutosaveLog::RemoveItem) {
+                    if (QGraphicsItem *item = items.take(quint32(in.varint()))) {
+                        scene->removeItem(item);
+                        delete item;
+                    }
+                } else if (kind == AutosaveLog::MoveItem) {
+                    QGraphicsItem *item = items.value(quint32(in.varint()));
+                    const QPointF offset = in.point();
+                    if (!item) continue;
+                    LayerItem::touch(item);
+                    item->moveBy(offset.x(), offset.y());
+                    LayerItem::touch(item);
+                } else if (kind == AutosaveLog::StyleItem) {
+                    QGraphicsItem *item = items.value(quint32(in.varint()));
+                    const QByteArray body = in.bytes();
+                    BinaryReader penIn(reinterpret_cast<const uchar*>(body.constData()), quint32(body.size()));
+                    const QPen pen = penIn.pen();
+                    if (item && penIn.isOk()) Selector::setStyle(item, pen);
+                } else if (kind == AutosaveLog::ClearTiles || kind == AutosaveLog::RestoreTiles) {
+                    const int layer = int(in.varint());
+                    const TilePatches tiles = ChbDocument::decodeTiles(in);
+                    if (!in.isOk() || layer >= layers.size()) break;
+                    if (kind == AutosaveLog::ClearTiles) {
+                        layers[layer]->bakedTiles()->removePatches(tiles);
+                    } else {
+                        layers[layer]->bakedTiles()->restorePatches(tiles);
+                    }
+                } else if (kind == AutosaveLog::BakeItems) {
+                    const int layer = int(in.varint());
+                    const quint64 idCount = in.varint();
+                    QList<QGraphicsItem*> baked;
+                    for (quint64 i = 0; i < idCount && in.isOk(); ++i) {
+                        if (QGraphicsItem *item = items.take(quint32(in.varint()))) baked.append(item);
+                    }
+                    if (!in.isOk() || layer >= layers.size()) break;
+                    layers[layer]->bakedTiles()->bakeItems(baked);
+                    foreach (QGraphicsItem *item, baked) {
+                        scene->removeItem(item);
+                        delete item;
+                    }
+                } else {
+                    break;
+                }
+            }
+            ++entries;
+        }
+    }
+
+    // 之后新画的图形排在恢复的内容之上
+    const qreal base = view->reserveZ(0);
+    if (maxZ + 1 > base) view->reserveZ(qCeil(maxZ + 1 - base));
+    if (replayed) *replayed = entries;
+    return true;
+}
+
+void Autosave::start() {
+    if (started) return;
+    started = true;
+    generation = quint32(latestGeneration());
+    connect(journal, &UndoJournal::applied, this, &Autosave::onApplied);
+    connect(journal, &UndoJournal::baking, this, &Autosave::onBaking);
+    connect(view, &DrawingView::strokeReshaped, this, &Autosave::onStrokeReshaped);
+    writerThread->start(QThread::LowPriority);
+    takeSnapshot();
+}
+
+void Autosave::suspend() {
+    suspended = true;
+    idleTimer->stop();
+}
+
+void Autosave::resume() {
+    if (!suspended) return;
+    suspended = false;
+    invalidate();
+}
+
+void Autosave::markLayersChanged() {
+    if (!started || suspended) return;
+    idleTimer->start(IdleMilliseconds);
+}
+
+// 远端操作不经过撤回日志：日志从此不再完整，连续到来时合并成一份快照
+void Autosave::markExternalChange() {
+    if (!started || suspended) return;
+    stale = true;
+    if (!idleTimer->isActive()) idleTimer->start(IdleMilliseconds);
+}
+
+void Autosave::invalidate() {
+    stale = true;
+    idleTimer->start(0);
+}
+
+// 快照只在没有进行中的绘制时做：预览和拖动中的图形还没有提交，不能写进快照
+void Autosave::trySnapshot() {
+    if (!started || suspended) return;
+    if (!view->isIdle() || QApplication::mouseButtons() != Qt::NoButton) {
+        idleTimer->start(RetryMilliseconds);
+        return;
+    }
+    takeSnapshot();
+}
+
+// 快照在 GUI 线程只取出记录（图形的廉价编码和瓦片的浅拷贝），PNG 压缩、写盘和 fsync 交给写入线程。
+// 编号按快照中的记录顺序重新分配
+void Autosave::takeSnapshot() {
+    QVector<ChbDocument::SavedRecord> saved;
+    const QList<LayerItem*> layers = LayerItem::layers(view->scene());
+    const QVector<ChbDocument::DeferredRecord> records = ChbDocument::collect(layers, &saved);
+
+    ids.clear();
+    layerIndex.clear();
+    for (int i = 0; i < layers.size(); ++i) {
+        layerIndex.insert(layers[i], i);
+    }
+    QByteArray base;
+    BinaryWriter out(&base);
+    out.varint(quint64(saved.size()));
+    qint64 lastZ = 0;
+    for (int i = 0; i < saved.size(); ++i) {
+        const ChbDocument::SavedRecord &record = saved[i];
+        const qint64 z = record.item ? qRound64(record.item->zValue()) : 0;
+        if (record.item) ids.insert(ContentKey(record.item, record.primitive), quint32(i + 1));
+        out.svarint(z - lastZ);
+        lastZ = z;
+    }
+    nextId = quint32(saved.size() + 1);
+    writerThread->startGeneration(++generation, records, base);
+    entriesSinceSnapshot = 0;
+    bytesSinceSnapshot = 0;
+    stale = false;
+    ++snapshots;
+}
+
+quint32 Autosave::assign(const ContentKey &key) {
+    const quint32 id = nextId++;
+    ids.insert(key, id);
+    return id;
+}
+
+int Autosave::layerIndexOf(QGraphicsItem *item) const {
+    LayerItem *layer = item ? qgraphicsitem_cast<LayerItem*>(item->parentItem()) : nullptr;
+    return layerIndex.value(layer, -1);
+}
+
+bool Autosave::addItemAction(QGraphicsItem *item, const ContentKey &key, int layer, QList<AutosaveAction> *actions,
+                             quint32 id) {
+    if (layer < 0) return false;
+    AutosaveAction action;
+    action.kind = AutosaveLog::AddItem;
+    action.layer = layer;
+    action.z = qRound64(item->zValue());
+    action.vector = item->pos();
+    BinaryWriter out(&action.body);
+    action.tag = ChbDocument::encodeItem(item, out, &action.tiles);
+    if (action.tag == ChbDocument::EndRecord) return false;
+    action.id = id ? id : assign(key);
+    bytesSinceSnapshot += action.body.size() + TileLayer::patchBytes(action.tiles) / 4;
+    actions->append(action);
+    return true;
+}
+
+// 一条记录折算成自包含的操作：出现的图形（含撤回时放回的）按当时的状态完整编码，
+// 消失的和原地修改的图形按编号指代。任何一项表达不了（图层增删、编号未知）就改为重新做快照
+void Autosave::onApplied(const JournalEntry &entry, bool forward) {
+    if (!started || suspended || stale) return;
+    const QList<QGraphicsItem*> &gone = forward ? entry.removed : entry.added;
+    const QList<QGraphicsItem*> &come = forward ? entry.added : entry.removed;
+    const QVector<PrimitiveRef> &primitivesGone = forward ? entry.removedPrimitives : entry.addedPrimitives;
+    const QVector<PrimitiveRef> &primitivesCome = forward ? entry.addedPrimitives : entry.removedPrimitives;
+
+    QList<AutosaveAction> actions;
+    AutosaveAction action;
+    action.kind = AutosaveLog::RemoveItem;
+    foreach (QGraphicsItem *item, gone) {
+        action.id = ids.take(ContentKey(item, -1));
+        if (!action.id || qgraphicsitem_cast<LayerItem*>(item)) return invalidate();
+        actions.append(action);
+    }
+    foreach (const PrimitiveRef &ref, primitivesGone) {
+        action.id = ids.take(ContentKey(ref.batch, ref.index));
+        if (!action.id) return invalidate();
+        actions.append(action);
+    }
+    foreach (QGraphicsItem *item, come) {
+        if (qgraphicsitem_cast<LayerItem*>(item)
+            || !addItemAction(item, ContentKey(item, -1), layerIndexOf(item), &actions)) {
+            return invalidate();
+        }
+    }
+    foreach (const PrimitiveRef &ref, primitivesCome) {
+        ShapeItem *shape = ref.batch->toShapeItem(ref.index);
+        const bool ok = addItemAction(shape, ContentKey(ref.batch, ref.index), layerIndexOf(ref.batch), &actions);
+        delete shape;
+        if (!ok) return invalidate();
+    }
+    if (entry.patchLayer && !entry.tilePatches.isEmpty()) {
+        AutosaveAction tiles;
+        tiles.kind = forward ? AutosaveLog::ClearTiles : AutosaveLog::RestoreTiles;
+        tiles.layer = layerIndexOf(entry.patchLayer);
+        tiles.tiles = entry.tilePatches;
+        if (tiles.layer < 0) return invalidate();
+        bytesSinceSnapshot += TileLayer::patchBytes(tiles.tiles) / 4;
+        actions.append(tiles);
+    }
+    for (int n = 0; n < entry.edits.size(); ++n) {
+        const ItemEdit &edit = entry.edits[forward ? n : entry.edits.size() - 1 - n];
+        if (come.contains(edit.item) || gone.contains(edit.item)) continue; // 已按生效后的状态编码或已删除
+        AutosaveAction change;
+        change.id = ids.value(ContentKey(edit.item, -1));
+        if (!change.id) return invalidate();
+        if (edit.restyled) {
+            change.kind = AutosaveLog::StyleItem;
+            BinaryWriter out(&change.body);
+            out.pen(forward ? edit.styleAfter : edit.styleBefore);
+            actions.append(change);
+        }
+        if (!edit.offset.isNull()) {
+            change.kind = AutosaveLog::MoveItem;
+            change.vector = forward ? edit.offset : -edit.offset;
+            actions.append(change);
+        }
+    }
+    if (actions.isEmpty()) return;
+    appendEntry(actions);
+}
+
+void Autosave::appendEntry(const QList<AutosaveAction> &actions) {
+    writerThread->append(actions);
+    ++entriesSinceSnapshot;
+    if (entriesSinceSnapshot >= SnapshotEntries || bytesSinceSnapshot >= SnapshotBytes) {
+        idleTimer->start(IdleMilliseconds);
+    }
+}
+
+// 后台简化完成后已提交笔迹的几何被替换：按原编号重新编码一次，恢复时替换掉原始折线。
+// 编号未知的笔迹还没有写进日志（之后按简化后的几何写入）或已被删除、烘焙，不必处理
+void Autosave::onStrokeReshaped(StrokeItem *stroke) {
+    if (!started || suspended || stale) return;
+    const ContentKey key(stroke, -1);
+    const quint32 id = ids.value(key);
+    if (!id) return;
+    QList<AutosaveAction> actions;
+    if (!addItemAction(stroke, key, layerIndexOf(stroke), &actions, id)) return invalidate();
+    appendEntry(actions);
+}
+
+// 淘汰的历史烘焙进栅格：恢复时用同样的图形按同样的次序烘焙，得到相同的瓦片
+void Autosave::onBaking(LayerItem *layer, const QList<QGraphicsItem*> &items) {
+    if (!started || suspended || stale) return;
+    AutosaveAction action;
+    action.kind = AutosaveLog::BakeItems;
+    action.layer = layerIndex.value(layer, -1);
+    if (action.layer < 0) return invalidate();
+    foreach (QGraphicsItem *item, items) {
+        const quint32 id = ids.take(ContentKey(item, -1));
+        if (!id) return invalidate();
+        action.ids.append(id);
+    }
+    QList<AutosaveAction> actions;
+    actions.append(action);
+    writerThread->append(actions);
+}
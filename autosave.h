@@ -0,0 +1,166 @@
+#ifndef AUTOSAVE_H
+#define AUTOSAVE_H
+
+#include <QObject>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QHash>
+#include <QPair>
+#include <QList>
+#include <QVector>
+#include <QByteArray>
+#include <QPointF>
+#include <QString>
+#include <QLockFile>
+#include <QFile>
+#include "tilelayer.h"
+#include "chbdocument.h"
+
+class QGraphicsItem;
+class QTimer;
+class DrawingView;
+class UndoJournal;
+class LayerItem;
+class StrokeItem;
+struct JournalEntry;
+
+// 自动保存（崩溃恢复）目录中按“代”成对存放：
+//   snapshot-<代>.chb  某一时刻的完整文档（与 .chb 文档格式相同）
+//   journal-<代>.log   之后每条生效的历史记录（新记录、撤回、重做）折算成的操作，只追加
+// 日志：“CHBJ” | u16 版本 | u16 保留 | u32 代，之后是连续的记录
+//   记录  u32 长度 | u16 校验（qChecksum）| u8 类型 | 类型相关数据；长度或校验不符处视为崩溃时写了一半，之后的丢弃
+// 第一条是 Base 记录（快照中每条图形记录原来的层叠次序），之后每条 Entry 记录是一条历史的全部操作，恢复时整条生效或整条丢弃。
+// 操作里的图形用编号指代：快照中第 i 条记录为 i + 1，之后新出现的图形继续编号；图层用它在快照中的序号指代
+namespace AutosaveLog {
+
+enum { Version = 1 };
+
+enum RecordType {
+    Base = 1,           // 快照记录数 + 各记录的层叠次序
+    Entry = 2           // 一条历史的操作
+};
+
+enum ActionKind {
+    AddItem = 1,        // 编号 | 图层 | 层叠次序 | 位置 | 图形记录类型 | 记录体
+    RemoveItem = 2,     // 编号
+    MoveItem = 3,       // 编号 | 位移
+    StyleItem = 4,      // 编号 | 画笔
+    ClearTiles = 5,     // 图层 | 瓦片（以其透明度为遮罩清除图层栅格）
+    RestoreTiles = 6,   // 图层 | 瓦片（贴回图层栅格）
+    BakeItems = 7       // 图层 | 编号列表（按层叠次序画进图层栅格后删除）
+};
+
+}
+
+// 一个操作：在 GUI 线程只做浅拷贝和廉价的编码，笔刷和栅格瓦片的 PNG 压缩留给写入线程
+struct AutosaveAction {
+    quint8 kind = 0;
+    quint32 id = 0;              // 图形编号
+    int layer = -1;              // 图层在快照中的序号
+    qint64 z = 0;                // 层叠次序
+    QPointF vector;              // 位置或位移
+    quint8 tag = 0;              // 图形记录类型
+    QByteArray body;             // 图形记录体（笔刷不含瓦片）或画笔
+    TilePatches tiles;           // 笔刷瓦片或栅格像素（隐式共享）
+    QVector<quint32> ids;        // 烘焙的图形
+};
+
+// 写入线程：排队的操作成批编码、写入并 fsync，GUI 线程只做加锁入队；开始新一代时先写好快照再换日志文件，
+// 快照中瓦片和笔刷的 PNG 压缩也在这里做
+class AutosaveWriter : public QThread {
+    Q_OBJECT
+public:
+    explicit AutosaveWriter(const QString &directory, QObject *parent = nullptr);
+    ~AutosaveWriter();
+
+    void startGeneration(quint32 generation, const QVector<ChbDocument::DeferredRecord> &snapshot,
+                         const QByteArray &base);    // 换到新的一代
+    void append(const QList<AutosaveAction> &actions);   // 追加一条 Entry 记录（写入当前这一代）
+    void stop();                                 // 写完队列中的内容后结束线程
+
+    quint64 bytesWritten() const;                // 已写入日志的字节数（不含快照）
+    quint64 syncCount() const;                   // fsync 次数（每批一次）
+
+protected:
+    void run() override;
+
+private:
+    struct Task {
+        quint32 generation = 0;                  // 非 0 时为换代
+        QVector<ChbDocument::DeferredRecord> snapshot;
+        QByteArray base;
+        QList<AutosaveAction> actions;
+    };
+
+    bool beginGeneration(const Task &task, QFile &log); // 写快照、建新日志、删除旧的代
+    static QByteArray encodeEntry(const QList<AutosaveAction> &actions);
+
+    QString directory;
+    mutable QMutex mutex;
+    QWaitCondition wake;
+    QList<Task> queue;                           // 待写的任务（受 mutex 保护）
+    bool stopping;
+    quint64 written;
+    quint64 syncs;
+};
+
+// 自动保存：监听撤回日志，把每条生效的记录折算成自包含的操作交给写入线程；
+// 操作数或日志大小超过阈值后在空闲时重新做快照，恢复时只需加载快照再重放有限条操作。
+// 图层的增删（含清空画布）和图层属性变化不写日志，直接重新做快照
+class Autosave : public QObject {
+    Q_OBJECT
+public:
+    Autosave(DrawingView *view, UndoJournal *journal, const QString &directory, QObject *parent = nullptr);
+    ~Autosave();                                 // 正常退出：停止写入并删除全部自动保存文件
+
+    bool open(QString *error);                   // 建立并加锁目录（另一实例正在使用该目录时失败）
+    bool hasRecovery() const;                    // 目录中有上次未正常退出时留下的快照
+    bool recover(QString *error, int *replayed = nullptr); // 加载快照并重放日志（open 之后、start 之前，场景中没有图层时调用）
+    void discardRecovery();                      // 放弃上次留下的内容
+    void start();                                // 开始记录：先做第一份快照
+
+    void suspend();                              // 暂停记录（打开文档期间）
+    void resume();                               // 恢复记录并重新做快照
+    void markLayersChanged();                    // 图层属性变化：空闲时重新做快照
+    void markExternalChange();                   // 内容被历史之外的途径改动（实时同步）：停止记录，空闲时重新做快照
+    AutosaveWriter *writer() const { return writerThread; }
+    int snapshotCount() const { return snapshots; }
+
+private slots:
+    void onApplied(const JournalEntry &entry, bool forward);
+    void onBaking(LayerItem *layer, const QList<QGraphicsItem*> &items);
+    void onStrokeReshaped(StrokeItem *stroke);
+    void trySnapshot();                          // 空闲时做快照，否则稍后再试
+
+private:
+    typedef QPair<const void*, int> ContentKey;  // 图形（序号 -1）或批量层中的图元
+
+    void invalidate();                           // 日志无法表达当前变化：停止记录直到下一份快照
+    void takeSnapshot();
+    bool addItemAction(QGraphicsItem *item, const ContentKey &key, int layer, QList<AutosaveAction> *actions,
+                       quint32 id = 0);          // 图形的完整编码（id 为 0 时分配新编号，否则替换该编号），无法表示时返回 false
+    void appendEntry(const QList<AutosaveAction> &actions); // 交给写入线程，累计到阈值时安排快照
+    quint32 assign(const ContentKey &key);       // 分配新编号
+    int latestGeneration() const;                // 目录中最新一份快照的代，没有为 0
+    int layerIndexOf(QGraphicsItem *item) const; // 图形所在图层在快照中的序号，未知为 -1
+
+    DrawingView *view;
+    UndoJournal *journal;
+    QString directory;
+    QLockFile lock;
+    AutosaveWriter *writerThread;
+    QTimer *idleTimer;                           // 快照的空闲等待
+    QHash<ContentKey, quint32> ids;              // 图形 -> 编号（快照时重建）
+    QHash<LayerItem*, int> layerIndex;           // 图层 -> 在快照中的序号
+    quint32 nextId;
+    quint32 generation;
+    int entriesSinceSnapshot;                    // 快照之后写入的记录数
+    qint64 bytesSinceSnapshot;                   // 快照之后写入的数据量（估算）
+    bool started;
+    bool suspended;
+    bool stale;                                  // 日志已无法表达当前状态，等待快照
+    int snapshots;
+};
+
+#endif // AUTOSAVE_H
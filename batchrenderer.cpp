@@ -0,0 +1,362 @@
+#include "batchrenderer.h"
+#include "mainwindow.h"
+#include "undojournal.h"
+#include "eraser.h"
+#include "inputtrace.h"
+#include "chbdocument.h"
+#include "layeritem.h"
+#include "imageexporter.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QGraphicsScene>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFileInfo>
+#include <QDir>
+#include <QSaveFile>
+#include <QImageWriter>
+#include <QScopedPointer>
+#include <QTextStream>
+#include <QtConcurrent>
+#include <QtMath>
+
+namespace {
+
+const QSizeF EmptyCanvas(800, 600);          // 空画布的输出范围（与新窗口的初始画布相同）
+const qreal Margin = 8;                      // 内容包围盒四周的留白（与“保存图片”相同）
+
+// 回放轨迹用的最小会话：不显示的视图、第一个图层和历史日志，
+// 代替主窗口接收绘制、擦除、撤回/重做/清空和图层命令，不创建工具栏和面板
+class TraceSession {
+public:
+    explicit TraceSession(QGraphicsScene *scene)
+        : view(scene),
+          journal(scene),
+          replayer(&view),
+          layerSerial(1) {
+        LayerItem *layer = new LayerItem("图层 1");
+        scene->addItem(layer);
+        view.setCurrentLayer(layer);
+        view.resize(1280, 900);
+        UndoJournal *history = &journal;
+        DrawingView *drawingView = &view;
+        TraceSession *session = this;
+        QObject::connect(&view, &DrawingView::itemDrawn, [history](QGraphicsItem *item, int primitive) {
+            history->record(JournalEntry::drawn(item, primitive));
+        });
+        QObject::connect(&view, &DrawingView::itemsErased, [history](const EraseResult &result) {
+            history->record(JournalEntry::erased(result));
+        });
+        QObject::connect(&view, &DrawingView::textEdited, [history](QGraphicsItem *before, QGraphicsItem *after) {
+            history->record(JournalEntry::textEdited(before, after));
+        });
+        QObject::connect(&view, &DrawingView::selectionEdited, history, &UndoJournal::record);
+        QObject::connect(&replayer, &TraceReplayer::commandReplayed, [drawingView, history, session](int type) {
+            drawingView->cancelDrawing();
+            if (type == InputTrace::Undo) {
+                history->undo();
+            } else if (type == InputTrace::Redo) {
+                history->redo();
+            } else if (type == InputTrace::Clear) {
+                drawingView->detachBatches();
+                history->recordClear();
+            } else {
+                session->layerCommand(type);
+            }
+        });
+    }
+
+    // 图层命令与主窗口相同：新建和删除作为历史记录（新图层按同样的序号命名），调整次序只交换 zValue
+    void layerCommand(int type) {
+        QGraphicsScene *scene = view.scene();
+        LayerItem *current = view.activeLayer();
+        if (type == InputTrace::AddLayer) {
+            LayerItem *layer = LayerItem::addTop(scene, ++layerSerial);
+            view.setCurrentLayer(layer);
+            journal.record(JournalEntry::layerAdded(layer));
+        } else if (type == InputTrace::DeleteLayer) {
+            if (!current || LayerItem::layers(scene).size() <= 1) return;
+            view.detachBatches();
+            scene->removeItem(current);
+            journal.record(JournalEntry::layerDeleted(current));
+        } else if (type == InputTrace::RaiseLayer || type == InputTrace::LowerLayer) {
+            if (!current || !LayerItem::swapWithNeighbour(current, type == InputTrace::RaiseLayer ? 1 : -1)) return;
+            view.setCurrentLayer(current);
+        }
+    }
+
+    // 最快速回放到结束；笔迹的后台简化也要完成，同一轨迹每次渲染的结果相同
+    bool replay(const QString &filePath, QString *error) {
+        QEventLoop loop;
+        QObject::connect(&replayer, &TraceReplayer::finished, &loop, &QEventLoop::quit);
+        if (!replayer.start(filePath, TraceReplayer::AsFastAsPossible, error)) return false;
+        if (replayer.isReplaying()) loop.exec();
+        view.cancelDrawing();
+        QThreadPool::globalInstance()->waitForDone();
+        QCoreApplication::processEvents();
+        return true;
+    }
+
+private:
+    DrawingView view;
+    UndoJournal journal;
+    TraceReplayer replayer;
+    int layerSerial;             // 新图层的编号（与主窗口一样从第一个图层算起）
+};
+
+}
+
+BatchRenderer::BatchRenderer(const BatchRenderOptions &options, QObject *parent)
+    : QObject(parent),
+      options(options),
+      pendingBytes(0),
+      pendingJobs(0),
+      imageCount(0) {
+    if (options.jobs > 0) pool.setMaxThreadCount(options.jobs);
+}
+
+BatchRenderer::~BatchRenderer() {
+    pool.waitForDone();
+}
+
+QStringList BatchRenderer::errors() const {
+    QMutexLocker locker(&mutex);
+    return failures;
+}
+
+// 载入（GUI 线程，串行）与渲染编码（线程池，并行）流水线：载入下一个文件时，前面的文件在后台渲染
+BatchRenderStats BatchRenderer::run(const QStringList &inputs) {
+    QElapsedTimer clock;
+    clock.start();
+    {
+        QMutexLocker locker(&mutex);
+        imageCount = 0;
+        failures.clear();
+    }
+    foreach (const QString &input, inputs) {
+        Job job;
+        QString error;
+        if (prepare(input, &job, &error)) {
+            submit(job);
+        } else {
+            fail(input, error);
+        }
+    }
+    pool.waitForDone();
+
+    BatchRenderStats stats;
+    QMutexLocker locker(&mutex);
+    stats.files = inputs.size();
+    stats.images = imageCount;
+    stats.failed = failures.size();
+    stats.elapsedMs = clock.elapsed();
+    return stats;
+}
+
+// 场景、图形和图层只在这里存在；录制成绘图指令后随局部变量一起释放，内存中不会同时有两个文件的场景
+bool BatchRenderer::prepare(const QString &input, Job *job, QString *error) {
+    QGraphicsScene scene;
+    QScopedPointer<TraceSession> trace;
+    if (input.endsWith(".chbtrace", Qt::CaseInsensitive)) {
+        trace.reset(new TraceSession(&scene));
+        if (!trace->replay(input, error)) return false;
+    } else {
+        DocumentLoader loader(&scene);
+        if (!loader.open(input, error)) return false;
+        loader.start(0, QRectF());
+        loader.finish();
+    }
+
+    QRectF source = scene.itemsBoundingRect();
+    if (source.isEmpty()) {
+        source = QRectF(QPointF(0, 0), EmptyCanvas);
+    } else {
+        source = source.adjusted(-Margin, -Margin, Margin, Margin).toAlignedRect();
+    }
+    job->input = input;
+    job->outputs = outputsFor(input, source);
+    job->picture = ImageExporter::record(&scene, source);
+    // 同一文件的各个尺寸依次渲染，峰值是最大的一张：RGB32 渲染缓冲加转换后的 RGB888
+    qint64 largest = 0;
+    foreach (const Output &output, job->outputs) {
+        largest = qMax(largest, qint64(output.size.width()) * output.size.height() * 7);
+    }
+    job->bytes = job->picture.size() + largest;
+    return true;
+}
+
+// 输出尺寸：sizes 中每一项按比例缩放到框内（方框即最长边），文件名带上尺寸；没有指定尺寸时按 scale 输出一张
+QList<BatchRenderer::Output> BatchRenderer::outputsFor(const QString &input, const QRectF &source) const {
+    const QFileInfo info(input);
+    const QDir directory(options.outputDirectory.isEmpty() ? info.absolutePath() : options.outputDirectory);
+    const QString suffix = "." + QString::fromLatin1(options.format);
+    QList<Output> outputs;
+    if (options.sizes.isEmpty()) {
+        Output output;
+        output.filePath = directory.filePath(info.completeBaseName() + suffix);
+        output.scale = options.scale;
+        output.size = ImageExporter::outputSize(source, output.scale);
+        outputs.append(output);
+        return outputs;
+    }
+    foreach (const QSize &box, options.sizes) {
+        Output output;
+        const QString label = box.width() == box.height()
+            ? QString::number(box.width()) : QString("%1x%2").arg(box.width()).arg(box.height());
+        output.filePath = directory.filePath(QString("%1_%2%3").arg(info.completeBaseName(), label, suffix));
+        output.scale = qMin(box.width() / source.width(), box.height() / source.height());
+        output.size = ImageExporter::outputSize(source, output.scale).boundedTo(box);
+        outputs.append(output);
+    }
+    return outputs;
+}
+
+// 预算不足时等待已提交的任务结束；没有在途任务时总是放行，单个超出预算的大图也能渲染
+void BatchRenderer::submit(const Job &job) {
+    {
+        QMutexLocker locker(&mutex);
+        while (pendingJobs > 0 && pendingBytes + job.bytes > options.memoryBudget) {
+            released.wait(&mutex);
+        }
+        pendingBytes += job.bytes;
+        ++pendingJobs;
+    }
+    QtConcurrent::run(&pool, [this, job]() { render(job); });
+}
+
+void BatchRenderer::render(const Job &job) {
+    int written = 0;
+    QString error;
+    foreach (const Output &output, job.outputs) {
+        QImage image = ImageExporter::renderBand(job.picture, QRect(QPoint(0, 0), output.size),
+                                                 output.scale, options.background);
+        if (image.isNull()) {
+            error = QString("内存不足，无法分配 %1×%2 的图像").arg(output.size.width()).arg(output.size.height());
+            break;
+        }
+        const int dotsPerMeter = qRound(96 * output.scale / 0.0254);
+        image.setDotsPerMeterX(dotsPerMeter);
+        image.setDotsPerMeterY(dotsPerMeter);
+
+        QSaveFile file(output.filePath);
+        if (!file.open(QIODevice::WriteOnly)) {
+            error = QString("无法写入 %1: %2").arg(output.filePath, file.errorString());
+            break;
+        }
+        QImageWriter writer(&file, options.format);
+        writer.setQuality(options.quality);
+        if (!writer.write(image) || !file.commit()) {
+            error = QString("写入 %1 失败: %2").arg(output.filePath, writer.errorString());
+            break;
+        }
+        ++written;
+    }
+
+    QMutexLocker locker(&mutex);
+    imageCount += written;
+    if (!error.isEmpty()) failures.append(QString("%1: %2").arg(job.input, error));
+    pendingBytes -= job.bytes;
+    --pendingJobs;
+    released.wakeAll();
+}
+
+void BatchRenderer::fail(const QString &input, const QString &message) {
+    QMutexLocker locker(&mutex);
+    failures.append(QString("%1: %2").arg(input, message));
+}
+
+// caihonghuaban --render [选项] 文件或目录...
+// 目录中的 .chb 和 .chbtrace 按文件名顺序全部渲染；有文件失败时退出码为 1
+int BatchRenderer::runCommandLine(const QStringList &arguments) {
+    QCommandLineParser parser;
+    parser.setApplicationDescription("彩虹画板批量渲染：把文档（.chb）和输入轨迹（.chbtrace）渲染成图片，不打开窗口");
+    parser.addHelpOption();
+    QCommandLineOption renderOption("render", "无窗口批量渲染");
+    QCommandLineOption sizeOption("size", "输出尺寸，逗号分隔；N 为最长边 N 像素，WxH 为缩放到框内；不指定时按 --scale 输出", "list");
+    QCommandLineOption scaleOption("scale", "缩放倍数（1 倍 = 96 DPI），未指定 --size 时使用", "n", "1");
+    QCommandLineOption formatOption("format", "输出格式：png 或 jpg", "format", "png");
+    QCommandLineOption qualityOption("quality", "JPG 质量（0-100）", "n", "-1");
+    QCommandLineOption backgroundOption("background", "背景色", "color", "white");
+    QCommandLineOption outputOption("output-dir", "输出目录（默认与输入文件相同）", "dir");
+    QCommandLineOption jobsOption("jobs", "并行渲染的文件数（默认 CPU 核数）", "n", "0");
+    QCommandLineOption memoryOption("memory", "渲染中的文件占用的内存上限（MB）", "mb", "512");
+    parser.addOption(renderOption);
+    parser.addOption(sizeOption);
+    parser.addOption(scaleOption);
+    parser.addOption(formatOption);
+    parser.addOption(qualityOption);
+    parser.addOption(backgroundOption);
+    parser.addOption(outputOption);
+    parser.addOption(jobsOption);
+    parser.addOption(memoryOption);
+    parser.addPositionalArgument("inputs", "文档、轨迹文件或包含它们的目录", "inputs...");
+    parser.process(arguments);
+
+    QTextStream err(stderr);
+    BatchRenderOptions options;
+    options.format = parser.value(formatOption).toLower().toLatin1();
+    if (options.format == "jpeg") options.format = "jpg";
+    if (options.format != "png" && options.format != "jpg") {
+        err << "不支持的输出格式: " << parser.value(formatOption) << endl;
+        return 2;
+    }
+    foreach (const QString &item, parser.value(sizeOption).split(',')) {
+        const QStringList parts = item.trimmed().toLower().split('x');
+        if (item.trimmed().isEmpty()) continue;
+        const int width = parts.first().toInt();
+        const int height = parts.size() > 1 ? parts[1].toInt() : width;
+        if (parts.size() > 2 || width <= 0 || height <= 0) {
+            err << "无效的输出尺寸: " << item << endl;
+            return 2;
+        }
+        options.sizes.append(QSize(width, height));
+    }
+    options.scale = parser.value(scaleOption).toDouble();
+    if (options.scale <= 0) {
+        err << "无效的缩放倍数: " << parser.value(scaleOption) << endl;
+        return 2;
+    }
+    options.quality = parser.value(qualityOption).toInt();
+    options.background = QColor(parser.value(backgroundOption));
+    if (!options.background.isValid()) {
+        err << "无效的背景色: " << parser.value(backgroundOption) << endl;
+        return 2;
+    }
+    options.outputDirectory = parser.value(outputOption);
+    if (!options.outputDirectory.isEmpty() && !QDir().mkpath(options.outputDirectory)) {
+        err << "无法创建输出目录: " << options.outputDirectory << endl;
+        return 2;
+    }
+    options.jobs = qMax(0, parser.value(jobsOption).toInt());
+    options.memoryBudget = qMax(qint64(1), parser.value(memoryOption).toLongLong()) * 1024 * 1024;
+
+    QStringList inputs;
+    foreach (const QString &path, parser.positionalArguments()) {
+        const QFileInfo info(path);
+        if (info.isDir()) {
+            foreach (const QFileInfo &entry, QDir(path).entryInfoList(QStringList() << "*.chb" << "*.chbtrace",
+                                                                      QDir::Files, QDir::Name)) {
+                inputs.append(entry.filePath());
+            }
+        } else {
+            inputs.append(path);
+        }
+    }
+    if (inputs.isEmpty()) {
+        err << "没有要渲染的文件" << endl;
+        return 2;
+    }
+
+    BatchRenderer renderer(options);
+    const BatchRenderStats stats = renderer.run(inputs);
+    foreach (const QString &error, renderer.errors()) {
+        err << error << endl;
+    }
+    const qreal seconds = qMax<qint64>(1, stats.elapsedMs) / 1000.0;
+    QTextStream(stdout) << QString("渲染完成: %1 个文件（失败 %2 个），%3 张图片，用时 %4 s，%5 个文件/秒")
+                               .arg(stats.files).arg(stats.failed).arg(stats.images)
+                               .arg(seconds, 0, 'f', 2)
+                               .arg(stats.files / seconds, 0, 'f', 1)
+                        << endl;
+    return stats.failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,81 @@
+#ifndef BATCHRENDERER_H
+#define BATCHRENDERER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QColor>
+#include <QList>
+#include <QMutex>
+#include <QRectF>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+class QGraphicsScene;
+
+// 批量渲染参数
+struct BatchRenderOptions {
+    QString outputDirectory;         // 输出目录，空为输入文件所在目录
+    QByteArray format = "png";       // png 或 jpg
+    QList<QSize> sizes;              // 每个文件输出的尺寸：按比例缩放到框内；为空时按 scale 输出一张
+    qreal scale = 1.0;               // 缩放倍数，1 对应 96 DPI
+    QColor background = Qt::white;   // 背景色
+    int quality = -1;                // JPG 质量，-1 为默认
+    int jobs = 0;                    // 并行渲染的文件数，0 为 CPU 核数
+    qint64 memoryBudget = qint64(512) * 1024 * 1024; // 排队和渲染中的文件占用的内存上限（估算）
+};
+
+// 批量渲染统计
+struct BatchRenderStats {
+    int files = 0;                   // 输入文件数
+    int images = 0;                  // 写出的图片数
+    int failed = 0;                  // 失败的文件数
+    qint64 elapsedMs = 0;            // 总用时
+};
+
+// 无窗口批量渲染：文档（.chb）和输入轨迹（.chbtrace）逐个在 GUI 线程载入场景，录制成绘图指令后立即释放场景；
+// 指令的回放和图片编码按文件放进线程池并行。排队和渲染中的文件按估算内存限流，超出预算时 GUI 线程等待
+class BatchRenderer : public QObject {
+    Q_OBJECT
+public:
+    explicit BatchRenderer(const BatchRenderOptions &options, QObject *parent = nullptr);
+    ~BatchRenderer();
+
+    BatchRenderStats run(const QStringList &inputs); // 渲染全部文件，阻塞到全部写出
+    QStringList errors() const;                  // 失败原因（每个失败的文件一条）
+
+    static int runCommandLine(const QStringList &arguments); // --render 模式的入口，返回进程退出码
+
+private:
+    // 一个文件的渲染任务：只持有绘图指令，不引用场景
+    struct Output {
+        QString filePath;
+        QSize size;                  // 输出像素尺寸
+        qreal scale;                 // 场景到输出的缩放
+    };
+    struct Job {
+        QString input;
+        QByteArray picture;          // 场景 source 区域的绘图指令
+        QList<Output> outputs;
+        qint64 bytes;                // 估算占用的内存
+    };
+
+    bool prepare(const QString &input, Job *job, QString *error); // GUI 线程：载入场景并录制成任务，场景随即释放
+    QList<Output> outputsFor(const QString &input, const QRectF &source) const;
+    void submit(const Job &job);                 // 等到预算允许后放进线程池
+    void render(const Job &job);                 // 工作线程：回放、编码、写出
+    void fail(const QString &input, const QString &message);
+
+    BatchRenderOptions options;
+    QThreadPool pool;
+    mutable QMutex mutex;
+    QWaitCondition released;                     // 有任务结束、归还了内存预算
+    qint64 pendingBytes;                         // 排队和渲染中的任务占用（受 mutex 保护）
+    int pendingJobs;
+    int imageCount;
+    QStringList failures;
+};
+
+#endif // BATCHRENDERER_H
@@ -0,0 +1,1262 @@
+#include "mainwindow.h"
+#include "undojournal.h"
+#include "imageexporter.h"
+#include "chbdocument.h"
+#include "shapeitem.h"
+#include "floodfill.h"
+#include "brushengine.h"
+#include "brushstrokeitem.h"
+#include "layeritem.h"
+#include "strokeitem.h"
+#include "selector.h"
+#include "autosave.h"
+#include "batchrenderer.h"
+#include "vectorexporter.h"
+#include "statictextitem.h"
+#include "livesync.h"
+#include "binarycodec.h"
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QTemporaryDir>
+#include <QBuffer>
+#include <QtEndian>
+#include <QCryptographicHash>
+#include <QThreadPool>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+#include <QTextStream>
+#include <QStringList>
+#include <QtMath>
+#include <algorithm>
+#include <functional>
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+// 一组耗时样本，输出时换算为微秒
+class Samples {
+public:
+    void add(qint64 nanoseconds) { values.append(nanoseconds / 1000.0); }
+    int count() const { return values.size(); }
+
+    QJsonObject toJson() const {
+        QJsonObject result;
+        result["count"] = values.size();
+        if (values.isEmpty()) return result;
+        QVector<double> sorted = values;
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0;
+        foreach (double v, sorted) sum += v;
+        result["mean"] = sum / sorted.size();
+        result["p50"] = at(sorted, 0.50);
+        result["p95"] = at(sorted, 0.95);
+        result["p99"] = at(sorted, 0.99);
+        result["max"] = sorted.last();
+        return result;
+    }
+
+private:
+    static double at(const QVector<double> &sorted, double fraction) {
+        return sorted[qMin(sorted.size() - 1, int(fraction * sorted.size()))];
+    }
+
+    QVector<double> values;
+};
+
+// 进程峰值常驻内存（KB），取不到时为 -1
+qint64 peakRssKb() {
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return qint64(counters.PeakWorkingSetSize / 1024);
+    }
+    return -1;
+#elif defined(Q_OS_LINUX)
+    QFile status("/proc/self/status");
+    if (!status.open(QIODevice::ReadOnly)) return -1;
+    foreach (const QByteArray &line, status.readAll().split('\n')) {
+        if (line.startsWith("VmHWM:")) {
+            return line.mid(6).trimmed().split(' ').first().toLongLong();
+        }
+    }
+    return -1;
+#elif defined(Q_OS_UNIX)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return -1;
+#if defined(Q_OS_MAC)
+    return qint64(usage.ru_maxrss / 1024);   // macOS 以字节为单位
+#else
+    return qint64(usage.ru_maxrss);
+#endif
+#else
+    return -1;
+#endif
+}
+
+// 简单的线性同余序列，保证每次运行的工作负载完全一致
+class Sequence {
+public:
+    explicit Sequence(quint32 seed) : state(seed) {}
+    qreal next(qreal low, qreal high) {
+        state = state * 1664525u + 1013904223u;
+        return low + (high - low) * (state >> 8) / qreal(1 << 24);
+    }
+private:
+    quint32 state;
+};
+
+// 向视图视口发送合成鼠标事件，记录每个事件的处理耗时和每帧的重绘耗时
+class Driver {
+public:
+    explicit Driver(DrawingView *view) : view(view), events(0) {}
+
+    void press(const QPointF &scenePos) { send(QEvent::MouseButtonPress, scenePos, Qt::LeftButton, Qt::LeftButton); }
+    void move(const QPointF &scenePos) { send(QEvent::MouseMove, scenePos, Qt::NoButton, Qt::LeftButton); }
+    void release(const QPointF &scenePos) { send(QEvent::MouseButtonRelease, scenePos, Qt::LeftButton, Qt::NoButton); }
+
+    // 一帧：处理缓冲的移动采样，再同步重绘视口
+    void frame() {
+        view->flushPendingMoves();
+        QElapsedTimer clock;
+        clock.start();
+        view->viewport()->repaint();
+        repaint.add(clock.nsecsElapsed());
+    }
+
+    Samples latency;    // 单个事件的处理耗时
+    Samples repaint;    // 每帧重绘耗时
+    int events;
+
+private:
+    void send(QEvent::Type type, const QPointF &scenePos, Qt::MouseButton button, Qt::MouseButtons buttons) {
+        const QPoint pos = view->mapFromScene(scenePos);
+        QMouseEvent event(type, pos, view->viewport()->mapToGlobal(pos), button, buttons, Qt::NoModifier);
+        QElapsedTimer clock;
+        clock.start();
+        QApplication::sendEvent(view->viewport(), &event);
+        latency.add(clock.nsecsElapsed());
+        ++events;
+    }
+
+    DrawingView *view;
+};
+
+// 等待后台简化等线程池任务完成，并处理它们排队的回调
+void settle() {
+    QThreadPool::globalInstance()->waitForDone();
+    QCoreApplication::processEvents();
+}
+
+QJsonObject result(const QString &name, const Driver &driver, qint64 elapsedNs, int items) {
+    const double seconds = elapsedNs / 1e9;
+    QJsonObject object;
+    object["name"] = name;
+    object["events"] = driver.events;
+    object["items"] = items;
+    object["seconds"] = seconds;
+    object["itemsPerSecond"] = seconds > 0 ? items / seconds : 0;
+    object["eventLatencyUs"] = driver.latency.toJson();
+    object["repaintUs"] = driver.repaint.toJson();
+    object["peakRssKb"] = peakRssKb();
+    return object;
+}
+
+// 长笔迹：每条 500 个采样点，每 4 个采样一帧
+QJsonObject penStrokes(DrawingView *view, int strokes) {
+    Driver driver(view);
+    view->setCurrentTool(DrawingTool::PEN);
+    QElapsedTimer clock;
+    clock.start();
+    for (int s = 0; s < strokes; ++s) {
+        const QPointF start(40 + (s % 8) * 130, 60 + (s / 8 % 6) * 120);
+        driver.press(start);
+        QPointF p = start;
+        for (int i = 1; i <= 500; ++i) {
+            p = start + QPointF(i * 0.2, 40 * qSin(i * 0.05));
+            driver.move(p);
+            if (i % 4 == 0) driver.frame();
+        }
+        driver.release(p);
+        driver.frame();
+    }
+    settle();
+    return result("pen_strokes", driver, clock.nsecsElapsed(), strokes);
+}
+
+// 笔迹内存：strokeCount 条 500 点的笔迹提交后每条占用的字节数（与不压缩时对照），
+// 以及清空解码缓存后首次绘制（逐条解码）和再次绘制（命中缓存）全部笔迹的耗时；笔迹数取缓存能全部容纳的规模
+QJsonObject strokeMemory(int strokeCount) {
+    QGraphicsScene scene;
+    LayerItem *layer = new LayerItem("图层 1");
+    scene.addItem(layer);
+    Sequence random(17);
+    const QPen pen(Qt::darkBlue, 3, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
+    QList<StrokeItem*> strokes;
+    const qint64 rssBefore = peakRssKb();
+    for (int s = 0; s < strokeCount; ++s) {
+        const QPointF start(random.next(0, 4000), random.next(0, 4000));
+        StrokeItem *stroke = new StrokeItem(start, pen);
+        for (int i = 1; i < 500; ++i) {
+            stroke->appendPoint(start + QPointF(i * 0.2 + random.next(-0.3, 0.3), 40 * qSin(i * 0.05)));
+        }
+        stroke->compact();
+        stroke->setZValue(s);
+        layer->adopt(stroke);
+        strokes.append(stroke);
+    }
+
+    qint64 compactBytes = 0;
+    qint64 expandedBytes = 0;
+    foreach (StrokeItem *stroke, strokes) {
+        compactBytes += stroke->byteSize();
+        expandedBytes += stroke->expandedByteSize();
+    }
+
+    QImage image(1000, 1000, QImage::Format_ARGB32_Premultiplied);
+    StrokeItem::setCacheLimit(1);               // 清空缓存
+    StrokeItem::setCacheLimit(qint64(64) * 1024 * 1024);
+    const StrokeCacheStats before = StrokeItem::cacheStats();
+    QElapsedTimer clock;
+    clock.start();
+    {
+        QPainter painter(&image);
+        foreach (StrokeItem *stroke, strokes) {
+            QStyleOptionGraphicsItem option;
+            option.exposedRect = stroke->boundingRect();
+            painter.save();
+            painter.scale(0.25, 0.25);
+            stroke->paint(&painter, &option, nullptr);
+            painter.restore();
+        }
+    }
+    const qint64 coldNs = clock.nsecsElapsed();
+    clock.restart();
+    {
+        QPainter painter(&image);
+        foreach (StrokeItem *stroke, strokes) {
+            QStyleOptionGraphicsItem option;
+            option.exposedRect = stroke->boundingRect();
+            painter.save();
+            painter.scale(0.25, 0.25);
+            stroke->paint(&painter, &option, nullptr);
+            painter.restore();
+        }
+    }
+    const qint64 warmNs = clock.nsecsElapsed();
+    const StrokeCacheStats after = StrokeItem::cacheStats();
+
+    QJsonObject object;
+    object["name"] = QString("stroke_memory_%1").arg(strokeCount);
+    object["strokes"] = strokeCount;
+    object["pointsPerStroke"] = 500;
+    object["bytesPerStrokeBefore"] = double(expandedBytes / qMax(1, strokeCount));
+    object["bytesPerStrokeAfter"] = double(compactBytes / qMax(1, strokeCount));
+    object["coldPaintMs"] = coldNs / 1e6;
+    object["warmPaintMs"] = warmNs / 1e6;
+    object["cacheMisses"] = double(after.misses - before.misses);
+    object["cacheHits"] = double(after.hits - before.hits);
+    object["cacheKb"] = double(after.bytes / 1024);
+    object["rssGrowthKb"] = double(peakRssKb() - rssBefore);
+    object["peakRssKb"] = peakRssKb();
+    return object;
+}
+
+// 快速拖拽形状：直线/矩形/圆形轮换，每次拖动 12 步
+QJsonObject shapeDrags(DrawingView *view, int drags) {
+    Driver driver(view);
+    Sequence random(7);
+    const DrawingTool tools[] = { DrawingTool::LINE, DrawingTool::RECTANGLE, DrawingTool::CIRCLE };
+    QElapsedTimer clock;
+    clock.start();
+    for (int d = 0; d < drags; ++d) {
+        view->setCurrentTool(tools[d % 3]);
+        const QPointF start(random.next(20, 1000), random.next(20, 650));
+        const QPointF end = start + QPointF(random.next(10, 150), random.next(10, 120));
+        driver.press(start);
+        for (int i = 1; i <= 12; ++i) {
+            driver.move(start + (end - start) * (i / 12.0));
+            if (i % 2 == 0) driver.frame();
+        }
+        driver.release(end);
+    }
+    driver.frame();
+    return result("shape_drags", driver, clock.nsecsElapsed(), drags);
+}
+
+// 笔刷笔迹：与 pen_strokes 相同的路径，每个采样都盖印笔印并重绘碰到的瓦片
+QJsonObject brushStrokes(DrawingView *view, int strokes) {
+    Driver driver(view);
+    view->setCurrentTool(DrawingTool::BRUSH);
+    view->setBrushKind(BrushEngine::Soft);
+    QElapsedTimer clock;
+    clock.start();
+    for (int s = 0; s < strokes; ++s) {
+        const QPointF start(40 + (s % 8) * 130, 60 + (s / 8 % 6) * 120);
+        driver.press(start);
+        QPointF p = start;
+        for (int i = 1; i <= 500; ++i) {
+            p = start + QPointF(i * 0.2, 40 * qSin(i * 0.05));
+            driver.move(p);
+            if (i % 4 == 0) driver.frame();
+        }
+        driver.release(p);
+        driver.frame();
+    }
+    return result("brush_strokes", driver, clock.nsecsElapsed(), strokes);
+}
+
+// 笔印吞吐：不经过场景，沿正弦路径盖印 dabs 个笔印，只计合成耗时
+QJsonObject brushDabs(int kind, qreal diameter, int dabs) {
+    BrushStrokeItem stroke(kind, QColor(40, 90, 200), diameter);
+    const qreal step = qMax<qreal>(1, diameter * BrushEngine::spacing(kind));
+    QElapsedTimer clock;
+    clock.start();
+    for (int i = 0; stroke.dabCount() < dabs; ++i) {
+        const qreal x = i * step;
+        stroke.strokeTo(QPointF(std::fmod(x, 4000.0), 2000 + 800 * qSin(x * 0.002) + (int(x / 4000) % 8) * 60),
+                        0.6 + 0.4 * qSin(i * 0.01));
+    }
+    const qint64 elapsedNs = clock.nsecsElapsed();
+
+    const char *names[] = { "soft", "airbrush", "textured" };
+    QJsonObject object;
+    object["name"] = QString("brush_dabs_%1_%2").arg(names[kind]).arg(int(diameter));
+    object["dabs"] = stroke.dabCount();
+    object["tiles"] = stroke.tileImages().size();
+    object["seconds"] = elapsedNs / 1e9;
+    object["dabsPerSecond"] = elapsedNs > 0 ? stroke.dabCount() / (elapsedNs / 1e9) : 0;
+    object["peakRssKb"] = peakRssKb();
+    return object;
+}
+
+// 大量文本：逐格点击，每 50 次一帧
+QJsonObject textStamps(DrawingView *view, int stamps) {
+    Driver driver(view);
+    view->setCurrentTool(DrawingTool::TEXT);
+    view->setTextProperties("基准测试", 14);
+    QElapsedTimer clock;
+    clock.start();
+    for (int t = 0; t < stamps; ++t) {
+        const QPointF pos(10 + (t % 16) * 70, 10 + (t / 16 % 30) * 24);
+        driver.press(pos);
+        driver.release(pos);
+        if (t % 50 == 49) driver.frame();
+    }
+    driver.frame();
+    return result("text_stamps", driver, clock.nsecsElapsed(), stamps);
+}
+
+// 撤回风暴：反复撤回全部历史再重做，每 10 次操作一帧
+QJsonObject undoStorm(DrawingView *view, UndoJournal *journal, int cycles) {
+    Driver driver(view);
+    int operations = 0;
+    QElapsedTimer clock;
+    clock.start();
+    for (int c = 0; c < cycles; ++c) {
+        while (journal->canUndo()) {
+            QElapsedTimer op;
+            op.start();
+            journal->undo();
+            driver.latency.add(op.nsecsElapsed());
+            if (++operations % 10 == 0) driver.frame();
+        }
+        while (journal->canRedo()) {
+            QElapsedTimer op;
+            op.start();
+            journal->redo();
+            driver.latency.add(op.nsecsElapsed());
+            if (++operations % 10 == 0) driver.frame();
+        }
+    }
+    driver.events = operations;
+    QJsonObject object = result("undo_storm", driver, clock.nsecsElapsed(), operations);
+
+    // 每条记录占用内存的分布：按 1KB、16KB、256KB、4MB 分档
+    const qint64 limits[4] = { 1024, 16 * 1024, 256 * 1024, 4 * 1024 * 1024 };
+    int buckets[5] = { 0, 0, 0, 0, 0 };
+    qint64 largest = 0;
+    foreach (qint64 bytes, journal->entryBytes()) {
+        int bucket = 0;
+        while (bucket < 4 && bytes >= limits[bucket]) ++bucket;
+        ++buckets[bucket];
+        largest = qMax(largest, bytes);
+    }
+    QJsonObject histogram;
+    histogram["under1KB"] = buckets[0];
+    histogram["under16KB"] = buckets[1];
+    histogram["under256KB"] = buckets[2];
+    histogram["under4MB"] = buckets[3];
+    histogram["atLeast4MB"] = buckets[4];
+    object["entryBytesHistogram"] = histogram;
+    object["entryBytesMax"] = double(largest);
+    object["historyBytes"] = double(journal->totalBytes());
+    return object;
+}
+
+// 全场景导出：BMP 流式写出与 PNG 整幅编码各一次
+QJsonArray exports(QGraphicsScene *scene, const QString &directory) {
+    QJsonArray results;
+    const QRectF source = scene->itemsBoundingRect();
+    const QStringList formats = QStringList() << "bmp" << "png";
+    foreach (const QString &format, formats) {
+        ImageExporter exporter;
+        ExportOptions options;
+        options.filePath = QDir(directory).filePath(QString("export.%1").arg(format));
+        options.scale = 2;
+        QEventLoop loop;
+        bool ok = false;
+        QObject::connect(&exporter, &ImageExporter::finished, [&](bool success, const QString &) {
+            ok = success;
+            loop.quit();
+        });
+        QElapsedTimer clock;
+        clock.start();
+        if (exporter.start(scene, source, options)) loop.exec();
+        const qint64 elapsed = clock.nsecsElapsed();
+
+        const QSize size = ImageExporter::outputSize(source, options.scale);
+        QJsonObject object;
+        object["name"] = QString("export_%1").arg(format);
+        object["ok"] = ok;
+        object["pixels"] = double(size.width()) * size.height();
+        object["seconds"] = elapsed / 1e9;
+        object["megapixelsPerSecond"] = double(size.width()) * size.height() / 1e6 / (elapsed / 1e9);
+        object["fileBytes"] = double(QFileInfo(options.filePath).size());
+        object["peakRssKb"] = peakRssKb();
+        results.append(object);
+    }
+    return results;
+}
+
+// 把图层重新编码成文档，拆成逐条记录用于比较；瓦片按哈希表次序写出，同一图层的瓦片记录排序后再比
+QList<QByteArray> documentRecords(const QList<LayerItem*> &layers) {
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    ChbDocument::write(&buffer, layers, nullptr);
+    QList<QByteArray> records;
+    int tilesFrom = -1;
+    int offset = 8;                      // 魔数 + 版本 + 保留
+    while (offset + 5 <= data.size()) {  // u8 类型 + u32 长度
+        const quint8 tag = quint8(data.at(offset));
+        const int length = int(qFromLittleEndian<quint32>(
+            reinterpret_cast<const uchar*>(data.constData()) + offset + 1));
+        if (tag == ChbDocument::TileRecord) {
+            if (tilesFrom < 0) tilesFrom = records.size();
+        } else if (tilesFrom >= 0) {
+            std::sort(records.begin() + tilesFrom, records.end());
+            tilesFrom = -1;
+        }
+        records.append(data.mid(offset, 5 + length));
+        offset += 5 + length;
+    }
+    if (tilesFrom >= 0) std::sort(records.begin() + tilesFrom, records.end());
+    return records;
+}
+
+// 文档保存与加载：保存当前场景，再在新场景中完整加载，
+// 重新编码加载结果并与保存前逐条比较（图层属性、瓦片内容和每个图形），不一致即判为失败
+QJsonObject documentRoundTrip(QGraphicsScene *scene, const QString &directory) {
+    const QString path = QDir(directory).filePath("bench.chb");
+    const QList<QByteArray> before = documentRecords(LayerItem::layers(scene));
+    QElapsedTimer clock;
+    clock.start();
+    int written = 0;
+    ChbDocument::save(path, LayerItem::layers(scene), nullptr, &written);
+    const qint64 saveNs = clock.nsecsElapsed();
+
+    QGraphicsScene loaded;
+    DocumentLoader loader(&loaded);
+    clock.restart();
+    loader.open(path, nullptr);
+    const qint64 indexNs = clock.nsecsElapsed();
+    loader.start(0, QRectF(0, 0, 1200, 800));
+    const qint64 firstScreenNs = clock.nsecsElapsed();
+    loader.finish();
+    const qint64 loadNs = clock.nsecsElapsed();
+
+    const QList<QByteArray> after = documentRecords(LayerItem::layers(&loaded));
+    int mismatches = qAbs(before.size() - after.size());
+    for (int i = 0; i < qMin(before.size(), after.size()); ++i) {
+        if (before.at(i) != after.at(i)) ++mismatches;
+    }
+
+    QJsonObject object;
+    object["name"] = "document_round_trip";
+    object["items"] = written;
+    object["records"] = before.size();
+    object["mismatches"] = mismatches;
+    object["passed"] = mismatches == 0;
+    object["fileBytes"] = double(QFileInfo(path).size());
+    object["saveSeconds"] = saveNs / 1e9;
+    object["indexSeconds"] = indexNs / 1e9;
+    object["firstScreenSeconds"] = firstScreenNs / 1e9;
+    object["loadSeconds"] = loadNs / 1e9;
+    object["peakRssKb"] = peakRssKb();
+    return object;
+}
+
+// 崩溃恢复：自动保存目录由运行中的实例加锁，复制一份后在新场景中恢复，重新编码后与当前场景比较。
+// 批量层中的图元恢复成层叠次序相同的独立形状，彼此先后不定，所以每个图层内的记录排序后再比
+bool recoveryMatches(QGraphicsScene *scene, const QString &autosaveDirectory, const QString &copyDirectory,
+                     int *replayed) {
+    const QDir source(autosaveDirectory);
+    const QDir copy(copyDirectory);
+    QDir().mkpath(copyDirectory);
+    foreach (const QString &name, source.entryList(QStringList() << "snapshot-*.chb" << "journal-*.log", QDir::Files)) {
+        QFile::copy(source.filePath(name), copy.filePath(name));
+    }
+    QGraphicsScene recovered;
+    DrawingView view(&recovered);
+    UndoJournal journal(&recovered);
+    Autosave autosave(&view, &journal, copyDirectory);
+    if (!autosave.open(nullptr) || !autosave.recover(nullptr, replayed)) return false;
+
+    QList<QByteArray> expected = documentRecords(LayerItem::layers(scene));
+    QList<QByteArray> actual = documentRecords(LayerItem::layers(&recovered));
+    foreach (QList<QByteArray> *records, QList<QList<QByteArray>*>() << &expected << &actual) {
+        int from = 0;
+        for (int i = 0; i <= records->size(); ++i) {
+            if (i == records->size() || quint8(records->at(i).at(0)) == ChbDocument::LayerRecord) {
+                std::sort(records->begin() + from, records->begin() + i);
+                from = i + 1;
+            }
+        }
+    }
+    return expected == actual;
+}
+
+// 批量渲染：把往返测试保存的文档复制 files 份，渲染成 256 和 1024 两种尺寸的 PNG，统计每秒文件数
+QJsonObject batchRender(const QString &directory, int files) {
+    QDir dir(directory);
+    dir.mkpath("batch");
+    QStringList inputs;
+    for (int i = 0; i < files; ++i) {
+        const QString path = dir.filePath(QString("batch/doc%1.chb").arg(i));
+        QFile::copy(dir.filePath("bench.chb"), path);
+        inputs.append(path);
+    }
+    BatchRenderOptions options;
+    options.sizes << QSize(256, 256) << QSize(1024, 1024);
+    BatchRenderer renderer(options);
+    const BatchRenderStats stats = renderer.run(inputs);
+
+    QJsonObject object;
+    object["name"] = "batch_render";
+    object["files"] = stats.files;
+    object["images"] = stats.images;
+    object["failed"] = stats.failed;
+    object["seconds"] = stats.elapsedMs / 1e3;
+    object["filesPerSecond"] = stats.files / (qMax<qint64>(1, stats.elapsedMs) / 1e3);
+    object["peakRssKb"] = peakRssKb();
+    return object;
+}
+
+// 矢量导出：itemCount 个图形（笔迹、四种形状、文字各占一部分）分别导出为 SVG、PDF，
+// 与同一场景按 1 倍栅格化导出 PNG 对照耗时、文件大小和峰值内存
+QJsonArray vectorExport(const QString &directory, int itemCount) {
+    QGraphicsScene scene;
+    LayerItem *layer = new LayerItem("图层 1");
+    scene.addItem(layer);
+    Sequence random(23);
+    const QFont font("SimSun", 12);
+    for (int i = 0; i < itemCount; ++i) {
+        const QPointF start(random.next(0, 4000), random.next(0, 3000));
+        const QPen pen(QColor::fromHsv(i * 7 % 360, 200, 200), 2, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
+        QGraphicsItem *item = nullptr;
+        switch (i % 5) {
+        case 0:
+        case 1: {
+            StrokeItem *stroke = new StrokeItem(start, pen);
+            for (int p = 1; p < 30; ++p) {
+                stroke->appendPoint(start + QPointF(p * 1.5, 10 * qSin(p * 0.3) + random.next(-0.5, 0.5)));
+            }
+            stroke->compact();
+            item = stroke;
+            break;
+        }
+        case 2:
+        case 3: {
+            const ShapeItem::Kind kind = ShapeItem::Kind(i / 5 % 4);
+            ShapeItem *shape = new ShapeItem(kind, start, pen);
+            shape->setPoint(1, start + QPointF(random.next(8, 48), random.next(8, 48)));
+            if (kind == ShapeItem::Triangle) shape->setPoint(2, start + QPointF(random.next(-24, 0), random.next(8, 48)));
+            item = shape;
+            break;
+        }
+        default:
+            item = new StaticTextItem(QString("文字 %1").arg(i), font, pen.color());
+            item->setPos(start);
+            break;
+        }
+        item->setZValue(i);
+        item->setParentItem(layer);
+    }
+    const QList<LayerItem*> layers = LayerItem::layers(&scene);
+    const QRectF source = scene.itemsBoundingRect().adjusted(-8, -8, 8, 8).toAlignedRect();
+
+    QJsonArray results;
+    const QStringList formats = QStringList() << "svg" << "pdf" << "png";
+    foreach (const QString &format, formats) {
+        const QString path = QDir(directory).filePath(QString("vector.%1").arg(format));
+        bool ok = false;
+        int written = 0;
+        QElapsedTimer clock;
+        clock.start();
+        if (format == "svg") {
+            ok = VectorExport::exportSvg(layers, source, path, nullptr, &written);
+        } else if (format == "pdf") {
+            ok = VectorExport::exportPdf(layers, source, path, nullptr, &written);
+        } else {
+            ImageExporter exporter;
+            ExportOptions options;
+            options.filePath = path;
+            QEventLoop loop;
+            QObject::connect(&exporter, &ImageExporter::finished, [&](bool success, const QString &) {
+                ok = success;
+                loop.quit();
+            });
+            if (exporter.start(&scene, source, options)) loop.exec();
+            written = itemCount;
+        }
+        const qint64 elapsed = clock.nsecsElapsed();
+
+        QJsonObject object;
+        object["name"] = QString("vector_export_%1").arg(format);
+        object["ok"] = ok;
+        object["items"] = written;
+        object["seconds"] = elapsed / 1e9;
+        object["itemsPerSecond"] = written / (qMax<qint64>(1, elapsed) / 1e9);
+        object["fileBytes"] = double(QFileInfo(path).size());
+        object["peakRssKb"] = peakRssKb();
+        results.append(object);
+    }
+    return results;
+}
+
+// 多图层：下面 layerCount - 1 个图层各铺满 itemsPerLayer 个图形，在空的最上层画笔迹。
+// cached 为 false 时下层图形不进图层缓存、由场景逐个绘制，作为对照；
+// 缓存时下层在首帧之后不应再重画（lowerLayerRebuilds 为 0），每帧只贴图
+QJsonObject layeredStrokes(int layerCount, int itemsPerLayer, int strokes, bool cached) {
+    QGraphicsScene scene;
+    DrawingView view(&scene);
+    view.resize(1200, 800);
+    view.show();
+    view.tuneSceneIndex(layerCount * itemsPerLayer);
+
+    Sequence random(5);
+    QList<LayerItem*> layers;
+    for (int l = 0; l < layerCount; ++l) {
+        LayerItem *layer = new LayerItem(QString("图层 %1").arg(l + 1));
+        layer->setZValue(l);
+        scene.addItem(layer);
+        layers.append(layer);
+        if (l == layerCount - 1) break;
+        const QPen pen(QColor::fromHsv(l * 40 % 360, 200, 200), 2);
+        for (int i = 0; i < itemsPerLayer; ++i) {
+            const QPointF topLeft(random.next(0, 1150), random.next(0, 750));
+            ShapeItem *item = new ShapeItem(i % 2 ? ShapeItem::Rectangle : ShapeItem::Ellipse, topLeft, pen);
+            item->setPoint(1, topLeft + QPointF(random.next(8, 48), random.next(8, 48)));
+            item->setZValue(i);
+            if (cached) {
+                layer->adopt(item);
+            } else {
+                item->setParentItem(layer);
+            }
+        }
+    }
+    view.setCurrentLayer(layers.last());
+    view.setCurrentTool(DrawingTool::PEN);
+    view.centerOn(QPointF(600, 400));
+    view.viewport()->repaint();     // 首帧建立索引和图层缓存，不计入
+
+    int lowerBefore = 0;
+    for (int l = 0; l < layerCount - 1; ++l) lowerBefore += layers[l]->cacheRebuilds();
+    Driver driver(&view);
+    QElapsedTimer clock;
+    clock.start();
+    for (int s = 0; s < strokes; ++s) {
+        const QPointF start(40 + (s % 8) * 130, 60 + (s / 8 % 6) * 120);
+        driver.press(start);
+        QPointF p = start;
+        for (int i = 1; i <= 200; ++i) {
+            p = start + QPointF(i * 0.5, 40 * qSin(i * 0.05));
+            driver.move(p);
+            if (i % 4 == 0) driver.frame();
+        }
+        driver.release(p);
+        driver.frame();
+    }
+    settle();
+    const qint64 elapsedNs = clock.nsecsElapsed();
+    int lowerAfter = 0;
+    for (int l = 0; l < layerCount - 1; ++l) lowerAfter += layers[l]->cacheRebuilds();
+
+    QJsonObject object = result(QString("layered_strokes_%1").arg(cached ? "cached" : "direct"),
+                                driver, elapsedNs, strokes);
+    object["layers"] = layerCount;
+    object["lowerItems"] = (layerCount - 1) * itemsPerLayer;
+    object["lowerLayerRebuilds"] = lowerAfter - lowerBefore;
+    object["topLayerRebuilds"] = layers.last()->cacheRebuilds();
+    return object;
+}
+
+// 场景索引：图形总数增加而可见数量不变时，视口重绘时间应基本不变
+QJsonObject indexScaling(int itemCount) {
+    QGraphicsScene scene;
+    DrawingView view(&scene);
+    view.resize(1200, 800);
+    view.show();
+    view.tuneSceneIndex(itemCount);
+
+    // 固定间距的网格，画布边长随图形数增长
+    const int columns = qCeil(qSqrt(qreal(itemCount)));
+    const qreal spacing = 40;
+    const QRectF area(0, 0, columns * spacing, columns * spacing);
+    view.ensureCanvasCovers(area);
+    const QPen pen(Qt::darkBlue, 2);
+    QElapsedTimer clock;
+    clock.start();
+    for (int i = 0; i < itemCount; ++i) {
+        const QPointF topLeft((i % columns) * spacing, (i / columns) * spacing);
+        ShapeItem *item = new ShapeItem(i % 2 ? ShapeItem::Rectangle : ShapeItem::Ellipse, topLeft, pen);
+        item->setPoint(1, topLeft + QPointF(24, 24));
+        scene.addItem(item);
+    }
+    const qint64 buildNs = clock.nsecsElapsed();
+    view.centerOn(area.center());
+    view.viewport()->repaint();     // 首帧触发索引建立，不计入
+
+    Samples repaint;
+    for (int i = 0; i < 30; ++i) {
+        QElapsedTimer frame;
+        frame.start();
+        view.viewport()->repaint();
+        repaint.add(frame.nsecsElapsed());
+    }
+    const QRectF visible = view.mapToScene(view.viewport()->rect()).boundingRect();
+
+    QJsonObject object;
+    object["name"] = QString("index_%1").arg(itemCount);
+    object["items"] = itemCount;
+    object["visibleItems"] = scene.items(visible).size();
+    object["bspDepth"] = scene.bspTreeDepth();
+    object["buildSeconds"] = buildNs / 1e9;
+    object["repaintUs"] = repaint.toJson();
+    object["peakRssKb"] = peakRssKb();
+    return object;
+}
+
+// 命中测试：一个图层中 strokeCount 条 20 点的笔迹，按固定密度铺开（画布随数量增长），
+// 测量点选和 200×200 框选的耗时；两者都应与总笔迹数基本无关
+QJsonObject hitTesting(int strokeCount) {
+    QGraphicsScene scene;
+    DrawingView view(&scene);
+    view.resize(1200, 800);
+    view.show();
+    view.tuneSceneIndex(strokeCount);
+
+    const qreal side = qSqrt(qreal(strokeCount)) * 60;
+    view.ensureCanvasCovers(QRectF(0, 0, side, side));
+    LayerItem *layer = new LayerItem("图层 1");
+    scene.addItem(layer);
+    Sequence random(13);
+    const QPen pen(Qt::darkGreen, 3, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
+    for (int i = 0; i < strokeCount; ++i) {
+        QPointF p(random.next(0, side), random.next(0, side));
+        StrokeItem *stroke = new StrokeItem(p, pen);
+        for (int k = 1; k < 20; ++k) {
+            p += QPointF(random.next(-6, 10), random.next(-6, 10));
+            stroke->appendPoint(p);
+        }
+        stroke->compact();
+        stroke->setZValue(i);
+        layer->adopt(stroke);
+    }
+    view.setCurrentLayer(layer);
+    Selector::pickAt(layer, QPointF(side / 2, side / 2), 4);   // 首次查询建立索引，不计入
+
+    Samples pick;
+    int picked = 0;
+    for (int i = 0; i < 2000; ++i) {
+        const QPointF pos(random.next(0, side), random.next(0, side));
+        QElapsedTimer clock;
+        clock.start();
+        picked += Selector::pickAt(layer, pos, 4).size();
+        pick.add(clock.nsecsElapsed());
+    }
+    Samples band;
+    qint64 collected = 0;
+    for (int i = 0; i < 200; ++i) {
+        const QRectF rect(random.next(0, side - 200), random.next(0, side - 200), 200, 200);
+        QElapsedTimer clock;
+        clock.start();
+        collected += Selector::collect(layer, rect).size();
+        band.add(clock.nsecsElapsed());
+    }
+
+    QJsonObject object;
+    object["name"] = QString("hit_test_%1").arg(strokeCount);
+    object["strokes"] = strokeCount;
+    object["pickHitRate"] = picked / 2000.0;
+    object["pickUs"] = pick.toJson();
+    object["bandAverageItems"] = collected / 200.0;
+    object["bandUs"] = band.toJson();
+    object["peakRssKb"] = peakRssKb();
+    return object;
+}
+
+// 填充：8K×8K 画布上用方框围出边长为 regionSize 的区域，框内散布圆形障碍物，从框内一点填充
+QJsonObject fillRegion(int regionSize) {
+    const int canvasSize = 8192;
+    regionSize = qBound(16, regionSize, canvasSize - 16);
+    QImage canvas(canvasSize, canvasSize, QImage::Format_RGB32);
+    canvas.fill(Qt::white);
+    const QRect region((canvasSize - regionSize) / 2, (canvasSize - regionSize) / 2, regionSize, regionSize);
+    {
+        QPainter painter(&canvas);
+        painter.setRenderHint(QPainter::Antialiasing);
+        painter.setPen(QPen(Qt::black, 3));
+        painter.drawRect(region);
+        Sequence random(11);
+        const int obstacles = regionSize * regionSize / 40000;
+        for (int i = 0; i < obstacles; ++i) {
+            const QPointF center(random.next(region.left() + 40, region.right() - 40),
+                                 random.next(region.top() + 40, region.bottom() - 40));
+            painter.drawEllipse(center, 12, 12);
+        }
+    }
+    const QPoint seed(region.left() + 8, region.top() + 8);
+
+    Samples times;
+    FillResult fill;
+    for (int i = 0; i < 5; ++i) {
+        fill = FloodFill::fill(canvas, seed, 32);
+        times.add(fill.elapsedNs);
+    }
+
+    QJsonObject object;
+    object["name"] = QString("fill_%1").arg(regionSize);
+    object["canvas"] = canvasSize;
+    object["pixels"] = double(fill.pixels);
+    object["rects"] = fill.rects.size();
+    object["fillUs"] = times.toJson();
+    object["megapixelsPerSecond"] = fill.elapsedNs > 0 ? fill.pixels / (fill.elapsedNs / 1e3) : 0;
+    object["peakRssKb"] = peakRssKb();
+    return object;
+}
+
+// 视图中的填充：整个 fillAt（栅格化可见区域、扫描、生成轮廓、提交）在 GUI 线程上的耗时。
+// 另外单独测量由扫描段生成轮廓与逐段 addRect 后 simplified() 的耗时，两者栅格化后应完全一致
+QJsonObject fillView(int obstacles) {
+    QGraphicsScene scene;
+    DrawingView view(&scene);
+    view.resize(1200, 800);
+    view.show();
+    LayerItem *layer = new LayerItem("图层 1");
+    scene.addItem(layer);
+    view.setCurrentLayer(layer);
+    const QRectF region(20, 20, 1100, 700);
+    const QPen pen(Qt::black, 3);
+    ShapeItem *border = new ShapeItem(ShapeItem::Rectangle, region.topLeft(), pen);
+    border->setPoint(1, region.bottomRight());
+    layer->adopt(border);
+    Sequence random(13);
+    for (int i = 0; i < obstacles; ++i) {
+        const QPointF center(random.next(region.left() + 40, region.right() - 40),
+                             random.next(region.top() + 40, region.bottom() - 40));
+        ShapeItem *circle = new ShapeItem(ShapeItem::Ellipse, center - QPointF(12, 12), pen);
+        circle->setPoint(1, center + QPointF(12, 12));
+        layer->adopt(circle);
+    }
+    view.centerOn(region.center());
+    view.viewport()->repaint();
+    const QPointF seed = region.topLeft() + QPointF(8, 8);
+
+    // 每次换一种颜色填同一区域，上一次的填充不影响区域形状
+    Samples total;
+    Samples scan;
+    int rects = 0;
+    QObject::connect(&view, &DrawingView::regionFilled, [&](qint64, int count, qint64 elapsedUs) {
+        scan.add(elapsedUs * 1000);
+        rects = count;
+    });
+    for (int i = 0; i < 10; ++i) {
+        view.setPenColor(QColor::fromHsv(i * 36, 160, 240));
+        QElapsedTimer clock;
+        clock.start();
+        view.fillAt(seed);
+        total.add(clock.nsecsElapsed());
+    }
+
+    const QRectF source = view.mapToScene(view.viewport()->rect()).boundingRect();
+    QImage image(view.viewport()->size(), QImage::Format_RGB32);
+    image.fill(Qt::white);
+    {
+        QPainter painter(&image);
+        scene.render(&painter, QRectF(image.rect()), source, Qt::IgnoreAspectRatio);
+    }
+    const FillResult fill = FloodFill::fill(image, view.mapFromScene(seed), 32);
+    Samples outline;
+    Samples simplified;
+    QPainterPath direct;
+    QPainterPath merged;
+    for (int i = 0; i < 5; ++i) {
+        QElapsedTimer clock;
+        clock.start();
+        direct = FloodFill::outline(fill.rects);
+        outline.add(clock.nsecsElapsed());
+        clock.restart();
+        QPainterPath pixels;
+        pixels.setFillRule(Qt::WindingFill);
+        foreach (const QRect &rect, fill.rects) pixels.addRect(rect);
+        merged = pixels.simplified();
+        simplified.add(clock.nsecsElapsed());
+    }
+    QImage directImage(image.size(), QImage::Format_ARGB32);
+    QImage mergedImage(image.size(), QImage::Format_ARGB32);
+    directImage.fill(Qt::transparent);
+    mergedImage.fill(Qt::transparent);
+    QPainter(&directImage).fillPath(direct, Qt::black);
+    QPainter(&mergedImage).fillPath(merged, Qt::black);
+
+    QJsonObject object;
+    object["name"] = QString("fill_view_%1").arg(obstacles);
+    object["obstacles"] = obstacles;
+    object["rects"] = rects;
+    object["fillAtUs"] = total.toJson();
+    object["scanUs"] = scan.toJson();
+    object["outlineUs"] = outline.toJson();
+    object["simplifiedUs"] = simplified.toJson();
+    object["passed"] = !fill.isEmpty() && directImage == mergedImage;
+    object["peakRssKb"] = peakRssKb();
+    return object;
+}
+
+// 处理事件直到 done 成立，超时返回 false
+bool waitFor(const std::function<bool()> &done, int timeoutMs) {
+    QElapsedTimer clock;
+    clock.start();
+    while (!done()) {
+        if (clock.elapsed() > timeoutMs) return false;
+        QCoreApplication::processEvents();
+    }
+    return true;
+}
+
+// 两个实例是否一致：逐个图层比较名称和全部图形（层叠次序、位置、记录体），图层内排序后比较
+QStringList syncSignature(QGraphicsScene *scene) {
+    QStringList signature;
+    foreach (LayerItem *layer, LayerItem::layers(scene)) {
+        QStringList items;
+        foreach (QGraphicsItem *item, layer->childItems()) {
+            if (item == layer->bakedTiles()) continue;
+            QByteArray body;
+            BinaryWriter out(&body);
+            const quint8 tag = ChbDocument::encodeItem(item, out);
+            items.append(QString("%1 %2 %3,%4 %5").arg(item->zValue()).arg(tag)
+                             .arg(item->pos().x()).arg(item->pos().y()).arg(QString(body.toBase64())));
+        }
+        // 栅格瓦片按像素比较（擦除、撤回擦除和远端回放的 ClearTiles 都要逐字节一致），只记摘要
+        const TilePatches tiles = layer->bakedTiles()->tileImages();
+        for (TilePatches::const_iterator it = tiles.constBegin(); it != tiles.constEnd(); ++it) {
+            const QImage tile = it.value().convertToFormat(QImage::Format_ARGB32_Premultiplied);
+            const QByteArray bits(reinterpret_cast<const char*>(tile.constBits()), tile.bytesPerLine() * tile.height());
+            items.append(QString("tile %1 %2").arg(it.key())
+                             .arg(QString(QCryptographicHash::hash(bits, QCryptographicHash::Sha1).toHex())));
+        }
+        items.sort();
+        signature.append(layer->name());
+        signature += items;
+    }
+    return signature;
+}
+
+// 一条 100 点的笔迹：每 4 个采样一帧，帧末发出同步攒下的操作
+void syncedStroke(Driver &driver, LiveSync *sync, const QPointF &start) {
+    driver.press(start);
+    QPointF p = start;
+    for (int i = 1; i <= 100; ++i) {
+        p = start + QPointF(i * 0.6, 30 * qSin(i * 0.08));
+        driver.move(p);
+        if (i % 4 == 0) {
+            driver.frame();
+            sync->flush();
+            QCoreApplication::processEvents();
+        }
+    }
+    driver.release(p);
+}
+
+// 实时同步回环：同一进程里两个窗口通过本地套接字（lan 时经本机回环地址的 TCP）加入同一画板，轮流各画 strokes 条笔迹，
+// 统计从松开鼠标到对方出现这条笔迹的延迟（含等下一帧发出）和每笔的传输字节数；
+// 之后双方撤回、重做，烘焙并擦除栅格，一方清空画布再撤回清空（走快照），检查两边最终内容一致（图形和栅格瓦片）；
+// 两次检查都一致且没有超时才算通过；局域网时口令不符的第三个实例还须被主机拒绝
+QJsonObject liveSyncLoopback(int strokes, bool lan) {
+    QJsonObject object;
+    object["name"] = lan ? "live_sync_lan_loopback" : "live_sync_loopback";
+    object["passed"] = false;
+    const QString board = lan ? QString("benchmark@:0") : QString("benchmark-%1").arg(QCoreApplication::applicationPid());
+    MainWindow host;
+    MainWindow guest;
+    host.resize(1000, 700);
+    guest.resize(1000, 700);
+    host.show();
+    guest.show();
+    QString error;
+    if (!host.startSync(board, &error)) {
+        object["error"] = error;
+        return object;
+    }
+    const quint16 port = host.findChild<LiveSync*>()->lanPort();
+    if (!guest.startSync(lan ? QString("benchmark@127.0.0.1:%1").arg(port) : board, &error)) {
+        object["error"] = error;
+        return object;
+    }
+    DrawingView *views[2] = { host.findChild<DrawingView*>(), guest.findChild<DrawingView*>() };
+    UndoJournal *journals[2] = { host.findChild<UndoJournal*>(), guest.findChild<UndoJournal*>() };
+    LiveSync *syncs[2] = { host.findChild<LiveSync*>(), guest.findChild<LiveSync*>() };
+    if (!waitFor([&]() { return syncs[1]->siteId() != 0 && syncs[1]->stats().snapshotsApplied > 0; }, 5000)) {
+        object["error"] = QString("加入画板超时");
+        return object;
+    }
+    // 局域网画板：口令不符的成员应被主机断开，主机上不留下连接
+    bool intruderRejected = true;
+    if (lan) {
+        MainWindow intruder;
+        intruder.startSync(QString("wrong@127.0.0.1:%1").arg(port), &error);
+        bool stopped = false;
+        if (LiveSync *probe = intruder.findChild<LiveSync*>()) {
+            QObject::connect(probe, &LiveSync::stopped, [&stopped]() { stopped = true; });
+        }
+        intruderRejected = waitFor([&]() { return stopped; }, 5000) && syncs[0]->peerCount() == 1;
+    }
+    syncs[0]->resetStats();
+    syncs[1]->resetStats();
+    QGraphicsScene *scenes[2] = { views[0]->scene(), views[1]->scene() };
+    Driver drivers[2] = { Driver(views[0]), Driver(views[1]) };
+    views[0]->setCurrentTool(DrawingTool::PEN);
+    views[1]->setCurrentTool(DrawingTool::PEN);
+
+    // 轮流画：每条笔迹等对方的图层里多出一个图形再画下一条
+    Samples latency;
+    int timeouts = 0;
+    QElapsedTimer clock;
+    clock.start();
+    for (int s = 0; s < strokes * 2; ++s) {
+        const int side = s % 2;
+        LayerItem *remoteLayer = LayerItem::layers(scenes[1 - side]).last();
+        const int before = remoteLayer->childItems().size();
+        syncedStroke(drivers[side], syncs[side], QPointF(40 + (s % 10) * 90, 60 + (s / 10 % 6) * 100));
+        QElapsedTimer arrival;
+        arrival.start();
+        if (waitFor([&]() { return remoteLayer->childItems().size() > before; }, 2000)) {
+            latency.add(arrival.nsecsElapsed());
+        } else {
+            ++timeouts;
+        }
+    }
+    const qint64 drawNs = clock.nsecsElapsed();
+    const LiveSyncStats drawn[2] = { syncs[0]->stats(), syncs[1]->stats() };
+
+    // 撤回、重做、清空和撤回清空
+    for (int i = 0; i < 3; ++i) journals[0]->undo();
+    for (int i = 0; i < 2; ++i) journals[1]->undo();
+    journals[0]->redo();
+    syncs[0]->flush();
+    syncs[1]->flush();
+    settle();
+    const bool convergedAfterUndo = waitFor([&]() { return syncSignature(scenes[0]) == syncSignature(scenes[1]); }, 5000);
+    // 把最早的笔迹烘焙进栅格再擦过去：栅格的擦除、撤回和重做以瓦片补丁同步，两边的瓦片须逐字节一致
+    journals[0]->setDepthLimit(8);
+    views[0]->setEraserMode(true);
+    syncedStroke(drivers[0], syncs[0], QPointF(40, 60));
+    views[0]->setEraserMode(false);
+    journals[0]->undo();
+    journals[0]->redo();
+    syncs[0]->flush();
+    settle();
+    const bool convergedAfterErase = waitFor([&]() { return syncSignature(scenes[0]) == syncSignature(scenes[1]); }, 5000);
+    views[0]->cancelDrawing();
+    views[0]->detachBatches();
+    journals[0]->recordClear();
+    syncedStroke(drivers[1], syncs[1], QPointF(300, 300));
+    waitFor([&]() { return !LayerItem::layers(scenes[0]).last()->childItems().isEmpty(); }, 2000);
+    journals[0]->undo();
+    syncedStroke(drivers[0], syncs[0], QPointF(500, 300));
+    settle();
+    clock.restart();
+    const bool converged = waitFor([&]() { return syncSignature(scenes[0]) == syncSignature(scenes[1]); }, 5000);
+    const qint64 convergeNs = clock.nsecsElapsed();
+
+    const LiveSyncStats stats[2] = { syncs[0]->stats(), syncs[1]->stats() };
+    const double sent = qMax<quint64>(1, drawn[0].strokesSent + drawn[1].strokesSent);
+    const double acks = qMax<quint64>(1, drawn[0].acks + drawn[1].acks);
+    object["strokes"] = strokes * 2;
+    object["items"] = syncSignature(scenes[0]).size() - LayerItem::layers(scenes[0]).size();
+    object["seconds"] = drawNs / 1e9;
+    object["timeouts"] = timeouts;
+    object["latencyUs"] = latency.toJson();
+    object["ackLatencyMeanUs"] = (drawn[0].ackLatencyTotalUs + drawn[1].ackLatencyTotalUs) / acks;
+    object["ackLatencyMaxUs"] = double(qMax(drawn[0].ackLatencyMaxUs, drawn[1].ackLatencyMaxUs));
+    object["strokeBytesPerStroke"] = (drawn[0].strokeBytes + drawn[1].strokeBytes) / sent;
+    object["liveBytesPerStroke"] = (drawn[0].liveBytes + drawn[1].liveBytes) / sent;
+    object["wireBytesPerStroke"] = (drawn[0].bytesSent + drawn[1].bytesSent) / sent;
+    object["framesPerStroke"] = (drawn[0].framesSent + drawn[1].framesSent) / sent;
+    object["snapshots"] = double(stats[0].snapshotsSent + stats[1].snapshotsSent);
+    object["convergedAfterUndo"] = convergedAfterUndo;
+    object["convergedAfterErase"] = convergedAfterErase;
+    object["converged"] = converged;
+    if (lan) object["intruderRejected"] = intruderRejected;
+    object["passed"] = converged && convergedAfterUndo && convergedAfterErase && intruderRejected && timeouts == 0;
+    object["convergeSeconds"] = convergeNs / 1e9;
+    object["peakRssKb"] = peakRssKb();
+    return object;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    // 默认使用 offscreen 平台，不需要显示器和 GPU
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("彩虹画板基准测试");
+    parser.addHelpOption();
+    QCommandLineOption outputOption("output", "结果写入文件（默认输出到标准输出）", "file");
+    QCommandLineOption scaleOption("scale", "工作负载倍数", "n", "1");
+    QCommandLineOption indexOption("index-sizes", "索引测试的图形数，逗号分隔", "list", "10000,100000,1000000");
+    parser.addOption(outputOption);
+    parser.addOption(scaleOption);
+    parser.addOption(indexOption);
+    QCommandLineOption fillOption("fill-sizes", "填充测试的区域边长（8K 画布内），逗号分隔", "list", "256,1024,4096,8000");
+    parser.addOption(fillOption);
+    QCommandLineOption brushOption("brush-sizes", "笔印吞吐测试的笔刷直径，逗号分隔", "list", "8,32,128");
+    parser.addOption(brushOption);
+    QCommandLineOption hitOption("hit-sizes", "命中测试的笔迹数，逗号分隔", "list", "10000,100000");
+    parser.addOption(hitOption);
+    parser.process(app);
+    const int scale = qMax(1, parser.value(scaleOption).toInt());
+
+    QTemporaryDir directory;
+    MainWindow window;
+    window.resize(1280, 900);
+    window.show();
+    QCoreApplication::processEvents();
+    DrawingView *view = window.findChild<DrawingView*>();
+    UndoJournal *journal = window.findChild<UndoJournal*>();
+
+    QJsonArray workloads;
+    workloads.append(penStrokes(view, 100 * scale));
+    workloads.append(shapeDrags(view, 1000 * scale));
+    // 同样的拖拽放进批量层
+    view->setPrimitiveBatching(true);
+    QJsonObject batched = shapeDrags(view, 1000 * scale);
+    batched["name"] = "shape_drags_batched";
+    workloads.append(batched);
+    view->setPrimitiveBatching(false);
+    workloads.append(brushStrokes(view, 20 * scale));
+    workloads.append(textStamps(view, 2000 * scale));
+    workloads.append(undoStorm(view, journal, 5 * scale));
+    foreach (const QJsonValue &value, exports(view->scene(), directory.path())) {
+        workloads.append(value);
+    }
+    workloads.append(documentRoundTrip(view->scene(), directory.path()));
+    workloads.append(batchRender(directory.path(), 50 * scale));
+    foreach (const QJsonValue &value, vectorExport(directory.path(), 100000 * scale)) {
+        workloads.append(value);
+    }
+    workloads.append(layeredStrokes(6, 5000 * scale, 20, false));
+    workloads.append(layeredStrokes(6, 5000 * scale, 20, true));
+    foreach (const QString &size, parser.value(indexOption).split(',')) {
+        const int itemCount = size.trimmed().toInt();
+        if (itemCount > 0) workloads.append(indexScaling(itemCount));
+    }
+    foreach (const QString &size, parser.value(hitOption).split(',')) {
+        const int strokeCount = size.trimmed().toInt();
+        if (strokeCount > 0) workloads.append(hitTesting(strokeCount));
+    }
+    workloads.append(strokeMemory(2000));
+    foreach (const QString &size, parser.value(fillOption).split(',')) {
+        const int regionSize = size.trimmed().toInt();
+        if (regionSize > 0) workloads.append(fillRegion(regionSize));
+    }
+    workloads.append(fillView(300));
+    foreach (const QString &size, parser.value(brushOption).split(',')) {
+        const int diameter = size.trimmed().toInt();
+        if (diameter <= 0) continue;
+        for (int kind = BrushEngine::Soft; kind <= BrushEngine::Textured; ++kind) {
+            workloads.append(brushDabs(kind, diameter, 20000 * scale));
+        }
+    }
+    workloads.append(liveSyncLoopback(20 * scale, false));
+    workloads.append(liveSyncLoopback(20 * scale, true));
+    // 开启自动保存后再画一遍笔迹：GUI 线程只多出入队的开销，写盘和 fsync 在写入线程
+    if (window.startAutosave(directory.path() + "/autosave")) {
+        QJsonObject autosaved = penStrokes(view, 100 * scale);
+        autosaved["name"] = "pen_strokes_autosave";
+        if (Autosave *autosave = window.findChild<Autosave*>()) {
+            // 写完队列后停止写入线程，目录里就是此刻崩溃会留下的内容
+            autosave->writer()->stop();
+            int replayed = 0;
+            autosaved["passed"] = recoveryMatches(view->scene(), directory.path() + "/autosave",
+                                                  directory.path() + "/recovered", &replayed);
+            autosaved["recoveredEntries"] = replayed;
+            autosaved["journalBytes"] = double(autosave->writer()->bytesWritten());
+            autosaved["journalSyncs"] = double(autosave->writer()->syncCount());
+            autosaved["snapshots"] = autosave->snapshotCount();
+        }
+        workloads.append(autosaved);
+    }
+
+    QJsonObject report;
+    report["benchmark"] = "caihonghuaban";
+    report["formatVersion"] = 1;
+    report["qtVersion"] = QString(qVersion());
+    report["platform"] = QGuiApplication::platformName();
+    report["scale"] = scale;
+    report["workloads"] = workloads;
+    report["peakRssKb"] = peakRssKb();
+    const QByteArray json = QJsonDocument(report).toJson();
+    // 带 passed 字段的工作负载同时是正确性检查，任何一项失败时以非零状态退出
+    QStringList failed;
+    foreach (const QJsonValue &value, workloads) {
+        const QJsonObject object = value.toObject();
+        if (object.contains("passed") && !object["passed"].toBool()) {
+            failed.append(object["name"].toString());
+        }
+    }
+
+    if (parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly)) {
+            QTextStream(stderr) << "无法写入 " << file.fileName() << endl;
+            return 1;
+        }
+        file.write(json);
+    } else {
+        QTextStream(stdout) << json;
+    }
+    if (!failed.isEmpty()) {
+        QTextStream(stderr) << "检查失败: " << failed.join(", ") << endl;
+        return 2;
+    }
+    return 0;
+}
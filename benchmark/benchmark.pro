@@ -0,0 +1,20 @@
+#-------------------------------------------------
+#
+# 无界面基准测试：在 offscreen 平台上用合成的鼠标事件驱动 DrawingView，
+# 结果以 JSON 输出，供回归比较
+#   qmake && make && ./caihonghuaban-benchmark --output result.json
+#
+#-------------------------------------------------
+
+QT       += core gui concurrent widgets network
+
+TARGET = caihonghuaban-benchmark
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../core.pri)
+
+SOURCES += benchmark.cpp
+
+win32: LIBS += -lpsapi
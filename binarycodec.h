@@ -0,0 +1,133 @@
+#ifndef BINARYCODEC_H
+#define BINARYCODEC_H
+
+#include <QByteArray>
+#include <QString>
+#include <QRectF>
+#include <QPointF>
+#include <QPen>
+#include <QColor>
+#include <QtEndian>
+#include <cstring>
+
+// 小端二进制编码：追加写入可复用的缓冲
+class BinaryWriter {
+public:
+    explicit BinaryWriter(QByteArray *buffer) : buf(buffer) {}
+
+    void u8(quint8 v) { buf->append(char(v)); }
+    void u16(quint16 v) { v = qToLittleEndian(v); buf->append(reinterpret_cast<const char*>(&v), 2); }
+    void u32(quint32 v) { v = qToLittleEndian(v); buf->append(reinterpret_cast<const char*>(&v), 4); }
+    void u64(quint64 v) { v = qToLittleEndian(v); buf->append(reinterpret_cast<const char*>(&v), 8); }
+    void f32(qreal v) {
+        const float f = float(v);
+        quint32 bits;
+        std::memcpy(&bits, &f, 4);
+        u32(bits);
+    }
+    void varint(quint64 v) {
+        while (v >= 0x80) {
+            u8(quint8(v) | 0x80);
+            v >>= 7;
+        }
+        u8(quint8(v));
+    }
+    void svarint(qint64 v) { varint((quint64(v) << 1) ^ quint64(v >> 63)); }
+    void bytes(const QByteArray &data) {
+        varint(quint64(data.size()));
+        buf->append(data);
+    }
+    void raw(const QByteArray &data) { buf->append(data); }  // 不带长度前缀
+    void string(const QString &text) { bytes(text.toUtf8()); }
+    void rect(const QRectF &r) { f32(r.x()); f32(r.y()); f32(r.width()); f32(r.height()); }
+    void point(const QPointF &p) { f32(p.x()); f32(p.y()); }
+    void pen(const QPen &pen) {
+        u32(pen.color().rgba());
+        f32(pen.widthF());
+        u8(quint8(pen.style()));
+        u16(quint16(pen.capStyle()));
+        u16(quint16(pen.joinStyle()));
+    }
+
+private:
+    QByteArray *buf;
+};
+
+// 小端二进制解码：越界时置 ok 为 false，后续读取都返回 0
+class BinaryReader {
+public:
+    BinaryReader() : p(nullptr), end(nullptr), ok(false) {}
+    BinaryReader(const uchar *data, quint32 length) : p(data), end(data + length), ok(true) {}
+
+    bool isOk() const { return ok; }
+    bool atEnd() const { return p == end; }
+    const uchar *position() const { return p; }  // 下一个未读字节
+
+    quint8 u8() { return need(1) ? *p++ : 0; }
+    quint16 u16() { return need(2) ? take<quint16>() : 0; }
+    quint32 u32() { return need(4) ? take<quint32>() : 0; }
+    quint64 u64() { return need(8) ? take<quint64>() : 0; }
+    qreal f32() {
+        const quint32 bits = u32();
+        float f;
+        std::memcpy(&f, &bits, 4);
+        return f;
+    }
+    quint64 varint() {
+        quint64 v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            const quint8 b = u8();
+            v |= quint64(b & 0x7f) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        ok = false;
+        return 0;
+    }
+    qint64 svarint() {
+        const quint64 v = varint();
+        return qint64(v >> 1) ^ -qint64(v & 1);
+    }
+    QByteArray bytes() {
+        const quint64 size = varint();
+        if (!need(size)) return QByteArray();
+        const QByteArray data(reinterpret_cast<const char*>(p), int(size));
+        p += size;
+        return data;
+    }
+    QString string() { return QString::fromUtf8(bytes()); }
+    QRectF rect() {
+        const qreal x = f32(), y = f32(), w = f32(), h = f32();
+        return QRectF(x, y, w, h);
+    }
+    QPointF point() {
+        const qreal x = f32();
+        return QPointF(x, f32());
+    }
+    QPen pen() {
+        QPen pen(QColor::fromRgba(u32()));
+        pen.setWidthF(f32());
+        pen.setStyle(Qt::PenStyle(u8()));
+        pen.setCapStyle(Qt::PenCapStyle(u16()));
+        pen.setJoinStyle(Qt::PenJoinStyle(u16()));
+        return pen;
+    }
+
+private:
+    bool need(quint64 size) {
+        if (ok && quint64(end - p) >= size) return true;
+        ok = false;
+        return false;
+    }
+    template <typename T> T take() {
+        T v;
+        std::memcpy(&v, p, sizeof(T));
+        p += sizeof(T);
+        return qFromLittleEndian(v);
+    }
+
+    const uchar *p;
+    const uchar *end;
+    bool ok;
+};
+
+#endif // BINARYCODEC_H
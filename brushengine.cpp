@@ -0,0 +1,173 @@
+#include "brushengine.h"
+#include <QCache>
+#include <QRect>
+#include <QtMath>
+#include <cstring>
+
+// x86-64 总是支持 SSE2；32 位 MinGW 由 core.pri 加上 -msse2，其他未打开 SSE2 的 32 位编译用标量合成
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BRUSHENGINE_SSE2
+#endif
+
+namespace {
+
+const int kMaxDiameter = 1024;
+const int kExactDiameter = 64;               // 不超过此直径的遮罩逐像素缓存，更大的按比例量化
+const int kMaskCacheBytes = 16 * 1024 * 1024; // 遮罩缓存上限
+
+// 近似 x / 255（x 不超过 255 * 255），与标量版本结果一致
+inline int div255(int x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+// 固定的颗粒噪声（0-255），同一位置每次相同
+inline int grain(int x, int y) {
+    quint32 h = quint32(x) * 374761393u + quint32(y) * 668265263u;
+    h = (h ^ (h >> 13)) * 1274126177u;
+    return int((h ^ (h >> 16)) & 0xff);
+}
+
+QImage buildMask(int kind, int diameter) {
+    QImage mask(diameter, diameter, QImage::Format_Alpha8);
+    const qreal radius = diameter / 2.0;
+    for (int y = 0; y < diameter; ++y) {
+        uchar *line = mask.scanLine(y);
+        for (int x = 0; x < diameter; ++x) {
+            const qreal dx = (x + 0.5 - radius) / radius;
+            const qreal dy = (y + 0.5 - radius) / radius;
+            const qreal r = qSqrt(dx * dx + dy * dy);
+            qreal a = 0;
+            if (r < 1) {
+                switch (kind) {
+                case BrushEngine::Airbrush:
+                    a = qExp(-4.5 * r * r);
+                    break;
+                case BrushEngine::Textured: {
+                    const qreal edge = r < 0.7 ? 1 : 1 - (r - 0.7) / 0.3;
+                    a = edge * (0.35 + 0.65 * grain(x, y) / 255.0);
+                    break;
+                }
+                default: {
+                    const qreal edge = r < 0.5 ? 1 : 1 - (r - 0.5) / 0.5;
+                    a = edge * edge;
+                    break;
+                }
+                }
+            }
+            line[x] = uchar(qRound(qBound<qreal>(0, a, 1) * 255));
+        }
+    }
+    return mask;
+}
+
+// 单个像素的 source-over：src = color * sa，dst = src + dst * (1 - sa)
+inline void blendPixel(quint32 *dst, int m, int flow, const int color[4]) {
+    const int sa = div255(div255(m * flow) * color[3]);
+    if (sa == 0) return;
+    const int inv = 255 - sa;
+    quint32 d = *dst;
+    quint32 out = 0;
+    for (int c = 0; c < 4; ++c) {
+        const int source = c == 3 ? sa : div255(color[c] * sa);
+        const int value = source + div255(int((d >> (c * 8)) & 0xff) * inv);
+        out |= quint32(qMin(255, value)) << (c * 8);
+    }
+    *dst = out;
+}
+
+#ifdef BRUSHENGINE_SSE2
+inline __m128i div255x8(__m128i x) {
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+#endif
+
+}
+
+namespace BrushEngine {
+
+qreal flow(int kind) {
+    switch (kind) {
+    case Airbrush: return 0.08;
+    case Textured: return 0.6;
+    default: return 0.35;
+    }
+}
+
+qreal spacing(int kind) {
+    switch (kind) {
+    case Airbrush: return 0.05;
+    case Textured: return 0.3;
+    default: return 0.15;
+    }
+}
+
+// 大直径量化到直径的 1/64 左右（看不出差别），连续变化的笔压不会为每个像素直径各建一张遮罩；
+// 缓存按字节数计费，超出上限时淘汰最久未用的
+QImage dabMask(int kind, int diameter) {
+    static QCache<int, QImage> cache(kMaskCacheBytes);
+    diameter = qBound(1, diameter, kMaxDiameter);
+    if (diameter > kExactDiameter) {
+        const int step = int(qNextPowerOfTwo(quint32(diameter))) / kExactDiameter;
+        diameter = qMin(kMaxDiameter, (diameter + step / 2) / step * step);
+    }
+    const int key = kind * (kMaxDiameter + 1) + diameter;
+    if (QImage *mask = cache.object(key)) return *mask;
+    QImage *mask = new QImage(buildMask(kind, diameter));
+    const QImage result = *mask;
+    cache.insert(key, mask, mask->bytesPerLine() * mask->height());
+    return result;
+}
+
+// 每次处理 4 个像素：遮罩乘流量得到每像素的 sa，扩展到 B/G/R/A 四个 16 位通道后一起混合
+void composite(QImage *tile, const QPoint &offset, const QImage &mask, QRgb color, int flow) {
+    const QRect area = QRect(offset, mask.size()) & tile->rect();
+    if (area.isEmpty() || flow <= 0) return;
+    flow = qMin(flow, 255);
+    const int channels[4] = { qBlue(color), qGreen(color), qRed(color), qAlpha(color) };
+
+#ifdef BRUSHENGINE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i flowv = _mm_set1_epi16(short(flow));
+    const __m128i alphav = _mm_set1_epi16(short(channels[3]));
+    const __m128i v255 = _mm_set1_epi16(255);
+    // 两个像素的 B, G, R, 255（alpha 通道乘 sa 即得 sa）
+    const __m128i colorv = _mm_setr_epi16(short(channels[0]), short(channels[1]), short(channels[2]), 255,
+                                          short(channels[0]), short(channels[1]), short(channels[2]), 255);
+#endif
+
+    for (int y = area.top(); y <= area.bottom(); ++y) {
+        quint32 *dst = reinterpret_cast<quint32*>(tile->scanLine(y)) + area.left();
+        const uchar *m = mask.constScanLine(y - offset.y()) + (area.left() - offset.x());
+        int x = 0;
+        const int count = area.width();
+#ifdef BRUSHENGINE_SSE2
+        for (; x + 4 <= count; x += 4) {
+            quint32 m4;
+            std::memcpy(&m4, m + x, 4);
+            if (m4 == 0) continue;
+            __m128i mv = _mm_unpacklo_epi8(_mm_cvtsi32_si128(int(m4)), zero);
+            mv = div255x8(_mm_mullo_epi16(mv, flowv));
+            const __m128i sa = div255x8(_mm_mullo_epi16(mv, alphav));     // 低 4 个通道为 4 个像素的 sa
+            const __m128i sa2 = _mm_unpacklo_epi16(sa, sa);
+            const __m128i saLo = _mm_unpacklo_epi32(sa2, sa2);             // 像素 0、1 的 sa 各重复 4 次
+            const __m128i saHi = _mm_unpackhi_epi32(sa2, sa2);             // 像素 2、3
+            const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + x));
+            __m128i lo = _mm_unpacklo_epi8(d, zero);
+            __m128i hi = _mm_unpackhi_epi8(d, zero);
+            lo = _mm_add_epi16(div255x8(_mm_mullo_epi16(colorv, saLo)),
+                               div255x8(_mm_mullo_epi16(lo, _mm_sub_epi16(v255, saLo))));
+            hi = _mm_add_epi16(div255x8(_mm_mullo_epi16(colorv, saHi)),
+                               div255x8(_mm_mullo_epi16(hi, _mm_sub_epi16(v255, saHi))));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(lo, hi));
+        }
+#endif
+        for (; x < count; ++x) {
+            if (m[x]) blendPixel(dst + x, m[x], flow, channels);
+        }
+    }
+}
+
+}
@@ -0,0 +1,27 @@
+#ifndef BRUSHENGINE_H
+#define BRUSHENGINE_H
+
+#include <QImage>
+#include <QPoint>
+#include <QColor>
+
+// 笔刷引擎：笔印遮罩和合成内核
+namespace BrushEngine {
+
+enum Kind {
+    Soft,       // 柔边
+    Airbrush,   // 喷枪（低流量、密集）
+    Textured    // 纹理（带颗粒）
+};
+
+qreal flow(int kind);                    // 每个笔印的不透明度（0-1）
+qreal spacing(int kind);                 // 笔印间距（直径的比例）
+QImage dabMask(int kind, int diameter);  // 笔印遮罩（Alpha8，大直径会量化，有总量上限的缓存，只在 GUI 线程调用）
+
+// 把笔印按 source-over 合成进瓦片（ARGB32_Premultiplied）：
+// 遮罩左上角位于瓦片坐标 offset，超出瓦片的部分裁掉；flow 为 0-255 的流量
+void composite(QImage *tile, const QPoint &offset, const QImage &mask, QRgb color, int flow);
+
+}
+
+#endif // BRUSHENGINE_H
@@ -0,0 +1,177 @@
+#include "brushstrokeitem.h"
+#include "brushengine.h"
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+#include <QLineF>
+#include <QtMath>
+
+namespace {
+
+// 与矩形相交的瓦片范围（列、行闭区间）
+void tileSpan(const QRectF &rect, int *firstColumn, int *lastColumn, int *firstRow, int *lastRow) {
+    *firstColumn = qFloor(rect.left() / TileLayer::TileSize);
+    *lastColumn = qFloor(rect.right() / TileLayer::TileSize);
+    *firstRow = qFloor(rect.top() / TileLayer::TileSize);
+    *lastRow = qFloor(rect.bottom() / TileLayer::TileSize);
+}
+
+}
+
+BrushStrokeItem::BrushStrokeItem(int kind, const QColor &color, qreal diameter, QGraphicsItem *parent)
+    : QGraphicsItem(parent),
+      brushKind(kind),
+      brushColor(color),
+      brushDiameter(qMax<qreal>(1, diameter)),
+      started(false),
+      lastPressure(1),
+      carried(0),
+      dabs(0) {
+    // 需要 exposedRect 只绘制可见瓦片
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+}
+
+QImage &BrushStrokeItem::tileAt(TileKey key) {
+    TilePatches::iterator it = tiles.find(key);
+    if (it != tiles.end()) return it.value();
+
+    prepareGeometryChange();
+    const QRect rect = TileLayer::tileRect(key);
+    bounds = bounds.isNull() ? QRectF(rect) : bounds.united(rect);
+    QImage tile(TileLayer::TileSize, TileLayer::TileSize, QImage::Format_ARGB32_Premultiplied);
+    tile.fill(Qt::transparent);
+    return tiles.insert(key, tile).value();
+}
+
+// 笔印按整数像素对齐；压力小时笔印变小变淡
+void BrushStrokeItem::dab(const QPointF &center, qreal pressure) {
+    pressure = qBound<qreal>(0, pressure, 1);
+    const int diameter = qMax(1, qRound(brushDiameter * (0.3 + 0.7 * pressure)));
+    const int flow = qRound(BrushEngine::flow(brushKind) * pressure * 255);
+    if (flow <= 0) return;
+
+    const QImage mask = BrushEngine::dabMask(brushKind, diameter);
+    const QRect rect(qRound(center.x() - mask.width() / 2.0), qRound(center.y() - mask.height() / 2.0),
+                     mask.width(), mask.height());
+    int firstColumn, lastColumn, firstRow, lastRow;
+    tileSpan(rect, &firstColumn, &lastColumn, &firstRow, &lastRow);
+    for (int row = firstRow; row <= lastRow; ++row) {
+        for (int column = firstColumn; column <= lastColumn; ++column) {
+            const TileKey key = TileLayer::keyOf(column, row);
+            QImage &tile = tileAt(key);
+            BrushEngine::composite(&tile, rect.topLeft() - TileLayer::tileRect(key).topLeft(), mask, brushColor.rgba(), flow);
+        }
+    }
+    dirty |= rect;
+    ++dabs;
+}
+
+// 按间距沿线段插值盖印，走过的零头留给下一段，压力在两端之间线性插值
+void BrushStrokeItem::strokeTo(const QPointF &pos, qreal pressure) {
+    dirty = QRect();
+    if (!started) {
+        started = true;
+        dab(pos, pressure);
+    } else {
+        const qreal length = QLineF(lastPoint, pos).length();
+        const qreal step = qMax<qreal>(1, brushDiameter * BrushEngine::spacing(brushKind));
+        qreal travelled = step - carried;
+        while (travelled <= length) {
+            const qreal t = travelled / length;
+            dab(lastPoint + (pos - lastPoint) * t, lastPressure + (pressure - lastPressure) * t);
+            travelled += step;
+        }
+        carried = length - (travelled - step);
+    }
+    lastPoint = pos;
+    lastPressure = pressure;
+    if (!dirty.isEmpty()) update(dirty);
+}
+
+void BrushStrokeItem::setTileImages(const TilePatches &images) {
+    prepareGeometryChange();
+    tiles = images;
+    bounds = QRectF();
+    for (TilePatches::const_iterator it = tiles.constBegin(); it != tiles.constEnd(); ++it) {
+        bounds |= QRectF(TileLayer::tileRect(it.key()));
+    }
+}
+
+// 只有被擦到的瓦片会脱离共享而复制像素
+BrushStrokeItem *BrushStrokeItem::erased(const QPainterPath &area) const {
+    const QPainterPath local = mapFromScene(area);
+    if (!local.intersects(bounds)) return nullptr;
+
+    BrushStrokeItem *copy = new BrushStrokeItem(brushKind, brushColor, brushDiameter);
+    copy->setPos(pos());
+    copy->tiles = tiles;
+    copy->bounds = bounds;
+    copy->dabs = dabs;
+    bool touched = false;
+    for (TilePatches::iterator it = copy->tiles.begin(); it != copy->tiles.end(); ++it) {
+        const QRect rect = TileLayer::tileRect(it.key());
+        const QPainterPath tilePath = local.translated(-rect.topLeft());
+        if (!tilePath.intersects(QRectF(0, 0, TileLayer::TileSize, TileLayer::TileSize))) continue;
+        QPainter painter(&it.value());
+        painter.setRenderHint(QPainter::Antialiasing);
+        painter.setCompositionMode(QPainter::CompositionMode_DestinationOut);
+        painter.fillPath(tilePath, Qt::black);
+        touched = true;
+    }
+    if (!touched) {
+        delete copy;
+        return nullptr;
+    }
+    return copy;
+}
+
+int BrushStrokeItem::alphaAt(const QPoint &pos) const {
+    const TileKey key = TileLayer::keyOf(qFloor(pos.x() / qreal(TileLayer::TileSize)),
+                                         qFloor(pos.y() / qreal(TileLayer::TileSize)));
+    TilePatches::const_iterator it = tiles.constFind(key);
+    if (it == tiles.constEnd()) return 0;
+    return qAlpha(it.value().pixel(pos - TileLayer::tileRect(key).topLeft()));
+}
+
+// 逐行扫描相交瓦片的 alpha，找到第一个就返回；只在索引筛出的少量笔迹上调用
+bool BrushStrokeItem::coversAny(const QRect &rect) const {
+    const int threshold = 16;
+    int firstColumn, lastColumn, firstRow, lastRow;
+    tileSpan(rect, &firstColumn, &lastColumn, &firstRow, &lastRow);
+    for (int row = firstRow; row <= lastRow; ++row) {
+        for (int column = firstColumn; column <= lastColumn; ++column) {
+            const TileKey key = TileLayer::keyOf(column, row);
+            TilePatches::const_iterator it = tiles.constFind(key);
+            if (it == tiles.constEnd()) continue;
+            const QRect tileRect = TileLayer::tileRect(key);
+            const QRect area = (rect & tileRect).translated(-tileRect.topLeft());
+            for (int y = area.top(); y <= area.bottom(); ++y) {
+                const QRgb *line = reinterpret_cast<const QRgb*>(it.value().constScanLine(y));
+                for (int x = area.left(); x <= area.right(); ++x) {
+                    if (qAlpha(line[x]) > threshold) return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+qint64 BrushStrokeItem::byteSize() const {
+    return sizeof(BrushStrokeItem) + qint64(tiles.size()) * TileLayer::TileSize * TileLayer::TileSize * 4;
+}
+
+void BrushStrokeItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) {
+    Q_UNUSED(widget);
+    const QRectF exposed = option->exposedRect & bounds;
+    if (exposed.isEmpty()) return;
+    painter->setRenderHint(QPainter::SmoothPixmapTransform);
+    int firstColumn, lastColumn, firstRow, lastRow;
+    tileSpan(exposed, &firstColumn, &lastColumn, &firstRow, &lastRow);
+    for (int row = firstRow; row <= lastRow; ++row) {
+        for (int column = firstColumn; column <= lastColumn; ++column) {
+            const TileKey key = TileLayer::keyOf(column, row);
+            TilePatches::const_iterator it = tiles.constFind(key);
+            if (it == tiles.constEnd()) continue;
+            painter->drawImage(TileLayer::tileRect(key).topLeft(), it.value());
+        }
+    }
+}
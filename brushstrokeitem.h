@@ -0,0 +1,54 @@
+#ifndef BRUSHSTROKEITEM_H
+#define BRUSHSTROKEITEM_H
+
+#include <QGraphicsItem>
+#include <QColor>
+#include <QPointF>
+#include <QRectF>
+#include <QPainterPath>
+#include "tilelayer.h"
+
+// 栅格笔刷笔迹：沿输入路径按间距盖印笔印，像素存放在只覆盖笔迹的稀疏瓦片里，
+// 每个笔印只合成并重绘它碰到的瓦片区域。笔迹是普通场景图形，撤回/擦除/保存都按整个图形处理
+class BrushStrokeItem : public QGraphicsItem {
+public:
+    enum { Type = UserType + 6 };
+
+    BrushStrokeItem(int kind, const QColor &color, qreal diameter, QGraphicsItem *parent = nullptr);
+
+    int kind() const { return brushKind; }        // BrushEngine::Kind
+    QColor color() const { return brushColor; }
+    qreal diameter() const { return brushDiameter; }
+
+    void strokeTo(const QPointF &pos, qreal pressure);   // 从上一个笔印按间距盖印到 pos（第一次调用只盖一个）
+    void dab(const QPointF &center, qreal pressure);     // 盖一个笔印（压力缩放直径和流量）
+    int dabCount() const { return dabs; }
+
+    TilePatches tileImages() const { return tiles; }     // 全部瓦片（隐式共享，保存文档用）
+    void setTileImages(const TilePatches &images);       // 读取文档时恢复瓦片
+    BrushStrokeItem *erased(const QPainterPath &area) const; // 擦掉区域后的副本（瓦片隐式共享），不相交时返回 nullptr
+    int alphaAt(const QPoint &pos) const;                // 该像素的不透明度（本地坐标，没有瓦片为 0）
+    bool coversAny(const QRect &rect) const;             // 区域内是否有不透明度超过阈值的像素（命中测试用）
+    qint64 byteSize() const;                             // 瓦片占用的内存
+
+    int type() const override { return Type; }
+    QRectF boundingRect() const override { return bounds; }
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
+
+private:
+    QImage &tileAt(TileKey key);                         // 取瓦片，不存在时创建透明瓦片
+
+    int brushKind;
+    QColor brushColor;
+    qreal brushDiameter;
+    TilePatches tiles;             // 已创建的瓦片
+    QRectF bounds;                 // 所有瓦片的并集（只在新建瓦片时变化）
+    QRect dirty;                   // 本次 strokeTo 修改过的区域
+    bool started;                  // 是否已盖过笔印
+    QPointF lastPoint;             // 上一个输入点
+    qreal lastPressure;
+    qreal carried;                 // 上一个笔印之后已走过的距离
+    int dabs;                      // 笔印总数
+};
+
+#endif // BRUSHSTROKEITEM_H
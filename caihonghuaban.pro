@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui
+QT       += core gui concurrent network
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -12,10 +12,10 @@ TARGET = caihonghuaban
 TEMPLATE = app
 
 
-SOURCES += main.cpp\
-        mainwindow.cpp
+# 绘图核心（主程序与基准测试共用）
+include(core.pri)
 
-HEADERS  += mainwindow.h
+SOURCES += main.cpp
 
 FORMS    += mainwindow.ui
 RESOURCES +=
@@ -0,0 +1,569 @@
+#include "chbdocument.h"
+#include "strokeitem.h"
+#include "shapeitem.h"
+#include "tilelayer.h"
+#include "statictextitem.h"
+#include "primitivebatch.h"
+#include "brushstrokeitem.h"
+#include "layeritem.h"
+#include "binarycodec.h"
+#include <QGraphicsScene>
+#include <QGraphicsPathItem>
+#include <QSaveFile>
+#include <QBuffer>
+#include <QImage>
+#include <QFont>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QtEndian>
+#include <QtMath>
+#include <cstring>
+#include <functional>
+#include <climits>
+#include <algorithm>
+
+namespace {
+
+const char Magic[4] = { 'C', 'H', 'B', 'D' };
+const int HeaderSize = 8;
+const int RecordHeaderSize = 5;          // u8 类型 + u32 长度
+const int BatchMilliseconds = 8;         // 每个时间片的创建时长
+const int PriorityLimit = 50000;         // 可见区域优先创建的上限，超出部分随后分批创建
+const quint8 LayerVisible = 0x01;        // 图层标志
+const quint8 LayerLocked = 0x02;
+
+}
+
+// 按图形类型编码记录体，返回记录类型；无法表示的图形返回 EndRecord
+quint8 ChbDocument::encodeItem(QGraphicsItem *item, BinaryWriter &out, TilePatches *deferredTiles) {
+    if (StrokeItem *stroke = qgraphicsitem_cast<StrokeItem*>(item)) {
+        out.pen(stroke->pen());
+        out.u8(stroke->isCubic() ? 1 : 0);
+        // 笔迹内部的紧凑编码与文件格式相同，直接写出
+        out.varint(quint64(stroke->pointCount()));
+        out.raw(stroke->packedPoints());
+        return ChbDocument::StrokeRecord;
+    }
+    if (ShapeItem *shapeItem = qgraphicsitem_cast<ShapeItem*>(item)) {
+        out.pen(shapeItem->pen());
+        out.u8(quint8(shapeItem->kind()));
+        for (int i = 0; i < shapeItem->pointCount(); ++i) {
+            out.point(shapeItem->point(i));
+        }
+        return ChbDocument::ShapeRecord;
+    }
+    if (StaticTextItem *textItem = qgraphicsitem_cast<StaticTextItem*>(item)) {
+        out.u32(textItem->color().rgba());
+        out.string(textItem->font().toString());
+        out.string(textItem->text());
+        return ChbDocument::TextRecord;
+    }
+    if (BrushStrokeItem *brush = qgraphicsitem_cast<BrushStrokeItem*>(item)) {
+        out.u8(quint8(brush->kind()));
+        out.u32(brush->color().rgba());
+        out.f32(brush->diameter());
+        if (deferredTiles) {
+            *deferredTiles = brush->tileImages();
+        } else {
+            encodeTiles(brush->tileImages(), out);
+        }
+        return ChbDocument::BrushRecord;
+    }
+    if (QGraphicsPathItem *pathItem = qgraphicsitem_cast<QGraphicsPathItem*>(item)) {
+        const QPainterPath path = pathItem->path();
+        out.u32(pathItem->brush().color().rgba());
+        out.u8(quint8(path.fillRule()));
+        out.varint(quint64(path.elementCount()));
+        for (int i = 0; i < path.elementCount(); ++i) {
+            const QPainterPath::Element e = path.elementAt(i);
+            out.u8(quint8(e.type));
+            out.f32(e.x);
+            out.f32(e.y);
+        }
+        return ChbDocument::PathRecord;
+    }
+    return ChbDocument::EndRecord;
+}
+
+void ChbDocument::encodeTiles(const TilePatches &tiles, BinaryWriter &out) {
+    out.varint(quint64(tiles.size()));
+    for (TilePatches::const_iterator it = tiles.constBegin(); it != tiles.constEnd(); ++it) {
+        QByteArray png;
+        QBuffer buffer(&png);
+        buffer.open(QIODevice::WriteOnly);
+        it.value().save(&buffer, "PNG");
+        out.u64(it.key());
+        out.bytes(png);
+    }
+}
+
+TilePatches ChbDocument::decodeTiles(BinaryReader &in) {
+    TilePatches tiles;
+    const quint64 count = in.varint();
+    for (quint64 i = 0; i < count && in.isOk(); ++i) {
+        const TileKey key = in.u64();
+        const QByteArray png = in.bytes();
+        QImage tile;
+        if (!in.isOk() || !tile.loadFromData(png, "PNG")) return TilePatches();
+        tiles.insert(key, tile.convertToFormat(QImage::Format_ARGB32_Premultiplied));
+    }
+    return in.isOk() ? tiles : TilePatches();
+}
+
+QGraphicsItem *ChbDocument::decodeItem(quint8 tag, BinaryReader &in) {
+    switch (tag) {
+    case ChbDocument::StrokeRecord: {
+        const QPen pen = in.pen();
+        const bool cubic = in.u8() & 1;
+        const quint64 count = in.varint();
+        if (!in.isOk() || count == 0 || count > INT_MAX) return nullptr;
+        // 文件中的坐标差分就是笔迹的紧凑编码：只校验长度，原样交给笔迹保存
+        const uchar *packed = in.position();
+        for (quint64 i = 0; i < count * 2 && in.isOk(); ++i) {
+            in.varint();
+        }
+        if (!in.isOk()) return nullptr;
+        return new StrokeItem(QByteArray(reinterpret_cast<const char*>(packed), int(in.position() - packed)),
+                              int(count), cubic, pen);
+    }
+    case ChbDocument::ShapeRecord: {
+        const QPen pen = in.pen();
+        const quint8 kind = in.u8();
+        if (kind > ShapeItem::Triangle) return nullptr;
+        ShapeItem *shapeItem = new ShapeItem(ShapeItem::Kind(kind), QPointF(), pen);
+        for (int i = 0; i < shapeItem->pointCount(); ++i) {
+            shapeItem->setPoint(i, in.point());
+        }
+        return shapeItem;
+    }
+    case ChbDocument::TextRecord: {
+        const QColor color = QColor::fromRgba(in.u32());
+        QFont font;
+        font.fromString(in.string());
+        const QString text = in.string();
+        if (!in.isOk()) return nullptr;
+        return new StaticTextItem(text, font, color);
+    }
+    case ChbDocument::BrushRecord: {
+        const quint8 kind = in.u8();
+        const QColor color = QColor::fromRgba(in.u32());
+        const qreal diameter = in.f32();
+        const TilePatches images = decodeTiles(in);
+        if (images.isEmpty()) return nullptr;
+        BrushStrokeItem *brush = new BrushStrokeItem(kind, color, diameter);
+        brush->setTileImages(images);
+        return brush;
+    }
+    case ChbDocument::PathRecord: {
+        const QColor color = QColor::fromRgba(in.u32());
+        const Qt::FillRule fillRule = Qt::FillRule(in.u8());
+        const quint64 count = in.varint();
+        QPainterPath path;
+        path.setFillRule(fillRule);
+        for (quint64 i = 0; i < count && in.isOk(); ++i) {
+            const quint8 type = in.u8();
+            const qreal x = in.f32();
+            const qreal y = in.f32();
+            if (type == QPainterPath::MoveToElement) {
+                path.moveTo(x, y);
+            } else if (type == QPainterPath::LineToElement) {
+                path.lineTo(x, y);
+            } else if (type == QPainterPath::CurveToElement && i + 2 < count) {
+                in.u8();
+                const qreal x2 = in.f32(), y2 = in.f32();
+                in.u8();
+                const qreal x3 = in.f32(), y3 = in.f32();
+                path.cubicTo(x, y, x2, y2, x3, y3);
+                i += 2;
+            }
+        }
+        if (!in.isOk()) return nullptr;
+        QGraphicsPathItem *pathItem = new QGraphicsPathItem(path);
+        pathItem->setPen(Qt::NoPen);
+        pathItem->setBrush(color);
+        return pathItem;
+    }
+    default:
+        return nullptr;
+    }
+}
+
+namespace {
+
+typedef std::function<bool(quint8 tag, const QByteArray &body, const TilePatches &tiles)> RecordSink;
+
+bool writeRecord(QIODevice *device, quint8 tag, const QByteArray &body) {
+    char header[RecordHeaderSize];
+    header[0] = char(tag);
+    qToLittleEndian(quint32(body.size()), reinterpret_cast<uchar*>(header + 1));
+    return device->write(header, RecordHeaderSize) == RecordHeaderSize
+           && device->write(body) == body.size();
+}
+
+void writeHeader(QIODevice *device) {
+    QByteArray header(Magic, 4);
+    BinaryWriter headerOut(&header);
+    headerOut.u16(ChbDocument::Version);
+    headerOut.u16(0);
+    device->write(header);
+}
+
+// 补上推迟的 PNG 后写出：瓦片记录末尾是单个瓦片的 PNG，笔刷记录末尾是瓦片列表
+bool writeWithTiles(QIODevice *device, quint8 tag, const QByteArray &body, const TilePatches &tiles) {
+    if (tag != ChbDocument::TileRecord && tag != ChbDocument::BrushRecord) return writeRecord(device, tag, body);
+    QByteArray full = body;
+    BinaryWriter out(&full);
+    if (tag == ChbDocument::BrushRecord) {
+        ChbDocument::encodeTiles(tiles, out);
+    } else {
+        QByteArray png;
+        QBuffer buffer(&png);
+        buffer.open(QIODevice::WriteOnly);
+        tiles.constBegin().value().save(&buffer, "PNG");
+        out.bytes(png);
+    }
+    return writeRecord(device, tag, full);
+}
+
+// 取出一个图层：图层记录、栅格瓦片（在该图层所有图形之下），再按层叠次序取图形，逐条交给 sink。
+// 瓦片的 PNG 不在这里压缩，随记录交出；返回图形数，sink 失败返回 -1
+int collectLayer(LayerItem *layer, QByteArray &body, BinaryWriter &out, const RecordSink &sink,
+                 QVector<ChbDocument::SavedRecord> *saved) {
+    body.resize(0);
+    out.rect(QRectF());
+    out.point(QPointF());
+    out.string(layer->name());
+    out.u8((layer->isVisible() ? LayerVisible : 0) | (layer->isLocked() ? LayerLocked : 0));
+    out.f32(layer->opacity());
+    if (!sink(ChbDocument::LayerRecord, body, TilePatches())) return -1;
+
+    const TilePatches images = layer->bakedTiles()->tileImages();
+    for (TilePatches::const_iterator it = images.constBegin(); it != images.constEnd(); ++it) {
+        body.resize(0);
+        out.rect(TileLayer::tileRect(it.key()));
+        out.point(QPointF());
+        out.u64(it.key());
+        TilePatches tile;
+        tile.insert(it.key(), it.value());
+        if (!sink(ChbDocument::TileRecord, body, tile)) return -1;
+        if (saved) saved->append(ChbDocument::SavedRecord());
+    }
+
+    QList<QGraphicsItem*> items = layer->contentItems();
+    std::stable_sort(items.begin(), items.end(), [](QGraphicsItem *a, QGraphicsItem *b) {
+        return a->zValue() < b->zValue();
+    });
+    int count = 0;
+    TilePatches tiles;
+    foreach (QGraphicsItem *item, items) {
+        // 批量层逐个图元写成普通形状记录，文件格式不变
+        if (PrimitiveBatch *batch = qgraphicsitem_cast<PrimitiveBatch*>(item)) {
+            for (int i = 0; i < batch->count(); ++i) {
+                if (!batch->isAlive(i)) continue;
+                ShapeItem *shape = batch->toShapeItem(i);
+                body.resize(0);
+                out.rect(shape->sceneBoundingRect());
+                out.point(shape->pos());
+                const quint8 tag = ChbDocument::encodeItem(shape, out);
+                delete shape;
+                if (!sink(tag, body, TilePatches())) return -1;
+                if (saved) {
+                    ChbDocument::SavedRecord record;
+                    record.item = batch;
+                    record.primitive = i;
+                    saved->append(record);
+                }
+                ++count;
+            }
+            continue;
+        }
+        body.resize(0);
+        out.rect(item->sceneBoundingRect());
+        out.point(item->pos());
+        tiles.clear();
+        const quint8 tag = ChbDocument::encodeItem(item, out, &tiles);
+        if (tag == ChbDocument::EndRecord) continue;
+        if (!sink(tag, body, tiles)) return -1;
+        if (saved) {
+            ChbDocument::SavedRecord record;
+            record.item = item;
+            saved->append(record);
+        }
+        ++count;
+    }
+    return count;
+}
+
+}
+
+namespace ChbDocument {
+
+bool save(const QString &filePath, const QList<LayerItem*> &layers, QString *error, int *written) {
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+    if (!write(&file, layers, error, written)) return false;
+    if (!file.commit()) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool write(QIODevice *device, const QList<LayerItem*> &layers, QString *error, int *written,
+           QVector<SavedRecord> *saved) {
+    writeHeader(device);
+    QByteArray body;
+    body.reserve(4096);     // 预留容量后 resize(0) 不释放内存，缓冲在记录间复用
+    BinaryWriter out(&body);
+    const RecordSink sink = [device](quint8 tag, const QByteArray &recordBody, const TilePatches &tiles) {
+        return writeWithTiles(device, tag, recordBody, tiles);
+    };
+    int count = 0;
+
+    foreach (LayerItem *layer, layers) {
+        const int layerCount = collectLayer(layer, body, out, sink, saved);
+        if (layerCount < 0) {
+            if (error) *error = device->errorString();
+            return false;
+        }
+        count += layerCount;
+    }
+    if (!writeRecord(device, EndRecord, QByteArray())) {
+        if (error) *error = device->errorString();
+        return false;
+    }
+    if (written) *written = count;
+    return true;
+}
+
+QVector<DeferredRecord> collect(const QList<LayerItem*> &layers, QVector<SavedRecord> *saved) {
+    QVector<DeferredRecord> records;
+    QByteArray body;
+    BinaryWriter out(&body);
+    const RecordSink sink = [&records](quint8 tag, const QByteArray &recordBody, const TilePatches &tiles) {
+        DeferredRecord record;
+        record.tag = tag;
+        record.body = recordBody;
+        record.body.detach();   // body 是复用的缓冲，记录要有自己的一份
+        record.tiles = tiles;
+        records.append(record);
+        return true;
+    };
+    foreach (LayerItem *layer, layers) {
+        collectLayer(layer, body, out, sink, saved);
+    }
+    return records;
+}
+
+bool writeDeferred(QIODevice *device, const QVector<DeferredRecord> &records, QString *error) {
+    writeHeader(device);
+    foreach (const DeferredRecord &record, records) {
+        if (!writeWithTiles(device, record.tag, record.body, record.tiles)) {
+            if (error) *error = device->errorString();
+            return false;
+        }
+    }
+    if (!writeRecord(device, EndRecord, QByteArray())) {
+        if (error) *error = device->errorString();
+        return false;
+    }
+    return true;
+}
+
+}
+
+DocumentLoader::DocumentLoader(QGraphicsScene *scene, QObject *parent)
+    : QObject(parent),
+      scene(scene),
+      data(nullptr),
+      createdCount(0),
+      nextRecord(0),
+      zBase(0),
+      loading(false),
+      batchTimer(new QTimer(this)) {
+    batchTimer->setInterval(0);
+    connect(batchTimer, &QTimer::timeout, this, &DocumentLoader::loadBatch);
+}
+
+DocumentLoader::~DocumentLoader() {
+    close();
+}
+
+// 只扫描记录头和包围盒，不解码几何，百万条记录的索引也只需几十毫秒
+bool DocumentLoader::open(const QString &filePath, QString *error) {
+    close();
+    file.setFileName(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+    const qint64 size = file.size();
+    data = size >= HeaderSize ? file.map(0, size) : nullptr;
+    if (!data || std::memcmp(data, Magic, 4) != 0) {
+        if (error) *error = "不是彩虹画板文档";
+        close();
+        return false;
+    }
+    if (qFromLittleEndian<quint16>(data + 4) > ChbDocument::Version) {
+        if (error) *error = "文档版本过新，请升级程序";
+        close();
+        return false;
+    }
+
+    qint64 offset = HeaderSize;
+    while (offset + RecordHeaderSize <= size) {
+        RecordRef ref;
+        ref.tag = data[offset];
+        ref.length = qFromLittleEndian<quint32>(data + offset + 1);
+        ref.offset = offset + RecordHeaderSize;
+        if (ref.tag == ChbDocument::EndRecord) break;
+        if (ref.offset + ref.length > size) {
+            if (error) *error = "文档已损坏（记录越界）";
+            close();
+            return false;
+        }
+        BinaryReader in(data + ref.offset, ref.length);
+        ref.bounds = in.rect();
+        offset = ref.offset + ref.length;
+        if (ref.tag == ChbDocument::LayerRecord) {
+            in.point();
+            LayerInfo info;
+            info.name = in.string();
+            const quint8 flags = in.u8();
+            info.visible = flags & LayerVisible;
+            info.locked = flags & LayerLocked;
+            info.opacity = qBound<qreal>(0, in.f32(), 1);
+            if (!in.isOk()) {
+                if (error) *error = "文档已损坏（图层记录）";
+                close();
+                return false;
+            }
+            layerInfos.append(info);
+            continue;
+        }
+        // 版本 1 的文档没有图层记录，全部放进一个默认图层
+        if (layerInfos.isEmpty()) {
+            LayerInfo info = { "图层 1", true, false, 1 };
+            layerInfos.append(info);
+        }
+        ref.layer = layerInfos.size() - 1;
+        bounds = bounds.united(ref.bounds);
+        records.append(ref);
+    }
+    if (layerInfos.isEmpty()) {
+        LayerInfo info = { "图层 1", true, false, 1 };
+        layerInfos.append(info);
+    }
+    created.resize(records.size());
+    return true;
+}
+
+void DocumentLoader::start(qreal base, const QRectF &priorityArea) {
+    zBase = base;
+    nextRecord = 0;
+    loading = true;
+
+    layers.clear();
+    for (int i = 0; i < layerInfos.size(); ++i) {
+        const LayerInfo &info = layerInfos[i];
+        LayerItem *layer = new LayerItem(info.name);
+        layer->setZValue(i);
+        layer->setVisible(info.visible);
+        layer->setLocked(info.locked);
+        layer->setOpacity(info.opacity);
+        scene->addItem(layer);
+        layers.append(layer);
+    }
+
+    // 瓦片和可见区域内的图形先创建，保证打开后第一帧就完整
+    int priority = 0;
+    for (int i = 0; i < records.size() && priority < PriorityLimit; ++i) {
+        if (records[i].tag == ChbDocument::TileRecord || records[i].bounds.intersects(priorityArea)) {
+            create(i);
+            ++priority;
+        }
+    }
+    emit progress(createdCount, records.size());
+    if (createdCount == records.size()) {
+        complete();
+    } else {
+        batchTimer->start();
+    }
+}
+
+void DocumentLoader::loadBatch() {
+    QElapsedTimer clock;
+    clock.start();
+    while (nextRecord < records.size() && clock.elapsed() < BatchMilliseconds) {
+        // 每检查一次时间创建 64 条，避免计时本身成为开销
+        for (int n = 0; n < 64 && nextRecord < records.size(); ++nextRecord) {
+            if (created.testBit(nextRecord)) continue;
+            create(nextRecord);
+            ++n;
+        }
+    }
+    emit progress(createdCount, records.size());
+    if (nextRecord >= records.size()) complete();
+}
+
+void DocumentLoader::finish() {
+    if (!loading) return;
+    for (; nextRecord < records.size(); ++nextRecord) {
+        if (!created.testBit(nextRecord)) create(nextRecord);
+    }
+    complete();
+}
+
+void DocumentLoader::create(int index) {
+    const RecordRef &ref = records[index];
+    created.setBit(index);
+    ++createdCount;
+
+    BinaryReader in(data + ref.offset, ref.length);
+    in.rect();
+    const QPointF pos = in.point();
+    if (ref.tag == ChbDocument::TileRecord) {
+        const TileKey key = in.u64();
+        const QByteArray png = in.bytes();
+        QImage tile;
+        if (in.isOk() && tile.loadFromData(png, "PNG")) {
+            TilePatches patch;
+            patch.insert(key, tile.convertToFormat(QImage::Format_ARGB32_Premultiplied));
+            layers[ref.layer]->bakedTiles()->restorePatches(patch);
+        }
+        return;
+    }
+
+    QGraphicsItem *item = ChbDocument::decodeItem(ref.tag, in);
+    if (!item) return;
+    item->setPos(pos);
+    item->setZValue(zBase + index);
+    layers[ref.layer]->adopt(item);
+    emit recordCreated(index, item);
+}
+
+void DocumentLoader::complete() {
+    const int loaded = createdCount;
+    close();
+    emit finished(loaded);
+}
+
+void DocumentLoader::close() {
+    batchTimer->stop();
+    loading = false;
+    if (data) {
+        file.unmap(const_cast<uchar*>(data));
+        data = nullptr;
+    }
+    file.close();
+    records.clear();
+    layerInfos.clear();
+    layers.clear();
+    created.clear();
+    bounds = QRectF();
+    createdCount = 0;
+    nextRecord = 0;
+}
@@ -0,0 +1,138 @@
+#ifndef CHBDOCUMENT_H
+#define CHBDOCUMENT_H
+
+#include <QObject>
+#include <QFile>
+#include <QList>
+#include <QVector>
+#include <QRectF>
+#include <QString>
+#include <QByteArray>
+#include <QBitArray>
+#include "tilelayer.h"
+
+class QGraphicsItem;
+class QGraphicsScene;
+class QIODevice;
+class QTimer;
+class LayerItem;
+class BinaryWriter;
+class BinaryReader;
+
+// 彩虹画板文档（.chb）：小端二进制，文件头后是按层叠次序排列的记录
+//   文件头  "CHBD" | u16 版本 | u16 保留
+//   记录    u8 类型 | u32 记录体长度 | 记录体
+//   记录体  f32×4 场景包围盒 | f32×2 图形位置 | 类型相关数据
+// 笔迹坐标按 1/16 像素定点化，首点之后存 zigzag 变长整数差分；以长度为 0 的 EndRecord 结束
+// 版本 2 起按图层从下到上写出：每个图层一条 LayerRecord，随后是它的瓦片和图形；版本 1 的文档读成一个图层
+namespace ChbDocument {
+
+enum { Version = 2 };
+
+enum RecordTag {
+    EndRecord = 0,      // 文件结束
+    StrokeRecord = 1,   // 画笔笔迹
+    ShapeRecord = 2,    // 直线/矩形/椭圆/三角形
+    TextRecord = 3,     // 文本
+    PathRecord = 4,     // 擦除后保留的填充轮廓
+    TileRecord = 5,     // 历史栅格层的瓦片（PNG）
+    BrushRecord = 6,    // 栅格笔刷笔迹（笔刷参数 + 各瓦片 PNG）
+    LayerRecord = 7     // 图层（名称、可见/锁定标志、不透明度），之后的记录属于该图层
+};
+
+// 写出的一条图形或瓦片记录的来源（不含图层记录，与 DocumentLoader 的记录序号一一对应）：
+// 批量层中的图元 item 为批量层、primitive 为序号；其他图形 primitive 为 -1；瓦片记录 item 为空
+struct SavedRecord {
+    QGraphicsItem *item = nullptr;
+    int primitive = -1;
+};
+
+// 一条待写的记录：记录体在 GUI 线程编码好，只差瓦片的 PNG（瓦片记录末尾的单个瓦片、笔刷记录末尾的瓦片列表）。
+// 瓦片是隐式共享的副本，写出可以在任意线程进行
+struct DeferredRecord {
+    quint8 tag = EndRecord;
+    QByteArray body;
+    TilePatches tiles;
+};
+
+// 逐条编码写出，内存中只保留一条记录；layers 从下到上写入，图层内按层叠次序，无法表示的图形跳过
+bool save(const QString &filePath, const QList<LayerItem*> &layers, QString *error, int *written = nullptr);
+// 同上，写到已打开的设备；saved 非空时按顺序返回每条记录的来源
+bool write(QIODevice *device, const QList<LayerItem*> &layers, QString *error, int *written = nullptr,
+           QVector<SavedRecord> *saved = nullptr);
+// 分两步写出（自动保存快照用）：collect 在 GUI 线程取出全部记录，不做 PNG 压缩；
+// writeDeferred 在写入线程压缩瓦片并写出，结果与 write 相同
+QVector<DeferredRecord> collect(const QList<LayerItem*> &layers, QVector<SavedRecord> *saved = nullptr);
+bool writeDeferred(QIODevice *device, const QVector<DeferredRecord> &records, QString *error);
+
+// 单个图形的记录体编码（不含包围盒和位置），返回记录类型，无法表示时返回 EndRecord。
+// deferredTiles 非空时笔刷瓦片不在这里压缩，取出放进 deferredTiles，由调用方之后用 encodeTiles 补在记录体末尾
+quint8 encodeItem(QGraphicsItem *item, BinaryWriter &out, TilePatches *deferredTiles = nullptr);
+void encodeTiles(const TilePatches &tiles, BinaryWriter &out);   // 瓦片数 + 逐个瓦片（键和 PNG）
+QGraphicsItem *decodeItem(quint8 tag, BinaryReader &in);         // 解码记录体，失败返回空
+TilePatches decodeTiles(BinaryReader &in);                       // encodeTiles 的逆过程，失败返回空
+
+}
+
+// 文档加载：映射文件并建立记录索引，开始时先建好全部图层，
+// 再创建可见区域内的图形，其余在事件循环空闲时分批创建
+class DocumentLoader : public QObject {
+    Q_OBJECT
+public:
+    explicit DocumentLoader(QGraphicsScene *scene, QObject *parent = nullptr);
+    ~DocumentLoader();
+
+    bool open(const QString &filePath, QString *error);   // 映射文件并建立索引
+    void start(qreal zBase, const QRectF &priorityArea);  // 建好图层并开始创建图形（第 i 条记录的层叠次序为 zBase + i）
+    void finish();                               // 同步创建剩余的图形
+    void close();                                // 放弃未创建的图形并解除映射
+
+    bool isLoading() const { return loading; }
+    int recordCount() const { return records.size(); }   // 图形和瓦片记录数（不含图层记录）
+    int layerCount() const { return layerInfos.size(); }
+    int loadedCount() const { return createdCount; }
+    QRectF contentBounds() const { return bounds; }  // 全部记录的场景包围盒
+
+signals:
+    void recordCreated(int record, QGraphicsItem *item); // 第 record 条图形记录已创建（自动保存恢复时按序号找回图形）
+    void progress(int loaded, int total);        // 已创建的记录数
+    void finished(int loaded);                   // 全部记录已创建
+
+private slots:
+    void loadBatch();                            // 在时间片内创建一批图形
+
+private:
+    struct RecordRef {
+        qint64 offset;      // 记录体在文件中的偏移
+        quint32 length;     // 记录体长度
+        quint8 tag;         // 记录类型
+        int layer;          // 所属图层（layerInfos 的下标）
+        QRectF bounds;      // 场景包围盒
+    };
+
+    struct LayerInfo {
+        QString name;
+        bool visible;
+        bool locked;
+        qreal opacity;
+    };
+
+    void create(int index);                      // 解码并创建单条记录
+    void complete();                             // 加载结束
+
+    QGraphicsScene *scene;
+    QFile file;
+    const uchar *data;                           // 文件映射
+    QVector<RecordRef> records;                  // 记录索引
+    QVector<LayerInfo> layerInfos;               // 图层记录（从下到上）
+    QVector<LayerItem*> layers;                  // 已创建的图层（归场景所有）
+    QBitArray created;                           // 已创建的记录
+    QRectF bounds;                               // 全部记录的包围盒
+    int createdCount;
+    int nextRecord;                              // 分批创建的游标
+    qreal zBase;
+    bool loading;
+    QTimer *batchTimer;
+};
+
+#endif // CHBDOCUMENT_H
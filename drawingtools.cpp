@@ -0,0 +1,205 @@
+#include "drawingtools.h"
+#include "mainwindow.h"
+#include "strokeitem.h"
+#include "statictextitem.h"
+#include "brushstrokeitem.h"
+#include <QFont>
+
+// 画笔工具
+void PenTool::press(const QPointF &pos) {
+    stroke = new StrokeItem(pos, view->toolPen());
+    view->addLiveItem(stroke);
+}
+
+void PenTool::move(const QPointF &pos) {
+    if (!stroke) return;
+    // 增量追加，只重绘新线段
+    stroke->appendPoint(pos);
+}
+
+void PenTool::release(const QPointF &pos) {
+    Q_UNUSED(pos);
+    if (!stroke) return;
+    view->commitItem(stroke);
+    view->simplifyStroke(stroke);
+    stroke = nullptr;
+}
+
+void PenTool::cancel() {
+    if (!stroke) return;
+    view->discardItem(stroke);
+    stroke = nullptr;
+}
+
+// 拖拽形状工具
+void DragShapeTool::press(const QPointF &pos) {
+    preview = new ShapeItem(kind, pos, view->toolPen());
+    view->addLiveItem(preview);
+}
+
+void DragShapeTool::move(const QPointF &pos) {
+    if (!preview) return;
+    preview->setPoint(1, pos);
+}
+
+void DragShapeTool::release(const QPointF &pos) {
+    Q_UNUSED(pos);
+    if (!preview) return;
+    view->commitItem(preview);
+    preview = nullptr;
+}
+
+void DragShapeTool::cancel() {
+    if (!preview) return;
+    view->discardItem(preview);
+    preview = nullptr;
+}
+
+// 三角形工具
+void TriangleTool::press(const QPointF &pos) {
+    if (clickCount == 0) {
+        firstPoint = pos;
+        clickCount = 1;
+    } else if (clickCount == 1) {
+        preview = new ShapeItem(ShapeItem::Triangle, firstPoint, view->toolPen());
+        preview->setPoint(1, pos);
+        preview->setPreview(true);
+        view->addLiveItem(preview);
+        clickCount = 2;
+    } else {
+        // 第三次点击：预览对象直接转为成品
+        preview->setPoint(2, pos);
+        preview->setPen(view->toolPen());
+        preview->setPreview(false);
+        view->commitItem(preview);
+        preview = nullptr;
+        clickCount = 0;
+    }
+}
+
+void TriangleTool::move(const QPointF &pos) {
+    if (clickCount == 2) {
+        preview->setPoint(2, pos);
+    }
+}
+
+void TriangleTool::cancel() {
+    if (preview) {
+        view->discardItem(preview);
+        preview = nullptr;
+    }
+    clickCount = 0;
+}
+
+// 橡皮擦工具
+void EraserTool::press(const QPointF &pos) {
+    QPen trailPen(QColor(160, 160, 160, 110), view->toolPen().widthF(),
+                  Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
+    trail = new StrokeItem(pos, trailPen);
+    view->addLiveItem(trail);
+}
+
+void EraserTool::move(const QPointF &pos) {
+    if (!trail) return;
+    trail->appendPoint(pos);
+}
+
+void EraserTool::release(const QPointF &pos) {
+    Q_UNUSED(pos);
+    if (!trail) return;
+    view->eraseAlong(trail->points(), trail->pen().widthF() / 2, trail);
+    view->discardItem(trail);
+    trail = nullptr;
+}
+
+void EraserTool::cancel() {
+    if (!trail) return;
+    view->discardItem(trail);
+    trail = nullptr;
+}
+
+// 文本工具
+void TextTool::press(const QPointF &pos) {
+    if (view->toolText().isEmpty()) return;
+    QFont font;
+    font.setPointSize(view->toolFontSize());
+    StaticTextItem *textItem = new StaticTextItem(view->toolText(), font, view->toolColor());
+    textItem->setPos(pos);
+    view->addLiveItem(textItem);
+    view->commitItem(textItem);
+}
+
+// 填充工具
+void FillTool::press(const QPointF &pos) {
+    view->fillAt(pos);
+}
+
+// 笔刷工具
+void BrushTool::press(const QPointF &pos) {
+    stroke = new BrushStrokeItem(view->toolBrushKind(), view->toolColor(), view->toolBrushDiameter());
+    view->addLiveItem(stroke);
+    stroke->strokeTo(pos, view->pointerPressure());
+}
+
+void BrushTool::move(const QPointF &pos) {
+    if (!stroke) return;
+    stroke->strokeTo(pos, view->pointerPressure());
+}
+
+void BrushTool::release(const QPointF &pos) {
+    if (!stroke) return;
+    stroke->strokeTo(pos, view->pointerPressure());
+    view->commitItem(stroke);
+    stroke = nullptr;
+}
+
+void BrushTool::cancel() {
+    if (!stroke) return;
+    view->discardItem(stroke);
+    stroke = nullptr;
+}
+
+// 选择工具
+void SelectTool::press(const QPointF &pos) {
+    const Selection hit = view->pickAt(pos);
+    if (hit.isEmpty()) {
+        view->clearSelection();
+        banding = true;
+        origin = pos;
+        view->setRubberBand(QRectF(pos, pos));
+        return;
+    }
+    if (!view->selection().contains(hit)) view->setSelection(hit);
+    dragging = true;
+    last = pos;
+    view->beginMoveSelection();
+}
+
+void SelectTool::move(const QPointF &pos) {
+    if (dragging) {
+        view->moveSelection(pos - last);
+        last = pos;
+    } else if (banding) {
+        view->setRubberBand(QRectF(origin, pos).normalized());
+    }
+}
+
+void SelectTool::release(const QPointF &pos) {
+    move(pos);
+    if (dragging) {
+        dragging = false;
+        view->finishMoveSelection();
+    } else if (banding) {
+        banding = false;
+        const QRectF band = QRectF(origin, pos).normalized();
+        view->setRubberBand(QRectF());
+        view->setSelection(view->pickIn(band));
+    }
+}
+
+void SelectTool::cancel() {
+    dragging = false;
+    banding = false;
+    view->setRubberBand(QRectF());
+    view->clearSelection();
+}
@@ -0,0 +1,130 @@
+#ifndef DRAWINGTOOLS_H
+#define DRAWINGTOOLS_H
+
+#include <QPointF>
+#include "shapeitem.h"
+
+class DrawingView;
+class StrokeItem;
+class BrushStrokeItem;
+
+// 工具处理器基类：每个 DrawingTool 对应一个，DrawingView 按当前工具直接分发鼠标事件
+class ToolHandler {
+public:
+    explicit ToolHandler(DrawingView *view) : view(view) {}
+    virtual ~ToolHandler() {}
+
+    virtual void press(const QPointF &pos) = 0;                     // 左键按下
+    virtual void move(const QPointF &pos) { Q_UNUSED(pos); }        // 鼠标移动
+    virtual void release(const QPointF &pos) { Q_UNUSED(pos); }     // 左键释放
+    virtual void cancel() {}                                        // 放弃未完成的绘制
+    virtual bool wantsAllSamples() const { return false; }          // 是否需要每个移动采样（否则每帧只给最新一个）
+    virtual bool isBusy() const { return false; }                   // 是否有未完成的绘制（预览图形还在场景中）
+
+protected:
+    DrawingView *view;
+};
+
+// 画笔：按下创建笔迹，移动时增量追加
+class PenTool : public ToolHandler {
+public:
+    explicit PenTool(DrawingView *view) : ToolHandler(view), stroke(nullptr) {}
+    void press(const QPointF &pos) override;
+    void move(const QPointF &pos) override;
+    void release(const QPointF &pos) override;
+    void cancel() override;
+    bool wantsAllSamples() const override { return stroke != nullptr; }
+    bool isBusy() const override { return stroke != nullptr; }
+private:
+    StrokeItem *stroke;     // 正在绘制的笔迹
+};
+
+// 拖拽形状（直线/矩形/椭圆）：按下创建预览，拖动原地修改终点，释放时直接提交预览对象
+class DragShapeTool : public ToolHandler {
+public:
+    DragShapeTool(DrawingView *view, ShapeItem::Kind kind)
+        : ToolHandler(view), kind(kind), preview(nullptr) {}
+    void press(const QPointF &pos) override;
+    void move(const QPointF &pos) override;
+    void release(const QPointF &pos) override;
+    void cancel() override;
+    bool isBusy() const override { return preview != nullptr; }
+private:
+    ShapeItem::Kind kind;   // 形状类型
+    ShapeItem *preview;     // 预览对象
+};
+
+// 三角形：三次点击确定三个顶点，第二次点击后出现虚线预览
+class TriangleTool : public ToolHandler {
+public:
+    explicit TriangleTool(DrawingView *view)
+        : ToolHandler(view), clickCount(0), preview(nullptr) {}
+    void press(const QPointF &pos) override;
+    void move(const QPointF &pos) override;
+    void cancel() override;
+    bool isBusy() const override { return clickCount > 0; }
+private:
+    int clickCount;         // 已确定的顶点数
+    QPointF firstPoint;     // 第一个顶点
+    ShapeItem *preview;     // 预览对象
+};
+
+// 橡皮擦：拖动时显示擦除轨迹，释放时真正移除轨迹覆盖到的内容
+class EraserTool : public ToolHandler {
+public:
+    explicit EraserTool(DrawingView *view) : ToolHandler(view), trail(nullptr) {}
+    void press(const QPointF &pos) override;
+    void move(const QPointF &pos) override;
+    void release(const QPointF &pos) override;
+    void cancel() override;
+    bool wantsAllSamples() const override { return trail != nullptr; }
+    bool isBusy() const override { return trail != nullptr; }
+private:
+    StrokeItem *trail;      // 擦除轨迹（仅作预览，不提交）
+};
+
+// 文本：点击处放置文本
+class TextTool : public ToolHandler {
+public:
+    explicit TextTool(DrawingView *view) : ToolHandler(view) {}
+    void press(const QPointF &pos) override;
+};
+
+// 填充：点击处的连通区域填充当前颜色
+class FillTool : public ToolHandler {
+public:
+    explicit FillTool(DrawingView *view) : ToolHandler(view) {}
+    void press(const QPointF &pos) override;
+};
+
+// 笔刷：沿拖动路径盖印栅格笔印，每个移动采样都参与插值
+class BrushTool : public ToolHandler {
+public:
+    explicit BrushTool(DrawingView *view) : ToolHandler(view), stroke(nullptr) {}
+    void press(const QPointF &pos) override;
+    void move(const QPointF &pos) override;
+    void release(const QPointF &pos) override;
+    void cancel() override;
+    bool wantsAllSamples() const override { return stroke != nullptr; }
+    bool isBusy() const override { return stroke != nullptr; }
+private:
+    BrushStrokeItem *stroke; // 正在绘制的笔迹
+};
+
+// 选择：点中内容时选中并拖动（点中已选内容时拖动全部选中内容），点在空白处时框选
+class SelectTool : public ToolHandler {
+public:
+    explicit SelectTool(DrawingView *view) : ToolHandler(view), dragging(false), banding(false) {}
+    void press(const QPointF &pos) override;
+    void move(const QPointF &pos) override;
+    void release(const QPointF &pos) override;
+    void cancel() override;
+    bool isBusy() const override { return dragging || banding; }
+private:
+    bool dragging;          // 正在拖动选中内容
+    bool banding;           // 正在框选
+    QPointF origin;         // 框选起点
+    QPointF last;           // 拖动的上一个位置
+};
+
+#endif // DRAWINGTOOLS_H
@@ -0,0 +1,201 @@
+#include "eraser.h"
+#include "strokeitem.h"
+#include "shapeitem.h"
+#include "statictextitem.h"
+#include "brushstrokeitem.h"
+#include "layeritem.h"
+#include <QGraphicsScene>
+#include <QGraphicsPathItem>
+#include <QPainterPathStroker>
+#include <QBrush>
+#include <QtMath>
+
+namespace {
+
+qreal segmentDistance(const QPointF &p, const QPointF &a, const QPointF &b) {
+    const QPointF ab = b - a;
+    const qreal len2 = QPointF::dotProduct(ab, ab);
+    QPointF nearest = a;
+    if (len2 > 0) {
+        const qreal t = qBound<qreal>(0, QPointF::dotProduct(p - a, ab) / len2, 1);
+        nearest = a + ab * t;
+    }
+    const QPointF d = p - nearest;
+    return qSqrt(QPointF::dotProduct(d, d));
+}
+
+// 点到擦除轨迹的最短距离
+qreal distanceToTrail(const QPointF &p, const QVector<QPointF> &trail) {
+    if (trail.size() == 1) return segmentDistance(p, trail[0], trail[0]);
+    qreal best = segmentDistance(p, trail[0], trail[1]);
+    for (int i = 2; i < trail.size(); ++i) {
+        best = qMin(best, segmentDistance(p, trail[i - 1], trail[i]));
+    }
+    return best;
+}
+
+
+// 长线段细分，保证简化后的笔迹也能在擦除边界处精确切断
+QVector<QPointF> resample(const QVector<QPointF> &points, qreal step) {
+    QVector<QPointF> result;
+    result.reserve(points.size());
+    result.append(points.first());
+    for (int i = 1; i < points.size(); ++i) {
+        const QPointF a = points[i - 1];
+        const QPointF b = points[i];
+        const QPointF ab = b - a;
+        const int pieces = qCeil(qSqrt(QPointF::dotProduct(ab, ab)) / step);
+        for (int k = 1; k < pieces; ++k) {
+            result.append(a + ab * (qreal(k) / pieces));
+        }
+        result.append(b);
+    }
+    return result;
+}
+
+// 笔迹切割：去掉落在擦除范围内的采样点，剩余连续段各自成为新笔迹
+bool splitStroke(StrokeItem *stroke, const QVector<QPointF> &trail, const QRectF &areaBounds,
+                 qreal radius, QList<QVector<QPointF> > *pieces) {
+    QVector<QPointF> points = stroke->points();
+    if (stroke->isCubic()) {
+        const QList<QPolygonF> polygons = stroke->path().toSubpathPolygons();
+        if (polygons.isEmpty()) return false;
+        points = polygons.first();
+    }
+
+    const qreal reach = radius + stroke->pen().widthF() / 2;
+    points = resample(points, qMax<qreal>(0.5, reach / 2));
+    const QRectF reachBounds = areaBounds.adjusted(-reach, -reach, reach, reach);
+
+    bool changed = false;
+    QVector<QPointF> current;
+    for (int i = 0; i < points.size(); ++i) {
+        const QPointF &p = points[i];
+        const bool erased = reachBounds.contains(p) && distanceToTrail(p, trail) <= reach;
+        if (erased) {
+            changed = true;
+            if (current.size() >= 2) pieces->append(current);
+            current.clear();
+        } else {
+            current.append(p);
+        }
+    }
+    if (!changed) return false;
+    if (current.size() >= 2) pieces->append(current);
+    return true;
+}
+
+// 非笔迹图形的覆盖轮廓（场景坐标）及其颜色
+QPainterPath coverageOf(QGraphicsItem *item, QColor *color) {
+    QPainterPath coverage;
+    if (ShapeItem *shapeItem = qgraphicsitem_cast<ShapeItem*>(item)) {
+        coverage = shapeItem->shape();
+        *color = shapeItem->pen().color();
+    } else if (StaticTextItem *textItem = qgraphicsitem_cast<StaticTextItem*>(item)) {
+        coverage = textItem->outline();
+        *color = textItem->color();
+    } else if (QGraphicsPathItem *pathItem = qgraphicsitem_cast<QGraphicsPathItem*>(item)) {
+        coverage = pathItem->path();
+        *color = pathItem->brush().color();
+    }
+    return item->sceneTransform().map(coverage);
+}
+
+}
+
+namespace Eraser {
+
+QPainterPath trailArea(const QVector<QPointF> &trail, qreal radius) {
+    if (trail.size() == 1) {
+        QPainterPath dot;
+        dot.addEllipse(trail.first(), radius, radius);
+        return dot;
+    }
+    QPainterPath centerLine(trail.first());
+    for (int i = 1; i < trail.size(); ++i) centerLine.lineTo(trail[i]);
+    QPainterPathStroker stroker;
+    stroker.setWidth(radius * 2);
+    stroker.setCapStyle(Qt::RoundCap);
+    stroker.setJoinStyle(Qt::RoundJoin);
+    return stroker.createStroke(centerLine);
+}
+
+EraseResult eraseAlong(LayerItem *layer, const QVector<QPointF> &trail, qreal radius,
+                       QGraphicsItem *ignore) {
+    EraseResult result;
+    QGraphicsScene *scene = layer->scene();
+    if (trail.isEmpty() || !scene) return result;
+
+    const QPainterPath area = trailArea(trail, radius);
+    const QRectF areaBounds = area.boundingRect();
+    const QList<QGraphicsItem*> candidates = scene->items(areaBounds, Qt::IntersectsItemBoundingRect);
+
+    foreach (QGraphicsItem *item, candidates) {
+        // 只擦当前图层中已提交的图形（栅格由调用方处理）
+        if (item == ignore || item->parentItem() != layer || item == layer->bakedTiles()) continue;
+
+        // 批量层按图元处理：被覆盖的图元标记为移除，剩余部分和普通图形一样生成填充轮廓
+        if (PrimitiveBatch *batch = qgraphicsitem_cast<PrimitiveBatch*>(item)) {
+            foreach (int index, batch->primitivesIn(areaBounds)) {
+                ShapeItem *primitive = batch->toShapeItem(index);
+                const QPainterPath coverage = primitive->shape();
+                const QColor color = primitive->pen().color();
+                delete primitive;
+                if (!coverage.intersects(area)) continue;
+                const QPainterPath remaining = coverage.subtracted(area);
+                if (!remaining.isEmpty()) {
+                    QGraphicsPathItem *remnant = new QGraphicsPathItem(remaining);
+                    remnant->setPen(Qt::NoPen);
+                    remnant->setBrush(color);
+                    remnant->setZValue(batch->zValue());
+                    layer->adopt(remnant);
+                    result.added.append(remnant);
+                }
+                batch->setAlive(index, false);
+                PrimitiveRef ref;
+                ref.batch = batch;
+                ref.index = index;
+                result.removedPrimitives.append(ref);
+            }
+            continue;
+        }
+
+        QList<QGraphicsItem*> replacements;
+        if (StrokeItem *stroke = qgraphicsitem_cast<StrokeItem*>(item)) {
+            QList<QVector<QPointF> > pieces;
+            if (!splitStroke(stroke, trail, areaBounds, radius, &pieces)) continue;
+            foreach (const QVector<QPointF> &piece, pieces) {
+                replacements.append(new StrokeItem(piece, stroke->pen()));
+            }
+        } else if (BrushStrokeItem *brush = qgraphicsitem_cast<BrushStrokeItem*>(item)) {
+            // 栅格笔迹换成擦掉像素后的副本，撤回时换回原笔迹
+            BrushStrokeItem *rest = brush->erased(area);
+            if (!rest) continue;
+            replacements.append(rest);
+        } else {
+            QColor color;
+            const QPainterPath coverage = coverageOf(item, &color);
+            if (coverage.isEmpty() || !coverage.intersects(area)) continue;
+            const QPainterPath remaining = coverage.subtracted(area);
+            if (!remaining.isEmpty()) {
+                // 剩余部分以填充轮廓保留，再次擦除时继续做减法
+                QGraphicsPathItem *remnant = new QGraphicsPathItem(remaining);
+                remnant->setPen(Qt::NoPen);
+                remnant->setBrush(color);
+                replacements.append(remnant);
+            }
+        }
+
+        // 新图形继承原图形的层叠次序
+        foreach (QGraphicsItem *replacement, replacements) {
+            replacement->setZValue(item->zValue());
+            layer->adopt(replacement);
+            result.added.append(replacement);
+        }
+        scene->removeItem(item);
+        result.removed.append(item);
+    }
+    return result;
+}
+
+}
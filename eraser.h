@@ -0,0 +1,36 @@
+#ifndef ERASER_H
+#define ERASER_H
+
+#include <QList>
+#include <QVector>
+#include <QPointF>
+#include <QPainterPath>
+#include "tilelayer.h"
+#include "primitivebatch.h"
+
+class QGraphicsItem;
+class LayerItem;
+
+// 一次擦除的结果：被移出场景的图形，切割后剩余部分生成的新图形，被移除的批量图元，以及从栅格层清除的像素
+struct EraseResult {
+    QList<QGraphicsItem*> removed;
+    QList<QGraphicsItem*> added;
+    QVector<PrimitiveRef> removedPrimitives;
+    TilePatches tilePatches;
+    TileLayer *patchLayer = nullptr;     // tilePatches 所属的栅格
+    bool isEmpty() const { return removed.isEmpty() && removedPrimitives.isEmpty() && tilePatches.isEmpty(); }
+};
+
+namespace Eraser {
+
+// 擦除区域：轨迹按直径描边
+QPainterPath trailArea(const QVector<QPointF> &trail, qreal radius);
+
+// 沿轨迹擦除图层中的图形：半径内的覆盖被真正移除。笔迹按采样点切断，其余图形取轮廓做布尔减法。
+// 被移除的图形只移出场景不删除（交给撤回栈保管），新图形已加入同一图层。图层的栅格不在此处理
+EraseResult eraseAlong(LayerItem *layer, const QVector<QPointF> &trail, qreal radius,
+                       QGraphicsItem *ignore = nullptr);
+
+}
+
+#endif // ERASER_H
@@ -0,0 +1,323 @@
+#include "floodfill.h"
+#include <QElapsedTimer>
+#include <QHash>
+#include <QPair>
+#include <algorithm>
+#include <cstring>
+
+// x86-64 总是支持 SSE2；32 位 MinGW 由 core.pri 加上 -msse2，其他未打开 SSE2 的 32 位编译用标量比较
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FLOODFILL_SSE2
+#endif
+
+namespace {
+
+typedef QPair<int, int> Span;        // 一行中的 [x0, x1)
+typedef QVector<Span> Spans;
+
+// 颜色比较：B/G/R 三个字节与种子颜色的差都不超过容差，alpha 字节不参与（容差 255）
+class ColorMatch {
+public:
+    ColorMatch(quint32 seed, int tolerance)
+        : seed(seed),
+          tolerance(qBound(0, tolerance, 255)) {
+#ifdef FLOODFILL_SSE2
+        const quint32 t = quint32(this->tolerance);
+        seedv = _mm_set1_epi32(int(seed));
+        tolv = _mm_set1_epi32(int(0xff000000u | (t << 16) | (t << 8) | t));
+#endif
+    }
+
+    bool matches(quint32 pixel) const {
+        for (int shift = 0; shift < 24; shift += 8) {
+            const int diff = int((pixel >> shift) & 0xff) - int((seed >> shift) & 0xff);
+            if (diff > tolerance || diff < -tolerance) return false;
+        }
+        return true;
+    }
+
+    // 从 x 起第一个不匹配的位置（最多到 end）
+    int runEnd(const quint32 *row, int x, int end) const {
+#ifdef FLOODFILL_SSE2
+        while (x + 4 <= end) {
+            const int mask = matchMask(row + x);
+            if (mask != 0xffff) return x + firstPixel(~mask);
+            x += 4;
+        }
+#endif
+        while (x < end && matches(row[x])) ++x;
+        return x;
+    }
+
+    // 从 x 起第一个匹配的位置（最多到 end）
+    int skipEnd(const quint32 *row, int x, int end) const {
+#ifdef FLOODFILL_SSE2
+        while (x + 4 <= end) {
+            const int mask = matchMask(row + x);
+            if (mask != 0) {
+                // 四个字节都在容差内的像素才算匹配
+                for (int i = 0; i < 4; ++i) {
+                    if (((mask >> (i * 4)) & 0xf) == 0xf) return x + i;
+                }
+            }
+            x += 4;
+        }
+#endif
+        while (x < end && !matches(row[x])) ++x;
+        return x;
+    }
+
+private:
+#ifdef FLOODFILL_SSE2
+    // 一次比较 4 个像素：|p - seed| 逐字节饱和减去容差，为 0 的字节在容差内，返回每字节一位的掩码
+    int matchMask(const quint32 *pixels) const {
+        const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels));
+        const __m128i diff = _mm_or_si128(_mm_subs_epu8(p, seedv), _mm_subs_epu8(seedv, p));
+        const __m128i over = _mm_subs_epu8(diff, tolv);
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(over, _mm_setzero_si128()));
+    }
+
+    // 掩码中第一个有字节置位的像素
+    static int firstPixel(int mask) {
+        for (int i = 0; i < 4; ++i) {
+            if ((mask >> (i * 4)) & 0xf) return i;
+        }
+        return 4;
+    }
+
+    __m128i seedv;
+    __m128i tolv;
+#endif
+    quint32 seed;
+    int tolerance;
+};
+
+// 排序并合并重叠或相接的段
+void normalize(Spans *spans) {
+    if (spans->size() < 2) return;
+    std::sort(spans->begin(), spans->end());
+    int out = 0;
+    for (int i = 1; i < spans->size(); ++i) {
+        Span &last = (*spans)[out];
+        const Span &next = spans->at(i);
+        if (next.first <= last.second) {
+            last.second = qMax(last.second, next.second);
+        } else {
+            (*spans)[++out] = next;
+        }
+    }
+    spans->resize(out + 1);
+}
+
+// a 中不被 b 覆盖的部分，两者都已排序且互不重叠
+Spans subtract(const Spans &a, const Spans &b) {
+    Spans result;
+    int first = 0;
+    foreach (const Span &span, a) {
+        while (first < b.size() && b[first].second <= span.first) ++first;
+        int x = span.first;
+        for (int k = first; x < span.second; ++k) {
+            if (k >= b.size() || b[k].first >= span.second) {
+                result.append(Span(x, span.second));
+                break;
+            }
+            if (b[k].first > x) result.append(Span(x, b[k].first));
+            x = qMax(x, b[k].second);
+        }
+    }
+    return result;
+}
+
+// 轮廓上的一条有向边，区域在行进方向的右侧（y 向下）
+struct Edge {
+    QPoint from;
+    QPoint to;
+};
+
+quint64 vertexKey(const QPoint &p) {
+    return (quint64(quint32(p.x())) << 32) | quint32(p.y());
+}
+
+}
+
+namespace FloodFill {
+
+FillResult fill(const QImage &image, const QPoint &seed, int tolerance, int grow) {
+    FillResult result;
+    QElapsedTimer clock;
+    clock.start();
+    if (image.depth() != 32 || !image.rect().contains(seed)) return result;
+
+    const int width = image.width();
+    const int height = image.height();
+    const int stride = image.bytesPerLine() / 4;
+    const quint32 *bits = reinterpret_cast<const quint32*>(image.constBits());
+    const ColorMatch match(bits[seed.y() * stride + seed.x()], tolerance);
+
+    // 已填充标记；每次填充一整段极大匹配段，因此段内任一像素未标记说明整段都未填充
+    QVector<quint8> filled(width * height, 0);
+    QVector<Spans> rows(height);
+    QVector<QPoint> pending;
+    pending.reserve(1024);
+    pending.append(seed);
+    int top = seed.y(), bottom = seed.y();
+
+    while (!pending.isEmpty()) {
+        const QPoint p = pending.takeLast();
+        const quint32 *row = bits + p.y() * stride;
+        quint8 *marks = filled.data() + p.y() * width;
+        if (marks[p.x()]) continue;
+
+        int left = p.x();
+        while (left > 0 && match.matches(row[left - 1])) --left;
+        const int right = match.runEnd(row, p.x() + 1, width);
+        std::memset(marks + left, 1, size_t(right - left));
+        rows[p.y()].append(Span(left, right));
+        result.pixels += right - left;
+        top = qMin(top, p.y());
+        bottom = qMax(bottom, p.y());
+
+        // 上下两行在 [left, right) 内的每个未填充匹配段各压入一个种子
+        for (int ny = p.y() - 1; ny <= p.y() + 1; ny += 2) {
+            if (ny < 0 || ny >= height) continue;
+            const quint32 *nrow = bits + ny * stride;
+            const quint8 *nmarks = filled.constData() + ny * width;
+            int x = left;
+            while (x < right) {
+                x = match.skipEnd(nrow, x, right);
+                if (x >= right) break;
+                if (!nmarks[x]) pending.append(QPoint(x, ny));
+                x = match.runEnd(nrow, x, right);
+            }
+        }
+    }
+    filled = QVector<quint8>();
+
+    // 外扩：先横向加宽每段，再与上下 grow 行取并
+    grow = qMax(0, grow);
+    if (grow > 0) {
+        for (int y = top; y <= bottom; ++y) {
+            for (int i = 0; i < rows[y].size(); ++i) {
+                rows[y][i].first = qMax(0, rows[y][i].first - grow);
+                rows[y][i].second = qMin(width, rows[y][i].second + grow);
+            }
+            normalize(&rows[y]);
+        }
+        const int grownTop = qMax(0, top - grow);
+        const int grownBottom = qMin(height - 1, bottom + grow);
+        QVector<Spans> grown(height);
+        for (int y = grownTop; y <= grownBottom; ++y) {
+            for (int dy = -grow; dy <= grow; ++dy) {
+                const int source = y + dy;
+                if (source >= top && source <= bottom) grown[y] += rows[source];
+            }
+            normalize(&grown[y]);
+        }
+        rows.swap(grown);
+        top = grownTop;
+        bottom = grownBottom;
+    } else {
+        for (int y = top; y <= bottom; ++y) normalize(&rows[y]);
+    }
+
+    // 上下相邻行中位置相同的段合并成一个矩形
+    QHash<quint64, int> open;
+    QHash<quint64, int> next;
+    for (int y = top; y <= bottom; ++y) {
+        next.clear();
+        foreach (const Span &span, rows[y]) {
+            const quint64 key = (quint64(quint32(span.first)) << 32) | quint32(span.second);
+            const int index = open.value(key, -1);
+            if (index >= 0) {
+                result.rects[index].setBottom(y);
+                next.insert(key, index);
+            } else {
+                result.rects.append(QRect(span.first, y, span.second - span.first, 1));
+                next.insert(key, result.rects.size() - 1);
+            }
+        }
+        open.swap(next);
+    }
+    foreach (const QRect &rect, result.rects) result.bounds |= rect;
+    result.elapsedNs = clock.nsecsElapsed();
+    return result;
+}
+
+QPainterPath outline(const QVector<QRect> &rects) {
+    QPainterPath path;
+    path.setFillRule(Qt::WindingFill);
+    if (rects.isEmpty()) return path;
+    QRect bounds;
+    foreach (const QRect &rect, rects) bounds |= rect;
+
+    // 还原成逐行的扫描段，相接的段合并，区域内部不留边
+    QVector<Spans> rows(bounds.height());
+    foreach (const QRect &rect, rects) {
+        for (int y = rect.top(); y <= rect.bottom(); ++y) {
+            rows[y - bounds.top()].append(Span(rect.left(), rect.right() + 1));
+        }
+    }
+    for (int i = 0; i < rows.size(); ++i) normalize(&rows[i]);
+
+    // 边界上的边：每段左端向上、右端向下；相邻两行之间的水平线上，
+    // 下一行多出的部分是上边界（向右），上一行多出的部分是下边界（向左）
+    QVector<Edge> edges;
+    const Spans none;
+    for (int i = 0; i <= rows.size(); ++i) {
+        const int y = bounds.top() + i;
+        const Spans &above = i > 0 ? rows[i - 1] : none;
+        const Spans &current = i < rows.size() ? rows[i] : none;
+        foreach (const Span &span, subtract(current, above)) {
+            edges.append(Edge{QPoint(span.first, y), QPoint(span.second, y)});
+        }
+        foreach (const Span &span, subtract(above, current)) {
+            edges.append(Edge{QPoint(span.second, y), QPoint(span.first, y)});
+        }
+        foreach (const Span &span, current) {
+            edges.append(Edge{QPoint(span.first, y + 1), QPoint(span.first, y)});
+            edges.append(Edge{QPoint(span.second, y), QPoint(span.second, y + 1)});
+        }
+    }
+
+    // 按起点串起同一顶点出发的边（对角相接处有两条），再首尾相连成闭合子路径
+    QHash<quint64, int> starts;
+    QVector<int> sameStart(edges.size(), -1);
+    starts.reserve(edges.size());
+    for (int i = edges.size() - 1; i >= 0; --i) {
+        const quint64 key = vertexKey(edges[i].from);
+        sameStart[i] = starts.value(key, -1);
+        starts.insert(key, i);
+    }
+    QVector<bool> used(edges.size(), false);
+    QVector<QPoint> loop;
+    for (int start = 0; start < edges.size(); ++start) {
+        if (used[start]) continue;
+        loop.resize(0);
+        for (int e = start; e >= 0; ) {
+            used[e] = true;
+            loop.append(edges[e].from);
+            int candidate = starts.value(vertexKey(edges[e].to), -1);
+            while (candidate >= 0 && used[candidate]) candidate = sameStart[candidate];
+            e = candidate;
+        }
+        // 共线的中间顶点不进路径，只保留拐角
+        bool moved = false;
+        for (int i = 0; i < loop.size(); ++i) {
+            const QPoint &prev = loop[(i + loop.size() - 1) % loop.size()];
+            const QPoint &p = loop[i];
+            const QPoint &next = loop[(i + 1) % loop.size()];
+            if ((prev.x() == p.x() && p.x() == next.x()) || (prev.y() == p.y() && p.y() == next.y())) continue;
+            if (moved) {
+                path.lineTo(p);
+            } else {
+                path.moveTo(p);
+                moved = true;
+            }
+        }
+        if (moved) path.closeSubpath();
+    }
+    return path;
+}
+
+}
@@ -0,0 +1,33 @@
+#ifndef FLOODFILL_H
+#define FLOODFILL_H
+
+#include <QImage>
+#include <QPainterPath>
+#include <QPoint>
+#include <QRect>
+#include <QVector>
+
+// 填充结果：填充区域由互不重叠的矩形组成（逐行扫描段，上下相同的段已合并）
+struct FillResult {
+    QVector<QRect> rects;        // 像素坐标
+    QRect bounds;                // 包围盒
+    qint64 pixels = 0;           // 填充的像素数（不含外扩）
+    qint64 elapsedNs = 0;        // 扫描用时
+
+    bool isEmpty() const { return rects.isEmpty(); }
+};
+
+namespace FloodFill {
+
+// 扫描线填充：从种子像素出发，RGB 各通道与种子颜色相差都不超过 tolerance 的连通像素。
+// image 须为 Format_RGB32 或 Format_ARGB32(_Premultiplied)，比较忽略 alpha。
+// grow 为结果向外扩展的像素数，用来盖住抗锯齿边缘，避免填充与线条之间留下浅色缝隙
+FillResult fill(const QImage &image, const QPoint &seed, int tolerance, int grow = 1);
+
+// 填充区域的轮廓（像素坐标）：沿区域边界直接连成闭合路径，孔洞为反向的子路径。
+// 内部没有相邻矩形的公共边，抗锯齿填充时不露细缝，也不必对逐段 addRect 的路径做 simplified()
+QPainterPath outline(const QVector<QRect> &rects);
+
+}
+
+#endif // FLOODFILL_H
@@ -0,0 +1,215 @@
+#include "imageexporter.h"
+#include <QGraphicsScene>
+#include <QPicture>
+#include <QPainter>
+#include <QSaveFile>
+#include <QImageWriter>
+#include <QDataStream>
+#include <QFileInfo>
+#include <QList>
+#include <QFuture>
+#include <QtConcurrent>
+#include <QtMath>
+#include <cstring>
+
+namespace {
+
+const int BandBytes = 8 * 1024 * 1024;                 // 单个条带的目标大小
+const qint64 MaxWholeImageBytes = qint64(1) << 30;     // PNG/JPG 需要整幅图像，超过此大小改用 BMP
+const qint64 MaxBmpBytes = qint64(0xffffffffu);        // BMP 文件头的大小字段为 32 位
+
+QByteArray formatFor(const QString &filePath) {
+    const QString suffix = QFileInfo(filePath).suffix().toLower();
+    if (suffix == "jpg" || suffix == "jpeg") return "jpg";
+    if (suffix == "bmp") return "bmp";
+    return "png";
+}
+
+int bmpRowBytes(int width) {
+    return (width * 3 + 3) & ~3;
+}
+
+}
+
+ImageExporter::ImageExporter(QObject *parent)
+    : QObject(parent) {
+    connect(&watcher, &QFutureWatcherBase::finished, this, &ImageExporter::onRunFinished);
+}
+
+ImageExporter::~ImageExporter() {
+    cancel();
+    watcher.waitForFinished();
+    bandPool.waitForDone();
+}
+
+QSize ImageExporter::outputSize(const QRectF &source, qreal scale) {
+    return QSize(qMax(1, qCeil(source.width() * scale)), qMax(1, qCeil(source.height() * scale)));
+}
+
+bool ImageExporter::start(QGraphicsScene *scene, const QRectF &source, const ExportOptions &options) {
+    if (isRunning() || source.isEmpty() || options.scale <= 0) return false;
+
+    // 场景只能在 GUI 线程访问：先录制成绘图指令，之后的工作不再依赖场景，期间可以继续绘制
+    const QByteArray data = record(scene, source);
+
+    canceled.store(0);
+    watcher.setFuture(QtConcurrent::run(this, &ImageExporter::run, data, outputSize(source, options.scale), options));
+    return true;
+}
+
+QByteArray ImageExporter::record(QGraphicsScene *scene, const QRectF &source) {
+    QPicture picture;
+    {
+        QPainter painter(&picture);
+        painter.setRenderHint(QPainter::Antialiasing);
+        painter.setRenderHint(QPainter::TextAntialiasing);
+        painter.setRenderHint(QPainter::SmoothPixmapTransform);
+        scene->render(&painter, QRectF(QPointF(0, 0), source.size()), source, Qt::IgnoreAspectRatio);
+    }
+    return QByteArray(picture.data(), int(picture.size()));
+}
+
+void ImageExporter::cancel() {
+    canceled.store(1);
+}
+
+void ImageExporter::onRunFinished() {
+    const QString error = watcher.result();
+    if (canceled.load()) {
+        emit finished(false, QString());
+    } else {
+        emit finished(error.isEmpty(), error);
+    }
+}
+
+int ImageExporter::bandHeightFor(int width) {
+    return qBound(1, BandBytes / (qMax(1, width) * 4), 1024);
+}
+
+// 每个条带各自解析一份指令副本：QPicture 回放时会移动内部缓冲的读位置，不能跨线程共享
+QImage ImageExporter::renderBand(const QByteArray &picture, const QRect &band, qreal scale, const QColor &background) {
+    QPicture replay;
+    replay.setData(picture.constData(), uint(picture.size()));
+
+    QImage image(band.size(), QImage::Format_RGB32);
+    if (image.isNull()) return image;
+    image.fill(background);
+    {
+        QPainter painter(&image);
+        painter.translate(-band.topLeft());
+        painter.scale(scale, scale);
+        replay.play(&painter);
+    }
+    return image.convertToFormat(QImage::Format_RGB888);
+}
+
+// 自上而下存储的 24 位 BMP（高度取负），条带可以按顺序直接追加
+bool ImageExporter::writeBmpHeader(QIODevice *device, const QSize &size, int dotsPerMeter) {
+    const quint32 imageBytes = quint32(bmpRowBytes(size.width())) * quint32(size.height());
+    QDataStream out(device);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out << quint8('B') << quint8('M') << quint32(14 + 40 + imageBytes) << quint32(0) << quint32(14 + 40);
+    out << quint32(40) << qint32(size.width()) << qint32(-size.height())
+        << quint16(1) << quint16(24) << quint32(0) << imageBytes
+        << qint32(dotsPerMeter) << qint32(dotsPerMeter) << quint32(0) << quint32(0);
+    return out.status() == QDataStream::Ok;
+}
+
+// 后台导出：每批最多渲染线程数个条带，按顺序写出后再提交下一批，内存中的条带数有上限
+QString ImageExporter::run(const QByteArray &picture, const QSize &size, const ExportOptions &options) {
+    const QByteArray format = formatFor(options.filePath);
+    const bool streaming = format == "bmp";
+    const int dotsPerMeter = qRound(96 * options.scale / 0.0254);
+    const int bandHeight = bandHeightFor(size.width());
+    const int bandCount = (size.height() + bandHeight - 1) / bandHeight;
+    const int steps = bandCount + (streaming ? 0 : 1);
+
+    if (streaming && qint64(bmpRowBytes(size.width())) * size.height() + 54 > MaxBmpBytes) {
+        return "输出超出 BMP 格式的 4GB 上限，请减小缩放倍数";
+    }
+    if (!streaming && qint64(size.width()) * 3 * size.height() > MaxWholeImageBytes) {
+        return "输出过大，PNG/JPG 需要整幅图像驻留内存，请改存 BMP 或减小缩放倍数";
+    }
+
+    QSaveFile file(options.filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return QString("无法写入文件: %1").arg(file.errorString());
+    }
+
+    QImage whole;
+    if (streaming) {
+        if (!writeBmpHeader(&file, size, dotsPerMeter)) return "写入文件头失败";
+    } else {
+        whole = QImage(size, QImage::Format_RGB888);
+        if (whole.isNull()) return "内存不足，无法分配输出图像";
+        whole.setDotsPerMeterX(dotsPerMeter);
+        whole.setDotsPerMeterY(dotsPerMeter);
+    }
+
+    QByteArray row(bmpRowBytes(size.width()), '\0');    // BMP 行缓冲（含 4 字节对齐的填充）
+    const int batch = qMax(1, bandPool.maxThreadCount());
+    int done = 0;
+    for (int first = 0; first < bandCount; first += batch) {
+        if (canceled.load()) {
+            file.cancelWriting();
+            return QString();
+        }
+
+        QList<QFuture<QImage> > bands;
+        for (int i = first; i < qMin(bandCount, first + batch); ++i) {
+            const int top = i * bandHeight;
+            const QRect band(0, top, size.width(), qMin(bandHeight, size.height() - top));
+            bands.append(QtConcurrent::run(&bandPool, &ImageExporter::renderBand,
+                                           picture, band, options.scale, options.background));
+        }
+
+        for (int i = 0; i < bands.size(); ++i) {
+            const QImage image = bands[i].result();
+            if (image.isNull()) {
+                file.cancelWriting();
+                return "内存不足，条带渲染失败";
+            }
+            const int top = (first + i) * bandHeight;
+            if (streaming) {
+                // BMP 像素按 BGR 顺序存储
+                for (int y = 0; y < image.height(); ++y) {
+                    const uchar *src = image.constScanLine(y);
+                    uchar *dst = reinterpret_cast<uchar*>(row.data());
+                    for (int x = 0; x < size.width(); ++x, src += 3, dst += 3) {
+                        dst[0] = src[2];
+                        dst[1] = src[1];
+                        dst[2] = src[0];
+                    }
+                    if (file.write(row) != row.size()) {
+                        file.cancelWriting();
+                        return QString("写入文件失败: %1").arg(file.errorString());
+                    }
+                }
+            } else {
+                for (int y = 0; y < image.height(); ++y) {
+                    std::memcpy(whole.scanLine(top + y), image.constScanLine(y), size_t(size.width()) * 3);
+                }
+            }
+            emit progress(++done, steps);
+        }
+    }
+
+    if (!streaming) {
+        if (canceled.load()) {
+            file.cancelWriting();
+            return QString();
+        }
+        QImageWriter writer(&file, format);
+        writer.setQuality(options.quality);
+        if (!writer.write(whole)) {
+            file.cancelWriting();
+            return QString("图片编码失败: %1").arg(writer.errorString());
+        }
+        emit progress(++done, steps);
+    }
+
+    if (!file.commit()) {
+        return QString("保存文件失败: %1").arg(file.errorString());
+    }
+    return QString();
+}
@@ -0,0 +1,61 @@
+#ifndef IMAGEEXPORTER_H
+#define IMAGEEXPORTER_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QColor>
+#include <QFutureWatcher>
+#include <QImage>
+#include <QRect>
+#include <QRectF>
+#include <QSize>
+#include <QString>
+#include <QThreadPool>
+
+class QGraphicsScene;
+class QIODevice;
+
+// 导出参数
+struct ExportOptions {
+    QString filePath;                // 目标文件（扩展名决定格式）
+    qreal scale = 1.0;               // 缩放倍数，1 对应 96 DPI
+    QColor background = Qt::white;   // 背景色
+    int quality = -1;                // JPG 质量，-1 为默认
+};
+
+// 图片导出：场景在 GUI 线程录制成 QPicture 快照，之后按条带在线程池中并行回放、
+// 在后台拼接编码；BMP 逐条带写入文件，峰值内存与输出高度无关
+class ImageExporter : public QObject {
+    Q_OBJECT
+public:
+    explicit ImageExporter(QObject *parent = nullptr);
+    ~ImageExporter();
+
+    bool start(QGraphicsScene *scene, const QRectF &source, const ExportOptions &options); // 开始导出
+    bool isRunning() const { return watcher.isRunning(); }
+    static QSize outputSize(const QRectF &source, qreal scale);   // 输出像素尺寸
+    static QByteArray record(QGraphicsScene *scene, const QRectF &source); // 把场景的 source 区域录制成绘图指令（GUI 线程）
+    static QImage renderBand(const QByteArray &picture, const QRect &band, qreal scale, const QColor &background); // 回放指令渲染输出中的一个条带（任意线程）
+
+public slots:
+    void cancel();                               // 取消导出（已写出的部分文件会被丢弃）
+
+signals:
+    void progress(int done, int total);          // 已完成的步骤数
+    void finished(bool ok, const QString &message); // 导出结束（失败时附原因，取消时原因为空）
+
+private slots:
+    void onRunFinished();
+
+private:
+    QString run(const QByteArray &picture, const QSize &size, const ExportOptions &options);
+    static int bandHeightFor(int width);         // 单个条带的行数
+    static bool writeBmpHeader(QIODevice *device, const QSize &size, int dotsPerMeter);
+
+    QFutureWatcher<QString> watcher;             // 后台导出任务，结果为错误信息（空为成功）
+    QThreadPool bandPool;                        // 条带渲染线程池
+    QAtomicInt canceled;                         // 取消标志
+};
+
+#endif // IMAGEEXPORTER_H
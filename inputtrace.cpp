@@ -0,0 +1,309 @@
+#include "inputtrace.h"
+#include "mainwindow.h"
+#include "layeritem.h"
+#include <QTimer>
+#include <QColor>
+
+namespace {
+
+const char Magic[4] = { 'C', 'H', 'B', 'T' };
+const int HeaderSize = 8;
+const int FlushBytes = 64 * 1024;        // 缓冲写满后写入文件
+const qreal FixedScale = 16;             // 指针坐标的定点精度（1/16 像素）
+const int BatchMilliseconds = 8;         // 最快模式每个时间片的时长
+const quint64 MaxFillPixels = 8192;      // 回放的填充栅格边长上限，防止损坏的轨迹申请过大的图像
+
+}
+
+TraceRecorder::TraceRecorder()
+    : out(&buffer),
+      lastMicroseconds(0),
+      lastX(0),
+      lastY(0),
+      records(0) {
+}
+
+TraceRecorder::~TraceRecorder() {
+    stop();
+}
+
+bool TraceRecorder::start(const QString &filePath, QString *error) {
+    stop();
+    file.setFileName(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+    buffer.clear();
+    buffer.reserve(FlushBytes + 256);
+    buffer.append(Magic, 4);
+    out.u16(InputTrace::Version);
+    out.u16(0);
+    lastMicroseconds = 0;
+    lastX = lastY = 0;
+    records = 0;
+    clock.start();
+    return true;
+}
+
+void TraceRecorder::stop() {
+    if (!file.isOpen()) return;
+    file.write(buffer);
+    buffer.clear();
+    file.close();
+}
+
+void TraceRecorder::begin(quint8 type) {
+    const qint64 now = clock.nsecsElapsed() / 1000;
+    out.u8(type);
+    out.varint(quint64(now - lastMicroseconds));
+    lastMicroseconds = now;
+    ++records;
+}
+
+void TraceRecorder::flushIfFull() {
+    if (buffer.size() < FlushBytes) return;
+    file.write(buffer);
+    buffer.resize(0);       // 已预留容量，不释放内存
+}
+
+void TraceRecorder::pointer(quint8 type, const QPointF &scenePos) {
+    if (!file.isOpen()) return;
+    begin(type);
+    const qint64 x = qRound64(scenePos.x() * FixedScale);
+    const qint64 y = qRound64(scenePos.y() * FixedScale);
+    out.svarint(x - lastX);
+    out.svarint(y - lastY);
+    lastX = x;
+    lastY = y;
+    flushIfFull();
+}
+
+void TraceRecorder::value(quint8 type, quint32 value) {
+    if (!file.isOpen()) return;
+    begin(type);
+    out.varint(value);
+    flushIfFull();
+}
+
+void TraceRecorder::text(const QString &text, int fontSize) {
+    if (!file.isOpen()) return;
+    begin(InputTrace::Text);
+    out.string(text);
+    out.varint(quint64(qMax(0, fontSize)));
+    flushIfFull();
+}
+
+void TraceRecorder::zoom(qreal zoom) {
+    if (!file.isOpen()) return;
+    begin(InputTrace::Zoom);
+    out.f32(zoom);
+    flushIfFull();
+}
+
+void TraceRecorder::layerState(int index, bool visible, bool locked, int opacityPercent) {
+    if (!file.isOpen()) return;
+    begin(InputTrace::LayerState);
+    out.varint(quint64(qMax(0, index)));
+    out.u8((visible ? 1 : 0) | (locked ? 2 : 0));
+    out.varint(quint64(qBound(0, opacityPercent, 100)));
+    flushIfFull();
+}
+
+void TraceRecorder::fillSource(const QRectF &source, const QSize &size) {
+    if (!file.isOpen()) return;
+    begin(InputTrace::FillSource);
+    out.rect(source);
+    out.varint(quint64(qMax(0, size.width())));
+    out.varint(quint64(qMax(0, size.height())));
+    flushIfFull();
+}
+
+TraceReplayer::TraceReplayer(DrawingView *view, QObject *parent)
+    : QObject(parent),
+      view(view),
+      timer(new QTimer(this)),
+      speed(RealTime),
+      replaying(false),
+      nextType(0),
+      nextMicroseconds(0),
+      lastX(0),
+      lastY(0),
+      applied(0) {
+    timer->setSingleShot(true);
+    timer->setTimerType(Qt::PreciseTimer);
+    connect(timer, &QTimer::timeout, this, &TraceReplayer::step);
+}
+
+bool TraceReplayer::start(const QString &filePath, Speed mode, QString *error) {
+    stop();
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+    data = file.readAll();
+    if (data.size() < HeaderSize || !data.startsWith(QByteArray(Magic, 4))) {
+        if (error) *error = "不是输入轨迹文件";
+        return false;
+    }
+    in = BinaryReader(reinterpret_cast<const uchar*>(data.constData()) + 4, quint32(data.size() - 4));
+    if (in.u16() > InputTrace::Version) {
+        if (error) *error = "轨迹版本过新，请升级程序";
+        return false;
+    }
+    in.u16();
+
+    speed = mode;
+    replaying = true;
+    nextMicroseconds = 0;
+    lastX = lastY = 0;
+    applied = 0;
+    clock.start();
+    if (readHeader()) {
+        scheduleNext();
+    } else {
+        stop();
+    }
+    return true;
+}
+
+void TraceReplayer::stop() {
+    timer->stop();
+    if (!replaying) return;
+    replaying = false;
+    data.clear();
+    in = BinaryReader();
+    emit finished(applied, clock.elapsed());
+}
+
+bool TraceReplayer::readHeader() {
+    if (in.atEnd()) return false;
+    nextType = in.u8();
+    nextMicroseconds += qint64(in.varint());
+    return in.isOk();
+}
+
+void TraceReplayer::scheduleNext() {
+    if (speed == AsFastAsPossible) {
+        timer->start(0);
+        return;
+    }
+    const qint64 wait = nextMicroseconds / 1000 - clock.elapsed();
+    timer->start(int(qMax<qint64>(0, wait)));
+}
+
+void TraceReplayer::step() {
+    if (!replaying) return;
+    const qint64 deadline = clock.elapsed() + BatchMilliseconds;
+    do {
+        apply();
+        if (!replaying) return;
+        if (!readHeader()) {
+            view->flushPendingMoves();
+            stop();
+            return;
+        }
+        // 实时模式下只连续执行已经到时间的记录
+        if (speed == RealTime && nextMicroseconds / 1000 > clock.elapsed()) break;
+    } while (clock.elapsed() < deadline);
+    scheduleNext();
+}
+
+void TraceReplayer::apply() {
+    ++applied;
+    switch (nextType) {
+    case InputTrace::Press:
+    case InputTrace::Move:
+    case InputTrace::Release: {
+        lastX += in.svarint();
+        lastY += in.svarint();
+        const QPointF pos(lastX / FixedScale, lastY / FixedScale);
+        if (nextType == InputTrace::Press) {
+            view->pointerPress(pos);
+        } else if (nextType == InputTrace::Move) {
+            view->pointerMove(pos);
+        } else {
+            view->pointerRelease(pos);
+        }
+        break;
+    }
+    case InputTrace::Tool:
+        view->setCurrentTool(static_cast<DrawingTool>(in.varint()));
+        break;
+    case InputTrace::Color:
+        view->setPenColor(QColor::fromRgba(QRgb(in.varint())));
+        break;
+    case InputTrace::Width:
+        view->setPenWidth(int(in.varint()));
+        break;
+    case InputTrace::Text: {
+        const QString text = in.string();
+        view->setTextProperties(text, int(in.varint()));
+        break;
+    }
+    case InputTrace::Eraser:
+        view->setEraserMode(in.varint() != 0);
+        break;
+    case InputTrace::Zoom: {
+        const qreal zoom = in.f32();
+        if (zoom > 0) view->zoomBy(zoom / view->zoom());
+        break;
+    }
+    case InputTrace::Simplify:
+        view->setStrokeSimplification(int(in.varint()));
+        break;
+    case InputTrace::FillTolerance:
+        view->setFillTolerance(int(in.varint()));
+        break;
+    case InputTrace::BrushKind:
+        view->setBrushKind(int(in.varint()));
+        break;
+    case InputTrace::Pressure:
+        view->setPointerPressure(in.varint() / 1000.0);
+        break;
+    case InputTrace::Layer: {
+        const QList<LayerItem*> layers = LayerItem::layers(view->scene());
+        const int index = int(in.varint());
+        if (index < layers.size()) view->setCurrentLayer(layers.at(index));
+        emit commandReplayed(nextType);
+        break;
+    }
+    case InputTrace::LayerState: {
+        const int index = int(in.varint());
+        const quint8 flags = in.u8();
+        const int opacity = int(in.varint());
+        const QList<LayerItem*> layers = LayerItem::layers(view->scene());
+        if (in.isOk() && index < layers.size()) {
+            LayerItem *layer = layers.at(index);
+            layer->setVisible(flags & 1);
+            layer->setLocked(flags & 2);
+            layer->setOpacity(opacity / 100.0);
+        }
+        emit commandReplayed(nextType);
+        break;
+    }
+    case InputTrace::FillSource: {
+        const QRectF source = in.rect();
+        const int width = int(qMin<quint64>(in.varint(), MaxFillPixels));
+        const int height = int(qMin<quint64>(in.varint(), MaxFillPixels));
+        if (in.isOk()) view->setNextFillSource(source, QSize(width, height));
+        break;
+    }
+    case InputTrace::Undo:
+    case InputTrace::Redo:
+    case InputTrace::Clear:
+    case InputTrace::AddLayer:
+    case InputTrace::DeleteLayer:
+    case InputTrace::RaiseLayer:
+    case InputTrace::LowerLayer:
+        in.varint();
+        emit commandReplayed(nextType);
+        break;
+    default:
+        // 未知记录无法跳过，回放到此为止
+        stop();
+        return;
+    }
+    if (!in.isOk()) stop();
+}
@@ -0,0 +1,130 @@
+#ifndef INPUTTRACE_H
+#define INPUTTRACE_H
+
+#include <QObject>
+#include <QFile>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QPointF>
+#include <QRectF>
+#include <QSize>
+#include <QString>
+#include "binarycodec.h"
+
+class DrawingView;
+class QTimer;
+
+// 输入轨迹（.chbtrace）：小端二进制，"CHBT" | u16 版本 | u16 保留，之后是连续的记录
+//   记录  u8 类型 | 距上一条的微秒数（变长整数）| 类型相关数据
+// 指针坐标为场景坐标，按 1/16 像素定点化后存与上一个指针坐标的 zigzag 差分
+namespace InputTrace {
+
+// 新增记录类型时递增：旧程序遇到未知记录只能停止回放，版本号让它在开始时就拒绝
+//   2  填充容差
+//   3  笔刷种类、笔压
+//   4  图层切换、新建、删除、调整次序和图层状态
+//   5  填充的栅格化范围
+enum { Version = 5 };
+
+enum RecordType {
+    Press = 1,          // 左键按下
+    Move = 2,           // 移动
+    Release = 3,        // 左键释放
+    Tool = 4,           // 切换工具（DrawingTool）
+    Color = 5,          // 画笔颜色（ARGB）
+    Width = 6,          // 画笔粗细
+    Text = 7,           // 文本内容与字号
+    Eraser = 8,         // 橡皮擦模式开关
+    Zoom = 9,           // 缩放倍数
+    Simplify = 10,      // 笔迹简化模式
+    Undo = 11,          // 撤回
+    Redo = 12,          // 重做
+    Clear = 13,         // 清空画布
+    FillTolerance = 14, // 填充容差
+    BrushKind = 15,     // 笔刷种类
+    Pressure = 16,      // 笔压（千分之一）
+    Layer = 17,         // 切换当前图层（从下往上的位置）
+    AddLayer = 18,      // 新建图层
+    DeleteLayer = 19,   // 删除当前图层
+    RaiseLayer = 20,    // 当前图层上移
+    LowerLayer = 21,    // 当前图层下移
+    LayerState = 22,    // 图层位置 | 标志（1 可见、2 锁定）| 不透明度（百分比）
+    FillSource = 23     // 填充的场景矩形 | 栅格宽高，紧接在触发填充的按下之前
+};
+
+}
+
+// 轨迹录制：记录先追加到内存缓冲，满 64KB 才写文件，录制时每个事件只有几字节的追加开销
+class TraceRecorder {
+public:
+    TraceRecorder();
+    ~TraceRecorder();
+
+    bool start(const QString &filePath, QString *error);   // 开始录制（覆盖已有文件）
+    void stop();                                 // 结束录制并写出剩余缓冲
+    bool isRecording() const { return file.isOpen(); }
+    quint64 recordCount() const { return records; }
+
+    void pointer(quint8 type, const QPointF &scenePos);    // 按下/移动/释放
+    void value(quint8 type, quint32 value);      // 工具、颜色、粗细等整数设置和无参命令
+    void text(const QString &text, int fontSize);
+    void zoom(qreal zoom);
+    void layerState(int index, bool visible, bool locked, int opacityPercent);
+    void fillSource(const QRectF &source, const QSize &size);
+
+private:
+    void begin(quint8 type);                     // 写入类型和时间差
+    void flushIfFull();
+
+    QFile file;
+    QByteArray buffer;
+    BinaryWriter out;
+    QElapsedTimer clock;
+    qint64 lastMicroseconds;
+    qint64 lastX;                                // 上一个指针坐标（定点）
+    qint64 lastY;
+    quint64 records;
+};
+
+// 轨迹回放：实时模式按录制时的时间间隔重放，最快模式在时间片内连续重放、每片之间让出事件循环
+class TraceReplayer : public QObject {
+    Q_OBJECT
+public:
+    enum Speed {
+        RealTime,           // 按原始节奏
+        AsFastAsPossible    // 忽略时间间隔
+    };
+
+    explicit TraceReplayer(DrawingView *view, QObject *parent = nullptr);
+
+    bool start(const QString &filePath, Speed speed, QString *error);   // 开始回放
+    void stop();
+    bool isReplaying() const { return replaying; }
+
+signals:
+    void commandReplayed(int type);              // 撤回/重做/清空和图层命令，由主窗口执行
+    void finished(quint64 records, qint64 elapsedMs); // 回放结束
+
+private slots:
+    void step();
+
+private:
+    bool readHeader();                           // 读取下一条记录的类型和时间，没有时返回 false
+    void apply();                                // 执行当前记录
+    void scheduleNext();
+
+    DrawingView *view;
+    QTimer *timer;
+    QByteArray data;
+    BinaryReader in;
+    Speed speed;
+    bool replaying;
+    quint8 nextType;                             // 当前待执行记录的类型
+    qint64 nextMicroseconds;                     // 当前待执行记录的录制时间
+    qint64 lastX;
+    qint64 lastY;
+    quint64 applied;
+    QElapsedTimer clock;
+};
+
+#endif // INPUTTRACE_H
@@ -0,0 +1,272 @@
+#include "layeritem.h"
+#include "tilelayer.h"
+#include <QGraphicsScene>
+#include <QHash>
+#include <QPainter>
+#include <QPaintDevice>
+#include <QStyleOptionGraphicsItem>
+#include <QtMath>
+#include <algorithm>
+
+namespace {
+
+const int LayerIdKey = 0x4c41;       // 图形的 data 键：所属图层的 id（移出场景后据此放回）
+
+int nextLayerId = 1;
+QHash<int, LayerItem*> &registry() {  // 存活的图层（按 id）
+    static QHash<int, LayerItem*> layers;
+    return layers;
+}
+
+bool isCached(const QGraphicsItem *item) {
+    return item->flags() & QGraphicsItem::ItemHasNoContents;
+}
+
+// 是否只差平移：缩放、旋转不变时缓存可以平移复用
+bool sameLinear(const QTransform &a, const QTransform &b) {
+    return a.m11() == b.m11() && a.m12() == b.m12() && a.m21() == b.m21() && a.m22() == b.m22()
+           && a.m13() == b.m13() && a.m23() == b.m23() && a.m33() == b.m33();
+}
+
+}
+
+LayerItem::LayerItem(const QString &name)
+    : QGraphicsItem(nullptr),
+      layerId(nextLayerId++),
+      layerName(name),
+      locked(false),
+      tiles(nullptr),
+      cacheRatio(1),
+      rebuilds(0) {
+    // 需要 exposedRect 只重画、贴图可见部分
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+    registry().insert(layerId, this);
+    tiles = new TileLayer();
+    tiles->setZValue(-1);
+    adopt(tiles);
+}
+
+LayerItem::~LayerItem() {
+    registry().remove(layerId);
+}
+
+bool LayerItem::isEmpty() const {
+    return childItems().size() <= 1 && tiles->isEmpty();
+}
+
+QList<QGraphicsItem*> LayerItem::contentItems() const {
+    QList<QGraphicsItem*> items = childItems();
+    items.removeOne(tiles);
+    return items;
+}
+
+LayerItem *LayerItem::emptyCopy() const {
+    LayerItem *copy = new LayerItem(layerName);
+    copy->setVisible(isVisible());
+    copy->setOpacity(opacity());
+    copy->setZValue(zValue());
+    copy->locked = locked;
+    return copy;
+}
+
+void LayerItem::adopt(QGraphicsItem *item) {
+    item->setData(LayerIdKey, layerId);
+    item->setFlag(QGraphicsItem::ItemHasNoContents);
+    if (item->parentItem() != this) {
+        item->setParentItem(this);          // itemChange 中使其区域失效
+    } else {
+        invalidate(item->sceneBoundingRect());
+    }
+}
+
+void LayerItem::lift(QGraphicsItem *item) {
+    if (item->parentItem() != this || !isCached(item)) return;
+    invalidate(item->sceneBoundingRect());
+    item->setFlag(QGraphicsItem::ItemHasNoContents, false);
+}
+
+void LayerItem::grow(const QRectF &rect) {
+    if (bounds.contains(rect)) return;
+    prepareGeometryChange();
+    bounds = bounds.isNull() ? rect : bounds.united(rect);
+}
+
+// 只记录失效区域，真正的重画推迟到该区域下次显示时
+void LayerItem::invalidate(const QRectF &sceneRect) {
+    if (sceneRect.isNull()) return;
+    grow(sceneRect);
+    if (!cache.isNull()) {
+        const QRect area(QPoint(), cache.size() / cacheRatio);
+        dirty |= cacheTransform.mapRect(sceneRect).toAlignedRect().adjusted(-1, -1, 1, 1) & area;
+    }
+    update(sceneRect);
+}
+
+LayerItem *LayerItem::layerOf(const QGraphicsItem *item) {
+    if (LayerItem *layer = qgraphicsitem_cast<LayerItem*>(item->parentItem())) return layer;
+    const QVariant id = item->data(LayerIdKey);
+    return id.isValid() ? registry().value(id.toInt()) : nullptr;
+}
+
+void LayerItem::restore(QGraphicsScene *scene, QGraphicsItem *item) {
+    if (item->type() == Type) {
+        scene->addItem(item);
+        return;
+    }
+    LayerItem *layer = layerOf(item);
+    if (!layer || layer->scene() != scene) {
+        const QList<LayerItem*> all = layers(scene);
+        layer = all.isEmpty() ? nullptr : all.last();
+    }
+    if (layer) {
+        layer->adopt(item);
+    } else {
+        scene->addItem(item);
+    }
+}
+
+void LayerItem::touch(QGraphicsItem *item, const QRectF &rect) {
+    LayerItem *layer = qgraphicsitem_cast<LayerItem*>(item->parentItem());
+    if (!layer || !isCached(item)) return;
+    layer->invalidate(item->mapRectToScene(rect.isNull() ? item->boundingRect() : rect));
+}
+
+QList<LayerItem*> LayerItem::layers(QGraphicsScene *scene) {
+    QList<LayerItem*> result;
+    foreach (LayerItem *layer, registry()) {
+        if (layer->scene() == scene) result.append(layer);
+    }
+    std::sort(result.begin(), result.end(), [](LayerItem *a, LayerItem *b) {
+        return a->zValue() < b->zValue();
+    });
+    return result;
+}
+
+LayerItem *LayerItem::addTop(QGraphicsScene *scene, int serial) {
+    const QList<LayerItem*> existing = layers(scene);
+    LayerItem *layer = new LayerItem(QString("图层 %1").arg(serial));
+    layer->setZValue(existing.isEmpty() ? 0 : existing.last()->zValue() + 1);
+    scene->addItem(layer);
+    return layer;
+}
+
+// 交换次序只改变两个图层的 zValue，图层缓存都不失效
+bool LayerItem::swapWithNeighbour(LayerItem *layer, int step) {
+    const QList<LayerItem*> existing = layers(layer->scene());
+    const int index = existing.indexOf(layer);
+    const int other = index + step;
+    if (index < 0 || other < 0 || other >= existing.size()) return false;
+    const qreal z = layer->zValue();
+    layer->setZValue(existing[other]->zValue());
+    existing[other]->setZValue(z);
+    return true;
+}
+
+QVariant LayerItem::itemChange(GraphicsItemChange change, const QVariant &value) {
+    if (change == ItemChildAddedChange || change == ItemChildRemovedChange) {
+        QGraphicsItem *child = value.value<QGraphicsItem*>();
+        if (child && isCached(child)) invalidate(child->sceneBoundingRect());
+    } else if (change == ItemVisibleHasChanged && !value.toBool()) {
+        // 隐藏的图层不占用缓存，重新显示时整体重画
+        cache = QImage();
+        spare = QImage();
+        dirty = QRegion();
+    }
+    return QGraphicsItem::itemChange(change, value);
+}
+
+// 视口大小、设备像素比或缩放变化时整体失效；滚动（整像素平移）时平移缓存，只有新露出的部分失效
+void LayerItem::syncCache(const QSize &size, qreal ratio, const QTransform &transform) {
+    const QRect area(QPoint(), size);
+    if (cache.isNull() || cache.size() != size * ratio || cacheRatio != ratio
+        || !sameLinear(transform, cacheTransform)) {
+        cache = QImage(size * ratio, QImage::Format_ARGB32_Premultiplied);
+        cache.setDevicePixelRatio(ratio);
+        spare = QImage();
+        cacheTransform = transform;
+        cacheRatio = ratio;
+        dirty = area;
+        return;
+    }
+    const qreal dx = transform.dx() - cacheTransform.dx();
+    const qreal dy = transform.dy() - cacheTransform.dy();
+    if (dx == 0 && dy == 0) return;
+    const QPoint shift(qRound(dx), qRound(dy));
+    cacheTransform = transform;
+    if (qAbs(dx - shift.x()) > 0.001 || qAbs(dy - shift.y()) > 0.001
+        || qAbs(shift.x()) >= size.width() || qAbs(shift.y()) >= size.height()) {
+        dirty = area;
+        return;
+    }
+
+    if (spare.size() != cache.size()) spare = QImage(cache.size(), QImage::Format_ARGB32_Premultiplied);
+    spare.fill(Qt::transparent);
+    cache.setDevicePixelRatio(1);
+    {
+        QPainter painter(&spare);
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        painter.drawImage(shift * ratio, cache);
+    }
+    qSwap(cache, spare);
+    cache.setDevicePixelRatio(ratio);
+    dirty = (dirty.translated(shift) & area) | (QRegion(area) - QRegion(area.translated(shift)));
+}
+
+void LayerItem::renderContent(QPainter *painter, const QRectF &sceneRect) {
+    if (!scene() || sceneRect.isEmpty()) return;
+    const QTransform base = painter->worldTransform();
+    foreach (QGraphicsItem *item, scene()->items(sceneRect, Qt::IntersectsItemBoundingRect, Qt::AscendingOrder)) {
+        if (item->parentItem() != this || !isCached(item) || !item->isVisible()) continue;
+        const QTransform itemTransform = item->itemTransform(this);
+        QStyleOptionGraphicsItem option;
+        option.exposedRect = itemTransform.inverted().mapRect(sceneRect) & item->boundingRect();
+        painter->save();
+        painter->setWorldTransform(itemTransform * base);
+        item->paint(painter, &option, nullptr);
+        painter->restore();
+    }
+}
+
+void LayerItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) {
+    // 导出、填充取样等离屏绘制（没有 widget）直接画内容，不动视口缓存
+    if (!widget) {
+        renderContent(painter, option->exposedRect);
+        return;
+    }
+
+    QPaintDevice *device = painter->device();
+    const QSize size(device->width(), device->height());
+    const QTransform transform = painter->worldTransform();
+    syncCache(size, device->devicePixelRatioF(), transform);
+
+    const QRect exposed = transform.mapRect(option->exposedRect).toAlignedRect() & QRect(QPoint(), size);
+    if (exposed.isEmpty()) return;
+    const QRegion stale = dirty & exposed;
+    if (!stale.isEmpty()) {
+        QPainter cachePainter(&cache);
+        cachePainter.setCompositionMode(QPainter::CompositionMode_Source);
+        // Qt 5.8 起区域可以直接遍历，rects() 已弃用；更早的版本只能用 rects()
+#if QT_VERSION >= QT_VERSION_CHECK(5, 8, 0)
+        for (QRegion::const_iterator it = stale.begin(); it != stale.end(); ++it) {
+            cachePainter.fillRect(*it, Qt::transparent);
+        }
+#else
+        foreach (const QRect &rect, stale.rects()) cachePainter.fillRect(rect, Qt::transparent);
+#endif
+        cachePainter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+        cachePainter.setClipRegion(stale);
+        cachePainter.setRenderHints(QPainter::Antialiasing | QPainter::TextAntialiasing
+                                    | QPainter::SmoothPixmapTransform);
+        cachePainter.setWorldTransform(cacheTransform);
+        renderContent(&cachePainter, cacheTransform.inverted().mapRect(QRectF(stale.boundingRect())));
+        dirty -= stale;
+        ++rebuilds;
+    }
+
+    painter->save();
+    painter->setWorldTransform(QTransform());
+    const qreal ratio = cacheRatio;
+    painter->drawImage(QRectF(exposed), cache,
+                       QRectF(exposed.x() * ratio, exposed.y() * ratio, exposed.width() * ratio, exposed.height() * ratio));
+    painter->restore();
+}
@@ -0,0 +1,74 @@
+#ifndef LAYERITEM_H
+#define LAYERITEM_H
+
+#include <QGraphicsItem>
+#include <QImage>
+#include <QList>
+#include <QRegion>
+#include <QString>
+#include <QTransform>
+
+class QGraphicsScene;
+class TileLayer;
+
+// 图层：场景中的顶层图形，图层内容是它的子图形，层叠次序就是图层的 zValue。
+// 提交后的子图形设置 ItemHasNoContents，不再由场景逐个绘制，而是先画进按视口大小缓存的合成图像，
+// 只有本图层的图形变化时才重画失效的部分，重绘时每个图层只贴一次缓存图像。
+// 正在绘制的图形也是子图形但不进缓存，由场景直接画在缓存之上。
+// 隐藏用 setVisible，不透明度用 setOpacity（作用于合成后的整层），锁定只阻止绘制和擦除
+class LayerItem : public QGraphicsItem {
+public:
+    enum { Type = UserType + 7 };
+
+    explicit LayerItem(const QString &name);
+    ~LayerItem();
+
+    int id() const { return layerId; }               // 进程内唯一，撤回时按它找回原图层
+    QString name() const { return layerName; }
+    void setName(const QString &name) { layerName = name; }
+    bool isLocked() const { return locked; }
+    void setLocked(bool on) { locked = on; }
+    TileLayer *bakedTiles() const { return tiles; }  // 本图层的历史栅格（在所有子图形之下）
+    bool isEmpty() const;                            // 没有子图形也没有栅格像素
+    QList<QGraphicsItem*> contentItems() const;      // 子图形（按层叠次序，不含历史栅格）
+    LayerItem *emptyCopy() const;                    // 名称、可见性、锁定、不透明度和次序相同的空图层（清空画布用）
+
+    void adopt(QGraphicsItem *item);                 // 放进本图层并改由缓存绘制
+    void lift(QGraphicsItem *item);                  // 暂时移出缓存、由场景直接绘制（拖动中），之后再 adopt
+    void invalidate(const QRectF &sceneRect);        // 该区域的缓存失效
+    int cacheRebuilds() const { return rebuilds; }   // 重画缓存的次数（性能统计用）
+
+    static LayerItem *layerOf(const QGraphicsItem *item);  // 图形所在的图层（含已移出场景、记得原图层的图形）
+    static void restore(QGraphicsScene *scene, QGraphicsItem *item); // 放回场景：回到原图层，原图层不在场景中时放进最上层
+    static void touch(QGraphicsItem *item, const QRectF &rect = QRectF()); // 已提交的图形自身变化（局部坐标，空为整个图形）
+    static QList<LayerItem*> layers(QGraphicsScene *scene); // 场景中的图层（从下到上）
+    // 图层命令（主窗口和轨迹回放共用）
+    static LayerItem *addTop(QGraphicsScene *scene, int serial); // 新建“图层 serial”放在最上面
+    static bool swapWithNeighbour(LayerItem *layer, int step);   // 与上（step 为 1）或下（-1）相邻的图层交换次序，没有时返回 false
+
+    int type() const override { return Type; }
+    QRectF boundingRect() const override { return bounds; }
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
+
+protected:
+    QVariant itemChange(GraphicsItemChange change, const QVariant &value) override;
+
+private:
+    void grow(const QRectF &rect);                   // 扩大包围盒
+    void syncCache(const QSize &size, qreal ratio, const QTransform &transform); // 视口尺寸或变换变化时重建或平移缓存
+    void renderContent(QPainter *painter, const QRectF &sceneRect); // 按层叠次序绘制与区域相交的已提交子图形
+
+    int layerId;
+    QString layerName;
+    bool locked;
+    TileLayer *tiles;
+    QRectF bounds;               // 全部内容的并集（只增不减）
+    QImage cache;                // 合成缓存（视口设备坐标）
+    QImage spare;                // 平移缓存用的备用图像，避免每次滚动都分配
+    QTransform cacheTransform;   // 缓存对应的场景到设备变换
+    qreal cacheRatio;            // 缓存的设备像素比
+    QRegion dirty;               // 缓存中失效的区域（设备坐标）
+    int rebuilds;
+};
+
+#endif // LAYERITEM_H
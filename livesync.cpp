@@ -0,0 +1,1066 @@
+#include "livesync.h"
+#include "mainwindow.h"
+#include "undojournal.h"
+#include "layeritem.h"
+#include "strokeitem.h"
+#include "shapeitem.h"
+#include "primitivebatch.h"
+#include "statictextitem.h"
+#include "chbdocument.h"
+#include "selector.h"
+#include "tilelayer.h"
+#include <QApplication>
+#include <QGraphicsScene>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QMessageAuthenticationCode>
+#include <QBuffer>
+#include <QTemporaryFile>
+#include <QTimer>
+#include <QtEndian>
+#include <QtMath>
+
+using namespace LiveSyncProtocol;
+
+namespace {
+
+const int FrameMilliseconds = 16;        // 一帧：期间的操作合并成一个 Ops 帧
+const int ConnectMilliseconds = 500;     // 连接已有主机的等待时间
+const int LanConnectMilliseconds = 3000; // 连接局域网主机的等待时间
+const int RetryMilliseconds = 100;       // 正在绘制时推迟快照的间隔
+const int LayerMilliseconds = 300;       // 图层属性连续变化（拖动不透明度）时合并成一份快照
+const int FrameHeaderSize = 5;           // u32 长度 + u8 类型
+const quint32 MaxFrameBytes = 64u << 20; // 超过视为对方出错，断开（也是快照的上限）
+const quint32 MaxHelloBytes = 64;        // 主机上还没发过 Hello 的连接，帧长超过即断开，不替陌生连接缓冲大块数据
+const qreal FixedScale = 16;             // 预览点的定点精度（1/16 像素）
+const qreal PreviewZ = 1e12;             // 预览画在所有图层之上
+
+QPoint toFixed(const QPointF &point) {
+    return QPoint(qRound(point.x() * FixedScale), qRound(point.y() * FixedScale));
+}
+
+QPointF fromFixed(const QPoint &point) {
+    return QPointF(point.x() / FixedScale, point.y() / FixedScale);
+}
+
+QString serverName(const QString &board) {
+    return QString("caihonghuaban-sync-%1").arg(board);
+}
+
+// 口令不直接上网，只发摘要
+QByteArray passphraseDigest(const QString &passphrase) {
+    return QMessageAuthenticationCode::hash("caihonghuaban-livesync", passphrase.toUtf8(), QCryptographicHash::Sha256);
+}
+
+void abortSocket(QIODevice *socket) {
+    if (QLocalSocket *local = qobject_cast<QLocalSocket*>(socket)) {
+        local->abort();
+    } else if (QAbstractSocket *tcp = qobject_cast<QAbstractSocket*>(socket)) {
+        tcp->abort();
+    }
+}
+
+// 清空画布：每个图层都换成了空图层，不带其他内容
+bool isClear(const JournalEntry &entry, int layerCount) {
+    if (entry.added.size() != layerCount || entry.removed.size() != layerCount) return false;
+    if (!entry.addedPrimitives.isEmpty() || !entry.removedPrimitives.isEmpty()
+        || !entry.edits.isEmpty() || !entry.tilePatches.isEmpty()) {
+        return false;
+    }
+    foreach (QGraphicsItem *item, entry.added) {
+        LayerItem *layer = qgraphicsitem_cast<LayerItem*>(item);
+        if (!layer || !layer->isEmpty()) return false;
+    }
+    foreach (QGraphicsItem *item, entry.removed) {
+        if (!qgraphicsitem_cast<LayerItem*>(item)) return false;
+    }
+    return true;
+}
+
+}
+
+LiveSync::LiveSync(DrawingView *view, UndoJournal *journal, QObject *parent)
+    : QObject(parent),
+      view(view),
+      journal(journal),
+      server(nullptr),
+      tcpServer(nullptr),
+      frameTimer(new QTimer(this)),
+      idleTimer(new QTimer(this)),
+      connectTimer(new QTimer(this)),
+      site(0),
+      nextSite(2),
+      nextLocal(1),
+      revision(0, 0),
+      highestRevision(0),
+      pendingOut(&pending),
+      pendingCount(0),
+      pendingSince(0),
+      nextSequence(0),
+      liveStroke(nullptr),
+      liveId(0),
+      liveSent(0),
+      snapshotBroadcast(false),
+      suspended(false) {
+    frameTimer->setSingleShot(true);
+    frameTimer->setInterval(FrameMilliseconds);
+    connect(frameTimer, &QTimer::timeout, this, &LiveSync::flush);
+    idleTimer->setSingleShot(true);
+    connect(idleTimer, &QTimer::timeout, this, &LiveSync::trySnapshot);
+    connectTimer->setSingleShot(true);
+    connect(connectTimer, &QTimer::timeout, this, &LiveSync::onConnectFailed);
+    clock.start();
+}
+
+LiveSync::~LiveSync() {
+    stop();
+}
+
+// “口令@主机:端口”走局域网，其余是本机画板名（只有当前用户能连上，不需要口令）
+bool LiveSync::start(const QString &board, QString *error) {
+    if (isActive()) return true;
+    const int colon = board.lastIndexOf(':');
+    if (colon < 0) {
+        secret = passphraseDigest(QString());
+        return startLocal(board, error);
+    }
+    // 局域网上任何机器都能连到端口，没有口令的画板不开放
+    const int at = board.lastIndexOf('@', colon);
+    if (at <= 0) {
+        if (error) *error = "局域网画板需要口令，格式为“口令@地址:端口”或“口令@:端口”";
+        return false;
+    }
+    secret = passphraseDigest(board.left(at));
+    bool ok = false;
+    const quint16 port = board.mid(colon + 1).toUShort(&ok);
+    if (!ok) {
+        if (error) *error = QString("端口无效: %1").arg(board.mid(colon + 1));
+        return false;
+    }
+    QString address = board.mid(at + 1, colon - at - 1).trimmed();
+    if (address.startsWith('[') && address.endsWith(']')) address = address.mid(1, address.size() - 2);  // [IPv6]:端口
+    return startLan(address, port, error);
+}
+
+// 先试着连接同名画板的主机。没有套接字时自己监听；套接字在但连接被拒绝，是上次异常退出留下的，清掉再监听；
+// 等待超时说明主机还在、只是正忙，这时删掉它的套接字会让画板分裂成两个，只报错让用户稍后再试
+bool LiveSync::startLocal(const QString &board, QString *error) {
+    QLocalSocket *socket = new QLocalSocket(this);
+    socket->connectToServer(serverName(board));
+    if (socket->waitForConnected(ConnectMilliseconds)) {
+        join(socket);
+    } else {
+        const QLocalSocket::LocalSocketError reason = socket->error();
+        delete socket;
+        if (reason != QLocalSocket::ServerNotFoundError && reason != QLocalSocket::ConnectionRefusedError) {
+            if (error) *error = "画板的主机没有响应，请稍后再试";
+            return false;
+        }
+        server = new QLocalServer(this);
+        server->setSocketOptions(QLocalServer::UserAccessOption);  // 只有当前用户的实例能连上
+        if (reason == QLocalSocket::ConnectionRefusedError) QLocalServer::removeServer(serverName(board));
+        if (!server->listen(serverName(board))) {
+            if (error) *error = server->errorString();
+            delete server;
+            server = nullptr;
+            return false;
+        }
+        connect(server, &QLocalServer::newConnection, this, &LiveSync::onNewConnection);
+        host();
+    }
+    begin();
+    return true;
+}
+
+// 局域网：没有主机地址时在该端口上监听（端口为 0 时由系统分配），否则连接那台主机。
+// 连接是异步的，不阻塞界面：Hello 先写进套接字的缓冲，连上后发出；出错或超时由 onConnectFailed 结束同步
+bool LiveSync::startLan(const QString &address, quint16 port, QString *error) {
+    if (address.isEmpty()) {
+        tcpServer = new QTcpServer(this);
+        if (!tcpServer->listen(QHostAddress::Any, port)) {
+            if (error) *error = tcpServer->errorString();
+            delete tcpServer;
+            tcpServer = nullptr;
+            return false;
+        }
+        connect(tcpServer, &QTcpServer::newConnection, this, &LiveSync::onNewConnection);
+        host();
+    } else {
+        QTcpSocket *socket = new QTcpSocket(this);
+        connect(socket, &QTcpSocket::connected, connectTimer, &QTimer::stop);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+        connect(socket, &QAbstractSocket::errorOccurred, this, &LiveSync::onConnectFailed);
+#else
+        connect(socket, static_cast<void (QAbstractSocket::*)(QAbstractSocket::SocketError)>(&QAbstractSocket::error),
+                this, &LiveSync::onConnectFailed);
+#endif
+        connectTimer->start(LanConnectMilliseconds);
+        socket->connectToHost(address, port);
+        join(socket);
+    }
+    begin();
+    return true;
+}
+
+quint16 LiveSync::lanPort() const {
+    return tcpServer ? tcpServer->serverPort() : 0;
+}
+
+// 连上之后的错误由 onDisconnected 处理
+void LiveSync::onConnectFailed() {
+    const bool timedOut = sender() == connectTimer;
+    if (!timedOut && !connectTimer->isActive()) return;
+    const QString reason = timedOut || peers.isEmpty() ? QString("连接超时") : peers.first()->socket->errorString();
+    stop();
+    emit peersChanged(0);
+    emit stopped(QString("无法连接局域网主机：%1").arg(reason));
+}
+
+void LiveSync::join(QIODevice *socket) {
+    attach(socket);
+    QByteArray hello;
+    BinaryWriter out(&hello);
+    out.u16(Version);
+    out.bytes(secret);
+    send(peers.first(), Hello, hello);
+    site = 0;       // 等主机分配
+}
+
+void LiveSync::host() {
+    site = 1;
+    nextSite = 2;
+    revision = Revision(++highestRevision, site);
+    encodeSnapshot();   // 给现有内容分配编号
+}
+
+void LiveSync::begin() {
+    nextLocal = 1;
+    connect(journal, &UndoJournal::applied, this, &LiveSync::onApplied);
+    connect(journal, &UndoJournal::baking, this, &LiveSync::onBaking);
+    connect(view, &DrawingView::liveItemAdded, this, &LiveSync::onLiveItemAdded);
+    connect(view, &DrawingView::liveItemEnded, this, &LiveSync::onLiveItemEnded);
+    connect(view, &DrawingView::strokeReshaped, this, &LiveSync::onStrokeReshaped);
+}
+
+void LiveSync::stop() {
+    disconnect(journal, nullptr, this, nullptr);
+    disconnect(view, nullptr, this, nullptr);
+    foreach (Peer *peer, peers) {
+        disconnect(peer->socket, nullptr, this, nullptr);
+        abortSocket(peer->socket);
+        peer->socket->deleteLater();
+        delete peer;
+    }
+    peers.clear();
+    snapshotTargets.clear();
+    delete server;
+    server = nullptr;
+    delete tcpServer;
+    tcpServer = nullptr;
+    dropPreviews(0);
+    frameTimer->stop();
+    connectTimer->stop();
+    idleTimer->stop();
+    pending.resize(0);
+    pendingCount = 0;
+    unacked.clear();
+    ids.clear();
+    targets.clear();
+    liveStroke = nullptr;
+    snapshotBroadcast = false;
+    site = 0;
+    revision = Revision(0, 0);
+}
+
+// 打开文档时先暂停：旧内容被删除前丢掉预览，加载期间收到的内容不应用
+void LiveSync::suspend() {
+    suspended = true;
+    dropPreviews(0);
+    pending.resize(0);
+    pendingCount = 0;
+    liveStroke = nullptr;
+    idleTimer->stop();
+}
+
+void LiveSync::resume() {
+    if (!suspended) return;
+    suspended = false;
+    if (isActive()) invalidate();
+}
+
+void LiveSync::markLayersChanged() {
+    if (!isActive() || suspended || !site) return;
+    pending.resize(0);
+    pendingCount = 0;
+    snapshotBroadcast = true;
+    idleTimer->start(LayerMilliseconds);
+}
+
+void LiveSync::invalidate() {
+    pending.resize(0);
+    pendingCount = 0;
+    snapshotBroadcast = true;
+    idleTimer->start(0);
+}
+
+// ---- 连接 ----
+
+// 本地套接字和 TCP 连接用同样的分帧，这里只区分断开信号；TCP 关掉 Nagle，每帧的小包立即发出
+void LiveSync::attach(QIODevice *socket) {
+    Peer *peer = new Peer;
+    peer->socket = socket;
+    socket->setParent(this);
+    connect(socket, &QIODevice::readyRead, this, &LiveSync::onReadyRead);
+    if (QLocalSocket *local = qobject_cast<QLocalSocket*>(socket)) {
+        connect(local, &QLocalSocket::disconnected, this, &LiveSync::onDisconnected);
+    } else if (QAbstractSocket *tcp = qobject_cast<QAbstractSocket*>(socket)) {
+        tcp->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        connect(tcp, &QAbstractSocket::disconnected, this, &LiveSync::onDisconnected);
+    }
+    peers.append(peer);
+    emit peersChanged(peers.size());
+}
+
+LiveSync::Peer *LiveSync::peerFor(QObject *socket) const {
+    foreach (Peer *peer, peers) {
+        if (peer->socket == socket) return peer;
+    }
+    return nullptr;
+}
+
+void LiveSync::onNewConnection() {
+    while (server && server->hasPendingConnections()) {
+        attach(server->nextPendingConnection());
+    }
+    while (tcpServer && tcpServer->hasPendingConnections()) {
+        attach(tcpServer->nextPendingConnection());
+    }
+}
+
+void LiveSync::onDisconnected() {
+    Peer *peer = peerFor(sender());
+    if (!peer) return;
+    peers.removeAll(peer);
+    snapshotTargets.removeAll(peer);
+    peer->socket->deleteLater();
+    if (isHost()) {
+        dropPreviews(peer->site);
+        delete peer;
+        emit peersChanged(peers.size());
+        return;
+    }
+    // 主机退出：同步结束，本地内容保留；还没分配站点号就断开是主机拒绝了这个连接
+    const bool rejected = !site;
+    delete peer;
+    stop();
+    emit peersChanged(0);
+    emit stopped(rejected ? "主机拒绝了连接（口令不符或版本不同）" : "与主机的连接已断开");
+}
+
+void LiveSync::send(Peer *peer, quint8 type, const QByteArray &payload) {
+    QByteArray frame;
+    frame.reserve(FrameHeaderSize + payload.size());
+    BinaryWriter out(&frame);
+    out.u32(quint32(payload.size() + 1));
+    out.u8(type);
+    out.raw(payload);
+    peer->socket->write(frame);
+    ++counters.framesSent;
+    counters.bytesSent += frame.size();
+}
+
+// own 为 false 时是主机转发的帧，不计入本实例的发送统计
+void LiveSync::broadcast(quint8 type, const QByteArray &payload, Peer *except, bool own) {
+    const LiveSyncStats before = counters;
+    foreach (Peer *peer, peers) {
+        if (peer != except && (peer->site || !isHost())) send(peer, type, payload);
+    }
+    if (!own) {
+        counters.framesSent = before.framesSent;
+        counters.bytesSent = before.bytesSent;
+    }
+}
+
+void LiveSync::onReadyRead() {
+    Peer *peer = peerFor(sender());
+    if (!peer) return;
+    peer->inbox.append(peer->socket->readAll());
+    int offset = 0;
+    while (peer->inbox.size() - offset >= FrameHeaderSize) {
+        const uchar *bytes = reinterpret_cast<const uchar*>(peer->inbox.constData()) + offset;
+        const quint32 length = qFromLittleEndian<quint32>(bytes);
+        if (length == 0 || length > (isHost() && !peer->site ? MaxHelloBytes : MaxFrameBytes)) {
+            abortSocket(peer->socket);
+            return;
+        }
+        if (quint32(peer->inbox.size() - offset - 4) < length) break;
+        const quint8 type = bytes[4];
+        const QByteArray payload = peer->inbox.mid(offset + FrameHeaderSize, int(length) - 1);
+        offset += 4 + int(length);
+        ++counters.framesReceived;
+        counters.bytesReceived += 4 + length;
+        handleFrame(peer, type, payload);
+        if (!peers.contains(peer)) return;       // 处理中断开（已释放）
+    }
+    peer->inbox.remove(0, offset);
+}
+
+void LiveSync::handleFrame(Peer *peer, quint8 type, const QByteArray &payload) {
+    BinaryReader in(reinterpret_cast<const uchar*>(payload.constData()), quint32(payload.size()));
+    switch (type) {
+    case Hello: {
+        if (!isHost() || peer->site) return;
+        const quint16 version = in.u16();
+        const QByteArray proof = in.bytes();
+        if (!in.isOk() || version != Version || proof != secret) {
+            abortSocket(peer->socket);
+            return;
+        }
+        peer->site = nextSite++;
+        QByteArray welcome;
+        BinaryWriter out(&welcome);
+        out.varint(peer->site);
+        send(peer, Welcome, welcome);
+        queueSnapshot(peer);
+        break;
+    }
+    case Welcome:
+        if (isHost() || site) return;
+        site = quint32(in.varint());
+        break;
+    case Snapshot: {
+        const quint64 serial = in.varint();
+        const Revision incoming(serial, quint32(in.varint()));
+        highestRevision = qMax(highestRevision, serial);
+        if (!in.isOk() || suspended || !(revision < incoming)) return;
+        if (!applySnapshot(in, incoming)) return;
+        if (isHost()) broadcast(Snapshot, payload, peer, false);
+        break;
+    }
+    case Ops: {
+        const quint64 serial = in.varint();
+        const Revision tagged(serial, quint32(in.varint()));
+        const quint64 origin = in.varint();
+        const quint64 sequence = in.varint();
+        const quint64 count = in.varint();
+        if (!in.isOk()) return;
+        if (!suspended && tagged == revision) {
+            const int applied = applyOps(in, count);
+            counters.opsApplied += applied;
+            if (isHost()) broadcast(Ops, payload, peer, false);
+            emit remoteApplied(applied);
+        }
+        QByteArray ack;
+        BinaryWriter out(&ack);
+        out.varint(origin);
+        out.varint(sequence);
+        send(peer, Ack, ack);
+        break;
+    }
+    case Clear: {
+        const quint64 serial = in.varint();
+        const Revision incoming(serial, quint32(in.varint()));
+        highestRevision = qMax(highestRevision, serial);
+        if (!in.isOk() || suspended || !(revision < incoming)) return;
+        applyClear(incoming);
+        if (isHost()) broadcast(Clear, payload, peer, false);
+        emit remoteApplied(1);
+        break;
+    }
+    case Ack: {
+        const quint64 origin = in.varint();
+        const quint64 sequence = in.varint();
+        if (!in.isOk() || origin != site || !unacked.contains(sequence)) return;
+        const qint64 elapsedUs = (clock.nsecsElapsed() - unacked.take(sequence)) / 1000;
+        ++counters.acks;
+        counters.ackLatencyTotalUs += elapsedUs;
+        counters.ackLatencyMaxUs = qMax(counters.ackLatencyMaxUs, elapsedUs);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// ---- 发出 ----
+
+void LiveSync::beginOp(quint8 kind) {
+    if (pendingCount == 0) pendingSince = clock.nsecsElapsed();
+    pendingOut.u8(kind);
+    ++pendingCount;
+    if (!frameTimer->isActive()) frameTimer->start();
+}
+
+// 本帧攒下的操作合并成一帧；没有连接时直接丢弃（编号照常维护）
+void LiveSync::flush() {
+    if (liveStroke) sendLivePoints();
+    if (pendingCount > 0 && site && !peers.isEmpty()) {
+        QByteArray payload;
+        payload.reserve(pending.size() + 16);
+        BinaryWriter out(&payload);
+        out.varint(revision.first);
+        out.varint(revision.second);
+        out.varint(site);
+        out.varint(++nextSequence);
+        out.varint(quint64(pendingCount));
+        out.raw(pending);
+        unacked.insert(nextSequence, pendingSince);
+        counters.opsSent += pendingCount;
+        broadcast(Ops, payload);
+    }
+    pending.resize(0);      // 保留容量，下一帧复用
+    pendingCount = 0;
+    if (liveStroke) frameTimer->start();
+}
+
+quint64 LiveSync::readId(BinaryReader &in) {
+    const quint64 owner = in.varint();
+    return (owner << 32) | (in.varint() & 0xffffffffu);
+}
+
+quint64 LiveSync::assign(const ContentKey &key) {
+    const quint64 id = (quint64(site) << 32) | nextLocal++;
+    ids.insert(key, id);
+    targets.insert(id, key);
+    return id;
+}
+
+void LiveSync::forget(const ContentKey &key) {
+    targets.remove(ids.take(key));
+}
+
+int LiveSync::layerIndexOf(QGraphicsItem *item) const {
+    LayerItem *layer = item ? qgraphicsitem_cast<LayerItem*>(item->parentItem()) : nullptr;
+    return layer ? LayerItem::layers(view->scene()).indexOf(layer) : -1;
+}
+
+// 图形记录体与文档相同；笔刷瓦片在这里压缩成 PNG
+bool LiveSync::addItemOp(QGraphicsItem *item, quint64 id, int layer) {
+    if (layer < 0) return false;
+    QByteArray body;
+    BinaryWriter bodyOut(&body);
+    const quint8 tag = ChbDocument::encodeItem(item, bodyOut);
+    if (tag == ChbDocument::EndRecord) return false;
+    const int before = pending.size();
+    beginOp(AddItem);
+    writeId(pendingOut, id);
+    pendingOut.varint(quint64(layer));
+    pendingOut.svarint(qRound64(item->zValue()));
+    pendingOut.point(item->pos());
+    pendingOut.u8(tag);
+    pendingOut.bytes(body);
+    if (tag == ChbDocument::StrokeRecord) counters.strokeBytes += pending.size() - before;
+    return true;
+}
+
+// 绘制中的笔迹：第一帧发起点和画笔，之后每帧发新增点的定点差分
+void LiveSync::sendLivePoints() {
+    const int count = liveStroke->pointCount();
+    if (count <= liveSent) return;
+    const QVector<QPointF> points = liveStroke->points();
+    const int before = pending.size();
+    if (liveSent == 0) {
+        liveLast = toFixed(points.first());
+        beginOp(LiveBegin);
+        writeId(pendingOut, liveId);
+        pendingOut.pen(liveStroke->pen());
+        pendingOut.svarint(liveLast.x());
+        pendingOut.svarint(liveLast.y());
+        liveSent = 1;
+    }
+    if (count > liveSent) {
+        beginOp(LivePoints);
+        writeId(pendingOut, liveId);
+        pendingOut.varint(quint64(count - liveSent));
+        for (int i = liveSent; i < count; ++i) {
+            const QPoint fixed = toFixed(points[i]);
+            pendingOut.svarint(fixed.x() - liveLast.x());
+            pendingOut.svarint(fixed.y() - liveLast.y());
+            liveLast = fixed;
+        }
+        liveSent = count;
+    }
+    counters.liveBytes += pending.size() - before;
+}
+
+void LiveSync::onLiveItemAdded(QGraphicsItem *item) {
+    StrokeItem *stroke = qgraphicsitem_cast<StrokeItem*>(item);
+    if (!stroke || !site || suspended || peers.isEmpty()) return;
+    liveStroke = stroke;
+    liveId = (quint64(site) << 32) | nextLocal++;
+    liveSent = 0;
+    frameTimer->start();
+}
+
+// 提交或放弃：补发剩下的点再结束预览，提交时紧接着的 AddItem 在同一帧中
+void LiveSync::onLiveItemEnded(QGraphicsItem *item) {
+    if (!liveStroke || item != liveStroke) return;
+    sendLivePoints();
+    if (liveSent > 0) {
+        const int before = pending.size();
+        beginOp(LiveEnd);
+        writeId(pendingOut, liveId);
+        counters.liveBytes += pending.size() - before;
+    }
+    liveStroke = nullptr;
+}
+
+// 后台简化完成后笔迹几何变了：用同一编号重发，对方替换
+void LiveSync::onStrokeReshaped(StrokeItem *stroke) {
+    if (!site || suspended || snapshotBroadcast) return;
+    const quint64 id = ids.value(ContentKey(stroke, -1));
+    if (id) addItemOp(stroke, id, layerIndexOf(stroke));
+}
+
+// 与自动保存相同的折算：出现的图形按生效后的状态完整编码，消失的和原地修改的按编号指代。
+// 图层增删（清空画布除外）和编号未知时改为升版次重做快照
+void LiveSync::onApplied(const JournalEntry &entry, bool forward) {
+    if (!site || suspended || snapshotBroadcast) return;
+    const QList<QGraphicsItem*> &gone = forward ? entry.removed : entry.added;
+    const QList<QGraphicsItem*> &come = forward ? entry.added : entry.removed;
+    const QVector<PrimitiveRef> &primitivesGone = forward ? entry.removedPrimitives : entry.addedPrimitives;
+    const QVector<PrimitiveRef> &primitivesCome = forward ? entry.addedPrimitives : entry.removedPrimitives;
+
+    bool layersChanged = false;
+    foreach (QGraphicsItem *item, gone + come) {
+        if (qgraphicsitem_cast<LayerItem*>(item)) layersChanged = true;
+    }
+    if (layersChanged) {
+        if (!forward || !isClear(entry, LayerItem::layers(view->scene()).size())) {
+            invalidate();
+            return;
+        }
+        // 清空画布不需要快照：之前攒下的操作按旧版次发出，之后的操作属于新版次
+        flush();
+        revision = Revision(++highestRevision, site);
+        QByteArray payload;
+        BinaryWriter out(&payload);
+        out.varint(revision.first);
+        out.varint(revision.second);
+        ++counters.opsSent;
+        broadcast(Clear, payload);
+        ids.clear();
+        targets.clear();
+        return;
+    }
+
+    foreach (QGraphicsItem *item, gone) {
+        const quint64 id = ids.value(ContentKey(item, -1));
+        if (!id) {
+            invalidate();
+            return;
+        }
+        beginOp(RemoveItem);
+        writeId(pendingOut, id);
+        forget(ContentKey(item, -1));
+    }
+    foreach (const PrimitiveRef &ref, primitivesGone) {
+        const quint64 id = ids.value(ContentKey(ref.batch, ref.index));
+        if (!id) {
+            invalidate();
+            return;
+        }
+        beginOp(RemoveItem);
+        writeId(pendingOut, id);
+        forget(ContentKey(ref.batch, ref.index));
+    }
+    foreach (QGraphicsItem *item, come) {
+        if (!addItemOp(item, assign(ContentKey(item, -1)), layerIndexOf(item))) {
+            invalidate();
+            return;
+        }
+        if (qgraphicsitem_cast<StrokeItem*>(item)) ++counters.strokesSent;
+    }
+    foreach (const PrimitiveRef &ref, primitivesCome) {
+        ShapeItem *shape = ref.batch->toShapeItem(ref.index);
+        shape->setZValue(ref.batch->zValue());
+        const bool ok = addItemOp(shape, assign(ContentKey(ref.batch, ref.index)), layerIndexOf(ref.batch));
+        delete shape;
+        if (!ok) {
+            invalidate();
+            return;
+        }
+    }
+    if (entry.patchLayer && !entry.tilePatches.isEmpty()) {
+        const int layer = layerIndexOf(entry.patchLayer);
+        if (layer < 0) {
+            invalidate();
+            return;
+        }
+        beginOp(forward ? ClearTiles : RestoreTiles);
+        pendingOut.varint(quint64(layer));
+        ChbDocument::encodeTiles(entry.tilePatches, pendingOut);
+    }
+    for (int n = 0; n < entry.edits.size(); ++n) {
+        const ItemEdit &edit = entry.edits[forward ? n : entry.edits.size() - 1 - n];
+        if (come.contains(edit.item) || gone.contains(edit.item)) continue; // 已按生效后的状态编码或已删除
+        const quint64 id = ids.value(ContentKey(edit.item, -1));
+        if (!id) {
+            invalidate();
+            return;
+        }
+        if (edit.restyled) {
+            beginOp(StyleItem);
+            writeId(pendingOut, id);
+            pendingOut.pen(forward ? edit.styleAfter : edit.styleBefore);
+        }
+        if (!edit.offset.isNull()) {
+            beginOp(MoveItem);
+            writeId(pendingOut, id);
+            pendingOut.point(forward ? edit.offset : -edit.offset);
+        }
+    }
+}
+
+// 淘汰的历史烘焙进栅格：对方用同样的图形按同样的次序烘焙，得到相同的瓦片
+void LiveSync::onBaking(LayerItem *layer, const QList<QGraphicsItem*> &items) {
+    if (!site || suspended || snapshotBroadcast) return;
+    const int index = LayerItem::layers(view->scene()).indexOf(layer);
+    if (index < 0) {
+        invalidate();
+        return;
+    }
+    QVector<quint64> baked;
+    foreach (QGraphicsItem *item, items) {
+        const quint64 id = ids.value(ContentKey(item, -1));
+        if (!id) {
+            invalidate();
+            return;
+        }
+        baked.append(id);
+    }
+    beginOp(BakeItems);
+    pendingOut.varint(quint64(index));
+    pendingOut.varint(quint64(baked.size()));
+    foreach (quint64 id, baked) writeId(pendingOut, id);
+    foreach (QGraphicsItem *item, items) forget(ContentKey(item, -1));
+}
+
+// ---- 快照 ----
+
+void LiveSync::queueSnapshot(Peer *target) {
+    if (target) {
+        snapshotTargets.append(target);
+    } else {
+        snapshotBroadcast = true;
+    }
+    idleTimer->start(0);
+}
+
+// 快照只在没有进行中的绘制时做：预览和拖动中的图形还没有提交，不能写进快照
+void LiveSync::trySnapshot() {
+    if (!isActive() || suspended || (!snapshotBroadcast && snapshotTargets.isEmpty())) return;
+    if (!view->isIdle() || QApplication::mouseButtons() != Qt::NoButton) {
+        idleTimer->start(RetryMilliseconds);
+        return;
+    }
+    if (snapshotBroadcast && !site) return;
+    flush();
+    if (snapshotBroadcast) revision = Revision(++highestRevision, site);
+    const QByteArray payload = encodeSnapshot();
+    if (payload.isEmpty()) return;
+    if (quint32(payload.size()) >= MaxFrameBytes) {
+        // 对方会把超长的帧当作出错断开，画布太大时无法同步
+        stop();
+        emit peersChanged(0);
+        emit stopped("画布内容超过实时同步的上限（64 MB）");
+        return;
+    }
+    if (snapshotBroadcast) {
+        broadcast(Snapshot, payload);
+        ++counters.snapshotsSent;
+    } else {
+        foreach (Peer *peer, snapshotTargets) {
+            send(peer, Snapshot, payload);
+            ++counters.snapshotsSent;
+        }
+    }
+    snapshotBroadcast = false;
+    snapshotTargets.clear();
+}
+
+// 快照在 GUI 线程编码（与保存文档相同）；已有编号的内容沿用编号，其余分配新编号，不在快照中的编号丢弃
+QByteArray LiveSync::encodeSnapshot() {
+    QByteArray document;
+    QBuffer buffer(&document);
+    buffer.open(QIODevice::WriteOnly);
+    QVector<ChbDocument::SavedRecord> saved;
+    if (!ChbDocument::write(&buffer, LayerItem::layers(view->scene()), nullptr, nullptr, &saved)) return QByteArray();
+
+    QByteArray payload;
+    BinaryWriter out(&payload);
+    out.varint(revision.first);
+    out.varint(revision.second);
+    out.bytes(document);
+    out.varint(quint64(saved.size()));
+    QHash<ContentKey, quint64> kept;
+    qint64 lastZ = 0;
+    foreach (const ChbDocument::SavedRecord &record, saved) {
+        quint64 id = 0;
+        qint64 z = lastZ;
+        if (record.item) {
+            const ContentKey key(record.item, record.primitive);
+            id = ids.value(key);
+            if (!id) id = (quint64(site) << 32) | nextLocal++;
+            kept.insert(key, id);
+            z = qRound64(record.item->zValue());
+        }
+        writeId(out, id);
+        out.svarint(z - lastZ);
+        lastZ = z;
+    }
+    ids = kept;
+    targets.clear();
+    for (QHash<ContentKey, quint64>::const_iterator it = ids.constBegin(); it != ids.constEnd(); ++it) {
+        targets.insert(it.value(), it.key());
+    }
+    return payload;
+}
+
+// 远端快照替换全部内容：与打开文档相同，先丢弃历史和旧图层，再同步载入，按快照恢复编号和层叠次序
+bool LiveSync::applySnapshot(BinaryReader &in, const Revision &incoming) {
+    const QByteArray document = in.bytes();
+    const quint64 count = in.varint();
+    if (!in.isOk()) return false;
+    QTemporaryFile file;
+    if (!file.open() || file.write(document) != document.size()) return false;
+    file.close();
+
+    QGraphicsScene *scene = view->scene();
+    DocumentLoader loader(scene);
+    if (!loader.open(file.fileName(), nullptr) || quint64(loader.recordCount()) != count) return false;
+    QVector<QGraphicsItem*> records(loader.recordCount(), nullptr);
+    connect(&loader, &DocumentLoader::recordCreated, [&records](int record, QGraphicsItem *item) {
+        records[record] = item;
+    });
+
+    view->cancelDrawing();
+    view->detachBatches();
+    journal->clear();
+    dropPreviews(0);
+    QList<QGraphicsItem*> oldItems;
+    foreach (QGraphicsItem *item, scene->items()) {
+        if (!item->parentItem()) oldItems.append(item);
+    }
+    qDeleteAll(oldItems);
+    ids.clear();
+    targets.clear();
+
+    view->tuneSceneIndex(int(count));
+    loader.start(view->reserveZ(int(count)), QRectF());
+    loader.finish();
+    if (!loader.contentBounds().isEmpty()) view->ensureCanvasCovers(loader.contentBounds());
+    qint64 z = 0;
+    for (int i = 0; i < records.size(); ++i) {
+        const quint64 id = readId(in);
+        z += in.svarint();
+        if (!in.isOk()) break;
+        QGraphicsItem *item = records[i];
+        if (!item || !id) continue;
+        item->setZValue(z);
+        raiseZ(z);
+        ids.insert(ContentKey(item, -1), id);
+        targets.insert(id, ContentKey(item, -1));
+    }
+    if (LayerItem::layers(scene).isEmpty()) scene->addItem(new LayerItem("图层 1"));
+
+    revision = incoming;
+    pending.resize(0);
+    pendingCount = 0;
+    liveStroke = nullptr;
+    snapshotBroadcast = false;          // 本地未发出的图层变化被远端内容取代
+    ++counters.snapshotsApplied;
+    emit canvasReplaced();
+    return true;
+}
+
+// ---- 应用远端操作 ----
+
+// 被删除或替换的内容可能正被选中、正在编辑，或被本地历史引用（撤回时还会操作它）
+void LiveSync::releaseTarget(const ContentKey &key) {
+    const Selection selection = view->selection();
+    PrimitiveRef ref;
+    ref.batch = qgraphicsitem_cast<PrimitiveBatch*>(key.first);
+    ref.index = key.second;
+    if (selection.items.contains(key.first) || (key.second >= 0 && selection.primitives.contains(ref))) {
+        view->clearSelection();
+    }
+    if (view->isEditingText() && qgraphicsitem_cast<StaticTextItem*>(key.first)) view->cancelDrawing();
+    if (journal->references(key.first, key.second)) journal->clear();
+}
+
+void LiveSync::discardTarget(quint64 id) {
+    if (!targets.contains(id)) return;
+    const ContentKey key = targets.take(id);
+    ids.remove(key);
+    releaseTarget(key);
+    if (key.second >= 0) {
+        if (PrimitiveBatch *batch = qgraphicsitem_cast<PrimitiveBatch*>(key.first)) batch->setAlive(key.second, false);
+    } else {
+        view->scene()->removeItem(key.first);
+        delete key.first;
+    }
+}
+
+void LiveSync::raiseZ(qreal z) {
+    const qreal base = view->reserveZ(0);
+    if (z + 1 > base) view->reserveZ(qCeil(z + 1 - base));
+}
+
+void LiveSync::dropPreviews(quint32 fromSite) {
+    QHash<quint64, StrokeItem*>::iterator it = previews.begin();
+    while (it != previews.end()) {
+        if (fromSite == 0 || quint32(it.key() >> 32) == fromSite) {
+            delete it.value();
+            previewLast.remove(it.key());
+            it = previews.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// 旧图层直接释放；进行中的绘制放弃，本地历史引用旧图层，一并丢弃
+void LiveSync::applyClear(const Revision &incoming) {
+    QGraphicsScene *scene = view->scene();
+    view->cancelDrawing();
+    view->detachBatches();
+    journal->clear();
+    dropPreviews(0);
+    foreach (LayerItem *layer, LayerItem::layers(scene)) {
+        LayerItem *empty = layer->emptyCopy();
+        scene->removeItem(layer);
+        scene->addItem(empty);
+        delete layer;
+    }
+    ids.clear();
+    targets.clear();
+    revision = incoming;
+    pending.resize(0);
+    pendingCount = 0;
+    liveStroke = nullptr;
+    ++counters.opsApplied;
+    emit canvasReplaced();
+}
+
+// 逐个应用，数据不完整时停在出错处；返回应用的操作数
+int LiveSync::applyOps(BinaryReader &in, quint64 count) {
+    QGraphicsScene *scene = view->scene();
+    const QList<LayerItem*> layers = LayerItem::layers(scene);
+    int applied = 0;
+    for (quint64 n = 0; n < count && in.isOk(); ++n) {
+        const quint8 kind = in.u8();
+        switch (kind) {
+        case AddItem: {
+            const quint64 id = readId(in);
+            const int layer = int(in.varint());
+            const qint64 z = in.svarint();
+            const QPointF pos = in.point();
+            const quint8 tag = in.u8();
+            const QByteArray body = in.bytes();
+            if (!in.isOk() || layer < 0 || layer >= layers.size()) return applied;
+            BinaryReader bodyIn(reinterpret_cast<const uchar*>(body.constData()), quint32(body.size()));
+            QGraphicsItem *item = ChbDocument::decodeItem(tag, bodyIn);
+            if (!item) break;
+            discardTarget(id);      // 同一编号再次出现：替换（简化后的笔迹）
+            item->setPos(pos);
+            item->setZValue(z);
+            layers[layer]->adopt(item);
+            raiseZ(z);
+            ids.insert(ContentKey(item, -1), id);
+            targets.insert(id, ContentKey(item, -1));
+            break;
+        }
+        case RemoveItem:
+            discardTarget(readId(in));
+            break;
+        case MoveItem: {
+            const ContentKey key = targets.value(readId(in));
+            const QPointF offset = in.point();
+            if (!key.first || key.second >= 0) break;
+            LayerItem::touch(key.first);
+            key.first->moveBy(offset.x(), offset.y());
+            LayerItem::touch(key.first);
+            break;
+        }
+        case StyleItem: {
+            const ContentKey key = targets.value(readId(in));
+            const QPen pen = in.pen();
+            if (key.first && key.second < 0 && in.isOk()) Selector::setStyle(key.first, pen);
+            break;
+        }
+        case ClearTiles:
+        case RestoreTiles: {
+            const int layer = int(in.varint());
+            const TilePatches tiles = ChbDocument::decodeTiles(in);
+            if (!in.isOk() || layer < 0 || layer >= layers.size()) return applied;
+            if (kind == ClearTiles) {
+                layers[layer]->bakedTiles()->removePatches(tiles);
+            } else {
+                layers[layer]->bakedTiles()->restorePatches(tiles);
+            }
+            break;
+        }
+        case BakeItems: {
+            const int layer = int(in.varint());
+            const quint64 idCount = in.varint();
+            QList<QGraphicsItem*> baked;
+            for (quint64 i = 0; i < idCount && in.isOk(); ++i) {
+                const quint64 id = readId(in);
+                const ContentKey key = targets.value(id);
+                if (!key.first || key.second >= 0) continue;
+                releaseTarget(key);
+                targets.remove(id);
+                ids.remove(key);
+                baked.append(key.first);
+            }
+            if (!in.isOk() || layer < 0 || layer >= layers.size()) return applied;
+            layers[layer]->bakedTiles()->bakeItems(baked);
+            foreach (QGraphicsItem *item, baked) {
+                scene->removeItem(item);
+                delete item;
+            }
+            break;
+        }
+        case LiveBegin: {
+            const quint64 id = readId(in);
+            const QPen pen = in.pen();
+            const qint64 x = in.svarint();
+            const QPoint start(int(x), int(in.svarint()));
+            if (!in.isOk()) return applied;
+            delete previews.take(id);
+            StrokeItem *preview = new StrokeItem(fromFixed(start), pen);
+            preview->setZValue(PreviewZ);
+            scene->addItem(preview);
+            previews.insert(id, preview);
+            previewLast.insert(id, start);
+            break;
+        }
+        case LivePoints: {
+            const quint64 id = readId(in);
+            const quint64 points = in.varint();
+            StrokeItem *preview = previews.value(id);
+            QPoint last = previewLast.value(id);
+            for (quint64 i = 0; i < points && in.isOk(); ++i) {
+                const qint64 dx = in.svarint();
+                last += QPoint(int(dx), int(in.svarint()));
+                if (preview) preview->appendPoint(fromFixed(last));
+            }
+            if (preview) previewLast.insert(id, last);
+            break;
+        }
+        case LiveEnd: {
+            const quint64 id = readId(in);
+            delete previews.take(id);
+            previewLast.remove(id);
+            break;
+        }
+        default:
+            return applied;
+        }
+        if (in.isOk()) ++applied;
+    }
+    return applied;
+}
@@ -0,0 +1,204 @@
+#ifndef LIVESYNC_H
+#define LIVESYNC_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QPair>
+#include <QList>
+#include <QPoint>
+#include <QString>
+#include <QElapsedTimer>
+#include "binarycodec.h"
+
+class QGraphicsItem;
+class QLocalServer;
+class QTcpServer;
+class QIODevice;
+class QTimer;
+class DrawingView;
+class UndoJournal;
+class LayerItem;
+class StrokeItem;
+struct JournalEntry;
+
+// 实时同步：本机上同名画板的第一个实例在本地套接字上监听（主机），之后的实例连上它（成员）；
+// 局域网内由一个实例在 TCP 端口上做主机，其他机器按地址和端口连上它。两种连接的分帧相同，
+// 主机把成员发来的快照和操作转发给其他成员。
+// 局域网画板带口令，Hello 里是口令的 HMAC-SHA256 摘要（本机画板为空口令的摘要），主机核对不符即断开
+// 帧  u32 长度 | u8 类型 | 数据（长度覆盖类型和数据）
+//   Hello     u16 版本 | bytes 口令摘要                         成员 -> 主机
+//   Welcome   varint 站点号                                     主机 -> 成员，随后是一份快照
+//   Snapshot  版次 | bytes 文档（.chb 格式）| varint 记录数 | 每条记录的编号和层叠次序（差分）
+//   Ops       版次 | varint 发出站点 | varint 帧序号 | varint 操作数 | 操作...
+//   Ack       varint 发出站点 | varint 帧序号                   收到 Ops 并应用后回给上一跳（转发来的帧也确认，发出站点不是自己的确认忽略）
+//   Clear     版次                                              清空画布：每个图层换成同名的空图层，并升版次
+// 版次是 varint 序号 + varint 站点号：图层结构变化（增删、换序、属性、撤回清空）时由改动方重新做快照并升版次，
+// 清空画布只发 Clear；只接受比当前更新的快照和 Clear（序号相同时站点号大者为准），旧版次的操作丢弃，各实例据此收敛到同一份内容。
+// 图形编号由站点号和站点内序号组成，写成两个变长整数
+namespace LiveSyncProtocol {
+
+enum { Version = 2 };
+
+enum FrameType {
+    Hello = 1,
+    Welcome = 2,
+    Snapshot = 3,
+    Ops = 4,
+    Ack = 5,
+    Clear = 6
+};
+
+enum OpKind {
+    AddItem = 1,        // 编号 | 图层 | 层叠次序 | 位置 | 图形记录类型 | 记录体（编号已存在时替换，用于简化后的笔迹）
+    RemoveItem = 2,     // 编号
+    MoveItem = 3,       // 编号 | 位移
+    StyleItem = 4,      // 编号 | 画笔
+    ClearTiles = 5,     // 图层 | 瓦片（以其透明度为遮罩清除图层栅格）
+    RestoreTiles = 6,   // 图层 | 瓦片（贴回图层栅格）
+    BakeItems = 7,      // 图层 | 编号列表（按层叠次序画进图层栅格后删除）
+    LiveBegin = 8,      // 预览编号 | 画笔 | 起点（1/16 像素定点）：对方开始画一条笔迹
+    LivePoints = 9,     // 预览编号 | 点数 | 每点相对上一点的 1/16 像素 zigzag 差分
+    LiveEnd = 10        // 预览编号：笔迹已提交或放弃，预览删除
+};
+
+}
+
+// 同步统计
+struct LiveSyncStats {
+    quint64 framesSent = 0;
+    quint64 bytesSent = 0;           // 本实例产生的帧（不含转发）
+    quint64 framesReceived = 0;
+    quint64 bytesReceived = 0;
+    quint64 opsSent = 0;
+    quint64 opsApplied = 0;          // 应用的远端操作
+    quint64 liveBytes = 0;           // 其中绘制中笔迹预览的字节数
+    quint64 strokesSent = 0;         // 发出的笔迹（提交的 AddItem）
+    quint64 strokeBytes = 0;         // 这些笔迹的 AddItem 字节数
+    quint64 snapshotsSent = 0;
+    quint64 snapshotsApplied = 0;
+    quint64 acks = 0;                // 收到的确认
+    qint64 ackLatencyTotalUs = 0;    // 从操作产生到收到确认（含等帧、传输和对方应用）
+    qint64 ackLatencyMaxUs = 0;
+};
+
+// 实时同步：监听撤回日志，把每条生效的记录（含撤回、重做和清空）折算成紧凑的二进制操作，
+// 每帧（16ms）合并成一个 Ops 帧发出；绘制中的笔迹每帧发出新增的点，对方显示为预览。
+// 远端操作直接作用于场景，不进本地历史；要删除或替换的图形被本地历史引用时先丢弃本地历史
+class LiveSync : public QObject {
+    Q_OBJECT
+public:
+    LiveSync(DrawingView *view, UndoJournal *journal, QObject *parent = nullptr);
+    ~LiveSync();
+
+    // 本机画板名：加入同名画板，没有主机时自己做主机，主机无响应时失败；
+    // “口令@地址:端口”：连接局域网主机（异步，连不上时发出 stopped）；“口令@:端口”：在该端口上做局域网主机（0 为系统分配）
+    bool start(const QString &board, QString *error);
+    void stop();                                 // 断开全部连接
+    bool isActive() const { return isHost() || !peers.isEmpty(); }
+    bool isHost() const { return server != nullptr || tcpServer != nullptr; }
+    quint16 lanPort() const;                     // 局域网主机监听的端口，不是局域网主机为 0
+    int peerCount() const { return peers.size(); }
+    quint32 siteId() const { return site; }
+    LiveSyncStats stats() const { return counters; }
+    void resetStats() { counters = LiveSyncStats(); }
+
+    void suspend();                              // 暂停同步（打开文档期间），收到的内容丢弃
+    void resume();                               // 恢复并以本地内容重新做快照
+    void markLayersChanged();                    // 图层属性变化：空闲时重新做快照
+    void flush();                                // 立即发出本帧攒下的操作
+
+signals:
+    void canvasReplaced();                       // 应用了远端快照，图层已全部更换
+    void remoteApplied(int ops);                 // 应用了一帧远端操作
+    void peersChanged(int count);                // 连接数变化
+    void stopped(const QString &reason);         // 同步意外结束（与主机的连接断开、画布超过帧上限）
+
+private slots:
+    void onNewConnection();
+    void onReadyRead();
+    void onDisconnected();
+    void onApplied(const JournalEntry &entry, bool forward);
+    void onBaking(LayerItem *layer, const QList<QGraphicsItem*> &items);
+    void onLiveItemAdded(QGraphicsItem *item);
+    void onLiveItemEnded(QGraphicsItem *item);
+    void onStrokeReshaped(StrokeItem *stroke);
+    void onConnectFailed();                      // 局域网主机还没连上时出错或超时
+    void trySnapshot();                          // 空闲时做快照并发给 snapshotTargets，否则稍后再试
+
+private:
+    typedef QPair<QGraphicsItem*, int> ContentKey; // 图形（序号 -1）或批量层中的图元
+    typedef QPair<quint64, quint32> Revision;    // 版次：序号 + 站点号
+
+    struct Peer {
+        QIODevice *socket = nullptr;             // QLocalSocket 或 QTcpSocket
+        QByteArray inbox;                        // 未凑满一帧的数据
+        quint32 site = 0;
+    };
+
+    bool startLocal(const QString &board, QString *error);
+    bool startLan(const QString &address, quint16 port, QString *error);
+    void join(QIODevice *socket);                // 作为成员连上主机：发 Hello，等主机分配站点号
+    void host();                                 // 作为主机开始：站点号 1，给现有内容分配编号
+    void begin();                                // 开始监听撤回日志和绘制
+    void attach(QIODevice *socket);              // 接管一个连接
+    Peer *peerFor(QObject *socket) const;
+    void send(Peer *peer, quint8 type, const QByteArray &payload);
+    void broadcast(quint8 type, const QByteArray &payload, Peer *except = nullptr, bool own = true);
+    void handleFrame(Peer *peer, quint8 type, const QByteArray &payload);
+    bool applySnapshot(BinaryReader &in, const Revision &revision);
+    int applyOps(BinaryReader &in, quint64 count);
+    void applyClear(const Revision &revision);   // 与 UndoJournal::recordClear 相同的替换，但不进本地历史
+    QByteArray encodeSnapshot();                 // 当前内容编码成快照，重建编号
+    void queueSnapshot(Peer *target);            // target 为空时升版次并发给全部连接
+    void invalidate();                           // 图层结构变化：清掉攒下的操作，空闲时升版次重做快照
+
+    static void writeId(BinaryWriter &out, quint64 id) { out.varint(id >> 32); out.varint(id & 0xffffffffu); }
+    static quint64 readId(BinaryReader &in);
+    quint64 assign(const ContentKey &key);       // 分配新编号
+    void forget(const ContentKey &key);
+    int layerIndexOf(QGraphicsItem *item) const; // 图形所在图层的序号，未知为 -1
+    bool addItemOp(QGraphicsItem *item, quint64 id, int layer); // 追加 AddItem，无法表示时返回 false
+    void beginOp(quint8 kind);
+    void sendLivePoints();                       // 绘制中的笔迹新增的点
+    void releaseTarget(const ContentKey &key);   // 远端要删除或替换该内容：解除选择和本地历史的引用
+    void discardTarget(quint64 id);              // 删除编号对应的内容（批量图元标记移除）
+    void dropPreviews(quint32 fromSite);         // 删除某个站点（0 为全部）的预览
+    void raiseZ(qreal z);                        // 之后本地新画的图形排在远端图形之上
+
+    DrawingView *view;
+    UndoJournal *journal;
+    QLocalServer *server;                        // 本机主机
+    QTcpServer *tcpServer;                       // 局域网主机
+    QList<Peer*> peers;
+    QTimer *frameTimer;                          // 帧节拍：攒下的操作每帧发一次
+    QTimer *idleTimer;                           // 快照的空闲等待
+    QTimer *connectTimer;                        // 连接局域网主机的超时
+    QByteArray secret;                           // 口令摘要
+    quint32 site;                                // 本实例的站点号（主机为 1，成员由主机分配，未分配为 0）
+    quint32 nextSite;                            // 主机分配给下一个成员的站点号
+    quint32 nextLocal;                           // 站点内的下一个编号
+    Revision revision;                           // 当前版次
+    quint64 highestRevision;                     // 见过的最大版次序号
+    QHash<ContentKey, quint64> ids;              // 内容 -> 编号
+    QHash<quint64, ContentKey> targets;          // 编号 -> 内容
+    QByteArray pending;                          // 本帧攒下的操作
+    BinaryWriter pendingOut;
+    int pendingCount;
+    qint64 pendingSince;                         // 本帧第一个操作产生的时刻（clock 的纳秒）
+    quint64 nextSequence;                        // Ops 帧序号
+    QHash<quint64, qint64> unacked;              // 帧序号 -> 其中第一个操作产生的时刻
+    QElapsedTimer clock;
+    StrokeItem *liveStroke;                      // 本地正在绘制的笔迹
+    quint64 liveId;
+    int liveSent;                                // 已发出的点数
+    QPoint liveLast;                             // 最后发出的点（1/16 像素定点）
+    QHash<quint64, StrokeItem*> previews;        // 远端正在绘制的笔迹
+    QHash<quint64, QPoint> previewLast;          // 预览最后一个点（定点，差分解码用）
+    QList<Peer*> snapshotTargets;                // 等待快照的新成员
+    bool snapshotBroadcast;                      // 等待升版次的快照
+    bool suspended;
+    LiveSyncStats counters;
+};
+
+#endif // LIVESYNC_H
@@ -1,9 +1,21 @@
 #include "mainwindow.h"
+#include "batchrenderer.h"
 #include <QApplication>
 
 int main(int argc, char *argv[]) {
+    // --render：无窗口批量渲染，不创建主窗口和工具栏，默认使用 offscreen 平台（不需要显示器）
+    bool headless = false;
+    for (int i = 1; i < argc; ++i) {
+        if (qstrcmp(argv[i], "--render") == 0) headless = true;
+    }
+    if (headless && qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
     QApplication a(argc, argv);
+    if (headless) return BatchRenderer::runCommandLine(a.arguments());
+
     MainWindow w;
     w.show();
+    w.startAutosave();
     return a.exec();
 }
@@ -1,9 +1,21 @@
 #include "mainwindow.h"
+#include "drawingtools.h"
+#include "strokeitem.h"
+#include "eraser.h"
+#include "tilelayer.h"
+#include "imageexporter.h"
+#include "chbdocument.h"
+#include "statictextitem.h"
+#include "primitivebatch.h"
+#include "floodfill.h"
+#include "brushstrokeitem.h"
+#include "brushengine.h"
+#include "layeritem.h"
+#include "autosave.h"
+#include "vectorexporter.h"
+#include "livesync.h"
 #include <QStatusBar>
 #include <QPainter>
-#include <QGraphicsLineItem>
-#include <QGraphicsRectItem>
-#include <QGraphicsEllipseItem>
 #include <QMessageBox>
 #include <QFileDialog>
 #include <QPixmap>
@@ -11,239 +23,888 @@
 #include <QVBoxLayout>
 #include <QFont>
 #include <QDir>
+#include <QTimer>
+#include <QGuiApplication>
+#include <QScreen>
+#include <QInputDialog>
+#include <QProgressDialog>
+#include <QtMath>
+#include <QElapsedTimer>
+#include <QScrollBar>
+#include <QWheelEvent>
+#include <QShortcut>
+#include <QMenuBar>
+#include <QMenu>
+#include <QAction>
+#include <QTabletEvent>
+#include <QDockWidget>
+#include <QListWidget>
+#include <QCheckBox>
+#include <QStandardPaths>
+
+namespace {
+const qreal MinZoom = 0.02;          // 最小缩放
+const qreal MaxZoom = 32;            // 最大缩放
+const qreal WheelZoomStep = 1.15;    // 每个滚轮刻度的缩放倍数
+const int ItemsPerIndexLeaf = 32;    // BSP 每个叶子的目标图形数
+const int MinIndexDepth = 8;
+const int MaxIndexDepth = 16;        // 2^16 个叶子，再深时叶子本身的开销超过收益
+}
 
 // 自定义绘图视图实现
 DrawingView::DrawingView(QGraphicsScene *scene, QWidget *parent)
     : QGraphicsView(scene, parent),
-      isDrawing(false),
       currentColor(Qt::black),
       penWidth(3),
       isEraserMode(false),
-      lastColor(Qt::black),
       currentTool(DrawingTool::PEN),
-      tempItem(nullptr),
       currentFontSize(24),
-      currentPath(QPainterPath()) {
+      currentLayer(nullptr),
+      currentLayerIndex(0),
+      simplifyMode(StrokeSimplifier::Cubic),
+      coalesceInput(true),
+      frameTimer(new QTimer(this)),
+      pendingMoveCount(0),
+      panning(false),
+      growingCanvas(false),
+      indexedItems(0),
+      indexTunedFor(0),
+      hudLabel(new QLabel(this)),
+      hudTimer(new QTimer(this)),
+      editedText(nullptr),
+      textEditor(nullptr),
+      batchPrimitives(false),
+      batches(4, nullptr),
+      fillTolerance(32),
+      brushKind(BrushEngine::Soft),
+      pressure(1),
+      tabletPressure(1),
+      movingSelection(false) {
     setDragMode(QGraphicsView::NoDrag);
     setRenderHint(QPainter::Antialiasing);
     setMouseTracking(true);
+
+    // 按屏幕刷新率处理移动采样，高回报率鼠标的多余采样在帧内合并
+    QScreen *screen = QGuiApplication::primaryScreen();
+    const qreal refreshRate = (screen && screen->refreshRate() > 0) ? screen->refreshRate() : 60;
+    frameTimer->setSingleShot(true);
+    frameTimer->setTimerType(Qt::PreciseTimer);
+    frameTimer->setInterval(qMax(1, qRound(1000 / refreshRate)));
+    connect(frameTimer, &QTimer::timeout, this, &DrawingView::flushPendingMoves);
+
+    // 顺序与 DrawingTool 枚举一致
+    toolHandlers << new PenTool(this)
+                 << new DragShapeTool(this, ShapeItem::Line)
+                 << new DragShapeTool(this, ShapeItem::Rectangle)
+                 << new DragShapeTool(this, ShapeItem::Ellipse)
+                 << new TriangleTool(this)
+                 << new TextTool(this)
+                 << new FillTool(this)
+                 << new BrushTool(this)
+                 << new SelectTool(this);
+    eraserHandler = new EraserTool(this);
+    nextZ = 0;
+    tuneSceneIndex(0);
+
+    // 性能面板：默认隐藏，显示时定时刷新，不参与鼠标事件
+    hudLabel->setAttribute(Qt::WA_TransparentForMouseEvents);
+    hudLabel->setStyleSheet("QLabel { background: rgba(0, 0, 0, 160); color: white; padding: 6px; }");
+    hudLabel->hide();
+    hudTimer->setInterval(250);
+    connect(hudTimer, &QTimer::timeout, this, &DrawingView::refreshHud);
 }
 
-// 鼠标按下事件（开始绘图）
-void DrawingView::mousePressEvent(QMouseEvent *event) {
-    if (event->button() == Qt::LeftButton) {
-        QPointF currentPoint = mapToScene(event->pos());
-        QColor drawColor = isEraserMode ? Qt::white : currentColor;
-        QPen pen(drawColor, penWidth, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
-        QBrush brush(Qt::transparent);
-
-        // 三角形绘制逻辑
-        if (currentTool == DrawingTool::TRIANGLE) {
-            if (trianglePoints.isEmpty()) {
-                trianglePoints.append(currentPoint);
-            } else if (trianglePoints.size() == 1) {
-                trianglePoints.append(currentPoint);
-                isDrawing = true;
-                QPolygonF initPolygon({trianglePoints[0], trianglePoints[1], trianglePoints[0]});
-                tempItem = new QGraphicsPolygonItem(initPolygon);
-                if (auto polygonItem = dynamic_cast<QGraphicsPolygonItem*>(tempItem)) {
-                    polygonItem->setPen(pen);
-                    polygonItem->setBrush(brush);
-                }
-                scene()->addItem(tempItem);
-            } else if (trianglePoints.size() == 2) {
-                trianglePoints.append(currentPoint);
-                isDrawing = false;
-                QPolygonF finalPolygon(trianglePoints);
-                QGraphicsPolygonItem *triangleItem = new QGraphicsPolygonItem(finalPolygon);
-                if (auto polygonItem = dynamic_cast<QGraphicsPolygonItem*>(triangleItem)) {
-                    polygonItem->setPen(pen);
-                    polygonItem->setBrush(brush);
-                }
-                scene()->addItem(triangleItem);
-                emit itemDrawn(triangleItem);
-                trianglePoints.clear();
-                if (tempItem) {
-                    scene()->removeItem(tempItem);
-                    delete tempItem;
-                    tempItem = nullptr;
-                }
-            }
+DrawingView::~DrawingView() {
+    qDeleteAll(toolHandlers);
+    delete eraserHandler;
+}
+
+// 当前工具画笔
+QPen DrawingView::toolPen() const {
+    return QPen(toolColor(), penWidth, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
+}
+
+// 当前绘制颜色
+QColor DrawingView::toolColor() const {
+    return currentColor;
+}
+
+// 加入当前图层：每个新图形占用一个递增的层叠值，撤回后重新加入时仍在原来的位置。
+// 绘制中的图形由场景直接绘制，提交时才并入图层缓存
+void DrawingView::addLiveItem(QGraphicsItem *item) {
+    item->setZValue(nextZ++);
+    if (LayerItem *layer = activeLayer()) {
+        item->setParentItem(layer);
+    } else {
+        scene()->addItem(item);
+    }
+    emit liveItemAdded(item);
+}
+
+// 当前图层不在场景中（被删除、撤回或清空画布换掉，可能已被释放）时，取同一位置的图层
+LayerItem *DrawingView::activeLayer() {
+    const QList<LayerItem*> layers = LayerItem::layers(scene());
+    const int index = layers.indexOf(currentLayer);
+    if (index >= 0) {
+        currentLayerIndex = index;
+        return currentLayer;
+    }
+    // 原图层连同其中的批量层可能已被释放，不能再追加
+    detachBatches();
+    currentLayer = layers.isEmpty() ? nullptr : layers.at(qBound(0, currentLayerIndex, layers.size() - 1));
+    return currentLayer;
+}
+
+void DrawingView::setCurrentLayer(LayerItem *layer) {
+    const bool changed = layer != currentLayer;
+    if (changed) {
+        cancelDrawing();
+        detachBatches();
+    }
+    currentLayer = layer;
+    activeLayer();
+    if (changed) recorder.value(InputTrace::Layer, quint32(currentLayerIndex));
+}
+
+void DrawingView::recordLayerState(LayerItem *layer) {
+    const int index = LayerItem::layers(scene()).indexOf(layer);
+    if (index < 0) return;
+    recorder.layerState(index, layer->isVisible(), layer->isLocked(), qRound(layer->opacity() * 100));
+}
+
+qreal DrawingView::reserveZ(int count) {
+    const qreal base = nextZ;
+    nextZ += count;
+    return base;
+}
+
+// 沿轨迹擦除当前图层（图形与图层的历史栅格一起），有内容被擦除时通知主窗口记录历史
+void DrawingView::eraseAlong(const QVector<QPointF> &trail, qreal radius, QGraphicsItem *ignore) {
+    LayerItem *layer = activeLayer();
+    if (!layer) return;
+    EraseResult result = Eraser::eraseAlong(layer, trail, radius, ignore);
+    if (!layer->bakedTiles()->isEmpty()) {
+        result.tilePatches = layer->bakedTiles()->clearArea(Eraser::trailArea(trail, radius));
+        result.patchLayer = layer->bakedTiles();
+    }
+    if (!result.isEmpty()) {
+        emit itemsErased(result);
+    }
+}
+
+// 绘制完成：批量模式下形状并入批量层，原图形删除，场景索引里只有批量层一项
+void DrawingView::commitItem(QGraphicsItem *item) {
+    emit liveItemEnded(item);
+    ShapeItem *shape = batchPrimitives ? qgraphicsitem_cast<ShapeItem*>(item) : nullptr;
+    if (shape) {
+        PrimitiveBatch *batch = batchFor(shape->kind());
+        const int primitive = batch->append(shape);
+        if (primitive >= 0) {
+            discardItem(shape);
+            emit itemDrawn(batch, primitive);
             return;
         }
+    }
+    // 提交的笔迹转为紧凑存储，绘制时才解码
+    if (StrokeItem *stroke = qgraphicsitem_cast<StrokeItem*>(item)) stroke->compact();
+    if (LayerItem *layer = qgraphicsitem_cast<LayerItem*>(item->parentItem())) layer->adopt(item);
+    if (++indexedItems > indexTunedFor * 4) tuneSceneIndex(indexedItems);
+    emit itemDrawn(item);
+}
 
-        isDrawing = true;
-        lastPoint = currentPoint;
-        emit mouseClicked(currentPoint);
-
-        // 文本工具
-        if (currentTool == DrawingTool::TEXT && !currentText.isEmpty()) {
-            QGraphicsTextItem *textItem = new QGraphicsTextItem(currentText);
-            QFont font;
-            font.setPointSize(currentFontSize);
-            textItem->setFont(font);
-            textItem->setDefaultTextColor(drawColor);
-            textItem->setPos(currentPoint);
-            scene()->addItem(textItem);
-            emit itemDrawn(textItem);
-            isDrawing = false;
-        }
-        // 画笔工具
-        else if (currentTool == DrawingTool::PEN) {
-            currentPath = QPainterPath(currentPoint);
-            tempItem = new QGraphicsPathItem(currentPath);
-            if (auto pathItem = dynamic_cast<QGraphicsPathItem*>(tempItem)) {
-                pathItem->setPen(pen);
-            }
-            scene()->addItem(tempItem);
-        }
-        // 其他形状工具
-        else if (currentTool != DrawingTool::PEN) {
-            if (currentTool == DrawingTool::LINE) {
-                tempItem = new QGraphicsLineItem(QLineF(currentPoint, currentPoint));
-                if (auto lineItem = dynamic_cast<QGraphicsLineItem*>(tempItem)) {
-                    lineItem->setPen(pen);
-                }
-            } else if (currentTool == DrawingTool::RECTANGLE) {
-                tempItem = new QGraphicsRectItem(QRectF(currentPoint, currentPoint));
-                if (auto rectItem = dynamic_cast<QGraphicsRectItem*>(tempItem)) {
-                    rectItem->setPen(pen);
-                    rectItem->setBrush(brush);
-                }
-            } else if (currentTool == DrawingTool::CIRCLE) {
-                tempItem = new QGraphicsEllipseItem(QRectF(currentPoint, currentPoint));
-                if (auto ellipseItem = dynamic_cast<QGraphicsEllipseItem*>(tempItem)) {
-                    ellipseItem->setPen(pen);
-                    ellipseItem->setBrush(brush);
-                }
-            }
-            if (tempItem) {
-                scene()->addItem(tempItem);
-            }
+// 批量层的层叠次序取创建时的值，层内图元之间不再按绘制先后与其他图形交错
+PrimitiveBatch *DrawingView::batchFor(int kind) {
+    // 当前批量层总在当前图层中：切换图层或当前图层移出场景时已经放弃（见 activeLayer）
+    LayerItem *layer = activeLayer();
+    PrimitiveBatch *&batch = batches[kind];
+    if (!batch) {
+        batch = new PrimitiveBatch(ShapeItem::Kind(kind));
+        addLiveItem(batch);
+        if (layer) layer->adopt(batch);
+    }
+    return batch;
+}
+
+void DrawingView::detachBatches() {
+    batches.fill(nullptr);
+}
+
+void DrawingView::setPrimitiveBatching(bool enabled) {
+    batchPrimitives = enabled;
+}
+
+void DrawingView::setFillTolerance(int tolerance) {
+    fillTolerance = qBound(0, tolerance, 255);
+    recorder.value(InputTrace::FillTolerance, quint32(fillTolerance));
+}
+
+void DrawingView::setNextFillSource(const QRectF &source, const QSize &size) {
+    nextFillSource = source;
+    nextFillSize = size;
+}
+
+void DrawingView::setBrushKind(int kind) {
+    brushKind = qBound(int(BrushEngine::Soft), kind, int(BrushEngine::Textured));
+    recorder.value(InputTrace::BrushKind, quint32(brushKind));
+}
+
+// 只在变化时录制，鼠标输入不会产生笔压记录
+void DrawingView::setPointerPressure(qreal value) {
+    value = qBound<qreal>(0, value, 1);
+    if (value == pressure) return;
+    pressure = value;
+    recorder.value(InputTrace::Pressure, quint32(qRound(pressure * 1000)));
+}
+
+// 填充：可见区域按屏幕分辨率栅格化后做扫描线填充，结果转成一个填充轮廓图形。
+// 只看可见内容，所以耗时只与视口大小有关，与画布多大无关；区域被视口边缘截断。
+// 回放时改用录制的范围，结果不受回放窗口的大小和滚动位置影响
+void DrawingView::fillAt(const QPointF &scenePos) {
+    QRectF source = mapToScene(viewport()->rect()).boundingRect();
+    QSize size = viewport()->size();
+    if (!nextFillSource.isEmpty()) {
+        source = nextFillSource;
+        size = nextFillSize;
+        nextFillSource = QRectF();
+    }
+    if (size.isEmpty() || !source.contains(scenePos)) return;
+
+    QImage image(size, QImage::Format_RGB32);
+    image.fill(Qt::white);
+    {
+        QPainter painter(&image);
+        scene()->render(&painter, QRectF(image.rect()), source, Qt::IgnoreAspectRatio);
+    }
+    const qreal sx = image.width() / source.width();
+    const qreal sy = image.height() / source.height();
+    const QPoint seed(qBound(0, qFloor((scenePos.x() - source.left()) * sx), image.width() - 1),
+                      qBound(0, qFloor((scenePos.y() - source.top()) * sy), image.height() - 1));
+    const FillResult fill = FloodFill::fill(image, seed, fillTolerance);
+    if (fill.isEmpty()) return;
+
+    // 扫描段连成一条轮廓再填充：逐段 addRect 的相邻矩形在抗锯齿下会露出细缝。
+    // 轮廓在整数像素坐标里生成，之后再映射回场景坐标
+    const QTransform toScene(1 / sx, 0, 0, 1 / sy, source.left(), source.top());
+    QGraphicsPathItem *item = new QGraphicsPathItem(toScene.map(FloodFill::outline(fill.rects)));
+    item->setPen(Qt::NoPen);
+    item->setBrush(currentColor);
+    addLiveItem(item);
+    commitItem(item);
+    emit regionFilled(fill.pixels, fill.rects.size(), fill.elapsedNs / 1000);
+}
+
+// 固定 BSP 深度：默认的自动深度会在图形数变化时整棵重建，百万级图形时造成明显卡顿
+void DrawingView::tuneSceneIndex(int expectedItems) {
+    indexedItems = expectedItems;
+    indexTunedFor = qMax(1024, expectedItems);
+    // BSP 按 x/y 交替二分，叶子数为 2^depth
+    const int depth = qBound(MinIndexDepth,
+                             qCeil(qLn(qreal(indexTunedFor) / ItemsPerIndexLeaf) / qLn(2.0)),
+                             MaxIndexDepth);
+    if (scene()->itemIndexMethod() != QGraphicsScene::BspTreeIndex) {
+        scene()->setItemIndexMethod(QGraphicsScene::BspTreeIndex);
+    }
+    if (scene()->bspTreeDepth() != depth) scene()->setBspTreeDepth(depth);
+}
+
+// 场景矩形变化会重建 BSP 索引，因此每次至少向外扩展当前尺寸的一半
+void DrawingView::ensureCanvasCovers(const QRectF &rect) {
+    const QRectF current = scene()->sceneRect();
+    if (growingCanvas || rect.isEmpty() || current.contains(rect)) return;
+    growingCanvas = true;
+    const qreal growX = current.width() / 2;
+    const qreal growY = current.height() / 2;
+    QRectF grown = current;
+    if (rect.left() < current.left()) grown.setLeft(qMin(rect.left(), current.left() - growX));
+    if (rect.right() > current.right()) grown.setRight(qMax(rect.right(), current.right() + growX));
+    if (rect.top() < current.top()) grown.setTop(qMin(rect.top(), current.top() - growY));
+    if (rect.bottom() > current.bottom()) grown.setBottom(qMax(rect.bottom(), current.bottom() + growY));
+    scene()->setSceneRect(grown);
+    growingCanvas = false;
+}
+
+// 可见区域四周各留一屏，滚动或平移到边缘前画布已经扩展
+void DrawingView::growCanvasToView() {
+    const QRectF visible = mapToScene(viewport()->rect()).boundingRect();
+    ensureCanvasCovers(visible.adjusted(-visible.width(), -visible.height(), visible.width(), visible.height()));
+}
+
+void DrawingView::applyZoom(qreal factor) {
+    const qreal current = zoom();
+    const qreal target = qBound(MinZoom, current * factor, MaxZoom);
+    if (qFuzzyCompare(target, current)) return;
+    scale(target / current, target / current);
+    growCanvasToView();
+    recorder.zoom(zoom());
+    emit zoomChanged(zoom());
+}
+
+void DrawingView::zoomBy(qreal factor) {
+    setTransformationAnchor(QGraphicsView::AnchorViewCenter);
+    applyZoom(factor);
+}
+
+void DrawingView::resetZoom() {
+    zoomBy(1 / zoom());
+}
+
+// Ctrl+滚轮以光标为中心缩放，普通滚轮仍然滚动
+void DrawingView::wheelEvent(QWheelEvent *event) {
+    if (event->modifiers() & Qt::ControlModifier) {
+        setTransformationAnchor(QGraphicsView::AnchorUnderMouse);
+        applyZoom(qPow(WheelZoomStep, event->angleDelta().y() / 120.0));
+        event->accept();
+        return;
+    }
+    QGraphicsView::wheelEvent(event);
+}
+
+void DrawingView::scrollContentsBy(int dx, int dy) {
+    QGraphicsView::scrollContentsBy(dx, dy);
+    growCanvasToView();
+}
+
+void DrawingView::resizeEvent(QResizeEvent *event) {
+    QGraphicsView::resizeEvent(event);
+    growCanvasToView();
+}
+
+// 视口的绘制事件经由这里分发，测得的是整帧场景绘制时间
+void DrawingView::paintEvent(QPaintEvent *event) {
+    perfMetrics.frameStarted();
+    QGraphicsView::paintEvent(event);
+    perfMetrics.frameFinished();
+}
+
+PerfSnapshot DrawingView::perfSnapshot() const {
+    PerfSnapshot snapshot = perfMetrics.snapshot();
+    snapshot.sceneItems = scene()->items().size();
+    return snapshot;
+}
+
+bool DrawingView::isHudVisible() const {
+    return !hudLabel->isHidden();
+}
+
+void DrawingView::setHudVisible(bool visible) {
+    hudLabel->setVisible(visible);
+    if (visible) {
+        refreshHud();
+        hudTimer->start();
+    } else {
+        hudTimer->stop();
+    }
+}
+
+void DrawingView::refreshHud() {
+    hudLabel->setText(perfSnapshot().toText());
+    hudLabel->adjustSize();
+    hudLabel->move(viewport()->geometry().topLeft() + QPoint(8, 8));
+    hudLabel->raise();
+}
+
+// 放弃未提交的图形
+void DrawingView::discardItem(QGraphicsItem *item) {
+    emit liveItemEnded(item);
+    scene()->removeItem(item);
+    delete item;
+}
+
+// 提交后的笔迹在后台简化，容差随缩放和笔宽变化
+void DrawingView::simplifyStroke(StrokeItem *stroke) {
+    if (simplifyMode == StrokeSimplifier::Off) return;
+    const qreal tolerance = StrokeSimplifier::toleranceFor(stroke->pen().widthF(), transform().m11());
+    stroke->simplifyAsync(simplifyMode, tolerance, [this, stroke](const SimplifyStats &stats) {
+        emit strokeSimplified(stats.pointsBefore, stats.pointsAfter, stats.maxDeviation);
+        emit strokeReshaped(stroke);
+    });
+}
+
+// 处理本帧缓冲的移动采样：需要全部采样的工具（画笔）逐个处理，其余只处理最新一个
+void DrawingView::flushPendingMoves() {
+    frameTimer->stop();
+    if (pendingMoveCount == 0) return;
+
+    const QPointF latest = pendingMoves[pendingMoveCount - 1];
+    ToolHandler *handler = activeHandler();
+    int processed = 1;
+    if (handler->wantsAllSamples()) {
+        for (int i = 0; i < pendingMoveCount; ++i) {
+            handler->move(pendingMoves[i]);
         }
+        processed = pendingMoveCount;
+    } else {
+        handler->move(latest);
     }
-    QGraphicsView::mousePressEvent(event);
+    emit mouseMoved(latest);
+
+    frameStats.samples = pendingMoveCount;
+    frameStats.processed = processed;
+    frameStats.coalesced = pendingMoveCount - processed;
+    frameStats.totalProcessed += frameStats.processed;
+    frameStats.totalCoalesced += frameStats.coalesced;
+    pendingMoveCount = 0;
 }
 
-// 鼠标移动事件（更新预览）
-void DrawingView::mouseMoveEvent(QMouseEvent *event) {
-    QPointF currentPoint = mapToScene(event->pos());
-    emit mouseMoved(currentPoint);
-
-    if (!isDrawing || !tempItem) return;
-
-    QColor drawColor = isEraserMode ? Qt::white : currentColor;
-    QPen pen(drawColor, penWidth, Qt::DashLine, Qt::RoundCap, Qt::RoundJoin);
-    QBrush brush(Qt::transparent);
-
-    // 三角形预览
-    if (currentTool == DrawingTool::TRIANGLE && trianglePoints.size() == 2) {
-        scene()->removeItem(tempItem);
-        delete tempItem;
-        QVector<QPointF> previewPoints = trianglePoints;
-        previewPoints.append(currentPoint);
-        QPolygonF previewPolygon(previewPoints);
-        tempItem = new QGraphicsPolygonItem(previewPolygon);
-        if (auto polygonItem = dynamic_cast<QGraphicsPolygonItem*>(tempItem)) {
-            polygonItem->setPen(pen);
-            polygonItem->setBrush(brush);
+
+// 放弃进行中的绘制（包括未确认的文本编辑）
+void DrawingView::cancelDrawing() {
+    finishTextEdit(false);
+    flushPendingMoves();
+    activeHandler()->cancel();
+    clearSelection();
+}
+
+// 设置是否合并输入
+void DrawingView::setInputCoalescing(bool enabled) {
+    flushPendingMoves();
+    coalesceInput = enabled;
+}
+
+// 开始录制：先写入当前的工具状态，回放时从相同的状态开始
+bool DrawingView::startRecording(const QString &filePath, QString *error) {
+    flushPendingMoves();
+    if (!recorder.start(filePath, error)) return false;
+    recorder.value(InputTrace::Tool, quint32(currentTool));
+    recorder.value(InputTrace::Color, currentColor.rgba());
+    recorder.value(InputTrace::Width, quint32(penWidth));
+    recorder.text(currentText, currentFontSize);
+    recorder.value(InputTrace::Simplify, quint32(simplifyMode));
+    recorder.value(InputTrace::Eraser, isEraserMode ? 1 : 0);
+    recorder.value(InputTrace::FillTolerance, quint32(fillTolerance));
+    recorder.value(InputTrace::BrushKind, quint32(brushKind));
+    recorder.value(InputTrace::Pressure, quint32(qRound(pressure * 1000)));
+    recorder.zoom(zoom());
+    activeLayer();
+    recorder.value(InputTrace::Layer, quint32(currentLayerIndex));
+    return true;
+}
+
+void DrawingView::stopRecording() {
+    recorder.stop();
+}
+
+void DrawingView::recordCommand(int type) {
+    recorder.value(quint8(type), 0);
+}
+
+void DrawingView::pointerPress(const QPointF &scenePos) {
+    // 先处理之前缓冲的移动，保证事件顺序
+    flushPendingMoves();
+    // 填充范围取决于视口大小和滚动位置，轨迹里没有这些，在按下之前单独录制
+    if (currentTool == DrawingTool::FILL && !isEraserMode && recorder.isRecording()) {
+        recorder.fillSource(mapToScene(viewport()->rect()).boundingRect(), viewport()->size());
+    }
+    recorder.pointer(InputTrace::Press, scenePos);
+    emit mouseClicked(scenePos);
+    // 锁定或隐藏的图层不接受绘制和擦除；没有按下的工具会忽略随后的移动和释放
+    LayerItem *layer = activeLayer();
+    if (layer && (layer->isLocked() || !layer->isVisible())) {
+        emit drawingBlocked(QString("图层“%1”已%2，不能绘制").arg(layer->name())
+                                .arg(layer->isLocked() ? "锁定" : "隐藏"));
+        return;
+    }
+    activeHandler()->press(scenePos);
+}
+
+// 录制的是合并前的原始采样，回放时经过同样的合并
+void DrawingView::pointerMove(const QPointF &scenePos) {
+    recorder.pointer(InputTrace::Move, scenePos);
+    if (pendingMoveCount == pendingMoves.size()) {
+        pendingMoves.append(scenePos);
+    } else {
+        pendingMoves[pendingMoveCount] = scenePos;
+    }
+    ++pendingMoveCount;
+
+    if (!coalesceInput) {
+        flushPendingMoves();
+    } else if (!frameTimer->isActive()) {
+        frameTimer->start();
+    }
+}
+
+void DrawingView::pointerRelease(const QPointF &scenePos) {
+    flushPendingMoves();
+    recorder.pointer(InputTrace::Release, scenePos);
+    activeHandler()->release(scenePos);
+}
+
+// 编辑文本：静态文本没有文档，编辑时换成临时的 QGraphicsTextItem，结束后再换回新的静态文本
+bool DrawingView::beginTextEdit(const QPointF &scenePos) {
+    // 和擦除一样只作用于当前图层，锁定的图层不能编辑
+    LayerItem *layer = activeLayer();
+    if (layer && layer->isLocked()) return false;
+    StaticTextItem *target = nullptr;
+    foreach (QGraphicsItem *item, scene()->items(scenePos)) {
+        target = qgraphicsitem_cast<StaticTextItem*>(item);
+        if (target && target->parentItem() == layer) break;
+        target = nullptr;
+    }
+    if (!target) return false;
+
+    cancelDrawing();
+    editedText = target;
+    editedText->hide();
+    LayerItem::touch(editedText);
+    textEditor = new TextEditItem(editedText);
+    scene()->addItem(textEditor);
+    connect(textEditor, &TextEditItem::editingFinished, this, &DrawingView::finishTextEdit);
+    setFocus();
+    textEditor->setFocus();
+    return true;
+}
+
+void DrawingView::finishTextEdit(bool accepted) {
+    if (!textEditor) return;
+    // 先断开，移除编辑项引起的失去焦点不会再次进入
+    TextEditItem *editor = textEditor;
+    StaticTextItem *original = editedText;
+    textEditor = nullptr;
+    editedText = nullptr;
+    editor->disconnect(this);
+    const QString text = editor->toPlainText();
+    scene()->removeItem(editor);
+    editor->deleteLater();      // 可能正处于它自己的事件处理中
+    original->show();
+    LayerItem::touch(original);
+
+    if (!accepted || text == original->text()) return;
+    StaticTextItem *replacement = nullptr;
+    if (!text.isEmpty()) {
+        replacement = new StaticTextItem(text, original->font(), original->color());
+        replacement->setPos(original->pos());
+        replacement->setZValue(original->zValue());
+        LayerItem::restore(scene(), replacement);
+        if (LayerItem *layer = LayerItem::layerOf(original)) layer->adopt(replacement);
+    }
+    scene()->removeItem(original);
+    emit textEdited(original, replacement);
+}
+
+bool DrawingView::isIdle() const {
+    return !textEditor && !panning && !movingSelection && pendingMoveCount == 0
+           && !eraserHandler->isBusy() && !toolHandlers[static_cast<int>(currentTool)]->isBusy();
+}
+
+// 选中内容只保存指针：撤回/重做、切换图层或工具、清空画布之前都会经由 cancelDrawing 清空，
+// 不会留下已移出场景或已释放的图形
+void DrawingView::setSelection(const Selection &selection) {
+    cancelMoveSelection();
+    selected = selection;
+    selectedBounds = selected.sceneBounds();
+    viewport()->update();
+    emit selectionChanged(selected.size());
+}
+
+void DrawingView::clearSelection() {
+    if (selected.isEmpty() && !movingSelection) return;
+    setSelection(Selection());
+}
+
+// 点选容差按屏幕像素换算，缩小显示时仍然容易点中细线
+Selection DrawingView::pickAt(const QPointF &scenePos) {
+    return Selector::pickAt(activeLayer(), scenePos, 4 / zoom());
+}
+
+Selection DrawingView::pickIn(const QRectF &sceneRect) {
+    return Selector::collect(activeLayer(), sceneRect);
+}
+
+void DrawingView::setRubberBand(const QRectF &sceneRect) {
+    if (sceneRect == rubberBand) return;
+    rubberBand = sceneRect;
+    viewport()->update();
+}
+
+bool DrawingView::selectionEditable() {
+    LayerItem *layer = activeLayer();
+    return !selected.isEmpty() && layer && !layer->isLocked();
+}
+
+// 批量层中的图元不能单独移动或换画笔：取出为图层中的独立形状，原图元标记移除（撤回时恢复）
+QList<QGraphicsItem*> DrawingView::extractPrimitives(const QPen *pen) {
+    QList<QGraphicsItem*> shapes;
+    foreach (const PrimitiveRef &ref, selected.primitives) {
+        ShapeItem *shape = ref.batch->toShapeItem(ref.index);
+        if (pen) shape->setPen(*pen);
+        if (QGraphicsItem *layer = ref.batch->parentItem()) {
+            shape->setParentItem(layer);
+        } else {
+            scene()->addItem(shape);
         }
-        scene()->addItem(tempItem);
+        ref.batch->setAlive(ref.index, false);
+        shapes.append(shape);
+    }
+    return shapes;
+}
+
+// 拖动期间选中的图形移出图层缓存由场景直接绘制，每次位移只重画它们经过的区域
+void DrawingView::beginMoveSelection() {
+    if (movingSelection || !selectionEditable()) return;
+    movingSelection = true;
+    moveOffset = QPointF();
+    extractedFrom = selected.primitives;
+    extractedShapes = extractPrimitives(nullptr);
+    foreach (QGraphicsItem *item, selected.items) {
+        if (LayerItem *layer = qgraphicsitem_cast<LayerItem*>(item->parentItem())) layer->lift(item);
+    }
+}
+
+void DrawingView::moveSelection(const QPointF &delta) {
+    if (!movingSelection || delta.isNull()) return;
+    moveOffset += delta;
+    foreach (QGraphicsItem *item, selected.items) {
+        item->moveBy(delta.x(), delta.y());
+    }
+    foreach (QGraphicsItem *shape, extractedShapes) {
+        shape->moveBy(delta.x(), delta.y());
+    }
+    selectedBounds.translate(delta);
+    viewport()->update();
+}
+
+// 没有位移（只是点选）时按放弃处理，不产生历史记录
+void DrawingView::finishMoveSelection() {
+    if (!movingSelection) return;
+    if (moveOffset.isNull()) {
+        cancelMoveSelection();
         return;
     }
+    movingSelection = false;
+    JournalEntry entry;
+    entry.label = "移动";
+    Selection moved;
+    foreach (QGraphicsItem *item, selected.items) {
+        if (LayerItem *layer = qgraphicsitem_cast<LayerItem*>(item->parentItem())) layer->adopt(item);
+        ItemEdit edit;
+        edit.item = item;
+        edit.offset = moveOffset;
+        entry.edits.append(edit);
+        moved.items.append(item);
+    }
+    foreach (QGraphicsItem *shape, extractedShapes) {
+        if (LayerItem *layer = qgraphicsitem_cast<LayerItem*>(shape->parentItem())) layer->adopt(shape);
+        entry.added.append(shape);
+        moved.items.append(shape);
+    }
+    entry.removedPrimitives = extractedFrom;
+    extractedShapes.clear();
+    extractedFrom.clear();
+    emit selectionEdited(entry);
+    setSelection(moved);
+}
+
+void DrawingView::cancelMoveSelection() {
+    if (!movingSelection) return;
+    movingSelection = false;
+    foreach (QGraphicsItem *item, selected.items) {
+        item->moveBy(-moveOffset.x(), -moveOffset.y());
+        if (LayerItem *layer = qgraphicsitem_cast<LayerItem*>(item->parentItem())) layer->adopt(item);
+    }
+    qDeleteAll(extractedShapes);
+    foreach (const PrimitiveRef &ref, extractedFrom) {
+        ref.batch->setAlive(ref.index, true);
+    }
+    extractedShapes.clear();
+    extractedFrom.clear();
+    selectedBounds = selected.sceneBounds();
+    viewport()->update();
+}
+
+// 删除：图形移出场景交给历史保管，批量图元只标记移除
+void DrawingView::deleteSelection() {
+    if (!selectionEditable()) return;
+    cancelMoveSelection();
+    JournalEntry entry;
+    entry.label = "删除";
+    foreach (QGraphicsItem *item, selected.items) {
+        scene()->removeItem(item);
+        entry.removed.append(item);
+    }
+    foreach (const PrimitiveRef &ref, selected.primitives) {
+        ref.batch->setAlive(ref.index, false);
+        entry.removedPrimitives.append(ref);
+    }
+    emit selectionEdited(entry);
+    setSelection(Selection());
+}
 
-    // 其他工具预览
-    if (currentTool == DrawingTool::PEN) {
-        currentPath.lineTo(currentPoint);
-        if (auto pathItem = dynamic_cast<QGraphicsPathItem*>(tempItem)) {
-            pathItem->setPath(currentPath);
+// 改样式：图形原地换画笔，批量图元取出为换了画笔的独立形状。栅格笔迹不能改样式，之后不再选中：
+// 选中的图形都由这条记录的原地修改引用，历史淘汰时不会被烘焙释放
+void DrawingView::restyleSelection() {
+    if (!selectionEditable()) return;
+    cancelMoveSelection();
+    const QPen pen = toolPen();
+    JournalEntry entry;
+    entry.label = "修改样式";
+    Selection restyled;
+    foreach (QGraphicsItem *item, selected.items) {
+        if (!Selector::canRestyle(item)) continue;
+        restyled.items.append(item);
+        ItemEdit edit;
+        edit.item = item;
+        edit.restyled = true;
+        edit.styleBefore = Selector::styleOf(item);
+        Selector::setStyle(item, pen);
+        edit.styleAfter = Selector::styleOf(item);
+        entry.edits.append(edit);
+    }
+    foreach (QGraphicsItem *shape, extractPrimitives(&pen)) {
+        if (LayerItem *layer = qgraphicsitem_cast<LayerItem*>(shape->parentItem())) layer->adopt(shape);
+        entry.added.append(shape);
+        restyled.items.append(shape);
+    }
+    entry.removedPrimitives = selected.primitives;
+    if (!entry.isEmpty()) emit selectionEdited(entry);
+    setSelection(restyled);
+}
+
+// 选中框用不随缩放变化的虚线；选中项很多时只画总包围盒
+void DrawingView::drawForeground(QPainter *painter, const QRectF &rect) {
+    QGraphicsView::drawForeground(painter, rect);
+    if (selected.isEmpty() && rubberBand.isNull()) return;
+    const QColor accent(0, 120, 215);
+    painter->save();
+    painter->setBrush(Qt::NoBrush);
+    painter->setPen(QPen(accent, 0, Qt::DashLine));
+    if (selected.size() <= 256) {
+        foreach (QGraphicsItem *item, selected.items) {
+            painter->drawRect(item->sceneBoundingRect());
         }
-        lastPoint = currentPoint;
-    } else {
-        QRectF rect = QRectF(lastPoint, currentPoint).normalized();
-        if (currentTool == DrawingTool::LINE) {
-            if (auto lineItem = dynamic_cast<QGraphicsLineItem*>(tempItem)) {
-                lineItem->setLine(QLineF(lastPoint, currentPoint));
-            }
-        } else if (currentTool == DrawingTool::RECTANGLE) {
-            if (auto rectItem = dynamic_cast<QGraphicsRectItem*>(tempItem)) {
-                rectItem->setRect(rect);
+        if (movingSelection) {
+            foreach (QGraphicsItem *shape, extractedShapes) {
+                painter->drawRect(shape->sceneBoundingRect());
             }
-        } else if (currentTool == DrawingTool::CIRCLE) {
-            if (auto ellipseItem = dynamic_cast<QGraphicsEllipseItem*>(tempItem)) {
-                ellipseItem->setRect(rect);
+        } else {
+            foreach (const PrimitiveRef &ref, selected.primitives) {
+                painter->drawRect(ref.batch->primitiveRect(ref.index));
             }
         }
     }
+    if (selected.size() > 1) {
+        painter->setPen(QPen(accent, 0, Qt::SolidLine));
+        painter->drawRect(selectedBounds);
+    }
+    if (!rubberBand.isNull()) {
+        painter->setPen(QPen(accent, 0));
+        painter->setBrush(QColor(accent.red(), accent.green(), accent.blue(), 40));
+        painter->drawRect(rubberBand);
+    }
+    painter->restore();
 }
 
-// 鼠标释放事件（结束绘图）
-void DrawingView::mouseReleaseEvent(QMouseEvent *event) {
-    if (event->button() == Qt::LeftButton) {
-        // 三角形特殊处理
-        if (currentTool == DrawingTool::TRIANGLE) {
-            if (isDrawing) {
-                isDrawing = false;
-            }
-            return;
+// 鼠标按下事件（开始绘图）
+void DrawingView::mousePressEvent(QMouseEvent *event) {
+    perfMetrics.inputReceived();
+    // 编辑文本时，点在编辑框内交给编辑框，点在外面只结束编辑
+    if (textEditor && event->button() == Qt::LeftButton) {
+        if (textEditor->sceneBoundingRect().contains(mapToScene(event->pos()))) {
+            QGraphicsView::mousePressEvent(event);
+        } else {
+            finishTextEdit(true);
+            event->accept();
         }
+        return;
+    }
+    // 中键拖动平移画布，不交给工具
+    if (event->button() == Qt::MiddleButton) {
+        panning = true;
+        lastPanPos = event->pos();
+        viewport()->setCursor(Qt::ClosedHandCursor);
+        event->accept();
+        return;
+    }
+    if (event->button() == Qt::LeftButton) {
+        updatePressure(event);
+        pointerPress(mapToScene(event->pos()));
+    }
+    QGraphicsView::mousePressEvent(event);
+}
 
-        isDrawing = false;
+// 鼠标移动事件（更新预览）
+void DrawingView::mouseMoveEvent(QMouseEvent *event) {
+    perfMetrics.inputReceived();
+    if (panning) {
+        const QPoint delta = event->pos() - lastPanPos;
+        lastPanPos = event->pos();
+        horizontalScrollBar()->setValue(horizontalScrollBar()->value() - delta.x());
+        verticalScrollBar()->setValue(verticalScrollBar()->value() - delta.y());
+        event->accept();
+        return;
+    }
+    if (textEditor) {
+        QGraphicsView::mouseMoveEvent(event);   // 编辑框内拖动选择文字
+        return;
+    }
+    updatePressure(event);
+    pointerMove(mapToScene(event->pos()));
+}
 
-        if (currentTool == DrawingTool::PEN && tempItem) {
-            emit itemDrawn(tempItem);
-            tempItem = nullptr;
-            currentPath = QPainterPath();
-        } else if (tempItem && currentTool != DrawingTool::TEXT) {
-            emit itemDrawn(tempItem);
-            tempItem = nullptr;
-        }
+// 鼠标释放事件（结束绘图）
+void DrawingView::mouseReleaseEvent(QMouseEvent *event) {
+    perfMetrics.inputReceived();
+    if (event->button() == Qt::MiddleButton && panning) {
+        panning = false;
+        viewport()->unsetCursor();
+        event->accept();
+        return;
+    }
+    if (event->button() == Qt::LeftButton && !textEditor) {
+        pointerRelease(mapToScene(event->pos()));
     }
     QGraphicsView::mouseReleaseEvent(event);
 }
 
+// 不接受数位板事件，Qt 会随后合成对应的鼠标事件，绘制仍走鼠标路径
+void DrawingView::tabletEvent(QTabletEvent *event) {
+    tabletPressure = event->pressure();
+    event->ignore();
+}
+
+void DrawingView::updatePressure(QMouseEvent *event) {
+    setPointerPressure(event->source() == Qt::MouseEventNotSynthesized ? 1.0 : tabletPressure);
+}
+
 // 设置画笔颜色
 void DrawingView::setPenColor(const QColor &color) {
-    if (!isEraserMode) {
-        currentColor = color;
-        lastColor = color;
-    }
+    currentColor = color;
+    recorder.value(InputTrace::Color, color.rgba());
 }
 
 // 设置画笔粗细
 void DrawingView::setPenWidth(int width) {
     penWidth = width;
+    recorder.value(InputTrace::Width, quint32(qMax(0, width)));
 }
 
-// 切换橡皮擦模式
+// 切换橡皮擦模式：橡皮擦模式下鼠标事件交给橡皮擦处理器，真正移除覆盖的内容
 void DrawingView::setEraserMode(bool isEraser) {
+    flushPendingMoves();
+    activeHandler()->cancel();
     isEraserMode = isEraser;
-    if (isEraser) {
-        lastColor = currentColor;
-        currentColor = Qt::white;
-    } else {
-        currentColor = lastColor;
-    }
+    recorder.value(InputTrace::Eraser, isEraser ? 1 : 0);
 }
 
 // 设置当前绘图工具
 void DrawingView::setCurrentTool(DrawingTool tool) {
-    // 切换工具时清理状态
-    if (currentTool == DrawingTool::TRIANGLE) {
-        trianglePoints.clear();
-        if (tempItem) {
-            scene()->removeItem(tempItem);
-            delete tempItem;
-            tempItem = nullptr;
-        }
-    }
+    // 切换工具时清理未完成的绘制
+    activeHandler()->cancel();
     currentTool = tool;
+    recorder.value(InputTrace::Tool, quint32(tool));
+}
+
+// 设置笔迹简化模式
+void DrawingView::setStrokeSimplification(int mode) {
+    simplifyMode = mode;
+    recorder.value(InputTrace::Simplify, quint32(mode));
 }
 
 // 设置文本属性
 void DrawingView::setTextProperties(const QString &text, int fontSize) {
     currentText = text;
     currentFontSize = fontSize;
+    recorder.text(text, fontSize);
 }
 
 // 主窗口实现
@@ -257,8 +918,15 @@ MainWindow::MainWindow(QWidget *parent)
       widthSlider(new QSlider(Qt::Horizontal)),
       eraserBtn(new QPushButton("橡皮擦")),
       clearBtn(new QPushButton("清空画布")),
+      openBtn(new QPushButton("打开文档")),
       saveBtn(new QPushButton("保存图片")),
       undoBtn(new QPushButton("撤回")),
+      redoBtn(new QPushButton("重做")),
+      simplifyComboBox(new QComboBox()),
+      undoDepthSpinBox(new QSpinBox()),
+      historyBudgetSpinBox(new QSpinBox()),
+      fillToleranceSpinBox(new QSpinBox()),
+      brushComboBox(new QComboBox()),
       colorValueLabel(new QLabel("0")),
       widthValueLabel(new QLabel("3px")),
       colorButtonsWidget(new QWidget()),
@@ -267,7 +935,24 @@ MainWindow::MainWindow(QWidget *parent)
       fontSizeLabel(new QLabel("24pt")),
       currentText(""),
       currentFontSize(24),
-      drawingStack(QStack<QGraphicsItem*>()),
+      layerList(new QListWidget()),
+      layerLockBox(new QCheckBox("锁定")),
+      layerOpacitySlider(new QSlider(Qt::Horizontal)),
+      layerDeleteBtn(new QPushButton("删除")),
+      layerUpBtn(new QPushButton("上移")),
+      layerDownBtn(new QPushButton("下移")),
+      layerSerial(1),
+      refreshingLayers(false),
+      journal(nullptr),
+      exporter(new ImageExporter(this)),
+      exportProgress(nullptr),
+      loader(nullptr),
+      autosave(nullptr),
+      sync(nullptr),
+      syncAction(nullptr),
+      statusTimer(new QTimer(this)),
+      replayer(nullptr),
+      recordAction(nullptr),
       currentColor(Qt::black),
       penWidth(3),
       isEraserMode(false),
@@ -275,9 +960,18 @@ MainWindow::MainWindow(QWidget *parent)
       currentTool(DrawingTool::PEN) {
 
 
+    // 初始画布，视图滚动、平移或缩放到边缘时自动扩展
     scene->setSceneRect(0, 0, 800, 600);
     scene->setBackgroundBrush(Qt::white);
+    // 初始只有一个图层，超出撤回深度的历史烘焙进各图层自己的栅格
+    LayerItem *firstLayer = new LayerItem("图层 1");
+    scene->addItem(firstLayer);
+    view->setCurrentLayer(firstLayer);
+    journal = new UndoJournal(scene, this);
+    loader = new DocumentLoader(scene, this);
+    replayer = new TraceReplayer(view, this);
     initToolBar();
+    initLayerDock();
     setCentralWidget(view);
     setWindowTitle("🌈 彩虹画板）");
     resize(1000, 600);
@@ -288,11 +982,363 @@ MainWindow::MainWindow(QWidget *parent)
     connect(view, &DrawingView::mouseMoved, this, &MainWindow::onMouseMoved);
     connect(view, &DrawingView::mouseClicked, this, &MainWindow::onMouseClicked);
     connect(view, &DrawingView::itemDrawn, this, &MainWindow::onItemDrawn);
+    connect(view, &DrawingView::itemsErased, this, &MainWindow::onItemsErased);
+    connect(view, &DrawingView::strokeSimplified, this, &MainWindow::onStrokeSimplified);
+    connect(journal, &UndoJournal::changed, this, &MainWindow::onHistoryChanged);
+    connect(exporter, &ImageExporter::progress, this, &MainWindow::onExportProgress);
+    connect(exporter, &ImageExporter::finished, this, &MainWindow::onExportFinished);
+    connect(loader, &DocumentLoader::progress, this, &MainWindow::onDocumentProgress);
+    connect(loader, &DocumentLoader::finished, this, &MainWindow::onDocumentLoaded);
+    connect(view, &DrawingView::zoomChanged, this, &MainWindow::onZoomChanged);
+    connect(view, &DrawingView::textEdited, this, &MainWindow::onTextEdited);
+    connect(view, &DrawingView::regionFilled, this, &MainWindow::onRegionFilled);
+    connect(view, &DrawingView::drawingBlocked, this, &MainWindow::onDrawingBlocked);
+    connect(view, &DrawingView::selectionEdited, this, &MainWindow::onSelectionEdited);
+    connect(journal, &UndoJournal::changed, this, &MainWindow::refreshLayerList);
+    connect(replayer, &TraceReplayer::commandReplayed, this, &MainWindow::onReplayCommand);
+    connect(replayer, &TraceReplayer::finished, this, &MainWindow::onReplayFinished);
+
+    // 状态栏坐标每 100ms 最多刷新一次
+    statusTimer->setSingleShot(true);
+    statusTimer->setInterval(100);
+    connect(statusTimer, &QTimer::timeout, this, &MainWindow::updateCursorStatus);
+    initEditMenu();
+    initSyncMenu();
+    initDebugMenu();
+
+    // 缩放快捷键：Ctrl+= 放大、Ctrl+- 缩小、Ctrl+0 恢复
+    DrawingView *drawingView = view;
+    connect(new QShortcut(QKeySequence::ZoomIn, this), &QShortcut::activated,
+            [drawingView]() { drawingView->zoomBy(1.25); });
+    connect(new QShortcut(QKeySequence::ZoomOut, this), &QShortcut::activated,
+            [drawingView]() { drawingView->zoomBy(0.8); });
+    connect(new QShortcut(QKeySequence("Ctrl+0"), this), &QShortcut::activated,
+            view, &DrawingView::resetZoom);
 }
 
 MainWindow::~MainWindow() {
-    qDeleteAll(drawingStack);
-    drawingStack.clear();
+    // 被移出场景的图形由历史日志（本窗口的子对象）释放，场景中的图形随场景释放
+    // 自动保存先于历史日志停止：正常退出时删除自动保存文件，释放历史时的烘焙不再写日志
+    delete autosave;
+    autosave = nullptr;
+    delete sync;
+    sync = nullptr;
+}
+
+// 目录被另一个窗口占用时不自动保存；恢复时像打开文档一样替换当前画布
+bool MainWindow::startAutosave(const QString &directory) {
+    if (autosave) return true;
+    const QString path = directory.isEmpty()
+        ? QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)).filePath("autosave")
+        : directory;
+    autosave = new Autosave(view, journal, path, this);
+    QString error;
+    if (!autosave->open(&error)) {
+        delete autosave;
+        autosave = nullptr;
+        statusBar()->showMessage(QString("自动保存未开启: %1").arg(error));
+        return false;
+    }
+
+    if (autosave->hasRecovery()) {
+        if (QMessageBox::question(this, "恢复", "上次没有正常退出，是否恢复自动保存的内容？",
+                                  QMessageBox::Yes | QMessageBox::No) == QMessageBox::Yes) {
+            view->cancelDrawing();
+            loader->finish();
+            view->detachBatches();
+            journal->clear();
+            QList<QGraphicsItem*> oldItems;
+            foreach (QGraphicsItem *item, scene->items()) {
+                if (!item->parentItem()) oldItems.append(item);
+            }
+            qDeleteAll(oldItems);
+
+            int replayed = 0;
+            const bool ok = autosave->recover(&error, &replayed);
+            QList<LayerItem*> layers = LayerItem::layers(scene);
+            if (layers.isEmpty()) {
+                LayerItem *layer = new LayerItem("图层 1");
+                scene->addItem(layer);
+                layers.append(layer);
+            }
+            view->setCurrentLayer(layers.last());
+            layerSerial = layers.size();
+            refreshLayerList();
+            view->tuneSceneIndex(scene->items().size());
+            view->ensureCanvasCovers(scene->itemsBoundingRect());
+            if (ok) {
+                statusBar()->showMessage(QString("已恢复自动保存的内容（重放 %1 条记录）").arg(replayed));
+            } else {
+                QMessageBox::warning(this, "恢复失败", QString("无法恢复自动保存的内容: %1").arg(error));
+            }
+        } else {
+            autosave->discardRecovery();
+        }
+    }
+    // 恢复的内容在新一代快照落盘后才删除
+    autosave->start();
+    return true;
+}
+
+// 加入后当前画布被画板的内容替换（自己做主机时保留当前内容）
+bool MainWindow::startSync(const QString &board, QString *error) {
+    if (!sync) {
+        sync = new LiveSync(view, journal, this);
+        connect(sync, &LiveSync::canvasReplaced, this, &MainWindow::onSyncCanvasReplaced);
+        connect(sync, &LiveSync::stopped, this, &MainWindow::onSyncStopped);
+        connect(sync, &LiveSync::remoteApplied, [this]() {
+            if (autosave) autosave->markExternalChange();
+        });
+        connect(sync, &LiveSync::peersChanged, [this](int count) {
+            statusBar()->showMessage(QString("实时同步：%1 个连接").arg(count));
+        });
+    }
+    if (!sync->start(board, error)) return false;
+    if (syncAction) syncAction->setChecked(true);
+    return true;
+}
+
+// 协作菜单：同一台机器上或局域网内的多个实例共用一块画板
+void MainWindow::initSyncMenu() {
+    QMenu *syncMenu = menuBar()->addMenu("协作");
+    syncAction = syncMenu->addAction("加入画板...");
+    syncAction->setCheckable(true);
+    connect(syncAction, &QAction::triggered, this, &MainWindow::toggleSync);
+
+    // 每笔的字节数和从操作产生到对方确认的延迟
+    QAction *statsAction = syncMenu->addAction("同步统计");
+    connect(statsAction, &QAction::triggered, [this]() {
+        if (!sync || !sync->isActive()) {
+            statusBar()->showMessage("实时同步未开启");
+            return;
+        }
+        const LiveSyncStats stats = sync->stats();
+        const quint64 strokes = qMax<quint64>(1, stats.strokesSent);
+        const quint64 acks = qMax<quint64>(1, stats.acks);
+        statusBar()->showMessage(QString("%1（站点 %2，%3 个连接）| 发出 %4 帧 %5 KB，收到 %6 帧 %7 KB | 每笔 %8 + 预览 %9 字节 | 确认延迟 平均 %10 ms，最大 %11 ms")
+                                     .arg(sync->isHost() ? "主机" : "成员").arg(sync->siteId()).arg(sync->peerCount())
+                                     .arg(stats.framesSent).arg(stats.bytesSent / 1024)
+                                     .arg(stats.framesReceived).arg(stats.bytesReceived / 1024)
+                                     .arg(stats.strokeBytes / strokes).arg(stats.liveBytes / strokes)
+                                     .arg(stats.ackLatencyTotalUs / 1000.0 / acks, 0, 'f', 2)
+                                     .arg(stats.ackLatencyMaxUs / 1000.0, 0, 'f', 2));
+    });
+}
+
+void MainWindow::toggleSync() {
+    if (sync && sync->isActive()) {
+        sync->stop();
+        syncAction->setChecked(false);
+        statusBar()->showMessage("已退出实时同步");
+        return;
+    }
+    syncAction->setChecked(false);
+    bool ok = false;
+    const QString board = QInputDialog::getText(this, "加入画板",
+                                                "画板名称（同一台机器上同名的实例共享画布）；\n"
+                                                "局域网：“口令@:端口”在本机做主机，“口令@地址:端口”加入其他机器上的画板：",
+                                                QLineEdit::Normal, "default", &ok).trimmed();
+    if (!ok || board.isEmpty()) return;
+    QString error;
+    if (!startSync(board, &error)) {
+        QMessageBox::warning(this, "同步失败", QString("无法开启实时同步: %1").arg(error));
+        return;
+    }
+    if (sync->lanPort()) {
+        statusBar()->showMessage(QString("已在端口 %1 上创建局域网画板，等待其他机器加入").arg(sync->lanPort()));
+        return;
+    }
+    // 局域网连接在后台进行，失败时由 onSyncStopped 报告
+    if (!sync->isHost() && board.contains(':')) {
+        statusBar()->showMessage(QString("正在连接局域网画板 %1").arg(board.mid(board.lastIndexOf('@') + 1)));
+        return;
+    }
+    statusBar()->showMessage(sync->isHost() ? QString("已创建画板 %1，等待其他实例加入").arg(board)
+                                            : QString("已加入画板 %1").arg(board));
+}
+
+// 旧图层已释放：当前图层按原来的位置重新取，列表重建
+void MainWindow::onSyncCanvasReplaced() {
+    view->activeLayer();
+    layerSerial = qMax(layerSerial, LayerItem::layers(scene).size());
+    refreshLayerList();
+    if (autosave) autosave->markExternalChange();
+}
+
+void MainWindow::onSyncStopped(const QString &reason) {
+    syncAction->setChecked(false);
+    statusBar()->showMessage(QString("实时同步已结束：%1").arg(reason));
+}
+
+// 编辑菜单：文本绘制后是静态的，只能通过这里显式进入编辑
+void MainWindow::initEditMenu() {
+    QMenu *editMenu = menuBar()->addMenu("编辑");
+    QAction *editTextAction = editMenu->addAction("编辑文本");
+    editTextAction->setShortcut(QKeySequence(Qt::Key_F2));
+    connect(editTextAction, &QAction::triggered, this, &MainWindow::editTextUnderCursor);
+
+    // 大量生成的图形放进按形状合并的批量层，不再每个图形一个场景项
+    editMenu->addSeparator();
+    QAction *batchAction = editMenu->addAction("批量绘制形状");
+    batchAction->setCheckable(true);
+    batchAction->setToolTip("直线、矩形、圆形、三角形合并到批量层绘制，适合上万个图形；层内图元统一位于创建层时的层叠位置");
+    connect(batchAction, &QAction::toggled, view, &DrawingView::setPrimitiveBatching);
+
+    // 选择工具选中的内容（只在当前图层中选择）
+    editMenu->addSeparator();
+    QAction *deleteAction = editMenu->addAction("删除所选");
+    deleteAction->setShortcut(QKeySequence::Delete);
+    connect(deleteAction, &QAction::triggered, view, &DrawingView::deleteSelection);
+    QAction *restyleAction = editMenu->addAction("所选应用当前颜色和粗细");
+    restyleAction->setToolTip("笔迹和形状换成当前颜色和粗细，文字和填充区域只换颜色；笔刷笔迹不变");
+    connect(restyleAction, &QAction::triggered, view, &DrawingView::restyleSelection);
+}
+
+void MainWindow::editTextUnderCursor() {
+    if (view->beginTextEdit(lastMousePos)) {
+        statusBar()->showMessage("编辑文本：回车确认，Esc 放弃");
+    } else {
+        statusBar()->showMessage("光标下没有文本（把鼠标移到文字上再按 F2）");
+    }
+}
+
+// 编辑后的文本替换原来的文本，作为一条可撤回的历史
+void MainWindow::onTextEdited(QGraphicsItem *before, QGraphicsItem *after) {
+    journal->record(JournalEntry::textEdited(before, after));
+    statusBar()->showMessage(QString("文本已修改 | 历史: %1 项").arg(journal->undoCount()));
+}
+
+void MainWindow::onRegionFilled(qint64 pixels, int rects, qint64 elapsedUs) {
+    statusBar()->showMessage(QString("已填充 %1 像素（%2 个矩形，扫描 %3 ms）| 历史: %4 项")
+                                 .arg(pixels).arg(rects)
+                                 .arg(elapsedUs / 1000.0, 0, 'f', 1)
+                                 .arg(journal->undoCount()));
+}
+
+// 调试菜单：性能面板开关、统计重置、输入轨迹录制与回放
+void MainWindow::initDebugMenu() {
+    QMenu *debugMenu = menuBar()->addMenu("调试");
+    QAction *hudAction = debugMenu->addAction("性能面板");
+    hudAction->setCheckable(true);
+    hudAction->setShortcut(QKeySequence(Qt::Key_F12));
+    connect(hudAction, &QAction::toggled, view, &DrawingView::setHudVisible);
+
+    QAction *resetAction = debugMenu->addAction("重置性能统计");
+    DrawingView *drawingView = view;
+    connect(resetAction, &QAction::triggered, [drawingView]() {
+        drawingView->metrics()->reset();
+        drawingView->refreshHud();
+    });
+
+    // 笔迹内存：压缩存储与不压缩时的对照，以及解码缓存的命中情况
+    QAction *memoryAction = debugMenu->addAction("笔迹内存报告");
+    connect(memoryAction, &QAction::triggered, [this]() {
+        int strokes = 0;
+        qint64 compactBytes = 0;
+        qint64 expandedBytes = 0;
+        foreach (QGraphicsItem *item, scene->items()) {
+            if (StrokeItem *stroke = qgraphicsitem_cast<StrokeItem*>(item)) {
+                ++strokes;
+                compactBytes += stroke->byteSize();
+                expandedBytes += stroke->expandedByteSize();
+            }
+        }
+        const StrokeCacheStats cache = StrokeItem::cacheStats();
+        const int count = qMax(1, strokes);
+        statusBar()->showMessage(QString("笔迹 %1 条：每条 %2 字节（不压缩 %3 字节）| 解码缓存 %4 条 %5 KB / %6 KB，命中 %7，未命中 %8")
+                                     .arg(strokes).arg(compactBytes / count).arg(expandedBytes / count)
+                                     .arg(cache.entries).arg(cache.bytes / 1024).arg(cache.limit / 1024)
+                                     .arg(cache.hits).arg(cache.misses));
+    });
+
+    debugMenu->addSeparator();
+    recordAction = debugMenu->addAction("录制输入...");
+    recordAction->setCheckable(true);
+    connect(recordAction, &QAction::triggered, this, &MainWindow::toggleRecording);
+    QAction *replayAction = debugMenu->addAction("回放轨迹（实时）...");
+    connect(replayAction, &QAction::triggered, [this]() { replayTrace(false); });
+    QAction *fastReplayAction = debugMenu->addAction("回放轨迹（最快）...");
+    connect(fastReplayAction, &QAction::triggered, [this]() { replayTrace(true); });
+    QAction *stopReplayAction = debugMenu->addAction("停止回放");
+    connect(stopReplayAction, &QAction::triggered, replayer, &TraceReplayer::stop);
+}
+
+// 开始/结束录制：轨迹包含此后的全部鼠标输入、工具设置变化和撤回/重做/清空命令
+void MainWindow::toggleRecording() {
+    if (view->isRecording()) {
+        view->stopRecording();
+        recordAction->setChecked(false);
+        statusBar()->showMessage("输入录制已结束");
+        return;
+    }
+    const QString filePath = QFileDialog::getSaveFileName(this, "录制输入轨迹", QDir::homePath() + "/session.chbtrace",
+                                                          "输入轨迹 (*.chbtrace)");
+    QString error;
+    if (filePath.isEmpty() || !view->startRecording(filePath, &error)) {
+        if (!error.isEmpty()) QMessageBox::warning(this, "录制失败", QString("无法写入轨迹: %1").arg(error));
+        recordAction->setChecked(false);
+        return;
+    }
+    recordAction->setChecked(true);
+    statusBar()->showMessage(QString("正在录制输入到 %1").arg(filePath));
+}
+
+// 回放轨迹：在当前画布上重放，最快模式用于复现和分析性能问题
+void MainWindow::replayTrace(bool asFastAsPossible) {
+    const QString filePath = QFileDialog::getOpenFileName(this, "回放输入轨迹", QDir::homePath(),
+                                                          "输入轨迹 (*.chbtrace)");
+    if (filePath.isEmpty()) return;
+    view->cancelDrawing();
+    view->metrics()->reset();
+    QString error;
+    if (!replayer->start(filePath, asFastAsPossible ? TraceReplayer::AsFastAsPossible : TraceReplayer::RealTime,
+                         &error)) {
+        QMessageBox::warning(this, "回放失败", QString("无法读取轨迹: %1").arg(error));
+        return;
+    }
+    statusBar()->showMessage(QString("正在回放 %1").arg(filePath));
+}
+
+void MainWindow::onReplayCommand(int type) {
+    switch (type) {
+    case InputTrace::Undo:
+        onUndoClicked();
+        break;
+    case InputTrace::Redo:
+        onRedoClicked();
+        break;
+    case InputTrace::Clear:
+        clearCanvasNow();
+        break;
+    case InputTrace::AddLayer:
+        addLayer();
+        break;
+    case InputTrace::DeleteLayer:
+        deleteLayer();
+        break;
+    case InputTrace::RaiseLayer:
+        moveLayer(1);
+        break;
+    case InputTrace::LowerLayer:
+        moveLayer(-1);
+        break;
+    case InputTrace::Layer:
+        refreshLayerList();
+        break;
+    case InputTrace::LayerState:
+        refreshLayerList();
+        if (autosave) autosave->markLayersChanged();
+        if (sync) sync->markLayersChanged();
+        break;
+    }
+}
+
+void MainWindow::onReplayFinished(quint64 records, qint64 elapsedMs) {
+    const PerfSnapshot snapshot = view->perfSnapshot();
+    statusBar()->showMessage(QString("回放结束: %1 条记录，用时 %2 ms | 帧时间平均 %3 ms，最大 %4 ms")
+                                 .arg(records).arg(elapsedMs)
+                                 .arg(snapshot.frameMsAverage, 0, 'f', 1)
+                                 .arg(snapshot.frameMsMax, 0, 'f', 1));
 }
 
 // 初始化工具栏
@@ -316,7 +1362,7 @@ QWidget* MainWindow::createToolRow1() {
     layout->setContentsMargins(0, 0, 0, 0);
     layout->setSpacing(10);
 
-    toolComboBox->addItems({"画笔", "直线", "矩形", "圆形", "三角形", "文本"});
+    toolComboBox->addItems({"画笔", "直线", "矩形", "圆形", "三角形", "文本", "填充", "笔刷", "选择"});
     toolComboBox->setCurrentIndex(static_cast<int>(currentTool));
     layout->addWidget(toolComboBox);
     connect(toolComboBox, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged),
@@ -368,6 +1414,14 @@ QWidget* MainWindow::createToolRow2() {
         widthValueLabel->setText(QString("%1px").arg(value));
     });
 
+    // 顺序与 StrokeSimplifier::Mode 一致
+    simplifyComboBox->addItems({"原始笔迹", "折线简化", "曲线拟合"});
+    simplifyComboBox->setCurrentIndex(StrokeSimplifier::Cubic);
+    simplifyComboBox->setToolTip("提交笔迹时减少采样点");
+    layout->addWidget(simplifyComboBox);
+    connect(simplifyComboBox, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged),
+            view, &DrawingView::setStrokeSimplification);
+
     layout->addSpacing(15);
     QWidget *textWidget = new QWidget();
     QHBoxLayout *textLayout = new QHBoxLayout(textWidget);
@@ -387,16 +1441,55 @@ QWidget* MainWindow::createToolRow2() {
     connect(textInput, &QLineEdit::textChanged, this, &MainWindow::onTextChanged);
     connect(fontSizeSlider, &QSlider::valueChanged, this, &MainWindow::onFontSizeChanged);
 
+    fillToleranceSpinBox->setRange(0, 255);
+    fillToleranceSpinBox->setValue(32);
+    fillToleranceSpinBox->setToolTip("填充时与点击处颜色每个通道相差不超过此值的像素视为同一区域");
+    fillToleranceSpinBox->setEnabled(false);
+    layout->addWidget(new QLabel("容差:"));
+    layout->addWidget(fillToleranceSpinBox);
+    connect(fillToleranceSpinBox, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged),
+            view, &DrawingView::setFillTolerance);
+
+    // 顺序与 BrushEngine::Kind 一致
+    brushComboBox->addItems({"柔边", "喷枪", "纹理"});
+    brushComboBox->setToolTip("笔刷直径为画笔粗细的 4 倍，数位板笔压同时影响大小和浓淡");
+    brushComboBox->setEnabled(false);
+    layout->addWidget(new QLabel("笔刷:"));
+    layout->addWidget(brushComboBox);
+    connect(brushComboBox, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged),
+            view, &DrawingView::setBrushKind);
+
     layout->addStretch();
+    undoDepthSpinBox->setRange(1, 1000);
+    undoDepthSpinBox->setValue(journal->depthLimit());
+    undoDepthSpinBox->setToolTip("超出撤回深度的历史会被合并为栅格，不再占用图形对象");
+    layout->addWidget(new QLabel("撤回深度:"));
+    layout->addWidget(undoDepthSpinBox);
+    connect(undoDepthSpinBox, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged),
+            this, &MainWindow::setUndoDepth);
+
+    historyBudgetSpinBox->setRange(1, 4096);
+    historyBudgetSpinBox->setValue(int(journal->byteBudget() / (1024 * 1024)));
+    historyBudgetSpinBox->setToolTip("历史占用超出预算时先丢弃重做记录，再把最旧的记录合并为栅格");
+    layout->addWidget(new QLabel("历史内存(MB):"));
+    layout->addWidget(historyBudgetSpinBox);
+    connect(historyBudgetSpinBox, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged),
+            this, &MainWindow::setHistoryBudget);
+
     undoBtn->setEnabled(false);
+    redoBtn->setEnabled(false);
     layout->addWidget(undoBtn);
+    layout->addWidget(redoBtn);
     connect(undoBtn, &QPushButton::clicked, this, &MainWindow::onUndoClicked);
+    connect(redoBtn, &QPushButton::clicked, this, &MainWindow::onRedoClicked);
 
     layout->addWidget(eraserBtn);
     layout->addWidget(clearBtn);
+    layout->addWidget(openBtn);
     layout->addWidget(saveBtn);
     connect(eraserBtn, &QPushButton::clicked, this, &MainWindow::toggleEraser);
     connect(clearBtn, &QPushButton::clicked, this, &MainWindow::clearCanvas);
+    connect(openBtn, &QPushButton::clicked, this, &MainWindow::openDocument);
     connect(saveBtn, &QPushButton::clicked, this, &MainWindow::saveAsImage);
 
     return rowWidget;
@@ -447,7 +1540,7 @@ void MainWindow::onColorButtonClicked() {
         colorSlider->blockSignals(false);
 
         statusBar()->showMessage(QString("颜色已更改至: %1 | 历史: %2 项")
-                                     .arg(currentColor.name()).arg(drawingStack.size()));
+                                     .arg(currentColor.name()).arg(journal->undoCount()));
     }
 }
 
@@ -472,7 +1565,7 @@ void MainWindow::changeColor(int value) {
         view->setPenColor(currentColor);
     }
     statusBar()->showMessage(QString("颜色: %1 | 历史: %2 项")
-                                 .arg(currentColor.name()).arg(drawingStack.size()));
+                                 .arg(currentColor.name()).arg(journal->undoCount()));
 }
 
 // 粗细滑块改变粗细
@@ -480,7 +1573,7 @@ void MainWindow::changeWidth(int value) {
     penWidth = value;
     view->setPenWidth(value);
     statusBar()->showMessage(QString("粗细: %1px | 历史: %2 项")
-                                 .arg(value).arg(drawingStack.size()));
+                                 .arg(value).arg(journal->undoCount()));
 }
 
 // 切换橡皮擦/画笔
@@ -489,68 +1582,304 @@ void MainWindow::toggleEraser() {
     if (isEraserMode) {
         eraserBtn->setText("画笔模式");
         statusBar()->showMessage(QString("橡皮擦模式 | 历史: %1 项")
-                                 .arg(drawingStack.size()));
+                                 .arg(journal->undoCount()));
     } else {
         eraserBtn->setText("橡皮擦");
         statusBar()->showMessage(QString("画笔模式 | 历史: %1 项")
-                                 .arg(drawingStack.size()));
+                                 .arg(journal->undoCount()));
         view->setPenColor(currentColor);
     }
     view->setEraserMode(isEraserMode);
 }
 
-// 绘制完成事件（添加到历史栈）
-void MainWindow::onItemDrawn(QGraphicsItem *item) {
+// 绘制完成事件（添加到历史日志）
+void MainWindow::onItemDrawn(QGraphicsItem *item, int primitive) {
     if (item) {
-        drawingStack.push(item);
-        undoBtn->setEnabled(true);
-        statusBar()->showMessage(QString("绘制历史: %1 项").arg(drawingStack.size()));
+        journal->record(JournalEntry::drawn(item, primitive));
+        statusBar()->showMessage(QString("绘制历史: %1 项").arg(journal->undoCount()));
     }
 }
 
+// 擦除完成事件（整次擦除作为一条历史）
+void MainWindow::onItemsErased(const EraseResult &result) {
+    journal->record(JournalEntry::erased(result));
+    statusBar()->showMessage(QString("已擦除 %1 个图形，场景剩余 %2 项 | 历史: %3 项")
+                                 .arg(result.removed.size() + result.removedPrimitives.size())
+                                 .arg(scene->items().size())
+                                 .arg(journal->undoCount()));
+}
+
+// 历史变化：更新撤回/重做按钮
+void MainWindow::onHistoryChanged() {
+    view->metrics()->setHistory(journal->undoCount(), journal->totalBytes());
+    undoBtn->setEnabled(journal->canUndo());
+    redoBtn->setEnabled(journal->canRedo());
+    // 提示里带上这一条记录占用的内存，便于看出哪类操作让历史变大
+    undoBtn->setToolTip(journal->canUndo() ? QString("撤回: %1（占用 %2 KB）").arg(journal->undoLabel())
+                                                 .arg(journal->entryBytes().last() / 1024.0, 0, 'f', 1)
+                                           : QString());
+    redoBtn->setToolTip(journal->canRedo() ? QString("重做: %1").arg(journal->redoLabel()) : QString());
+}
+
+// 设置撤回深度
+// 淘汰的记录中仍在场景的图形会烘焙进栅格后释放，先取消选择
+void MainWindow::setUndoDepth(int depth) {
+    view->clearSelection();
+    journal->setDepthLimit(depth);
+}
+
+// 设置历史内存预算
+void MainWindow::setHistoryBudget(int megabytes) {
+    view->clearSelection();
+    journal->setByteBudget(qint64(megabytes) * 1024 * 1024);
+}
+
+// 笔迹简化完成
+void MainWindow::onStrokeSimplified(int pointsBefore, int pointsAfter, qreal maxDeviation) {
+    statusBar()->showMessage(QString("笔迹简化: %1 → %2 点，最大偏差 %3px | 历史: %4 项")
+                                 .arg(pointsBefore)
+                                 .arg(pointsAfter)
+                                 .arg(maxDeviation, 0, 'f', 2)
+                                 .arg(journal->undoCount()));
+}
+
 // 撤回操作
 void MainWindow::onUndoClicked() {
-    if (!drawingStack.isEmpty()) {
-        QGraphicsItem *itemToRemove = drawingStack.pop();
-        scene->removeItem(itemToRemove);
-        delete itemToRemove;
-        undoBtn->setEnabled(!drawingStack.isEmpty());
-        statusBar()->showMessage(QString("已撤回，剩余历史: %1 项")
-                                 .arg(drawingStack.size()));
+    if (journal->canUndo()) {
+        view->cancelDrawing();
+        view->recordCommand(InputTrace::Undo);
+        journal->undo();
+        statusBar()->showMessage(QString("已撤回，剩余历史: %1 项 | 历史占用 %2 KB")
+                                 .arg(journal->undoCount())
+                                 .arg(journal->totalBytes() / 1024));
     }
 }
 
-// 清空画布
+// 重做操作
+void MainWindow::onRedoClicked() {
+    if (journal->canRedo()) {
+        view->cancelDrawing();
+        view->recordCommand(InputTrace::Redo);
+        journal->redo();
+        statusBar()->showMessage(QString("已重做，历史: %1 项 | 历史占用 %2 KB")
+                                 .arg(journal->undoCount())
+                                 .arg(journal->totalBytes() / 1024));
+    }
+}
+
+// 清空画布（作为一条历史，可撤回）
 void MainWindow::clearCanvas() {
-    if (QMessageBox::question(this, "确认清空", "是否删除所有绘制内容？",
+    if (QMessageBox::question(this, "确认清空", "是否删除所有绘制内容？（可撤回）",
                               QMessageBox::Yes | QMessageBox::No) == QMessageBox::Yes) {
-        qDeleteAll(drawingStack);
-        drawingStack.clear();
-        scene->clear();
-        undoBtn->setEnabled(false);
-        statusBar()->showMessage("画布已清空 | 历史: 0 项");
+        clearCanvasNow();
     }
 }
 
+void MainWindow::clearCanvasNow() {
+    view->cancelDrawing();
+    view->detachBatches();
+    view->recordCommand(InputTrace::Clear);
+    loader->finish();
+    journal->recordClear();
+    statusBar()->showMessage(QString("画布已清空 | 历史: %1 项").arg(journal->undoCount()));
+}
+
+// 图层面板：列表从上到下对应图层从上到下，勾选框控制可见，双击改名
+void MainWindow::initLayerDock() {
+    QDockWidget *dock = new QDockWidget("图层", this);
+    dock->setFeatures(QDockWidget::DockWidgetMovable | QDockWidget::DockWidgetFloatable);
+    QWidget *panel = new QWidget();
+    QVBoxLayout *layout = new QVBoxLayout(panel);
+    layout->setContentsMargins(5, 5, 5, 5);
+    layout->setSpacing(5);
+    layerList->setEditTriggers(QAbstractItemView::DoubleClicked | QAbstractItemView::EditKeyPressed);
+    layout->addWidget(layerList);
+
+    QWidget *buttons = new QWidget();
+    QHBoxLayout *buttonLayout = new QHBoxLayout(buttons);
+    buttonLayout->setContentsMargins(0, 0, 0, 0);
+    buttonLayout->setSpacing(5);
+    QPushButton *addBtn = new QPushButton("新建");
+    buttonLayout->addWidget(addBtn);
+    buttonLayout->addWidget(layerDeleteBtn);
+    buttonLayout->addWidget(layerUpBtn);
+    buttonLayout->addWidget(layerDownBtn);
+    layout->addWidget(buttons);
+
+    QWidget *options = new QWidget();
+    QHBoxLayout *optionLayout = new QHBoxLayout(options);
+    optionLayout->setContentsMargins(0, 0, 0, 0);
+    layerLockBox->setToolTip("锁定的图层不能绘制、擦除和编辑文本");
+    optionLayout->addWidget(layerLockBox);
+    optionLayout->addWidget(new QLabel("不透明度:"));
+    layerOpacitySlider->setRange(0, 100);
+    layerOpacitySlider->setValue(100);
+    optionLayout->addWidget(layerOpacitySlider);
+    layout->addWidget(options);
+    dock->setWidget(panel);
+    addDockWidget(Qt::RightDockWidgetArea, dock);
+
+    connect(addBtn, &QPushButton::clicked, this, &MainWindow::addLayer);
+    connect(layerDeleteBtn, &QPushButton::clicked, this, &MainWindow::deleteLayer);
+    connect(layerUpBtn, &QPushButton::clicked, this, &MainWindow::moveLayerUp);
+    connect(layerDownBtn, &QPushButton::clicked, this, &MainWindow::moveLayerDown);
+    connect(layerList, &QListWidget::currentRowChanged, this, &MainWindow::onLayerRowChanged);
+    connect(layerList, &QListWidget::itemChanged, this, &MainWindow::onLayerItemChanged);
+    connect(layerLockBox, &QCheckBox::toggled, this, &MainWindow::setLayerLocked);
+    connect(layerOpacitySlider, &QSlider::valueChanged, this, &MainWindow::setLayerOpacity);
+    refreshLayerList();
+}
+
+LayerItem *MainWindow::layerAt(int row) const {
+    const QList<LayerItem*> layers = LayerItem::layers(scene);
+    return (row >= 0 && row < layers.size()) ? layers.at(layers.size() - 1 - row) : nullptr;
+}
+
+// 撤回/重做可能增删图层，每次历史变化后都按场景重建（图层数很少）
+void MainWindow::refreshLayerList() {
+    refreshingLayers = true;
+    layerList->clear();
+    const QList<LayerItem*> layers = LayerItem::layers(scene);
+    LayerItem *current = view->activeLayer();
+    for (int i = layers.size() - 1; i >= 0; --i) {
+        QListWidgetItem *row = new QListWidgetItem(layers[i]->name(), layerList);
+        row->setFlags(row->flags() | Qt::ItemIsEditable | Qt::ItemIsUserCheckable);
+        row->setCheckState(layers[i]->isVisible() ? Qt::Checked : Qt::Unchecked);
+        if (layers[i] == current) layerList->setCurrentItem(row);
+    }
+    syncLayerControls();
+    refreshingLayers = false;
+}
+
+void MainWindow::syncLayerControls() {
+    const bool wasRefreshing = refreshingLayers;
+    refreshingLayers = true;
+    LayerItem *layer = view->activeLayer();
+    const int row = layerList->currentRow();
+    layerLockBox->setChecked(layer && layer->isLocked());
+    layerOpacitySlider->setValue(layer ? qRound(layer->opacity() * 100) : 100);
+    layerDeleteBtn->setEnabled(layerList->count() > 1);
+    layerUpBtn->setEnabled(row > 0);
+    layerDownBtn->setEnabled(row >= 0 && row < layerList->count() - 1);
+    refreshingLayers = wasRefreshing;
+}
+
+void MainWindow::onLayerRowChanged(int row) {
+    if (refreshingLayers || row < 0) return;
+    view->setCurrentLayer(layerAt(row));
+    syncLayerControls();
+}
+
+void MainWindow::onLayerItemChanged(QListWidgetItem *row) {
+    if (refreshingLayers) return;
+    LayerItem *layer = layerAt(layerList->row(row));
+    if (!layer) return;
+    layer->setName(row->text());
+    layer->setVisible(row->checkState() == Qt::Checked);
+    view->recordLayerState(layer);
+    if (autosave) autosave->markLayersChanged();
+    if (sync) sync->markLayersChanged();
+}
+
+void MainWindow::setLayerLocked(bool locked) {
+    if (refreshingLayers) return;
+    if (LayerItem *layer = view->activeLayer()) {
+        layer->setLocked(locked);
+        view->recordLayerState(layer);
+    }
+    if (autosave) autosave->markLayersChanged();
+    if (sync) sync->markLayersChanged();
+}
+
+// 不透明度作用于合成后的整层，只需重新贴图，不重画图层缓存
+void MainWindow::setLayerOpacity(int percent) {
+    if (refreshingLayers) return;
+    if (LayerItem *layer = view->activeLayer()) {
+        layer->setOpacity(percent / 100.0);
+        view->recordLayerState(layer);
+    }
+    if (autosave) autosave->markLayersChanged();
+    if (sync) sync->markLayersChanged();
+}
+
+// 新图层放在最上面并成为当前图层；撤回时连同其中的栅格一起移出场景
+void MainWindow::addLayer() {
+    view->cancelDrawing();
+    view->recordCommand(InputTrace::AddLayer);
+    LayerItem *layer = LayerItem::addTop(scene, ++layerSerial);
+    view->setCurrentLayer(layer);
+    journal->record(JournalEntry::layerAdded(layer));
+    statusBar()->showMessage(QString("已新建%1 | 历史: %2 项").arg(layer->name()).arg(journal->undoCount()));
+}
+
+// 删除的图层连同其中的图形一起交给历史保管，撤回时整层放回
+void MainWindow::deleteLayer() {
+    LayerItem *layer = view->activeLayer();
+    if (!layer || LayerItem::layers(scene).size() <= 1) return;
+    view->cancelDrawing();
+    view->recordCommand(InputTrace::DeleteLayer);
+    view->detachBatches();
+    loader->finish();
+    const QString name = layer->name();
+    scene->removeItem(layer);
+    journal->record(JournalEntry::layerDeleted(layer)); // 之后图层归历史所有，可能已被淘汰释放
+    statusBar()->showMessage(QString("已删除%1 | 历史: %2 项").arg(name).arg(journal->undoCount()));
+}
+
+void MainWindow::moveLayerUp() {
+    moveLayer(1);
+}
+
+void MainWindow::moveLayerDown() {
+    moveLayer(-1);
+}
+
+void MainWindow::moveLayer(int step) {
+    LayerItem *layer = view->activeLayer();
+    if (!layer || !LayerItem::swapWithNeighbour(layer, step)) return;
+    view->recordCommand(step > 0 ? InputTrace::RaiseLayer : InputTrace::LowerLayer);
+    view->setCurrentLayer(layer);
+    refreshLayerList();
+    if (autosave) autosave->markLayersChanged();
+    if (sync) sync->markLayersChanged();
+}
+
+void MainWindow::onDrawingBlocked(const QString &reason) {
+    statusBar()->showMessage(reason);
+}
+
+void MainWindow::onSelectionEdited(const JournalEntry &entry) {
+    journal->record(entry);
+    statusBar()->showMessage(QString("已%1 %2 项 | 历史: %3 项")
+                                 .arg(entry.label).arg(view->selection().size())
+                                 .arg(journal->undoCount()));
+}
+
 // 鼠标移动更新状态栏
 void MainWindow::onMouseMoved(QPointF scenePos) {
-    QString toolName = toolComboBox->currentText();
-    statusBar()->showMessage(QString("工具: %1 | 坐标: (%.1f, %.1f) | 颜色: %2 | 历史: %3 项")
-                                 .arg(toolName)
-                                 .arg(scenePos.x())
-                                 .arg(scenePos.y())
+    // 只记录位置，状态栏由定时器节流刷新，移动的热路径上不做字符串格式化
+    lastMousePos = scenePos;
+    if (!statusTimer->isActive()) statusTimer->start();
+}
+
+// 节流刷新状态栏坐标
+void MainWindow::updateCursorStatus() {
+    statusBar()->showMessage(QString("工具: %1 | 坐标: (%2, %3) | 颜色: %4 | 历史: %5 项")
+                                 .arg(toolComboBox->currentText())
+                                 .arg(lastMousePos.x(), 0, 'f', 1)
+                                 .arg(lastMousePos.y(), 0, 'f', 1)
                                  .arg(currentColor.name())
-                                 .arg(drawingStack.size()));
+                                 .arg(journal->undoCount()));
 }
 
 // 鼠标点击事件
 void MainWindow::onMouseClicked(QPointF scenePos) {
     if (currentTool == DrawingTool::TEXT && !currentText.isEmpty()) {
-        statusBar()->showMessage(QString("在坐标 (%.1f, %.1f) 添加文本: %1 | 历史: %2 项")
-                                     .arg(scenePos.x())
-                                     .arg(scenePos.y())
+        statusBar()->showMessage(QString("在坐标 (%1, %2) 添加文本: %3 | 历史: %4 项")
+                                     .arg(scenePos.x(), 0, 'f', 1)
+                                     .arg(scenePos.y(), 0, 'f', 1)
                                      .arg(currentText)
-                                     .arg(drawingStack.size()));
+                                     .arg(journal->undoCount()));
     }
 }
 
@@ -563,32 +1892,203 @@ void MainWindow::onToolSelected(int index) {
     bool isTextTool = (currentTool == DrawingTool::TEXT);
     textInput->setEnabled(isTextTool);
     fontSizeSlider->setEnabled(isTextTool);
+    fillToleranceSpinBox->setEnabled(currentTool == DrawingTool::FILL);
+    brushComboBox->setEnabled(currentTool == DrawingTool::BRUSH);
 
     statusBar()->showMessage(QString("工具已切换至: %1 | 历史: %2 项")
-                                 .arg(toolName).arg(drawingStack.size()));
+                                 .arg(toolName).arg(journal->undoCount()));
 }
 
 // 保存图片
 void MainWindow::saveAsImage() {
-    QString filter = "PNG图片 (*.png);;JPG图片 (*.jpg);;BMP图片 (*.bmp)";
-    QString filePath = QFileDialog::getSaveFileName(this, "保存图片", QDir::homePath(), filter);
+    QString filter = "PNG图片 (*.png);;JPG图片 (*.jpg);;BMP图片 (*.bmp);;SVG矢量图 (*.svg);;PDF文档 (*.pdf);;彩虹画板文档 (*.chb)";
+    QString selectedFilter;
+    QString filePath = QFileDialog::getSaveFileName(this, "保存图片", QDir::homePath(), filter, &selectedFilter);
     if (filePath.isEmpty()) return;
 
-    if (!filePath.endsWith(".png", Qt::CaseInsensitive) &&
-        !filePath.endsWith(".jpg", Qt::CaseInsensitive) &&
-        !filePath.endsWith(".bmp", Qt::CaseInsensitive)) {
-        filePath += ".png";
+    // 文档保存为可再次编辑的图形
+    if (filePath.endsWith(".chb", Qt::CaseInsensitive) || selectedFilter.contains("*.chb")) {
+        if (!filePath.endsWith(".chb", Qt::CaseInsensitive)) filePath += ".chb";
+        saveDocument(filePath);
+        return;
+    }
+    // 矢量格式逐个图形写出，不经过栅格化
+    const bool svg = filePath.endsWith(".svg", Qt::CaseInsensitive) || selectedFilter.contains("*.svg");
+    const bool pdf = !svg && (filePath.endsWith(".pdf", Qt::CaseInsensitive) || selectedFilter.contains("*.pdf"));
+    if (svg || pdf) {
+        if (svg && !filePath.endsWith(".svg", Qt::CaseInsensitive)) filePath += ".svg";
+        if (pdf && !filePath.endsWith(".pdf", Qt::CaseInsensitive)) filePath += ".pdf";
+    } else {
+        if (exporter->isRunning()) return;
+        if (!filePath.endsWith(".png", Qt::CaseInsensitive) &&
+            !filePath.endsWith(".jpg", Qt::CaseInsensitive) &&
+            !filePath.endsWith(".bmp", Qt::CaseInsensitive)) {
+            filePath += ".png";
+        }
     }
 
-    QPixmap pixmap(scene->sceneRect().size().toSize());
-    pixmap.fill(Qt::white);
-    QPainter painter(&pixmap);
-    scene->render(&painter);
+    // 画布没有边界，导出范围取全部内容的包围盒；空画布导出当前可见区域
+    view->cancelDrawing();
+    loader->finish();
+    QRectF source = scene->itemsBoundingRect();
+    if (source.isEmpty()) {
+        source = view->mapToScene(view->viewport()->rect()).boundingRect();
+    } else {
+        source = source.adjusted(-8, -8, 8, 8).toAlignedRect();
+    }
+
+    if (svg || pdf) {
+        QElapsedTimer clock;
+        clock.start();
+        QString error;
+        int written = 0;
+        const QList<LayerItem*> layers = LayerItem::layers(scene);
+        const bool saved = svg ? VectorExport::exportSvg(layers, source, filePath, &error, &written)
+                               : VectorExport::exportPdf(layers, source, filePath, &error, &written);
+        if (saved) {
+            statusBar()->showMessage(QString("已导出至: %1（%2 个图元，用时 %3 ms）")
+                                         .arg(filePath).arg(written).arg(clock.elapsed()));
+        } else {
+            QMessageBox::warning(this, "导出失败", QString("无法导出: %1").arg(error));
+        }
+        return;
+    }
+
+    // 缩放倍数决定输出分辨率（1 倍为 96 DPI）
+    bool ok = false;
+    const double scale = QInputDialog::getDouble(this, "导出设置",
+                                                 QString("缩放倍数（1 倍 = %1×%2 像素，96 DPI）:")
+                                                     .arg(qCeil(source.width()))
+                                                     .arg(qCeil(source.height())),
+                                                 1.0, 0.1, 32.0, 2, &ok);
+    if (!ok) return;
+
+    ExportOptions options;
+    options.filePath = filePath;
+    options.scale = scale;
+    if (!exporter->start(scene, source, options)) return;
+
+    const QSize size = ImageExporter::outputSize(source, scale);
+    saveBtn->setEnabled(false);
+    exportProgress = new QProgressDialog(QString("正在导出 %1×%2 像素...").arg(size.width()).arg(size.height()),
+                                         "取消", 0, 0, this);
+    exportProgress->setWindowTitle("导出图片");
+    exportProgress->setMinimumDuration(300);
+    exportProgress->setAutoClose(false);
+    exportProgress->setAutoReset(false);
+    connect(exportProgress, &QProgressDialog::canceled, exporter, &ImageExporter::cancel);
+    statusBar()->showMessage(QString("正在导出: %1").arg(filePath));
+    exportPath = filePath;
+}
+
+// 导出进度
+void MainWindow::onExportProgress(int done, int total) {
+    view->metrics()->setExportProgress(done, total);
+    if (!exportProgress) return;
+    exportProgress->setMaximum(total);
+    exportProgress->setValue(done);
+}
 
-    if (pixmap.save(filePath)) {
+// 导出结束
+void MainWindow::onExportFinished(bool ok, const QString &message) {
+    view->metrics()->setExportProgress(0, 0);
+    if (exportProgress) {
+        exportProgress->disconnect(exporter);
+        exportProgress->deleteLater();
+        exportProgress = nullptr;
+    }
+    saveBtn->setEnabled(true);
+    if (ok) {
         statusBar()->showMessage(QString("图片已保存至: %1 | 历史: %2 项")
-                                     .arg(filePath).arg(drawingStack.size()));
+                                     .arg(exportPath).arg(journal->undoCount()));
+    } else if (message.isEmpty()) {
+        statusBar()->showMessage("导出已取消");
+    } else {
+        statusBar()->showMessage(message);
+        QMessageBox::warning(this, "保存失败", message);
+    }
+}
+
+// 保存文档：按层叠次序逐条写出
+void MainWindow::saveDocument(const QString &filePath) {
+    QElapsedTimer clock;
+    clock.start();
+    view->cancelDrawing();
+    loader->finish();
+
+    QString error;
+    int written = 0;
+    if (ChbDocument::save(filePath, LayerItem::layers(scene), &error, &written)) {
+        statusBar()->showMessage(QString("文档已保存至: %1（%2 个图形，用时 %3 ms）")
+                                     .arg(filePath).arg(written).arg(clock.elapsed()));
     } else {
-        QMessageBox::warning(this, "保存失败", "无法保存图片，请检查路径是否可写！");
+        QMessageBox::warning(this, "保存失败", QString("无法保存文档: %1").arg(error));
+    }
+}
+
+// 打开文档：替换当前画布，图形按可见区域优先分批创建
+void MainWindow::openDocument() {
+    const QString filePath = QFileDialog::getOpenFileName(this, "打开文档", QDir::homePath(),
+                                                          "彩虹画板文档 (*.chb)");
+    if (filePath.isEmpty()) return;
+    const QList<LayerItem*> layers = LayerItem::layers(scene);
+    if ((layers.size() > 1 || (!layers.isEmpty() && !layers.first()->isEmpty()))
+        && QMessageBox::question(this, "打开文档", "打开文档将替换当前画布且不能撤回，是否继续？",
+                                 QMessageBox::Yes | QMessageBox::No) != QMessageBox::Yes) {
+        return;
+    }
+
+    QElapsedTimer clock;
+    clock.start();
+    view->cancelDrawing();
+    loader->finish();
+    QString error;
+    if (!loader->open(filePath, &error)) {
+        QMessageBox::warning(this, "打开失败", QString("无法打开文档: %1").arg(error));
+        return;
+    }
+
+    // 先丢弃历史（释放其保管的移出场景的图形和图层），再删除场景中的图层
+    view->detachBatches();
+    journal->clear();
+    if (autosave) autosave->suspend();          // 加载完成后重新做快照
+    if (sync) sync->suspend();                  // 加载完成后以打开的文档升版次同步给其他实例
+    QList<QGraphicsItem*> oldItems;
+    foreach (QGraphicsItem *item, scene->items()) {
+        if (!item->parentItem()) oldItems.append(item);
+    }
+    qDeleteAll(oldItems);
+
+    // 先确定索引深度和画布范围，再把视图移到内容中心，批量插入时不再重建索引
+    const int total = loader->recordCount();
+    view->tuneSceneIndex(total);
+    if (!loader->contentBounds().isEmpty()) {
+        view->ensureCanvasCovers(loader->contentBounds());
+        view->centerOn(loader->contentBounds().center());
     }
+    loader->start(view->reserveZ(total), view->mapToScene(view->viewport()->rect()).boundingRect());
+    const QList<LayerItem*> loaded = LayerItem::layers(scene);
+    view->setCurrentLayer(loaded.isEmpty() ? nullptr : loaded.last());
+    layerSerial = loaded.size();
+    refreshLayerList();
+    statusBar()->showMessage(QString("已打开 %1：%2 条记录，首屏用时 %3 ms")
+                                 .arg(filePath).arg(total).arg(clock.elapsed()));
+}
+
+// 缩放变化
+void MainWindow::onZoomChanged(qreal zoom) {
+    statusBar()->showMessage(QString("缩放: %1%（Ctrl+滚轮缩放，中键拖动平移）").arg(qRound(zoom * 100)));
+}
+
+// 文档加载进度
+void MainWindow::onDocumentProgress(int loaded, int total) {
+    statusBar()->showMessage(QString("正在加载文档: %1 / %2").arg(loaded).arg(total));
+}
+
+// 文档加载完成
+void MainWindow::onDocumentLoaded(int loaded) {
+    if (autosave) autosave->resume();
+    if (sync) sync->resume();
+    statusBar()->showMessage(QString("文档加载完成: %1 条记录 | 历史: %2 项")
+                                 .arg(loaded).arg(journal->undoCount()));
 }
@@ -15,12 +15,36 @@
 #include <QMap>
 #include <QLineEdit>
 #include <QGraphicsTextItem>
-#include <QStack>
+
 #include <QPainterPath>
 #include <QGraphicsPathItem>
 #include <QVector>
 #include <QGraphicsPolygonItem>
 #include <QPolygonF>
+#include <QSpinBox>
+#include "eraser.h"
+#include "undojournal.h"
+#include "perfmetrics.h"
+#include "inputtrace.h"
+#include "selector.h"
+
+class ToolHandler;
+class StrokeItem;
+class QTimer;
+class TileLayer;
+class ImageExporter;
+class QProgressDialog;
+class QAction;
+class DocumentLoader;
+class Autosave;
+class LiveSync;
+class StaticTextItem;
+class TextEditItem;
+class PrimitiveBatch;
+class LayerItem;
+class QListWidget;
+class QListWidgetItem;
+class QCheckBox;
 
 // 绘图工具枚举
 enum class DrawingTool {
@@ -29,7 +53,19 @@ enum class DrawingTool {
     RECTANGLE,  // 矩形
     CIRCLE,     // 圆形
     TRIANGLE,   // 三角形
-    TEXT        // 文本
+    TEXT,       // 文本
+    FILL,       // 填充
+    BRUSH,      // 笔刷
+    SELECT      // 选择
+};
+
+// 输入合并统计：每帧收到的移动采样数，以及实际交给工具处理和被合并掉的数量
+struct InputFrameStats {
+    int samples = 0;             // 本帧收到的采样
+    int processed = 0;           // 交给工具处理的采样
+    int coalesced = 0;           // 被合并丢弃的采样
+    quint64 totalProcessed = 0;  // 累计处理
+    quint64 totalCoalesced = 0;  // 累计合并
 };
 
 // 自定义绘图视图
@@ -37,33 +73,159 @@ class DrawingView : public QGraphicsView {
     Q_OBJECT
 public:
     explicit DrawingView(QGraphicsScene *scene, QWidget *parent = nullptr);
+    ~DrawingView();
+
+    // 供工具处理器使用
+    QPen toolPen() const;                    // 当前工具画笔
+    QColor toolColor() const;                // 当前绘制颜色
+    QString toolText() const { return currentText; }
+    int toolFontSize() const { return currentFontSize; }
+    void addLiveItem(QGraphicsItem *item);   // 加入场景（预览/绘制中）
+    qreal reserveZ(int count);               // 预留一段层叠次序（加载文档用），返回起始值
+    void commitItem(QGraphicsItem *item);    // 绘制完成，发出 itemDrawn（批量模式下形状并入批量层）
+    void discardItem(QGraphicsItem *item);   // 放弃并删除未提交的图形
+    void simplifyStroke(StrokeItem *stroke); // 提交后的笔迹在后台简化
+    void eraseAlong(const QVector<QPointF> &trail, qreal radius, QGraphicsItem *ignore); // 沿轨迹擦除
+    InputFrameStats inputFrameStats() const { return frameStats; } // 最近一帧的输入合并统计
+    qreal zoom() const { return transform().m11(); }  // 当前缩放倍数
+    void ensureCanvasCovers(const QRectF &rect);  // 画布扩展到覆盖指定区域（加倍增长，减少索引重建）
+    void tuneSceneIndex(int expectedItems);      // 按预计图形数设置 BSP 深度
+    PerfMetrics *metrics() { return &perfMetrics; }   // 性能计数器
+    PerfSnapshot perfSnapshot() const;           // 当前性能计数（含场景图形数）
+    bool isHudVisible() const;                   // 性能面板是否显示
+    bool startRecording(const QString &filePath, QString *error); // 开始录制输入轨迹（先写入当前工具状态）
+    void stopRecording();                        // 结束录制
+    bool isRecording() const { return recorder.isRecording(); }
+    void recordCommand(int type);                // 录制撤回/重做/清空等窗口命令（InputTrace::RecordType）
+    void recordLayerState(LayerItem *layer);     // 录制图层的可见、锁定和不透明度
+    // 场景坐标的左键按下/移动/释放：鼠标事件和轨迹回放都经由这里，录制时写入轨迹
+    void pointerPress(const QPointF &scenePos);
+    void pointerMove(const QPointF &scenePos);
+    void pointerRelease(const QPointF &scenePos);
+    bool beginTextEdit(const QPointF &scenePos); // 把该位置最上层的静态文本临时换成可编辑文本
+    bool isEditingText() const { return textEditor != nullptr; }
+    bool isIdle() const;                     // 没有进行中的绘制、拖动、平移或文本编辑（场景里只有已提交的内容）
+    bool isPrimitiveBatching() const { return batchPrimitives; }
+    void fillAt(const QPointF &scenePos);    // 填充该位置所在的可见连通区域
+    void setNextFillSource(const QRectF &source, const QSize &size); // 回放：下一次填充按录制的范围栅格化
+    int toolBrushKind() const { return brushKind; }   // 当前笔刷种类（BrushEngine::Kind）
+    qreal toolBrushDiameter() const { return penWidth * 4; } // 笔刷直径随画笔粗细
+    qreal pointerPressure() const { return pressure; } // 当前笔压（0-1，鼠标为 1）
+    void setPointerPressure(qreal value);    // 设置笔压（数位板事件和轨迹回放用），录制时写入轨迹
+    void detachBatches();                    // 不再向现有批量层追加（清空画布、打开文档时，旧层交给历史或被删除）
+    LayerItem *activeLayer();                // 当前图层（原图层已不在场景中时取同一位置的图层）
+    void setCurrentLayer(LayerItem *layer);  // 切换当前图层（放弃进行中的绘制）
+    // 选择：只作用于当前图层，移动、删除、改样式都作为一条历史记录通过 selectionEdited 发出
+    Selection selection() const { return selected; }
+    void setSelection(const Selection &selection); // 替换选中内容（拖动中先放弃拖动）
+    Selection pickAt(const QPointF &scenePos);   // 当前图层中该位置最上层的内容（容差为屏幕上 4 像素）
+    Selection pickIn(const QRectF &sceneRect);   // 当前图层中与区域接触的内容
+    void setRubberBand(const QRectF &sceneRect); // 框选范围（空为不显示）
+    void beginMoveSelection();               // 开始拖动选中内容
+    void moveSelection(const QPointF &delta); // 拖动（批量图元在第一次位移时取出为独立形状）
+    void finishMoveSelection();              // 结束拖动，有位移时记录历史
+    void cancelMoveSelection();              // 放弃拖动，内容回到原位
 signals:
     void mouseMoved(QPointF scenePos);       // 鼠标移动信号
     void mouseClicked(QPointF scenePos);     // 鼠标点击信号
-    void itemDrawn(QGraphicsItem *item);     // 图形绘制完成信号
+    void itemDrawn(QGraphicsItem *item, int primitive = -1); // 图形绘制完成（primitive 不为 -1 时是 item 这个批量层中的图元）
+    void itemsErased(const EraseResult &result); // 擦除完成信号
+    void strokeSimplified(int pointsBefore, int pointsAfter, qreal maxDeviation); // 笔迹简化完成
+    void strokeReshaped(StrokeItem *stroke); // 已提交的笔迹几何被简化结果替换
+    void liveItemAdded(QGraphicsItem *item); // 未提交的图形加入场景（实时同步发预览用）
+    void liveItemEnded(QGraphicsItem *item); // 未提交的图形即将提交或放弃
+    void zoomChanged(qreal zoom);            // 缩放倍数变化
+    void textEdited(QGraphicsItem *before, QGraphicsItem *after); // 文本编辑完成（after 为空表示文字被删空）
+    void regionFilled(qint64 pixels, int rects, qint64 elapsedUs); // 填充完成（像素数、轮廓矩形数、扫描用时）
+    void drawingBlocked(const QString &reason); // 当前图层锁定或隐藏，拒绝了一次绘制
+    void selectionChanged(int count);        // 选中内容变化（选中的项数）
+    void selectionEdited(const JournalEntry &entry); // 选中内容被移动、删除或改样式
 public slots:
     void setPenColor(const QColor &color);   // 设置画笔颜色
     void setPenWidth(int width);             // 设置画笔粗细
     void setEraserMode(bool isEraser);       // 切换橡皮擦模式
     void setCurrentTool(DrawingTool tool);   // 设置当前工具
     void setTextProperties(const QString &text, int fontSize); // 设置文本属性
+    void setStrokeSimplification(int mode);  // 设置笔迹简化模式（StrokeSimplifier::Mode）
+    void setInputCoalescing(bool enabled);   // 是否按显示帧合并鼠标移动
+    void setPrimitiveBatching(bool enabled); // 直线/矩形/圆形/三角形是否放进批量层
+    void setFillTolerance(int tolerance);    // 填充的颜色容差（每通道 0-255）
+    void setBrushKind(int kind);             // 设置笔刷种类（BrushEngine::Kind）
+    void flushPendingMoves();                // 立即处理缓冲的移动采样
+    void clearSelection();                   // 取消选择
+    void deleteSelection();                  // 删除选中内容
+    void restyleSelection();                 // 选中内容改用当前颜色和粗细
+
+    void cancelDrawing();                    // 放弃进行中的绘制（清空画布前调用）
+    void zoomBy(qreal factor);               // 以视图中心为基准缩放
+    void resetZoom();                        // 恢复 100%
+    void setHudVisible(bool visible);        // 显示/隐藏性能面板
+    void refreshHud();                       // 刷新性能面板内容
 protected:
     void mousePressEvent(QMouseEvent *event) override;
     void mouseMoveEvent(QMouseEvent *event) override;
     void mouseReleaseEvent(QMouseEvent *event) override;
+    void tabletEvent(QTabletEvent *event) override;           // 只记下笔压，由 Qt 合成鼠标事件继续处理
+    void wheelEvent(QWheelEvent *event) override;             // Ctrl+滚轮缩放
+    void scrollContentsBy(int dx, int dy) override;           // 滚动时扩展画布
+    void resizeEvent(QResizeEvent *event) override;
+    void paintEvent(QPaintEvent *event) override;             // 统计帧时间和输入延迟
+    void drawForeground(QPainter *painter, const QRectF &rect) override; // 选中框和框选范围
 private:
-    bool isDrawing;              // 是否正在绘图
-    QPointF lastPoint;           // 上一次鼠标位置
+    ToolHandler *activeHandler() const {
+        return isEraserMode ? eraserHandler : toolHandlers[static_cast<int>(currentTool)];
+    }
+    void applyZoom(qreal factor);            // 缩放（限制在允许范围内）
+    void growCanvasToView();                 // 画布至少覆盖可见区域外一屏
+    void finishTextEdit(bool accepted);      // 结束文本编辑，换回静态文本
+    void updatePressure(QMouseEvent *event); // 真实鼠标笔压为 1，数位板合成的鼠标事件取最近的笔压
+    PrimitiveBatch *batchFor(int kind);      // 某种形状当前的批量层（没有则创建）
+    bool selectionEditable();                // 有选中内容且当前图层未锁定
+    QList<QGraphicsItem*> extractPrimitives(const QPen *pen); // 选中的批量图元取出为独立形状（可换画笔），原图元标记移除
+
     QColor currentColor;         // 当前画笔颜色
     int penWidth;                // 画笔粗细
     bool isEraserMode;           // 是否为橡皮擦模式
-    QColor lastColor;            // 切换橡皮擦前的颜色
     DrawingTool currentTool;     // 当前绘图工具
-    QGraphicsItem *tempItem;     // 临时绘图项（预览用）
     QString currentText;         // 当前文本内容
     int currentFontSize;         // 当前字体大小
-    QPainterPath currentPath;    // 画笔路径
-    QVector<QPointF> trianglePoints; // 三角形顶点
+    QVector<ToolHandler*> toolHandlers; // 工具处理器（按 DrawingTool 顺序）
+    ToolHandler *eraserHandler;  // 橡皮擦处理器（橡皮擦模式下替代当前工具）
+    qreal nextZ;                 // 新图形的层叠次序，撤回恢复时保持原位置
+    LayerItem *currentLayer;     // 当前图层（绘制和擦除都只作用于它）
+    int currentLayerIndex;       // 当前图层从下往上的位置
+    int simplifyMode;            // 笔迹简化模式
+    bool coalesceInput;          // 是否按帧合并输入
+    QTimer *frameTimer;          // 帧节拍定时器
+    QVector<QPointF> pendingMoves; // 本帧缓冲的移动采样（只增不缩，避免反复分配）
+    int pendingMoveCount;        // 本帧缓冲的采样数
+    InputFrameStats frameStats;  // 输入合并统计
+    bool panning;                // 是否正在中键平移
+    QPoint lastPanPos;           // 平移的上一个位置（视图坐标）
+    bool growingCanvas;          // 正在扩展画布（防止 setSceneRect 引起的滚动重入）
+    int indexedItems;            // 估计的图形数
+    int indexTunedFor;           // 上次设置 BSP 深度时的图形数
+    PerfMetrics perfMetrics;     // 性能计数
+    QLabel *hudLabel;            // 性能面板（视图的子控件，不随视口内容滚动）
+    QTimer *hudTimer;            // 性能面板刷新定时器
+    TraceRecorder recorder;      // 输入轨迹录制
+    StaticTextItem *editedText;  // 正在编辑的静态文本（编辑期间隐藏）
+    TextEditItem *textEditor;    // 编辑中的临时文本项
+    bool batchPrimitives;        // 是否使用批量层
+    QVector<PrimitiveBatch*> batches; // 按 ShapeItem::Kind 的当前批量层
+    int fillTolerance;           // 填充容差
+    QRectF nextFillSource;       // 回放时下一次填充的场景范围（为空时取视口）
+    QSize nextFillSize;          // 及其栅格大小
+    int brushKind;               // 笔刷种类
+    qreal pressure;              // 当前笔压
+    qreal tabletPressure;        // 最近一次数位板事件的笔压
+    Selection selected;          // 选中内容
+    QRectF selectedBounds;       // 选中内容的场景包围盒
+    QRectF rubberBand;           // 框选范围
+    bool movingSelection;        // 正在拖动选中内容
+    QPointF moveOffset;          // 本次拖动的累计位移
+    QList<QGraphicsItem*> extractedShapes; // 本次拖动中从批量层取出的形状
+    QVector<PrimitiveRef> extractedFrom;   // 它们原来的批量图元
 };
 
 // 主窗口类
@@ -72,6 +234,8 @@ class MainWindow : public QMainWindow {
 public:
     MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
+    bool startAutosave(const QString &directory = QString()); // 开始自动保存（先询问是否恢复上次未正常退出时的内容），默认目录在应用数据目录下
+    bool startSync(const QString &board, QString *error); // 加入实时同步：本机画板名，或局域网的“地址:端口”/“:端口”（见 LiveSync::start）
 private slots:
     void initToolBar();                          // 初始化工具栏
     void changeColor(int value);                 // 色相滑块改变颜色
@@ -86,11 +250,54 @@ private slots:
     void onTextChanged(const QString &text);     // 文本输入变化
     void onFontSizeChanged(int size);            // 字体大小变化
     void onUndoClicked();                        // 撤回操作
-    void onItemDrawn(QGraphicsItem *item);       // 接收绘制完成的图形
+    void onRedoClicked();                        // 重做操作
+    void onHistoryChanged();                     // 历史变化时刷新按钮
+    void onItemDrawn(QGraphicsItem *item, int primitive); // 接收绘制完成的图形或批量图元
+    void onItemsErased(const EraseResult &result); // 接收擦除结果
+    void setUndoDepth(int depth);                // 设置撤回深度
+    void setHistoryBudget(int megabytes);        // 设置历史内存预算
+    void onExportProgress(int done, int total);  // 导出进度
+    void onExportFinished(bool ok, const QString &message); // 导出结束
+    void openDocument();                         // 打开文档
+    void onDocumentProgress(int loaded, int total); // 文档加载进度
+    void onDocumentLoaded(int loaded);           // 文档加载完成
+    void onZoomChanged(qreal zoom);              // 显示缩放倍数
+    void updateCursorStatus();                   // 节流刷新状态栏坐标
+    void onStrokeSimplified(int pointsBefore, int pointsAfter, qreal maxDeviation); // 显示简化统计
+    void toggleRecording();                      // 开始/结束录制输入轨迹
+    void replayTrace(bool asFastAsPossible);     // 回放输入轨迹
+    void onReplayCommand(int type);              // 执行回放中的窗口命令
+    void onReplayFinished(quint64 records, qint64 elapsedMs); // 回放结束
+    void editTextUnderCursor();                  // 编辑光标处的文本
+    void onTextEdited(QGraphicsItem *before, QGraphicsItem *after); // 记录文本编辑
+    void onRegionFilled(qint64 pixels, int rects, qint64 elapsedUs); // 显示填充统计
+    void addLayer();                             // 在最上面新建图层（可撤回）
+    void deleteLayer();                          // 删除当前图层（可撤回，至少保留一个）
+    void moveLayerUp();                          // 当前图层上移一层
+    void moveLayerDown();                        // 当前图层下移一层
+    void refreshLayerList();                     // 按场景中的图层重建图层列表
+    void onLayerRowChanged(int row);             // 切换当前图层
+    void onLayerItemChanged(QListWidgetItem *row); // 图层改名或切换可见
+    void setLayerLocked(bool locked);            // 锁定/解锁当前图层
+    void setLayerOpacity(int percent);           // 当前图层不透明度
+    void onDrawingBlocked(const QString &reason); // 当前图层不能绘制时提示
+    void onSelectionEdited(const JournalEntry &entry); // 记录选择工具的编辑
+    void toggleSync();                           // 加入/退出实时同步
+    void onSyncCanvasReplaced();                 // 远端替换了全部图层
+    void onSyncStopped(const QString &reason);   // 同步被动结束
 private:
     void createColorButtons();                   // 创建颜色按钮
     QWidget* createToolRow1();                   // 创建工具栏第一行
     QWidget* createToolRow2();                   // 创建工具栏第二行
+    void saveDocument(const QString &filePath);  // 保存为文档
+    void initEditMenu();                         // 创建“编辑”菜单
+    void initDebugMenu();                        // 创建“调试”菜单
+    void initSyncMenu();                         // 创建“协作”菜单
+    void clearCanvasNow();                       // 清空画布（不询问）
+    void initLayerDock();                        // 创建图层面板
+    LayerItem *layerAt(int row) const;           // 图层列表第 row 行对应的图层（列表从上到下）
+    void moveLayer(int step);                    // 与相邻图层交换次序（step 为 1 上移、-1 下移）
+    void syncLayerControls();                    // 锁定、不透明度和按钮跟随当前图层
 
     QGraphicsScene *scene;                       // 绘图场景
     DrawingView *view;                           // 自定义绘图视图
@@ -101,8 +308,15 @@ private:
     QSlider *widthSlider;                        // 粗细滑块
     QPushButton *eraserBtn;                      // 橡皮擦按钮
     QPushButton *clearBtn;                       // 清空按钮
+    QPushButton *openBtn;                        // 打开文档按钮
     QPushButton *saveBtn;                        // 保存按钮
     QPushButton *undoBtn;                        // 撤回按钮
+    QPushButton *redoBtn;                        // 重做按钮
+    QComboBox *simplifyComboBox;                 // 笔迹简化模式
+    QSpinBox *undoDepthSpinBox;                  // 撤回深度
+    QSpinBox *historyBudgetSpinBox;              // 历史内存预算（MB）
+    QSpinBox *fillToleranceSpinBox;              // 填充容差
+    QComboBox *brushComboBox;                    // 笔刷种类
     QLabel *colorValueLabel;                     // 色相值显示
     QLabel *widthValueLabel;                     // 粗细值显示
 
@@ -115,7 +329,26 @@ private:
     QString currentText;                         // 当前文本
     int currentFontSize;                         // 当前字体大小
 
-    QStack<QGraphicsItem*> drawingStack;          // 绘制历史栈
+    QListWidget *layerList;                      // 图层列表（最上层在第一行，勾选为可见，可改名）
+    QCheckBox *layerLockBox;                     // 锁定当前图层
+    QSlider *layerOpacitySlider;                 // 当前图层不透明度（%）
+    QPushButton *layerDeleteBtn;                 // 删除图层
+    QPushButton *layerUpBtn;                     // 上移图层
+    QPushButton *layerDownBtn;                   // 下移图层
+    int layerSerial;                             // 新图层的编号
+    bool refreshingLayers;                       // 正在重建列表，忽略列表发出的变化
+    UndoJournal *journal;                        // 撤回/重做日志
+    ImageExporter *exporter;                     // 后台图片导出
+    QProgressDialog *exportProgress;             // 导出进度对话框
+    QString exportPath;                          // 正在导出的文件
+    DocumentLoader *loader;                      // 文档加载
+    Autosave *autosave;                          // 崩溃恢复用的自动保存
+    LiveSync *sync;                              // 本机多实例实时同步
+    QAction *syncAction;                         // “加入画板”菜单项
+    QTimer *statusTimer;                         // 状态栏节流定时器
+    QPointF lastMousePos;                        // 最近的鼠标位置（场景坐标）
+    TraceReplayer *replayer;                     // 输入轨迹回放
+    QAction *recordAction;                       // “录制输入”菜单项
 
     QColor currentColor;                         // 当前颜色
     int penWidth;                                // 当前粗细
@@ -0,0 +1,113 @@
+#include "perfmetrics.h"
+#include <algorithm>
+
+QString PerfSnapshot::toText() const {
+    QString text = QString("帧时间 %1 ms（平均 %2，最大 %3）\n")
+                       .arg(frameMs, 0, 'f', 1)
+                       .arg(frameMsAverage, 0, 'f', 1)
+                       .arg(frameMsMax, 0, 'f', 1);
+    text += QString("输入→绘制 p50 %1 / p95 %2 / p99 %3 ms\n")
+                .arg(latencyP50, 0, 'f', 1)
+                .arg(latencyP95, 0, 'f', 1)
+                .arg(latencyP99, 0, 'f', 1);
+    text += QString("图形 %1 | 历史 %2 项 %3 KB\n")
+                .arg(sceneItems)
+                .arg(historyEntries)
+                .arg(historyBytes / 1024);
+    text += exportTotal > 0 ? QString("导出 %1 / %2").arg(exportDone).arg(exportTotal)
+                            : QString("导出 空闲");
+    return text;
+}
+
+PerfMetrics::PerfMetrics()
+    : frameStartNs(0),
+      pendingInputNs(-1),
+      frameNext(0),
+      latencyNext(0),
+      frames(0),
+      lastFrameMs(0),
+      historyEntries(0),
+      historyBytes(0),
+      exportDone(0),
+      exportTotal(0) {
+    clock.start();
+    frameTimes.reserve(SampleCapacity);
+    latencies.reserve(SampleCapacity);
+}
+
+void PerfMetrics::inputReceived() {
+    if (pendingInputNs < 0) pendingInputNs = clock.nsecsElapsed();
+}
+
+void PerfMetrics::frameStarted() {
+    frameStartNs = clock.nsecsElapsed();
+}
+
+void PerfMetrics::frameFinished() {
+    const qint64 now = clock.nsecsElapsed();
+    lastFrameMs = (now - frameStartNs) / 1e6;
+    push(&frameTimes, &frameNext, lastFrameMs);
+    ++frames;
+    if (pendingInputNs >= 0) {
+        push(&latencies, &latencyNext, (now - pendingInputNs) / 1e6);
+        pendingInputNs = -1;
+    }
+}
+
+void PerfMetrics::setHistory(int entries, qint64 bytes) {
+    historyEntries = entries;
+    historyBytes = bytes;
+}
+
+void PerfMetrics::setExportProgress(int done, int total) {
+    exportDone = done;
+    exportTotal = total;
+}
+
+void PerfMetrics::reset() {
+    frameTimes.resize(0);
+    latencies.resize(0);
+    frameNext = latencyNext = 0;
+    frames = 0;
+    lastFrameMs = 0;
+    pendingInputNs = -1;
+}
+
+void PerfMetrics::push(QVector<qreal> *ring, int *next, qreal value) {
+    if (ring->size() < SampleCapacity) {
+        ring->append(value);
+    } else {
+        (*ring)[*next] = value;
+        *next = (*next + 1) % SampleCapacity;
+    }
+}
+
+qreal PerfMetrics::percentile(QVector<qreal> sorted, qreal fraction) {
+    if (sorted.isEmpty()) return 0;
+    const int index = qMin(sorted.size() - 1, int(fraction * sorted.size()));
+    std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+    return sorted[index];
+}
+
+PerfSnapshot PerfMetrics::snapshot() const {
+    PerfSnapshot result;
+    result.frames = frames;
+    result.frameMs = lastFrameMs;
+    if (!frameTimes.isEmpty()) {
+        qreal sum = 0;
+        foreach (qreal ms, frameTimes) {
+            sum += ms;
+            result.frameMsMax = qMax(result.frameMsMax, ms);
+        }
+        result.frameMsAverage = sum / frameTimes.size();
+    }
+    result.latencyP50 = percentile(latencies, 0.50);
+    result.latencyP95 = percentile(latencies, 0.95);
+    result.latencyP99 = percentile(latencies, 0.99);
+    result.latencySamples = latencies.size();
+    result.historyEntries = historyEntries;
+    result.historyBytes = historyBytes;
+    result.exportDone = exportDone;
+    result.exportTotal = exportTotal;
+    return result;
+}
@@ -0,0 +1,62 @@
+#ifndef PERFMETRICS_H
+#define PERFMETRICS_H
+
+#include <QElapsedTimer>
+#include <QVector>
+#include <QString>
+
+// 某一时刻的性能计数（时间单位为毫秒）
+struct PerfSnapshot {
+    quint64 frames = 0;          // 累计绘制帧数
+    qreal frameMs = 0;           // 最近一帧的绘制时间
+    qreal frameMsAverage = 0;    // 最近若干帧的平均绘制时间
+    qreal frameMsMax = 0;        // 最近若干帧的最长绘制时间
+    qreal latencyP50 = 0;        // 输入到绘制完成的延迟分位数
+    qreal latencyP95 = 0;
+    qreal latencyP99 = 0;
+    int latencySamples = 0;      // 参与统计的延迟样本数
+    int sceneItems = 0;          // 场景图形数
+    int historyEntries = 0;      // 撤回历史条数
+    qint64 historyBytes = 0;     // 撤回历史占用的内存
+    int exportDone = 0;          // 导出进度，exportTotal 为 0 表示没有进行中的导出
+    int exportTotal = 0;
+
+    QString toText() const;      // 多行文本（性能面板用）
+};
+
+// 性能计数器：绘制线程（GUI 线程）上记录，计数只在取快照时汇总，不给热路径增加格式化开销
+class PerfMetrics {
+public:
+    enum { SampleCapacity = 240 };   // 保留的最近样本数
+
+    PerfMetrics();
+
+    void inputReceived();                        // 收到输入；只记录尚未绘制的最早一个
+    void frameStarted();                         // 开始绘制
+    void frameFinished();                        // 绘制结束，计入帧时间和输入延迟
+    void setHistory(int entries, qint64 bytes);  // 撤回历史状态
+    void setExportProgress(int done, int total); // 导出进度（total 为 0 表示空闲）
+    void reset();                                // 清空样本
+
+    PerfSnapshot snapshot() const;               // 汇总当前计数（场景图形数由调用方填写）
+
+private:
+    static void push(QVector<qreal> *ring, int *next, qreal value);  // 写入环形缓冲
+    static qreal percentile(QVector<qreal> sorted, qreal fraction);
+
+    QElapsedTimer clock;
+    qint64 frameStartNs;             // 当前帧的开始时间
+    qint64 pendingInputNs;           // 尚未绘制的最早输入时间，-1 为无
+    QVector<qreal> frameTimes;       // 帧时间环形缓冲
+    int frameNext;
+    QVector<qreal> latencies;        // 延迟环形缓冲
+    int latencyNext;
+    quint64 frames;
+    qreal lastFrameMs;
+    int historyEntries;
+    qint64 historyBytes;
+    int exportDone;
+    int exportTotal;
+};
+
+#endif // PERFMETRICS_H
@@ -0,0 +1,250 @@
+#include "primitivebatch.h"
+#include "layeritem.h"
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+#include <QtMath>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+const qreal kCellSize = 512;            // 网格单元边长（场景坐标）
+const int kMaxCellsPerPrimitive = 16;   // 超过则放进大图元列表
+const qreal kPlaceholderPixels = 2.0;   // 小于此尺寸时只画色块（与 ShapeItem 一致）
+}
+
+PrimitiveBatch::PrimitiveBatch(ShapeItem::Kind kind, QGraphicsItem *parent)
+    : QGraphicsItem(parent),
+      shapeKind(kind),
+      aliveTotal(0),
+      maxMargin(1),
+      stamp(0) {
+    // 绘制时需要暴露区域，只画可见的图元
+    setFlag(ItemUsesExtendedStyleOption);
+}
+
+int PrimitiveBatch::penId(const QPen &pen) {
+    const float width = float(pen.widthF());
+    quint32 widthBits;
+    std::memcpy(&widthBits, &width, 4);
+    const quint64 key = (quint64(pen.color().rgba()) << 32) | widthBits;
+    QHash<quint64, int>::const_iterator it = paletteLookup.constFind(key);
+    if (it != paletteLookup.constEnd()) return it.value();
+    if (palette.size() >= 0xffff) return -1;
+    palette.append(pen);
+    paletteLookup.insert(key, palette.size() - 1);
+    maxMargin = qMax(maxMargin, pen.widthF() / 2 + 1);
+    return palette.size() - 1;
+}
+
+int PrimitiveBatch::append(const ShapeItem *shape) {
+    const int pen = penId(shape->pen());
+    if (pen < 0) return -1;
+
+    const QPointF offset = shape->pos();
+    float left = 0, top = 0, right = 0, bottom = 0;
+    for (int i = 0; i < pointCount(); ++i) {
+        const QPointF p = shape->point(qMin(i, shape->pointCount() - 1)) + offset;
+        xs[i].append(float(p.x()));
+        ys[i].append(float(p.y()));
+        if (i == 0) {
+            left = right = float(p.x());
+            top = bottom = float(p.y());
+        } else {
+            left = qMin(left, float(p.x()));
+            right = qMax(right, float(p.x()));
+            top = qMin(top, float(p.y()));
+            bottom = qMax(bottom, float(p.y()));
+        }
+    }
+    lefts.append(left);
+    tops.append(top);
+    rights.append(right);
+    bottoms.append(bottom);
+    pens.append(quint16(pen));
+    alive.append(1);
+    visitStamp.append(0);
+    ++aliveTotal;
+
+    const int primitive = alive.size() - 1;
+    const QRectF rect = primitiveRect(primitive);
+    QRectF geometry;
+    geometry.setCoords(left, top, right, bottom);
+    if (primitive == 0 || !geometryBounds.contains(geometry)) {
+        prepareGeometryChange();
+        geometryBounds = primitive == 0 ? geometry : geometryBounds.united(geometry);
+    }
+    index(primitive);
+    update(rect);
+    LayerItem::touch(this, rect);
+    return primitive;
+}
+
+void PrimitiveBatch::index(int primitive) {
+    const int x0 = qFloor(lefts[primitive] / kCellSize), x1 = qFloor(rights[primitive] / kCellSize);
+    const int y0 = qFloor(tops[primitive] / kCellSize), y1 = qFloor(bottoms[primitive] / kCellSize);
+    if (qint64(x1 - x0 + 1) * (y1 - y0 + 1) > kMaxCellsPerPrimitive) {
+        oversized.append(primitive);
+        return;
+    }
+    for (int cx = x0; cx <= x1; ++cx) {
+        for (int cy = y0; cy <= y1; ++cy) {
+            cells[cellKey(cx, cy)].append(primitive);
+        }
+    }
+}
+
+void PrimitiveBatch::setAlive(int index, bool on) {
+    if (index < 0 || index >= alive.size() || isAlive(index) == on) return;
+    alive[index] = on ? 1 : 0;
+    aliveTotal += on ? 1 : -1;
+    update(primitiveRect(index));
+    LayerItem::touch(this, primitiveRect(index));
+}
+
+QRectF PrimitiveBatch::primitiveRect(int index) const {
+    const qreal margin = palette[pens[index]].widthF() / 2 + 1;
+    QRectF rect;
+    rect.setCoords(lefts[index] - margin, tops[index] - margin, rights[index] + margin, bottoms[index] + margin);
+    return rect;
+}
+
+ShapeItem *PrimitiveBatch::toShapeItem(int index) const {
+    ShapeItem *shape = new ShapeItem(shapeKind, QPointF(xs[0][index], ys[0][index]), palette[pens[index]]);
+    for (int i = 1; i < pointCount(); ++i) {
+        shape->setPoint(i, QPointF(xs[i][index], ys[i][index]));
+    }
+    shape->setZValue(zValue());
+    return shape;
+}
+
+// 网格查询：区域覆盖的单元比已有单元还多时（缩得很小）直接遍历全部单元
+QVector<int> PrimitiveBatch::primitivesIn(const QRectF &rect) const {
+    QVector<int> result;
+    if (aliveTotal == 0 || rect.isEmpty()) return result;
+    const QRectF area = rect.adjusted(-maxMargin, -maxMargin, maxMargin, maxMargin);
+    if (++stamp == 0) {
+        visitStamp.fill(0);
+        stamp = 1;
+    }
+
+    auto visit = [&](const QVector<int> &candidates) {
+        foreach (int i, candidates) {
+            if (visitStamp[i] == stamp || !alive[i]) continue;
+            visitStamp[i] = stamp;
+            if (rights[i] < area.left() || lefts[i] > area.right()
+                || bottoms[i] < area.top() || tops[i] > area.bottom()) {
+                continue;
+            }
+            result.append(i);
+        }
+    };
+
+    const int x0 = qFloor(area.left() / kCellSize), x1 = qFloor(area.right() / kCellSize);
+    const int y0 = qFloor(area.top() / kCellSize), y1 = qFloor(area.bottom() / kCellSize);
+    if (qint64(x1 - x0 + 1) * (y1 - y0 + 1) > cells.size()) {
+        for (QHash<quint64, QVector<int> >::const_iterator it = cells.constBegin(); it != cells.constEnd(); ++it) {
+            visit(it.value());
+        }
+    } else {
+        for (int cx = x0; cx <= x1; ++cx) {
+            for (int cy = y0; cy <= y1; ++cy) {
+                QHash<quint64, QVector<int> >::const_iterator it = cells.constFind(cellKey(cx, cy));
+                if (it != cells.constEnd()) visit(it.value());
+            }
+        }
+    }
+    visit(oversized);
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+qint64 PrimitiveBatch::byteSize() const {
+    qint64 bytes = sizeof(PrimitiveBatch);
+    for (int i = 0; i < 3; ++i) bytes += qint64(xs[i].capacity() + ys[i].capacity()) * sizeof(float);
+    bytes += qint64(lefts.capacity() + tops.capacity() + rights.capacity() + bottoms.capacity()) * sizeof(float);
+    bytes += qint64(pens.capacity()) * sizeof(quint16) + alive.capacity() + qint64(visitStamp.capacity()) * sizeof(quint32);
+    bytes += qint64(palette.size()) * (sizeof(QPen) + 32);
+    for (QHash<quint64, QVector<int> >::const_iterator it = cells.constBegin(); it != cells.constEnd(); ++it) {
+        bytes += 32 + qint64(it.value().capacity()) * sizeof(int);
+    }
+    return bytes + qint64(oversized.capacity()) * sizeof(int);
+}
+
+QRectF PrimitiveBatch::boundingRect() const {
+    if (alive.isEmpty()) return QRectF();
+    return geometryBounds.adjusted(-maxMargin, -maxMargin, maxMargin, maxMargin);
+}
+
+// 只画暴露区域内的图元；同一画笔的图元连续绘制，直线和矩形一次提交整组。
+// 分组只在区段内进行：图元与区段中其他画笔的图元相交时从这里断开，重叠的不同颜色图元保持添加次序
+void PrimitiveBatch::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) {
+    Q_UNUSED(widget);
+    drawOrder = primitivesIn(option->exposedRect);
+    if (drawOrder.isEmpty()) return;
+    auto byPen = [this](int a, int b) { return pens[a] < pens[b]; };
+    int from = 0;
+    segmentBounds.clear();
+    for (int k = 0; k < drawOrder.size(); ++k) {
+        const int i = drawOrder[k];
+        const QRectF rect = primitiveRect(i);
+        bool overlaps = false;
+        for (QHash<quint16, QRectF>::const_iterator it = segmentBounds.constBegin(); it != segmentBounds.constEnd(); ++it) {
+            if (it.key() != pens[i] && it.value().intersects(rect)) {
+                overlaps = true;
+                break;
+            }
+        }
+        if (overlaps) {
+            std::stable_sort(drawOrder.begin() + from, drawOrder.begin() + k, byPen);
+            from = k;
+            segmentBounds.clear();
+        }
+        QRectF &bounds = segmentBounds[pens[i]];
+        bounds = bounds.isNull() ? rect : bounds.united(rect);
+    }
+    std::stable_sort(drawOrder.begin() + from, drawOrder.end(), byPen);
+
+    const qreal lod = QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform());
+    painter->setBrush(Qt::NoBrush);
+    int run = 0;
+    while (run < drawOrder.size()) {
+        const quint16 pen = pens[drawOrder[run]];
+        int end = run;
+        while (end < drawOrder.size() && pens[drawOrder[end]] == pen) ++end;
+
+        painter->setPen(palette[pen]);
+        lineBuffer.resize(0);
+        rectBuffer.resize(0);
+        for (int k = run; k < end; ++k) {
+            const int i = drawOrder[k];
+            QRectF geometry;
+            geometry.setCoords(lefts[i], tops[i], rights[i], bottoms[i]);
+            // 连同笔宽在屏幕上只有一两个像素时只画一个色块，与 ShapeItem 一致
+            const QRectF bounds = primitiveRect(i);
+            if (qMax(bounds.width(), bounds.height()) * lod < kPlaceholderPixels) {
+                painter->fillRect(bounds, palette[pen].color());
+                continue;
+            }
+            switch (shapeKind) {
+            case ShapeItem::Line:
+                lineBuffer.append(QLineF(xs[0][i], ys[0][i], xs[1][i], ys[1][i]));
+                break;
+            case ShapeItem::Rectangle:
+                rectBuffer.append(geometry);
+                break;
+            case ShapeItem::Ellipse:
+                painter->drawEllipse(geometry);
+                break;
+            case ShapeItem::Triangle: {
+                const QPointF triangle[3] = { QPointF(xs[0][i], ys[0][i]), QPointF(xs[1][i], ys[1][i]),
+                                              QPointF(xs[2][i], ys[2][i]) };
+                painter->drawPolygon(triangle, 3);
+                break;
+            }
+            }
+        }
+        if (!lineBuffer.isEmpty()) painter->drawLines(lineBuffer.constData(), lineBuffer.size());
+        if (!rectBuffer.isEmpty()) painter->drawRects(rectBuffer.constData(), rectBuffer.size());
+        run = end;
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef PRIMITIVEBATCH_H
+#define PRIMITIVEBATCH_H
+
+#include <QGraphicsItem>
+#include <QVector>
+#include <QHash>
+#include <QPen>
+#include <QRectF>
+#include <QLineF>
+#include "shapeitem.h"
+
+class PrimitiveBatch;
+
+// 批量层中的一个图元（撤回记录和擦除结果用）
+struct PrimitiveRef {
+    PrimitiveBatch *batch = nullptr;
+    int index = -1;
+
+    bool operator==(const PrimitiveRef &other) const { return batch == other.batch && index == other.index; }
+};
+
+// 批量图元层：同一种形状的大量图元放在一个场景图形里，按列存储（结构数组），
+// 自带网格索引，绘制时只取可见的图元并按画笔分组。图元只追加不移动，撤回/擦除只切换存活标记，
+// 序号在层的生命周期内保持不变
+class PrimitiveBatch : public QGraphicsItem {
+public:
+    enum { Type = UserType + 5 };
+
+    explicit PrimitiveBatch(ShapeItem::Kind kind, QGraphicsItem *parent = nullptr);
+
+    ShapeItem::Kind kind() const { return shapeKind; }
+    int pointCount() const { return shapeKind == ShapeItem::Triangle ? 3 : 2; }
+    int append(const ShapeItem *shape);           // 追加图元，返回序号；画笔种类用尽时返回 -1
+    int count() const { return alive.size(); }    // 图元总数（含已移除的）
+    int aliveCount() const { return aliveTotal; }
+    bool isAlive(int index) const { return alive[index] != 0; }
+    void setAlive(int index, bool on);            // 撤回、重做、擦除时切换
+    QRectF primitiveRect(int index) const;        // 图元包围盒（含笔宽）
+    QPointF vertex(int index, int i) const { return QPointF(xs[i][index], ys[i][index]); } // 第 i 个顶点（场景坐标）
+    QPen pen(int index) const { return palette[pens[index]]; }
+    ShapeItem *toShapeItem(int index) const;      // 还原为独立图形（保存、擦除时取轮廓用，调用方负责释放）
+    QVector<int> primitivesIn(const QRectF &rect) const; // 包围盒与区域相交的存活图元（按序号升序）
+    qint64 byteSize() const;                      // 占用的内存
+
+    int type() const override { return Type; }
+    QRectF boundingRect() const override;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
+
+private:
+    quint64 cellKey(int cx, int cy) const { return (quint64(quint32(cx)) << 32) | quint32(cy); }
+    int penId(const QPen &pen);                   // 画笔调色板序号（相同颜色和笔宽共用）
+    void index(int primitive);                    // 加入网格索引
+
+    ShapeItem::Kind shapeKind;
+    QVector<float> xs[3];                         // 顶点坐标（按列存储，直线/矩形/椭圆只用前两列）
+    QVector<float> ys[3];
+    QVector<float> lefts;                         // 几何包围盒（不含笔宽）
+    QVector<float> tops;
+    QVector<float> rights;
+    QVector<float> bottoms;
+    QVector<quint16> pens;                        // 画笔序号
+    QVector<quint8> alive;                        // 存活标记
+    int aliveTotal;
+    QVector<QPen> palette;                        // 画笔调色板
+    QHash<quint64, int> paletteLookup;            // 颜色+笔宽 -> 调色板序号
+    qreal maxMargin;                              // 最大笔宽的一半
+    QRectF geometryBounds;                        // 全部图元的几何包围盒
+    QHash<quint64, QVector<int> > cells;          // 网格索引：单元 -> 图元
+    QVector<int> oversized;                       // 跨越单元过多、不进网格的大图元
+    mutable QVector<quint32> visitStamp;          // 查询去重（一个图元可能在多个单元中）
+    mutable quint32 stamp;
+    QVector<int> drawOrder;                       // 本次绘制的图元（互不重叠的区段内按画笔排序）
+    QHash<quint16, QRectF> segmentBounds;         // 当前区段里每种画笔的图元范围
+    QVector<QLineF> lineBuffer;                   // 合并提交的直线/矩形，只增不缩
+    QVector<QRectF> rectBuffer;
+};
+
+#endif // PRIMITIVEBATCH_H
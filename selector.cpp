@@ -0,0 +1,318 @@
+#include "selector.h"
+#include "layeritem.h"
+#include "tilelayer.h"
+#include "strokeitem.h"
+#include "shapeitem.h"
+#include "statictextitem.h"
+#include "brushstrokeitem.h"
+#include <QGraphicsScene>
+#include <QGraphicsPathItem>
+#include <QtMath>
+
+namespace {
+
+const int CubicPieces = 16;          // 每段贝塞尔曲线展平的折线段数
+const qreal EllipseStep = 2;         // 椭圆展平时每段对应的最大半径增量（像素）
+
+// 点到线段的距离不超过 reach（先按线段包围盒快速排除）
+bool nearSegment(const QPointF &p, const QPointF &a, const QPointF &b, qreal reach) {
+    if (p.x() < qMin(a.x(), b.x()) - reach || p.x() > qMax(a.x(), b.x()) + reach
+        || p.y() < qMin(a.y(), b.y()) - reach || p.y() > qMax(a.y(), b.y()) + reach) {
+        return false;
+    }
+    const qreal dx = b.x() - a.x(), dy = b.y() - a.y();
+    const qreal lengthSquared = dx * dx + dy * dy;
+    qreal t = lengthSquared > 0 ? ((p.x() - a.x()) * dx + (p.y() - a.y()) * dy) / lengthSquared : 0;
+    t = qBound<qreal>(0, t, 1);
+    const qreal ex = a.x() + t * dx - p.x(), ey = a.y() + t * dy - p.y();
+    return ex * ex + ey * ey <= reach * reach;
+}
+
+// 线段与矩形是否相交（Liang-Barsky 裁剪）
+bool segmentInRect(const QPointF &a, const QPointF &b, const QRectF &rect) {
+    const qreal dx = b.x() - a.x(), dy = b.y() - a.y();
+    const qreal p[4] = { -dx, dx, -dy, dy };
+    const qreal q[4] = { a.x() - rect.left(), rect.right() - a.x(), a.y() - rect.top(), rect.bottom() - a.y() };
+    qreal t0 = 0, t1 = 1;
+    for (int i = 0; i < 4; ++i) {
+        if (p[i] == 0) {
+            if (q[i] < 0) return false;
+            continue;
+        }
+        const qreal t = q[i] / p[i];
+        if (p[i] < 0) {
+            t0 = qMax(t0, t);
+        } else {
+            t1 = qMin(t1, t);
+        }
+        if (t0 > t1) return false;
+    }
+    return true;
+}
+
+// 对折线（closed 时首尾相连）的每条线段调用 test，任一返回 true 即为 true
+template <typename Test>
+bool anySegment(const QPointF *points, int count, bool closed, Test test) {
+    if (count == 1) return test(points[0], points[0]);
+    for (int i = 1; i < count; ++i) {
+        if (test(points[i - 1], points[i])) return true;
+    }
+    return closed && count > 2 && test(points[count - 1], points[0]);
+}
+
+// 三次贝塞尔曲线段：控制点包围盒（曲线必在其中）与 area 不相交时跳过，否则展平后逐段测试
+template <typename Test>
+bool anyCubicSegment(const QVector<QPointF> &points, const QRectF &area, Test test) {
+    for (int i = 0; i + 3 < points.size(); i += 3) {
+        const QPointF &p0 = points[i], &p1 = points[i + 1], &p2 = points[i + 2], &p3 = points[i + 3];
+        QRectF hull;
+        hull.setCoords(qMin(qMin(p0.x(), p1.x()), qMin(p2.x(), p3.x())), qMin(qMin(p0.y(), p1.y()), qMin(p2.y(), p3.y())),
+                       qMax(qMax(p0.x(), p1.x()), qMax(p2.x(), p3.x())), qMax(qMax(p0.y(), p1.y()), qMax(p2.y(), p3.y())));
+        if (hull.right() < area.left() || hull.left() > area.right()
+            || hull.bottom() < area.top() || hull.top() > area.bottom()) {
+            continue;
+        }
+        QPointF last = p0;
+        for (int k = 1; k <= CubicPieces; ++k) {
+            const qreal t = qreal(k) / CubicPieces, u = 1 - t;
+            const QPointF next = u * u * u * p0 + 3 * u * u * t * p1 + 3 * u * t * t * p2 + t * t * t * p3;
+            if (test(last, next)) return true;
+            last = next;
+        }
+    }
+    return false;
+}
+
+// 形状的轮廓折线（本地坐标）；矩形、三角形、椭圆是闭合的
+QVector<QPointF> shapeOutline(ShapeItem::Kind kind, const QPointF *pts, bool *closed) {
+    QVector<QPointF> outline;
+    *closed = kind != ShapeItem::Line;
+    switch (kind) {
+    case ShapeItem::Line:
+        outline << pts[0] << pts[1];
+        break;
+    case ShapeItem::Rectangle:
+        outline << pts[0] << QPointF(pts[1].x(), pts[0].y()) << pts[1] << QPointF(pts[0].x(), pts[1].y());
+        break;
+    case ShapeItem::Triangle:
+        outline << pts[0] << pts[1] << pts[2];
+        break;
+    case ShapeItem::Ellipse: {
+        // 段数随半径增加，弦高误差保持在零点几个像素以内
+        const QPointF center = (pts[0] + pts[1]) / 2;
+        const qreal rx = qAbs(pts[1].x() - pts[0].x()) / 2, ry = qAbs(pts[1].y() - pts[0].y()) / 2;
+        const int pieces = qBound(16, qCeil(qMax(rx, ry) / EllipseStep), 1024);
+        outline.reserve(pieces);
+        for (int i = 0; i < pieces; ++i) {
+            const qreal angle = 2 * M_PI * i / pieces;
+            outline << center + QPointF(rx * qCos(angle), ry * qSin(angle));
+        }
+        break;
+    }
+    }
+    return outline;
+}
+
+bool shapeHits(ShapeItem::Kind kind, const QPointF *pts, const QPointF &p, qreal reach) {
+    bool closed;
+    const QVector<QPointF> outline = shapeOutline(kind, pts, &closed);
+    return anySegment(outline.constData(), outline.size(), closed, [&](const QPointF &a, const QPointF &b) {
+        return nearSegment(p, a, b, reach);
+    });
+}
+
+bool shapeTouches(ShapeItem::Kind kind, const QPointF *pts, const QRectF &area) {
+    bool closed;
+    const QVector<QPointF> outline = shapeOutline(kind, pts, &closed);
+    return anySegment(outline.constData(), outline.size(), closed, [&](const QPointF &a, const QPointF &b) {
+        return segmentInRect(a, b, area);
+    });
+}
+
+bool primitiveHits(const PrimitiveBatch *batch, int index, const QPointF &scenePos, qreal tolerance) {
+    QPointF pts[3];
+    for (int i = 0; i < batch->pointCount(); ++i) pts[i] = batch->vertex(index, i);
+    return shapeHits(batch->kind(), pts, batch->mapFromScene(scenePos), batch->pen(index).widthF() / 2 + tolerance);
+}
+
+bool primitiveTouches(const PrimitiveBatch *batch, int index, const QRectF &sceneRect) {
+    const QRectF area = batch->mapRectFromScene(sceneRect);
+    if (area.contains(batch->primitiveRect(index))) return true;
+    QPointF pts[3];
+    for (int i = 0; i < batch->pointCount(); ++i) pts[i] = batch->vertex(index, i);
+    const qreal margin = batch->pen(index).widthF() / 2;
+    return shapeTouches(batch->kind(), pts, area.adjusted(-margin, -margin, margin, margin));
+}
+
+// 候选：图层中已提交、可见的图形（不含历史栅格）
+bool isCandidate(const QGraphicsItem *item, const LayerItem *layer) {
+    return item->parentItem() == layer && item != layer->bakedTiles() && item->isVisible();
+}
+
+}
+
+bool Selection::contains(const Selection &other) const {
+    foreach (QGraphicsItem *item, other.items) {
+        if (!items.contains(item)) return false;
+    }
+    foreach (const PrimitiveRef &ref, other.primitives) {
+        if (!primitives.contains(ref)) return false;
+    }
+    return true;
+}
+
+QRectF Selection::sceneBounds() const {
+    QRectF bounds;
+    foreach (QGraphicsItem *item, items) {
+        bounds |= item->sceneBoundingRect();
+    }
+    foreach (const PrimitiveRef &ref, primitives) {
+        bounds |= ref.batch->mapRectToScene(ref.batch->primitiveRect(ref.index));
+    }
+    return bounds;
+}
+
+namespace Selector {
+
+bool hits(const QGraphicsItem *item, const QPointF &scenePos, qreal tolerance) {
+    const QPointF p = item->mapFromScene(scenePos);
+    if (!item->boundingRect().adjusted(-tolerance, -tolerance, tolerance, tolerance).contains(p)) return false;
+
+    if (const StrokeItem *stroke = qgraphicsitem_cast<const StrokeItem*>(item)) {
+        const qreal reach = stroke->pen().widthF() / 2 + tolerance;
+        auto nearby = [&](const QPointF &a, const QPointF &b) { return nearSegment(p, a, b, reach); };
+        const QVector<QPointF> &points = stroke->points();
+        if (stroke->isCubic()) {
+            return anyCubicSegment(points, QRectF(p.x() - reach, p.y() - reach, 2 * reach, 2 * reach), nearby);
+        }
+        return anySegment(points.constData(), points.size(), false, nearby);
+    }
+    if (const ShapeItem *shape = qgraphicsitem_cast<const ShapeItem*>(item)) {
+        QPointF pts[3];
+        for (int i = 0; i < shape->pointCount(); ++i) pts[i] = shape->point(i);
+        return shapeHits(shape->kind(), pts, p, shape->pen().widthF() / 2 + tolerance);
+    }
+    if (qgraphicsitem_cast<const StaticTextItem*>(item)) {
+        return true;        // 文本框内即命中
+    }
+    if (const BrushStrokeItem *brush = qgraphicsitem_cast<const BrushStrokeItem*>(item)) {
+        return brush->coversAny(QRectF(p.x() - tolerance, p.y() - tolerance, 2 * tolerance, 2 * tolerance).toAlignedRect());
+    }
+    if (const QGraphicsPathItem *pathItem = qgraphicsitem_cast<const QGraphicsPathItem*>(item)) {
+        const QPainterPath path = pathItem->path();
+        return path.contains(p) || path.intersects(QRectF(p.x() - tolerance, p.y() - tolerance, 2 * tolerance, 2 * tolerance));
+    }
+    return false;
+}
+
+bool touches(const QGraphicsItem *item, const QRectF &sceneRect) {
+    const QRectF area = item->mapRectFromScene(sceneRect);
+    const QRectF bounds = item->boundingRect();
+    if (!area.intersects(bounds)) return false;
+    if (area.contains(bounds)) return true;
+
+    if (const StrokeItem *stroke = qgraphicsitem_cast<const StrokeItem*>(item)) {
+        const qreal margin = stroke->pen().widthF() / 2;
+        const QRectF grown = area.adjusted(-margin, -margin, margin, margin);
+        auto inside = [&](const QPointF &a, const QPointF &b) { return segmentInRect(a, b, grown); };
+        const QVector<QPointF> &points = stroke->points();
+        if (stroke->isCubic()) return anyCubicSegment(points, grown, inside);
+        return anySegment(points.constData(), points.size(), false, inside);
+    }
+    if (const ShapeItem *shape = qgraphicsitem_cast<const ShapeItem*>(item)) {
+        QPointF pts[3];
+        for (int i = 0; i < shape->pointCount(); ++i) pts[i] = shape->point(i);
+        const qreal margin = shape->pen().widthF() / 2;
+        return shapeTouches(shape->kind(), pts, area.adjusted(-margin, -margin, margin, margin));
+    }
+    if (qgraphicsitem_cast<const StaticTextItem*>(item)) {
+        return true;
+    }
+    if (const BrushStrokeItem *brush = qgraphicsitem_cast<const BrushStrokeItem*>(item)) {
+        return brush->coversAny((area & bounds).toAlignedRect());
+    }
+    if (const QGraphicsPathItem *pathItem = qgraphicsitem_cast<const QGraphicsPathItem*>(item)) {
+        return pathItem->path().intersects(area);
+    }
+    return false;
+}
+
+Selection pickAt(LayerItem *layer, const QPointF &scenePos, qreal tolerance) {
+    Selection result;
+    if (!layer || !layer->scene()) return result;
+    const QRectF probe(scenePos.x() - tolerance, scenePos.y() - tolerance, 2 * tolerance, 2 * tolerance);
+    foreach (QGraphicsItem *item, layer->scene()->items(probe, Qt::IntersectsItemBoundingRect, Qt::DescendingOrder)) {
+        if (!isCandidate(item, layer)) continue;
+        if (PrimitiveBatch *batch = qgraphicsitem_cast<PrimitiveBatch*>(item)) {
+            // 层内序号大的图元画在上面
+            const QVector<int> candidates = batch->primitivesIn(batch->mapRectFromScene(probe));
+            for (int i = candidates.size() - 1; i >= 0; --i) {
+                if (!primitiveHits(batch, candidates[i], scenePos, tolerance)) continue;
+                PrimitiveRef ref;
+                ref.batch = batch;
+                ref.index = candidates[i];
+                result.primitives.append(ref);
+                return result;
+            }
+            continue;
+        }
+        if (hits(item, scenePos, tolerance)) {
+            result.items.append(item);
+            return result;
+        }
+    }
+    return result;
+}
+
+Selection collect(LayerItem *layer, const QRectF &sceneRect) {
+    Selection result;
+    if (!layer || !layer->scene() || sceneRect.isEmpty()) return result;
+    foreach (QGraphicsItem *item, layer->scene()->items(sceneRect, Qt::IntersectsItemBoundingRect, Qt::AscendingOrder)) {
+        if (!isCandidate(item, layer)) continue;
+        if (PrimitiveBatch *batch = qgraphicsitem_cast<PrimitiveBatch*>(item)) {
+            foreach (int index, batch->primitivesIn(batch->mapRectFromScene(sceneRect))) {
+                if (!primitiveTouches(batch, index, sceneRect)) continue;
+                PrimitiveRef ref;
+                ref.batch = batch;
+                ref.index = index;
+                result.primitives.append(ref);
+            }
+            continue;
+        }
+        if (touches(item, sceneRect)) result.items.append(item);
+    }
+    return result;
+}
+
+bool canRestyle(const QGraphicsItem *item) {
+    const int type = item->type();
+    return type == StrokeItem::Type || type == ShapeItem::Type || type == StaticTextItem::Type
+           || type == QGraphicsPathItem::Type;
+}
+
+QPen styleOf(const QGraphicsItem *item) {
+    if (const StrokeItem *stroke = qgraphicsitem_cast<const StrokeItem*>(item)) return stroke->pen();
+    if (const ShapeItem *shape = qgraphicsitem_cast<const ShapeItem*>(item)) return shape->pen();
+    if (const StaticTextItem *text = qgraphicsitem_cast<const StaticTextItem*>(item)) return QPen(text->color());
+    if (const QGraphicsPathItem *pathItem = qgraphicsitem_cast<const QGraphicsPathItem*>(item)) {
+        return QPen(pathItem->brush().color());
+    }
+    return QPen();
+}
+
+// 改笔宽会改变包围盒，前后两次通知图层缓存失效
+void setStyle(QGraphicsItem *item, const QPen &pen) {
+    LayerItem::touch(item);
+    if (StrokeItem *stroke = qgraphicsitem_cast<StrokeItem*>(item)) {
+        stroke->setPen(pen);
+    } else if (ShapeItem *shape = qgraphicsitem_cast<ShapeItem*>(item)) {
+        shape->setPen(pen);
+    } else if (StaticTextItem *text = qgraphicsitem_cast<StaticTextItem*>(item)) {
+        text->setColor(pen.color());
+    } else if (QGraphicsPathItem *pathItem = qgraphicsitem_cast<QGraphicsPathItem*>(item)) {
+        pathItem->setBrush(pen.color());
+    }
+    LayerItem::touch(item);
+}
+
+}
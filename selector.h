@@ -0,0 +1,47 @@
+#ifndef SELECTOR_H
+#define SELECTOR_H
+
+#include <QList>
+#include <QVector>
+#include <QPointF>
+#include <QRectF>
+#include <QPen>
+#include "primitivebatch.h"
+
+class QGraphicsItem;
+class LayerItem;
+
+// 选中的内容：独立图形和批量层中的图元
+struct Selection {
+    QList<QGraphicsItem*> items;
+    QVector<PrimitiveRef> primitives;
+
+    bool isEmpty() const { return items.isEmpty() && primitives.isEmpty(); }
+    int size() const { return items.size() + primitives.size(); }
+    bool contains(const Selection &other) const;  // other 中的内容是否都已选中
+    QRectF sceneBounds() const;                   // 全部内容的场景包围盒
+};
+
+namespace Selector {
+
+// 命中测试：先用场景索引（批量层用自带的网格索引）取包围盒附近的候选，
+// 再对几何做精确测试：笔迹和形状轮廓按点到线段的距离（曲线先展平），文字按文本框，
+// 擦除剩余的填充区域按轮廓，栅格笔迹按像素不透明度。只看 layer 中已提交的图形，不含历史栅格
+
+// 点选：距离 scenePos 不超过笔宽一半加 tolerance 的最上层内容（最多一项）
+Selection pickAt(LayerItem *layer, const QPointF &scenePos, qreal tolerance);
+
+// 框选：与区域接触的全部内容（包围盒完全在区域内的不再做精确测试）
+Selection collect(LayerItem *layer, const QRectF &sceneRect);
+
+bool hits(const QGraphicsItem *item, const QPointF &scenePos, qreal tolerance);
+bool touches(const QGraphicsItem *item, const QRectF &sceneRect);
+
+// 样式：笔迹、形状的画笔，文字和填充区域只用画笔颜色；栅格笔迹不能改样式
+bool canRestyle(const QGraphicsItem *item);
+QPen styleOf(const QGraphicsItem *item);
+void setStyle(QGraphicsItem *item, const QPen &pen);
+
+}
+
+#endif // SELECTOR_H
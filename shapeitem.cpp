@@ -0,0 +1,121 @@
+#include "shapeitem.h"
+#include <QPainter>
+#include <QPainterPathStroker>
+#include <QStyleOptionGraphicsItem>
+
+namespace {
+const qreal kPlaceholderPixels = 2.0;   // 小于此尺寸时只画色块
+}
+
+ShapeItem::ShapeItem(Kind kind, const QPointF &start, const QPen &pen, QGraphicsItem *parent)
+    : QGraphicsItem(parent),
+      shapeKind(kind),
+      shapePen(pen),
+      preview(false) {
+    pts[0] = pts[1] = pts[2] = start;
+}
+
+// 原地修改顶点：只标记新旧包围盒为脏区，不分配内存
+void ShapeItem::setPoint(int index, const QPointF &point) {
+    if (pts[index] == point) return;
+    prepareGeometryChange();
+    pts[index] = point;
+}
+
+void ShapeItem::setPen(const QPen &pen) {
+    if (pen.widthF() != shapePen.widthF()) prepareGeometryChange();
+    shapePen = pen;
+    update();
+}
+
+void ShapeItem::setPreview(bool on) {
+    if (preview == on) return;
+    preview = on;
+    update();
+}
+
+QRectF ShapeItem::pointRect() const {
+    qreal left = pts[0].x(), right = pts[0].x();
+    qreal top = pts[0].y(), bottom = pts[0].y();
+    for (int i = 1; i < pointCount(); ++i) {
+        left = qMin(left, pts[i].x());
+        right = qMax(right, pts[i].x());
+        top = qMin(top, pts[i].y());
+        bottom = qMax(bottom, pts[i].y());
+    }
+    QRectF rect;
+    rect.setCoords(left, top, right, bottom);
+    return rect;
+}
+
+QPainterPath ShapeItem::geometryPath() const {
+    QPainterPath path;
+    switch (shapeKind) {
+    case Line:
+        path.moveTo(pts[0]);
+        path.lineTo(pts[1]);
+        break;
+    case Rectangle:
+        path.addRect(pointRect());
+        break;
+    case Ellipse:
+        path.addEllipse(pointRect());
+        break;
+    case Triangle:
+        path.moveTo(pts[0]);
+        path.lineTo(pts[1]);
+        path.lineTo(pts[2]);
+        path.closeSubpath();
+        break;
+    }
+    return path;
+}
+
+QRectF ShapeItem::boundingRect() const {
+    const qreal margin = shapePen.widthF() / 2 + 1;
+    return pointRect().adjusted(-margin, -margin, margin, margin);
+}
+
+QPainterPath ShapeItem::shape() const {
+    QPainterPathStroker stroker;
+    stroker.setWidth(qMax<qreal>(shapePen.widthF(), 1));
+    stroker.setCapStyle(shapePen.capStyle());
+    stroker.setJoinStyle(shapePen.joinStyle());
+    return stroker.createStroke(geometryPath());
+}
+
+void ShapeItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) {
+    Q_UNUSED(option);
+    Q_UNUSED(widget);
+    // 连同笔宽在屏幕上只有一两个像素时只画一个色块（长度为 0 的形状在正常缩放下仍按笔宽画出）
+    const qreal lod = QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform());
+    const QRectF bounds = boundingRect();
+    if (!preview && qMax(bounds.width(), bounds.height()) * lod < kPlaceholderPixels) {
+        painter->fillRect(bounds, shapePen.color());
+        return;
+    }
+
+    if (preview) {
+        QPen dashPen = shapePen;
+        dashPen.setStyle(Qt::DashLine);
+        painter->setPen(dashPen);
+    } else {
+        painter->setPen(shapePen);
+    }
+    painter->setBrush(Qt::NoBrush);
+
+    switch (shapeKind) {
+    case Line:
+        painter->drawLine(pts[0], pts[1]);
+        break;
+    case Rectangle:
+        painter->drawRect(pointRect());
+        break;
+    case Ellipse:
+        painter->drawEllipse(pointRect());
+        break;
+    case Triangle:
+        painter->drawPolygon(pts, 3);
+        break;
+    }
+}
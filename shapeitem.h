@@ -0,0 +1,47 @@
+#ifndef SHAPEITEM_H
+#define SHAPEITEM_H
+
+#include <QGraphicsItem>
+#include <QPen>
+#include <QPointF>
+#include <QRectF>
+#include <QPainterPath>
+
+// 基本形状图形项：直线/矩形/椭圆/三角形共用，几何原地修改，预览与成品是同一个对象
+class ShapeItem : public QGraphicsItem {
+public:
+    enum { Type = UserType + 2 };
+    enum Kind {
+        Line,       // 直线
+        Rectangle,  // 矩形
+        Ellipse,    // 椭圆
+        Triangle    // 三角形
+    };
+
+    ShapeItem(Kind kind, const QPointF &start, const QPen &pen, QGraphicsItem *parent = nullptr);
+
+    Kind kind() const { return shapeKind; }
+    QPointF point(int index) const { return pts[index]; }
+    int pointCount() const { return shapeKind == Triangle ? 3 : 2; }
+    void setPoint(int index, const QPointF &point);   // 修改单个顶点
+    QPen pen() const { return shapePen; }
+    void setPen(const QPen &pen);
+    bool isPreview() const { return preview; }
+    void setPreview(bool on);                         // 预览状态下使用虚线
+    QPainterPath geometryPath() const;                // 不含笔宽的几何轮廓
+
+    int type() const override { return Type; }
+    QRectF boundingRect() const override;
+    QPainterPath shape() const override;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
+
+private:
+    QRectF pointRect() const;                         // 顶点包围盒
+
+    Kind shapeKind;       // 形状类型
+    QPointF pts[3];       // 顶点（直线/矩形/椭圆只用前两个）
+    QPen shapePen;        // 画笔
+    bool preview;         // 是否为预览
+};
+
+#endif // SHAPEITEM_H
@@ -0,0 +1,118 @@
+#include "statictextitem.h"
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+#include <QFontMetricsF>
+#include <QTextCursor>
+#include <QKeyEvent>
+#include <QHash>
+
+namespace {
+
+const qreal kGreekPixels = 4.0;   // 字高小于此像素时只画色条
+
+// 排版缓存只在 GUI 线程访问（绘制、加载文档都在 GUI 线程）
+QHash<QString, TextLayout*> &layoutCache() {
+    static QHash<QString, TextLayout*> cache;
+    return cache;
+}
+
+TextLayout *acquireLayout(const QString &text, const QFont &font) {
+    const QString key = font.key() + QChar(0x1f) + text;
+    TextLayout *&layout = layoutCache()[key];
+    if (!layout) {
+        layout = new TextLayout;
+        layout->key = key;
+        layout->font = font;
+        layout->text = text;
+        layout->staticText.setText(text);
+        layout->staticText.setTextFormat(Qt::PlainText);
+        layout->staticText.prepare(QTransform(), font);
+        layout->size = layout->staticText.size();
+    }
+    ++layout->refs;
+    return layout;
+}
+
+void releaseLayout(TextLayout *layout) {
+    if (--layout->refs > 0) return;
+    layoutCache().remove(layout->key);
+    delete layout;
+}
+
+}
+
+StaticTextItem::StaticTextItem(const QString &text, const QFont &font, const QColor &color, QGraphicsItem *parent)
+    : QGraphicsItem(parent),
+      layout(acquireLayout(text, font)),
+      textColor(color) {
+}
+
+StaticTextItem::~StaticTextItem() {
+    releaseLayout(layout);
+}
+
+int StaticTextItem::cachedLayouts() {
+    return layoutCache().size();
+}
+
+QPainterPath StaticTextItem::outline() const {
+    QPainterPath path;
+    path.addText(QPointF(Margin, Margin + QFontMetricsF(layout->font).ascent()), layout->font, layout->text);
+    return path;
+}
+
+void StaticTextItem::setColor(const QColor &color) {
+    textColor = color;
+    update();
+}
+
+QRectF StaticTextItem::boundingRect() const {
+    return QRectF(0, 0, layout->size.width() + 2 * Margin, layout->size.height() + 2 * Margin);
+}
+
+void StaticTextItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) {
+    Q_UNUSED(option);
+    Q_UNUSED(widget);
+    // 缩小到看不清字形时画一条半透明色条代替，不做字形光栅化
+    const qreal lod = QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform());
+    if (layout->size.height() * lod < kGreekPixels) {
+        QColor greek = textColor;
+        greek.setAlphaF(greek.alphaF() / 2);
+        painter->fillRect(QRectF(QPointF(Margin, Margin + layout->size.height() / 4),
+                                 QSizeF(layout->size.width(), layout->size.height() / 2)), greek);
+        return;
+    }
+    painter->setFont(layout->font);
+    painter->setPen(textColor);
+    painter->drawStaticText(QPointF(Margin, Margin), layout->staticText);
+}
+
+TextEditItem::TextEditItem(const StaticTextItem *source, QGraphicsItem *parent)
+    : QGraphicsTextItem(source->text(), parent) {
+    setFont(source->font());
+    setDefaultTextColor(source->color());
+    setPos(source->pos());
+    setZValue(source->zValue());
+    setTextInteractionFlags(Qt::TextEditorInteraction);
+    QTextCursor cursor = textCursor();
+    cursor.select(QTextCursor::Document);
+    setTextCursor(cursor);
+}
+
+void TextEditItem::keyPressEvent(QKeyEvent *event) {
+    if (event->key() == Qt::Key_Escape) {
+        emit editingFinished(false);
+        return;
+    }
+    // 静态文本只有一行
+    if (event->key() == Qt::Key_Return || event->key() == Qt::Key_Enter) {
+        emit editingFinished(true);
+        return;
+    }
+    QGraphicsTextItem::keyPressEvent(event);
+}
+
+void TextEditItem::focusOutEvent(QFocusEvent *event) {
+    QGraphicsTextItem::focusOutEvent(event);
+    emit editingFinished(true);
+}
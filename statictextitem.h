@@ -0,0 +1,62 @@
+#ifndef STATICTEXTITEM_H
+#define STATICTEXTITEM_H
+
+#include <QGraphicsItem>
+#include <QGraphicsTextItem>
+#include <QStaticText>
+#include <QFont>
+#include <QColor>
+#include <QString>
+#include <QPainterPath>
+
+// 共享排版：字体和内容相同的文本项共用一份，字形位置只计算一次
+struct TextLayout {
+    QString key;                 // 缓存键（字体 + 内容）
+    QFont font;
+    QString text;
+    QStaticText staticText;      // 预先排好的字形
+    QSizeF size;                 // 排版尺寸
+    int refs = 0;                // 引用它的文本项数
+};
+
+// 静态文本图形项：绘制后不再编辑的文字，不带 QTextDocument，只引用共享排版和自己的颜色
+class StaticTextItem : public QGraphicsItem {
+public:
+    enum { Type = UserType + 4 };
+    enum { Margin = 4 };         // 与 QGraphicsTextItem 的文档边距一致，旧文档中文字位置不变
+
+    StaticTextItem(const QString &text, const QFont &font, const QColor &color, QGraphicsItem *parent = nullptr);
+    ~StaticTextItem();
+
+    QString text() const { return layout->text; }
+    QFont font() const { return layout->font; }
+    QColor color() const { return textColor; }
+    void setColor(const QColor &color);           // 改颜色（排版仍共享）
+    QPainterPath outline() const;                 // 文字轮廓（本地坐标，擦除用）
+
+    static int cachedLayouts();                   // 当前共享的排版数
+
+    int type() const override { return Type; }
+    QRectF boundingRect() const override;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
+
+private:
+    TextLayout *layout;          // 共享排版（引用计数）
+    QColor textColor;            // 颜色
+};
+
+// 临时的可编辑文本：“编辑文本”时替代静态文本，结束编辑后由视图换回静态文本
+class TextEditItem : public QGraphicsTextItem {
+    Q_OBJECT
+public:
+    explicit TextEditItem(const StaticTextItem *source, QGraphicsItem *parent = nullptr);
+
+signals:
+    void editingFinished(bool accepted);          // 回车/失去焦点为确认，Esc 为放弃
+
+protected:
+    void keyPressEvent(QKeyEvent *event) override;
+    void focusOutEvent(QFocusEvent *event) override;
+};
+
+#endif // STATICTEXTITEM_H
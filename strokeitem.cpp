@@ -0,0 +1,405 @@
+#include "strokeitem.h"
+#include "layeritem.h"
+#include "binarycodec.h"
+#include <QPainter>
+#include <QPainterPathStroker>
+#include <QStyleOptionGraphicsItem>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+#include <QCache>
+#include <climits>
+
+namespace {
+const qreal kInitialReserve = 32.0;   // 初始预留半径
+const qreal kLodTolerance[] = { 1.0, 4.0, 16.0 };  // 各级简化容差（场景坐标）
+const qreal kLodDeviceTolerance = 0.35;            // 屏幕上允许的偏差（像素）
+const qreal kPlaceholderPixels = 2.0;              // 小于此尺寸时只画色块
+const qreal kFixedScale = 16.0;                    // 紧凑编码的定点精度（1/16 像素，与文档相同）
+const qint64 kDefaultCacheBytes = qint64(64) * 1024 * 1024; // 解码缓存的默认容量
+
+// 解码缓存：按最近使用淘汰，代价为解码结果占用的字节数
+QCache<const StrokeItem*, StrokeGeometry> &decodeCache() {
+    static QCache<const StrokeItem*, StrokeGeometry> cache(int(kDefaultCacheBytes));
+    return cache;
+}
+
+quint64 cacheHits = 0;
+quint64 cacheMisses = 0;
+}
+
+qint64 StrokeGeometry::byteSize() const {
+    qint64 bytes = qint64(points.capacity()) * sizeof(QPointF)
+                 + qint64(cubicPath.elementCount()) * sizeof(QPainterPath::Element);
+    for (int level = 0; level < LodLevels; ++level) {
+        bytes += qint64(lodPoints[level].capacity()) * sizeof(QPointF);
+    }
+    return bytes;
+}
+
+StrokeItem::StrokeItem(const QPointF &startPoint, const QPen &pen, QGraphicsItem *parent)
+    : QGraphicsItem(parent),
+      packedCount(0),
+      strokePen(pen),
+      reservedBounds(startPoint.x() - kInitialReserve, startPoint.y() - kInitialReserve,
+                     kInitialReserve * 2, kInitialReserve * 2),
+      cubic(false),
+      fitWatcher(nullptr) {
+    live.points.append(startPoint);
+    // 需要 exposedRect 来跳过不在重绘区域内的分块
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+}
+
+StrokeItem::StrokeItem(const QVector<QPointF> &points, const QPen &pen, QGraphicsItem *parent)
+    : QGraphicsItem(parent),
+      packedCount(0),
+      strokePen(pen),
+      cubic(false),
+      fitWatcher(nullptr) {
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+    live.points = points;
+    rebuildBounds(points);
+    compact();
+}
+
+// 加载文档时直接保留文件中的编码，只为包围盒和分块临时解码一次，不进缓存
+StrokeItem::StrokeItem(const QByteArray &packed, int count, bool cubic, const QPen &pen, QGraphicsItem *parent)
+    : QGraphicsItem(parent),
+      packed(packed),
+      packedCount(count),
+      strokePen(pen),
+      cubic(cubic),
+      fitWatcher(nullptr) {
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+    StrokeGeometry decoded;
+    decodeInto(&decoded);
+    rebuildBounds(decoded.points);
+}
+
+StrokeItem::~StrokeItem() {
+    // 直接删除监视器即断开回调，后台结果被丢弃
+    delete fitWatcher;
+    dropCache();
+}
+
+// 追加采样点：只在超出预留区域时才改变几何，并只重绘新线段
+void StrokeItem::appendPoint(const QPointF &point) {
+    if (isCompact()) expand();
+    const QPointF last = live.points.last();
+    if (point == last) return;
+
+    const int segmentIndex = live.points.size() - 1;
+    live.points.append(point);
+    live.lodReady = false;
+
+    QRectF segmentRect;
+    segmentRect.setCoords(qMin(last.x(), point.x()), qMin(last.y(), point.y()),
+                          qMax(last.x(), point.x()), qMax(last.y(), point.y()));
+    if (segmentIndex % ChunkSize == 0) {
+        chunkBounds.append(segmentRect);
+    } else {
+        QRectF &chunk = chunkBounds.last();
+        chunk.setCoords(qMin(chunk.left(), segmentRect.left()), qMin(chunk.top(), segmentRect.top()),
+                        qMax(chunk.right(), segmentRect.right()), qMax(chunk.bottom(), segmentRect.bottom()));
+    }
+
+    growBounds(point);
+    const qreal margin = paintMargin();
+    update(segmentRect.adjusted(-margin, -margin, margin, margin));
+}
+
+// 超出预留区域时按当前尺寸的一半外扩，几何变更次数与笔迹长度成对数关系
+void StrokeItem::growBounds(const QPointF &point) {
+    if (reservedBounds.contains(point)) return;
+    prepareGeometryChange();
+    const qreal slack = qMax(kInitialReserve, qMax(reservedBounds.width(), reservedBounds.height()) / 2);
+    reservedBounds.setCoords(qMin(reservedBounds.left(), point.x() - slack),
+                             qMin(reservedBounds.top(), point.y() - slack),
+                             qMax(reservedBounds.right(), point.x() + slack),
+                             qMax(reservedBounds.bottom(), point.y() + slack));
+}
+
+// 后台简化：采样点隐式共享给工作线程，完成后回到 GUI 线程替换
+void StrokeItem::simplifyAsync(int mode, qreal tolerance,
+                               const std::function<void(const SimplifyStats &)> &done) {
+    if (mode == StrokeSimplifier::Off || cubic || fitWatcher) return;
+    fitWatcher = new QFutureWatcher<SimplifiedStroke>();
+    QObject::connect(fitWatcher, &QFutureWatcherBase::finished, [this, done]() {
+        const SimplifiedStroke result = fitWatcher->result();
+        fitWatcher->deleteLater();
+        fitWatcher = nullptr;
+        setSimplified(result);
+        if (done) done(result.stats);
+    });
+    fitWatcher->setFuture(QtConcurrent::run(StrokeSimplifier::simplify, points(), mode, tolerance));
+}
+
+// 简化结果只在提交后到来（或加载文档时直接设置），替换后即压缩
+void StrokeItem::setSimplified(const SimplifiedStroke &result) {
+    if (result.points.isEmpty()) return;
+    LayerItem::touch(this);     // 旧几何所在的缓存区域
+    prepareGeometryChange();
+    dropCache();
+    packed.clear();
+    packedCount = 0;
+    live = StrokeGeometry();
+    live.points = result.points;
+    cubic = result.isCubic;
+    rebuildBounds(live.points);
+    compact();
+    LayerItem::touch(this);
+}
+
+// 按给定的几何重新计算包围盒；折线模式同时重建分块
+void StrokeItem::rebuildBounds(const QVector<QPointF> &points) {
+    chunkBounds.clear();
+    const QPointF first = points.first();
+    reservedBounds = QRectF(first, first);
+    for (int i = 1; i < points.size(); ++i) {
+        const QPointF &a = points[i - 1];
+        const QPointF &b = points[i];
+        QRectF segmentRect;
+        segmentRect.setCoords(qMin(a.x(), b.x()), qMin(a.y(), b.y()), qMax(a.x(), b.x()), qMax(a.y(), b.y()));
+        if (!cubic) {
+            if ((i - 1) % ChunkSize == 0) {
+                chunkBounds.append(segmentRect);
+            } else {
+                QRectF &chunk = chunkBounds.last();
+                chunk.setCoords(qMin(chunk.left(), segmentRect.left()), qMin(chunk.top(), segmentRect.top()),
+                                qMax(chunk.right(), segmentRect.right()), qMax(chunk.bottom(), segmentRect.bottom()));
+            }
+        }
+        reservedBounds.setCoords(qMin(reservedBounds.left(), segmentRect.left()),
+                                 qMin(reservedBounds.top(), segmentRect.top()),
+                                 qMax(reservedBounds.right(), segmentRect.right()),
+                                 qMax(reservedBounds.bottom(), segmentRect.bottom()));
+    }
+}
+
+void StrokeItem::setPen(const QPen &pen) {
+    if (pen.widthF() != strokePen.widthF()) prepareGeometryChange();
+    strokePen = pen;
+    update();
+}
+
+qreal StrokeItem::paintMargin() const {
+    return strokePen.widthF() / 2 + 1;
+}
+
+// 压缩：坐标量化到 1/16 像素（最大偏差 1/32 像素，与保存再打开的结果相同），
+// 长笔迹相邻采样点的差分多为 1～2 字节，约为 QPointF 的八分之一
+void StrokeItem::compact() {
+    if (isCompact() || live.points.isEmpty()) return;
+    packed = packedPoints();
+    packed.squeeze();
+    packedCount = live.points.size();
+    live = StrokeGeometry();
+}
+
+QByteArray StrokeItem::packedPoints() const {
+    if (isCompact()) return packed;
+    QByteArray buffer;
+    buffer.reserve(live.points.size() * 2);
+    BinaryWriter out(&buffer);
+    qint64 lastX = 0, lastY = 0;
+    foreach (const QPointF &p, live.points) {
+        const qint64 x = qRound64(p.x() * kFixedScale);
+        const qint64 y = qRound64(p.y() * kFixedScale);
+        out.svarint(x - lastX);
+        out.svarint(y - lastY);
+        lastX = x;
+        lastY = y;
+    }
+    return buffer;
+}
+
+void StrokeItem::decodeInto(StrokeGeometry *geometry) const {
+    BinaryReader in(reinterpret_cast<const uchar*>(packed.constData()), quint32(packed.size()));
+    geometry->points.resize(packedCount);
+    QPointF *data = geometry->points.data();
+    qint64 x = 0, y = 0;
+    for (int i = 0; i < packedCount; ++i) {
+        x += in.svarint();
+        y += in.svarint();
+        data[i] = QPointF(x / kFixedScale, y / kFixedScale);
+    }
+    if (cubic) fillCubicPath(geometry);
+}
+
+void StrokeItem::fillCubicPath(StrokeGeometry *geometry) {
+    const QVector<QPointF> &points = geometry->points;
+    geometry->cubicPath = QPainterPath(points.first());
+    for (int i = 1; i + 2 < points.size(); i += 3) {
+        geometry->cubicPath.cubicTo(points[i], points[i + 1], points[i + 2]);
+    }
+}
+
+void StrokeItem::expand() {
+    if (!isCompact()) return;
+    live = StrokeGeometry();
+    decodeInto(&live);
+    dropCache();
+    packed.clear();
+    packedCount = 0;
+}
+
+// 命中时移到最近使用的一端；未命中时解码并放入缓存，代价预留了简化折线的空间。
+// 单条超过容量的笔迹按容量计，只淘汰其他内容，不会在放入时立即被删除
+StrokeGeometry *StrokeItem::geometry() const {
+    if (!isCompact()) {
+        if (cubic && live.cubicPath.isEmpty()) fillCubicPath(&live);
+        return &live;
+    }
+    QCache<const StrokeItem*, StrokeGeometry> &cache = decodeCache();
+    if (StrokeGeometry *cached = cache.object(this)) {
+        ++cacheHits;
+        return cached;
+    }
+    ++cacheMisses;
+    StrokeGeometry *decoded = new StrokeGeometry();
+    decodeInto(decoded);
+    const qint64 cost = decoded->byteSize() + qint64(packedCount) * sizeof(QPointF);
+    cache.insert(this, decoded, int(qMin<qint64>(cost, cache.maxCost())));
+    return decoded;
+}
+
+void StrokeItem::dropCache() const {
+    decodeCache().remove(this);
+}
+
+QVector<QPointF> StrokeItem::points() const {
+    return geometry()->points;
+}
+
+QPainterPath StrokeItem::path() const {
+    const StrokeGeometry *current = geometry();
+    if (cubic) return current->cubicPath;
+    const QVector<QPointF> &points = current->points;
+    QPainterPath result(points.first());
+    for (int i = 1; i < points.size(); ++i) {
+        result.lineTo(points[i]);
+    }
+    return result;
+}
+
+qint64 StrokeItem::byteSize() const {
+    return sizeof(StrokeItem)
+         + packed.capacity()
+         + qint64(chunkBounds.capacity()) * sizeof(QRectF)
+         + live.byteSize();
+}
+
+// 压缩前的存储：每个点一个 QPointF，贝塞尔曲线另有一份路径（每个控制点一个元素）
+qint64 StrokeItem::expandedByteSize() const {
+    const qint64 count = pointCount();
+    return sizeof(StrokeItem)
+         + qint64(chunkBounds.capacity()) * sizeof(QRectF)
+         + count * sizeof(QPointF)
+         + (cubic ? count * sizeof(QPainterPath::Element) : 0);
+}
+
+StrokeCacheStats StrokeItem::cacheStats() {
+    const QCache<const StrokeItem*, StrokeGeometry> &cache = decodeCache();
+    StrokeCacheStats stats;
+    stats.entries = cache.count();
+    stats.bytes = cache.totalCost();
+    stats.limit = cache.maxCost();
+    stats.hits = cacheHits;
+    stats.misses = cacheMisses;
+    return stats;
+}
+
+void StrokeItem::setCacheLimit(qint64 bytes) {
+    decodeCache().setMaxCost(int(qBound<qint64>(1, bytes, INT_MAX)));
+}
+
+// 逐级在上一级结果上继续简化，总开销接近一次完整简化；累计偏差不超过各级容差之和
+void StrokeItem::buildLods(StrokeGeometry *geometry) const {
+    QVector<QPointF> base = geometry->points;
+    if (cubic) {
+        const QList<QPolygonF> polygons = geometry->cubicPath.toSubpathPolygons();
+        if (!polygons.isEmpty()) base = polygons.first();
+    }
+    for (int level = 0; level < StrokeGeometry::LodLevels; ++level) {
+        const QVector<int> kept = StrokeSimplifier::douglasPeucker(base, kLodTolerance[level]);
+        QVector<QPointF> &simplified = geometry->lodPoints[level];
+        simplified.clear();
+        simplified.reserve(kept.size());
+        foreach (int index, kept) {
+            simplified.append(base[index]);
+        }
+        base = simplified;
+    }
+    geometry->lodReady = true;
+}
+
+// 选容差不超过一个屏幕像素左右的最粗级别
+int StrokeItem::lodFor(qreal levelOfDetail) {
+    const qreal allowed = kLodDeviceTolerance / levelOfDetail;
+    int level = -1;
+    for (int i = 0; i < StrokeGeometry::LodLevels && kLodTolerance[i] <= allowed; ++i) {
+        level = i;
+    }
+    return level;
+}
+
+QRectF StrokeItem::boundingRect() const {
+    const qreal margin = paintMargin();
+    return reservedBounds.adjusted(-margin, -margin, margin, margin);
+}
+
+QPainterPath StrokeItem::shape() const {
+    QPainterPathStroker stroker;
+    stroker.setWidth(qMax<qreal>(strokePen.widthF(), 1));
+    stroker.setCapStyle(strokePen.capStyle());
+    stroker.setJoinStyle(strokePen.joinStyle());
+    return stroker.createStroke(path());
+}
+
+// 只绘制与重绘区域相交的分块，连续的分块合并为一条折线
+void StrokeItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) {
+    Q_UNUSED(widget);
+    const qreal lod = QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform());
+    // 连同笔宽在屏幕上只有一两个像素时只画一个色块，不必解码；
+    // 按含笔宽的范围判断，单击点出的圆点和很短的笔迹在正常缩放下仍画成圆头
+    const QRectF bounds = boundingRect();
+    if (qMax(bounds.width(), bounds.height()) * lod < kPlaceholderPixels) {
+        painter->fillRect(bounds, strokePen.color());
+        return;
+    }
+
+    StrokeGeometry *current = geometry();
+    const QVector<QPointF> &points = current->points;
+    painter->setPen(strokePen);
+    painter->setBrush(Qt::NoBrush);
+    if (points.size() == 1) {
+        painter->drawPoint(points.first());
+        return;
+    }
+    const int level = lodFor(lod);
+    if (level >= 0) {
+        if (!current->lodReady) buildLods(current);
+        painter->drawPolyline(current->lodPoints[level].constData(), current->lodPoints[level].size());
+        return;
+    }
+    if (cubic) {
+        painter->drawPath(current->cubicPath);
+        return;
+    }
+
+    const qreal margin = paintMargin();
+    const QRectF exposed = option->exposedRect;
+    const QPointF *data = points.constData();
+    int runStart = -1;
+    for (int c = 0; c < chunkBounds.size(); ++c) {
+        const int first = c * ChunkSize;
+        if (chunkBounds[c].adjusted(-margin, -margin, margin, margin).intersects(exposed)) {
+            if (runStart < 0) runStart = first;
+        } else if (runStart >= 0) {
+            painter->drawPolyline(data + runStart, first - runStart + 1);
+            runStart = -1;
+        }
+    }
+    if (runStart >= 0) {
+        painter->drawPolyline(data + runStart, points.size() - runStart);
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef STROKEITEM_H
+#define STROKEITEM_H
+
+#include <QGraphicsItem>
+#include <QPen>
+#include <QVector>
+#include <QPointF>
+#include <QRectF>
+#include <QPainterPath>
+#include <QByteArray>
+#include <functional>
+#include "strokesimplifier.h"
+
+template <typename T> class QFutureWatcher;
+
+// 笔迹的几何：采样点（或贝塞尔控制点）、拟合后的曲线路径和各级简化折线
+struct StrokeGeometry {
+    enum { LodLevels = 3 };                      // 缩小显示用的简化级数
+
+    QVector<QPointF> points;
+    QPainterPath cubicPath;
+    QVector<QPointF> lodPoints[LodLevels];       // 首次缩小绘制时生成
+    bool lodReady = false;                       // 简化折线是否与当前几何一致
+
+    qint64 byteSize() const;
+};
+
+// 解码缓存的统计
+struct StrokeCacheStats {
+    int entries = 0;
+    qint64 bytes = 0;
+    qint64 limit = 0;
+    quint64 hits = 0;
+    quint64 misses = 0;
+};
+
+// 画笔笔迹图形项：绘制中采样点连续存储，追加时只重绘新增线段；
+// 提交后压缩为 1/16 像素定点、zigzag 变长整数差分的紧凑编码（与文档中的笔迹坐标相同），
+// 绘制、导出和命中测试时按需解码，解码结果放在按最近使用淘汰的全局缓存里（只在 GUI 线程访问）
+class StrokeItem : public QGraphicsItem {
+public:
+    enum { Type = UserType + 1 };
+
+    StrokeItem(const QPointF &startPoint, const QPen &pen, QGraphicsItem *parent = nullptr);
+    StrokeItem(const QVector<QPointF> &points, const QPen &pen, QGraphicsItem *parent = nullptr); // 由现成折线构造（紧凑存储）
+    StrokeItem(const QByteArray &packed, int count, bool cubic, const QPen &pen, QGraphicsItem *parent = nullptr); // 由紧凑编码构造（加载文档用）
+    ~StrokeItem();
+
+    void appendPoint(const QPointF &point);      // 追加采样点（均摊 O(1)）
+    QVector<QPointF> points() const;             // 采样点（紧凑存储时为解码结果，隐式共享）
+    int pointCount() const { return packed.isEmpty() ? live.points.size() : packedCount; }
+    QPen pen() const { return strokePen; }
+    void setPen(const QPen &pen);                // 设置画笔
+    QPainterPath path() const;                   // 转换为 QPainterPath（导出、命中测试用）
+    bool isCubic() const { return cubic; }       // points() 是否为贝塞尔控制点序列
+    qint64 byteSize() const;                     // 占用的内存（估算，不含解码缓存）
+    qint64 expandedByteSize() const;             // 不压缩时几何占用的内存（采样点、曲线路径和简化折线），对照用
+
+    void compact();                              // 转为紧凑存储（提交后调用；之后再追加采样点会先解压）
+    bool isCompact() const { return !packed.isEmpty(); }
+    QByteArray packedPoints() const;             // 紧凑编码（未压缩时现编）
+
+    static StrokeCacheStats cacheStats();        // 解码缓存的统计
+    static void setCacheLimit(qint64 bytes);     // 解码缓存的容量
+
+    // 后台简化：在线程池中运行，完成后在 GUI 线程替换几何并回调统计
+    void simplifyAsync(int mode, qreal tolerance, const std::function<void(const SimplifyStats &)> &done);
+    void setSimplified(const SimplifiedStroke &result);   // 直接替换为简化结果
+
+    int type() const override { return Type; }
+    QRectF boundingRect() const override;
+    QPainterPath shape() const override;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
+
+private:
+    enum { ChunkSize = 64 };                     // 每个分块包含的线段数
+
+    qreal paintMargin() const;                   // 笔宽带来的外扩量
+    void growBounds(const QPointF &point);       // 按需扩大包围盒
+    void rebuildBounds(const QVector<QPointF> &points); // 整体替换几何后重建包围盒和分块
+    void buildLods(StrokeGeometry *geometry) const; // 生成各级简化折线
+    static int lodFor(qreal levelOfDetail);      // 按缩放选择简化级别，-1 为原始几何
+    StrokeGeometry *geometry() const;            // 当前几何：未压缩时为 live，否则取自解码缓存（下次解码其他笔迹前有效）
+    void decodeInto(StrokeGeometry *geometry) const; // 解码紧凑编码
+    static void fillCubicPath(StrokeGeometry *geometry); // 由控制点生成曲线路径
+    void expand();                               // 解压回 live
+    void dropCache() const;                      // 几何变化或删除时移除缓存的解码结果
+
+    mutable StrokeGeometry live;                 // 绘制中（未压缩）的几何
+    QByteArray packed;                           // 紧凑编码，空为未压缩
+    int packedCount;                             // 紧凑编码中的点数
+    QVector<QRectF> chunkBounds;                 // 分块包围盒（绘制时裁剪用）
+    QPen strokePen;                              // 画笔
+    QRectF reservedBounds;                       // 预留的包围盒（成倍扩大，减少几何变更次数）
+    bool cubic;                                  // 是否已拟合为贝塞尔曲线
+    QFutureWatcher<SimplifiedStroke> *fitWatcher; // 进行中的后台简化
+};
+
+#endif // STROKEITEM_H
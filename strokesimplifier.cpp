@@ -0,0 +1,319 @@
+#include "strokesimplifier.h"
+#include <QPair>
+#include <QtMath>
+
+namespace {
+
+inline qreal dot(const QPointF &a, const QPointF &b) {
+    return a.x() * b.x() + a.y() * b.y();
+}
+
+inline qreal length(const QPointF &v) {
+    return qSqrt(dot(v, v));
+}
+
+inline QPointF normalized(const QPointF &v) {
+    const qreal len = length(v);
+    return len > 0 ? v / len : QPointF();
+}
+
+// 点到线段的距离
+qreal segmentDistance(const QPointF &p, const QPointF &a, const QPointF &b) {
+    const QPointF ab = b - a;
+    const qreal len2 = dot(ab, ab);
+    if (len2 <= 0) return length(p - a);
+    const qreal t = qBound<qreal>(0, dot(p - a, ab) / len2, 1);
+    return length(p - (a + ab * t));
+}
+
+// 三次贝塞尔段
+struct Bezier {
+    QPointF p[4];
+};
+
+QPointF bezierPoint(const Bezier &b, qreal t) {
+    const qreal mt = 1 - t;
+    return b.p[0] * (mt * mt * mt) + b.p[1] * (3 * mt * mt * t)
+         + b.p[2] * (3 * mt * t * t) + b.p[3] * (t * t * t);
+}
+
+// Schneider 曲线拟合（Graphics Gems I, "An Algorithm for Automatically Fitting Digitized Curves"）
+class CurveFitter {
+public:
+    CurveFitter(const QVector<QPointF> &points, qreal tolerance)
+        : d(points), errorSq(tolerance * tolerance) {}
+
+    void fit(QVector<QPointF> &out, QVector<int> &segmentEnds) {
+        result = &out;
+        ends = &segmentEnds;
+        const int last = d.size() - 1;
+        fitCubic(0, last, normalized(d[1] - d[0]), normalized(d[last - 1] - d[last]));
+    }
+
+private:
+    enum { MaxIterations = 4 };
+
+    void emitBezier(const Bezier &b, int last) {
+        if (result->isEmpty()) result->append(b.p[0]);
+        result->append(b.p[1]);
+        result->append(b.p[2]);
+        result->append(b.p[3]);
+        ends->append(last);
+    }
+
+    void fitCubic(int first, int last, const QPointF &tHat1, const QPointF &tHat2) {
+        const int nPts = last - first + 1;
+        if (nPts == 2) {
+            const qreal dist = length(d[last] - d[first]) / 3;
+            Bezier b;
+            b.p[0] = d[first];
+            b.p[3] = d[last];
+            b.p[1] = b.p[0] + tHat1 * dist;
+            b.p[2] = b.p[3] + tHat2 * dist;
+            emitBezier(b, last);
+            return;
+        }
+
+        QVector<qreal> u = chordLengthParameterize(first, last);
+        Bezier b = generateBezier(first, last, u, tHat1, tHat2);
+        int splitPoint = 0;
+        qreal maxError = computeMaxError(first, last, b, u, &splitPoint);
+        if (maxError < errorSq) {
+            emitBezier(b, last);
+            return;
+        }
+
+        // 误差不太大时先尝试牛顿迭代重新参数化
+        if (maxError < errorSq * 16) {
+            for (int i = 0; i < MaxIterations; ++i) {
+                u = reparameterize(first, last, u, b);
+                b = generateBezier(first, last, u, tHat1, tHat2);
+                maxError = computeMaxError(first, last, b, u, &splitPoint);
+                if (maxError < errorSq) {
+                    emitBezier(b, last);
+                    return;
+                }
+            }
+        }
+
+        QPointF tHatCenter = normalized(d[splitPoint - 1] - d[splitPoint + 1]);
+        if (tHatCenter.isNull()) tHatCenter = normalized(d[splitPoint - 1] - d[splitPoint]);
+        fitCubic(first, splitPoint, tHat1, tHatCenter);
+        fitCubic(splitPoint, last, -tHatCenter, tHat2);
+    }
+
+    QVector<qreal> chordLengthParameterize(int first, int last) const {
+        QVector<qreal> u(last - first + 1);
+        u[0] = 0;
+        for (int i = first + 1; i <= last; ++i) {
+            u[i - first] = u[i - first - 1] + length(d[i] - d[i - 1]);
+        }
+        const qreal total = u.last();
+        for (int i = 1; i < u.size(); ++i) {
+            u[i] = total > 0 ? u[i] / total : 1;
+        }
+        return u;
+    }
+
+    Bezier generateBezier(int first, int last, const QVector<qreal> &u,
+                          const QPointF &tHat1, const QPointF &tHat2) const {
+        qreal c00 = 0, c01 = 0, c11 = 0, x0 = 0, x1 = 0;
+        const QPointF p0 = d[first];
+        const QPointF p3 = d[last];
+        for (int i = 0; i < u.size(); ++i) {
+            const qreal t = u[i];
+            const qreal mt = 1 - t;
+            const qreal b0 = mt * mt * mt, b1 = 3 * mt * mt * t, b2 = 3 * mt * t * t, b3 = t * t * t;
+            const QPointF a0 = tHat1 * b1;
+            const QPointF a1 = tHat2 * b2;
+            c00 += dot(a0, a0);
+            c01 += dot(a0, a1);
+            c11 += dot(a1, a1);
+            const QPointF tmp = d[first + i] - (p0 * (b0 + b1) + p3 * (b2 + b3));
+            x0 += dot(a0, tmp);
+            x1 += dot(a1, tmp);
+        }
+
+        const qreal detC = c00 * c11 - c01 * c01;
+        qreal alphaL = 0, alphaR = 0;
+        if (!qFuzzyIsNull(detC)) {
+            alphaL = (x0 * c11 - x1 * c01) / detC;
+            alphaR = (c00 * x1 - c01 * x0) / detC;
+        }
+
+        Bezier b;
+        b.p[0] = p0;
+        b.p[3] = p3;
+        const qreal segLength = length(p3 - p0);
+        const qreal epsilon = 1.0e-6 * segLength;
+        if (alphaL < epsilon || alphaR < epsilon) {
+            // 最小二乘无意义时退化为 Wu/Barsky 启发式
+            const qreal dist = segLength / 3;
+            b.p[1] = p0 + tHat1 * dist;
+            b.p[2] = p3 + tHat2 * dist;
+        } else {
+            b.p[1] = p0 + tHat1 * alphaL;
+            b.p[2] = p3 + tHat2 * alphaR;
+        }
+        return b;
+    }
+
+    QVector<qreal> reparameterize(int first, int last, const QVector<qreal> &u, const Bezier &b) const {
+        QVector<qreal> uPrime(u.size());
+        for (int i = first; i <= last; ++i) {
+            uPrime[i - first] = newtonRaphsonRoot(b, d[i], u[i - first]);
+        }
+        return uPrime;
+    }
+
+    static qreal newtonRaphsonRoot(const Bezier &q, const QPointF &p, qreal u) {
+        QPointF q1[3], q2[2];
+        for (int i = 0; i < 3; ++i) q1[i] = (q.p[i + 1] - q.p[i]) * 3;
+        for (int i = 0; i < 2; ++i) q2[i] = (q1[i + 1] - q1[i]) * 2;
+        const qreal mu = 1 - u;
+        const QPointF qu = bezierPoint(q, u);
+        const QPointF q1u = q1[0] * (mu * mu) + q1[1] * (2 * mu * u) + q1[2] * (u * u);
+        const QPointF q2u = q2[0] * mu + q2[1] * u;
+        const qreal numerator = dot(qu - p, q1u);
+        const qreal denominator = dot(q1u, q1u) + dot(qu - p, q2u);
+        if (qFuzzyIsNull(denominator)) return u;
+        return qBound<qreal>(0, u - numerator / denominator, 1);
+    }
+
+    qreal computeMaxError(int first, int last, const Bezier &b, const QVector<qreal> &u, int *splitPoint) const {
+        qreal maxDist = 0;
+        *splitPoint = (first + last) / 2;
+        for (int i = first + 1; i < last; ++i) {
+            const QPointF v = bezierPoint(b, u[i - first]) - d[i];
+            const qreal dist = dot(v, v);
+            if (dist >= maxDist) {
+                maxDist = dist;
+                *splitPoint = i;
+            }
+        }
+        return maxDist;
+    }
+
+    const QVector<QPointF> &d;
+    qreal errorSq;
+    QVector<QPointF> *result = nullptr;
+    QVector<int> *ends = nullptr;
+};
+
+// 折线模式偏差：每个原始点到其所属保留线段的距离
+qreal polylineDeviation(const QVector<QPointF> &points, const QVector<int> &kept) {
+    qreal maxDev = 0;
+    for (int k = 1; k < kept.size(); ++k) {
+        const QPointF &a = points[kept[k - 1]];
+        const QPointF &b = points[kept[k]];
+        for (int i = kept[k - 1] + 1; i < kept[k]; ++i) {
+            maxDev = qMax(maxDev, segmentDistance(points[i], a, b));
+        }
+    }
+    return maxDev;
+}
+
+// 曲线模式偏差：把每段贝塞尔展开成细折线，再量原始点到它的距离
+qreal cubicDeviation(const QVector<QPointF> &points, const QVector<int> &kept,
+                     const QVector<QPointF> &curve, const QVector<int> &segmentEnds) {
+    enum { Steps = 16 };
+    qreal maxDev = 0;
+    int segmentStart = 0;
+    for (int s = 0; s < segmentEnds.size(); ++s) {
+        Bezier b;
+        for (int k = 0; k < 4; ++k) b.p[k] = curve[s * 3 + k];
+        QPointF flat[Steps + 1];
+        for (int k = 0; k <= Steps; ++k) flat[k] = bezierPoint(b, qreal(k) / Steps);
+
+        const int rawFirst = kept[segmentStart];
+        const int rawLast = kept[segmentEnds[s]];
+        for (int i = rawFirst + 1; i < rawLast; ++i) {
+            qreal best = segmentDistance(points[i], flat[0], flat[1]);
+            for (int k = 1; k < Steps; ++k) {
+                best = qMin(best, segmentDistance(points[i], flat[k], flat[k + 1]));
+            }
+            maxDev = qMax(maxDev, best);
+        }
+        segmentStart = segmentEnds[s];
+    }
+    return maxDev;
+}
+
+}
+
+namespace StrokeSimplifier {
+
+qreal toleranceFor(qreal penWidth, qreal viewScale) {
+    if (viewScale <= 0) viewScale = 1;
+    return (0.5 + 0.1 * penWidth) / viewScale;
+}
+
+QVector<int> douglasPeucker(const QVector<QPointF> &points, qreal tolerance) {
+    const int n = points.size();
+    QVector<int> kept;
+    if (n <= 2) {
+        for (int i = 0; i < n; ++i) kept.append(i);
+        return kept;
+    }
+
+    // 显式栈代替递归，避免长笔迹栈溢出
+    QVector<bool> keep(n, false);
+    keep[0] = keep[n - 1] = true;
+    QVector<QPair<int, int> > ranges;
+    ranges.append(qMakePair(0, n - 1));
+    while (!ranges.isEmpty()) {
+        const QPair<int, int> range = ranges.takeLast();
+        qreal maxDist = 0;
+        int index = -1;
+        for (int i = range.first + 1; i < range.second; ++i) {
+            const qreal dist = segmentDistance(points[i], points[range.first], points[range.second]);
+            if (dist > maxDist) {
+                maxDist = dist;
+                index = i;
+            }
+        }
+        if (index >= 0 && maxDist > tolerance) {
+            keep[index] = true;
+            ranges.append(qMakePair(range.first, index));
+            ranges.append(qMakePair(index, range.second));
+        }
+    }
+
+    for (int i = 0; i < n; ++i) {
+        if (keep[i]) kept.append(i);
+    }
+    return kept;
+}
+
+SimplifiedStroke simplify(const QVector<QPointF> &points, int mode, qreal tolerance) {
+    SimplifiedStroke result;
+    result.stats.pointsBefore = points.size();
+    if (mode == Off || points.size() < 3) {
+        result.points = points;
+        result.stats.pointsAfter = points.size();
+        return result;
+    }
+
+    // 曲线模式先用一半容差做折线预简化，减少拟合输入
+    const qreal rdpTolerance = (mode == Cubic) ? tolerance / 2 : tolerance;
+    const QVector<int> kept = douglasPeucker(points, rdpTolerance);
+    QVector<QPointF> reduced;
+    reduced.reserve(kept.size());
+    for (int i = 0; i < kept.size(); ++i) reduced.append(points[kept[i]]);
+
+    if (mode == Polyline || reduced.size() < 3) {
+        result.points = reduced;
+        result.stats.pointsAfter = reduced.size();
+        result.stats.maxDeviation = polylineDeviation(points, kept);
+        return result;
+    }
+
+    QVector<int> segmentEnds;
+    CurveFitter(reduced, tolerance).fit(result.points, segmentEnds);
+    result.isCubic = true;
+    result.stats.pointsAfter = result.points.size();
+    result.stats.maxDeviation = cubicDeviation(points, kept, result.points, segmentEnds);
+    return result;
+}
+
+}
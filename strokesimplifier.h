@@ -0,0 +1,40 @@
+#ifndef STROKESIMPLIFIER_H
+#define STROKESIMPLIFIER_H
+
+#include <QVector>
+#include <QPointF>
+
+// 笔迹简化统计
+struct SimplifyStats {
+    int pointsBefore = 0;       // 原始采样点数
+    int pointsAfter = 0;        // 简化后的点数（曲线模式下含控制点）
+    qreal maxDeviation = 0;     // 原始采样点到结果的最大偏差（场景坐标）
+};
+
+// 简化结果：折线模式下为顶点序列；曲线模式下为 p0,c1,c2,p1,c1,c2,p2... 的三次贝塞尔序列
+struct SimplifiedStroke {
+    QVector<QPointF> points;
+    bool isCubic = false;
+    SimplifyStats stats;
+};
+
+namespace StrokeSimplifier {
+
+enum Mode {
+    Off,        // 不简化
+    Polyline,   // Ramer–Douglas–Peucker 折线
+    Cubic       // 折线预简化后再做三次贝塞尔拟合
+};
+
+// 容差：屏幕上约半个像素加上笔宽的一小部分，再换算到场景坐标
+qreal toleranceFor(qreal penWidth, qreal viewScale);
+
+// Ramer–Douglas–Peucker，返回保留点在输入中的下标
+QVector<int> douglasPeucker(const QVector<QPointF> &points, qreal tolerance);
+
+// 完整简化流程（纯函数，可在工作线程中运行）
+SimplifiedStroke simplify(const QVector<QPointF> &points, int mode, qreal tolerance);
+
+}
+
+#endif // STROKESIMPLIFIER_H
@@ -0,0 +1,200 @@
+#include "tilelayer.h"
+#include "layeritem.h"
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+#include <QtMath>
+#include <algorithm>
+
+namespace {
+
+// 按抗锯齿遮罩把瓦片拆成被清除的部分（写进 patch）和剩余部分（留在 tile）：
+// 各分量按遮罩取整后再限制在剩余部分仍是合法预乘颜色的范围内，两部分逐字节相加正好是原图
+void splitByMask(QImage *tile, const QImage &mask, QImage *patch) {
+    for (int y = 0; y < tile->height(); ++y) {
+        QRgb *t = reinterpret_cast<QRgb*>(tile->scanLine(y));
+        const QRgb *m = reinterpret_cast<const QRgb*>(mask.constScanLine(y));
+        QRgb *p = reinterpret_cast<QRgb*>(patch->scanLine(y));
+        for (int x = 0; x < tile->width(); ++x) {
+            const int coverage = qAlpha(m[x]);
+            if (coverage == 0 || t[x] == 0) {
+                p[x] = 0;
+                continue;
+            }
+            const int ta = qAlpha(t[x]);
+            const int pa = (ta * coverage + 127) / 255;
+            const int tc[3] = { qRed(t[x]), qGreen(t[x]), qBlue(t[x]) };
+            int pc[3];
+            for (int c = 0; c < 3; ++c) {
+                pc[c] = qBound(qMax(0, pa - ta + tc[c]), (tc[c] * coverage + 127) / 255, qMin(pa, tc[c]));
+            }
+            p[x] = qRgba(pc[0], pc[1], pc[2], pa);
+            t[x] = qRgba(tc[0] - pc[0], tc[1] - pc[1], tc[2] - pc[2], ta - pa);
+        }
+    }
+}
+
+// 逐字节减去 patch；tile 是 splitByMask 之前的原图时结果与拆分后的剩余部分完全相同
+void subtractPatch(QImage *tile, const QImage &patch) {
+    for (int y = 0; y < tile->height(); ++y) {
+        QRgb *t = reinterpret_cast<QRgb*>(tile->scanLine(y));
+        const QRgb *p = reinterpret_cast<const QRgb*>(patch.constScanLine(y));
+        for (int x = 0; x < tile->width(); ++x) {
+            if (p[x] == 0) continue;
+            const int a = qMax(0, qAlpha(t[x]) - qAlpha(p[x]));
+            t[x] = qRgba(qBound(0, qRed(t[x]) - qRed(p[x]), a), qBound(0, qGreen(t[x]) - qGreen(p[x]), a),
+                         qBound(0, qBlue(t[x]) - qBlue(p[x]), a), a);
+        }
+    }
+}
+
+}
+
+TileLayer::TileLayer(QGraphicsItem *parent)
+    : QGraphicsItem(parent) {
+    // 需要 exposedRect 只绘制可见瓦片
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+}
+
+TileKey TileLayer::keyOf(int column, int row) {
+    return (TileKey(quint32(column)) << 32) | quint32(row);
+}
+
+QRect TileLayer::tileRect(TileKey key) {
+    const int column = qint32(quint32(key >> 32));
+    const int row = qint32(quint32(key & 0xffffffffu));
+    return QRect(column * TileSize, row * TileSize, TileSize, TileSize);
+}
+
+QList<TileKey> TileLayer::tilesFor(const QRectF &rect) const {
+    QList<TileKey> keys;
+    if (rect.isEmpty()) return keys;
+    const int firstColumn = qFloor(rect.left() / TileSize);
+    const int lastColumn = qFloor(rect.right() / TileSize);
+    const int firstRow = qFloor(rect.top() / TileSize);
+    const int lastRow = qFloor(rect.bottom() / TileSize);
+    for (int row = firstRow; row <= lastRow; ++row) {
+        for (int column = firstColumn; column <= lastColumn; ++column) {
+            keys.append(keyOf(column, row));
+        }
+    }
+    return keys;
+}
+
+QImage &TileLayer::tileAt(TileKey key) {
+    QHash<TileKey, QImage>::iterator it = tiles.find(key);
+    if (it != tiles.end()) return it.value();
+
+    prepareGeometryChange();
+    const QRect rect = tileRect(key);
+    bounds = bounds.isNull() ? QRectF(rect) : bounds.united(rect);
+    QImage tile(TileSize, TileSize, QImage::Format_ARGB32_Premultiplied);
+    tile.fill(Qt::transparent);
+    return tiles.insert(key, tile).value();
+}
+
+// 按层叠次序把图形画进它覆盖的每个瓦片
+void TileLayer::bakeItems(const QList<QGraphicsItem*> &items) {
+    QList<QGraphicsItem*> ordered = items;
+    std::stable_sort(ordered.begin(), ordered.end(), [](QGraphicsItem *a, QGraphicsItem *b) {
+        return a->zValue() < b->zValue();
+    });
+
+    foreach (QGraphicsItem *item, ordered) {
+        // 所在图层隐藏时内容照样烘焙
+        if (!item->isVisibleTo(item->parentItem())) continue;
+        const QTransform itemTransform = item->sceneTransform();
+        const QRectF itemRect = item->sceneBoundingRect();
+        foreach (TileKey key, tilesFor(itemRect)) {
+            const QRect rect = tileRect(key);
+            QImage &tile = tileAt(key);
+            QPainter painter(&tile);
+            painter.setRenderHint(QPainter::Antialiasing);
+            painter.setRenderHint(QPainter::TextAntialiasing);
+            painter.translate(-rect.topLeft());
+            painter.setTransform(itemTransform, true);
+
+            QStyleOptionGraphicsItem option;
+            option.exposedRect = itemTransform.inverted().mapRect(QRectF(rect)) & item->boundingRect();
+            item->paint(&painter, &option, nullptr);
+        }
+        update(itemRect);
+        LayerItem::touch(this, itemRect);
+    }
+}
+
+// 清除区域内像素：被清除的部分按抗锯齿遮罩拆出来保存，贴回（相加）后与剩余部分正好拼成原图
+TilePatches TileLayer::clearArea(const QPainterPath &area) {
+    TilePatches patches;
+    foreach (TileKey key, tilesFor(area.boundingRect())) {
+        QHash<TileKey, QImage>::iterator it = tiles.find(key);
+        if (it == tiles.end()) continue;
+        const QRect rect = tileRect(key);
+        const QPainterPath local = area.translated(-rect.topLeft());
+        if (!local.intersects(QRectF(0, 0, TileSize, TileSize))) continue;
+
+        QImage mask(TileSize, TileSize, QImage::Format_ARGB32_Premultiplied);
+        mask.fill(Qt::transparent);
+        {
+            QPainter painter(&mask);
+            painter.setRenderHint(QPainter::Antialiasing);
+            painter.fillPath(local, Qt::black);
+        }
+        QImage patch(TileSize, TileSize, QImage::Format_ARGB32_Premultiplied);
+        splitByMask(&it.value(), mask, &patch);
+        patches.insert(key, patch);
+        update(rect);
+        LayerItem::touch(this, rect);
+    }
+    return patches;
+}
+
+// 贴回的内容与剩余部分相加：源覆盖（SourceOver）会把剩余部分再乘一次 (1 - 贴回透明度)，抗锯齿边缘留下淡圈
+void TileLayer::restorePatches(const TilePatches &patches) {
+    for (TilePatches::const_iterator it = patches.constBegin(); it != patches.constEnd(); ++it) {
+        QPainter painter(&tileAt(it.key()));
+        painter.setCompositionMode(QPainter::CompositionMode_Plus);
+        painter.drawImage(0, 0, it.value());
+        update(tileRect(it.key()));
+        LayerItem::touch(this, tileRect(it.key()));
+    }
+}
+
+// 再次清除（重做、自动保存恢复、远端实例）：此时瓦片是清除前的原图，减去被清除的部分即得与 clearArea 逐字节相同的结果
+void TileLayer::removePatches(const TilePatches &patches) {
+    for (TilePatches::const_iterator it = patches.constBegin(); it != patches.constEnd(); ++it) {
+        QHash<TileKey, QImage>::iterator tile = tiles.find(it.key());
+        if (tile == tiles.end()) continue;
+        subtractPatch(&tile.value(), it.value().convertToFormat(QImage::Format_ARGB32_Premultiplied));
+        update(tileRect(it.key()));
+        LayerItem::touch(this, tileRect(it.key()));
+    }
+}
+
+qint64 TileLayer::patchBytes(const TilePatches &patches) {
+    qint64 bytes = 0;
+    for (TilePatches::const_iterator it = patches.constBegin(); it != patches.constEnd(); ++it) {
+        bytes += qint64(it.value().bytesPerLine()) * it.value().height();
+    }
+    return bytes;
+}
+
+void TileLayer::clear() {
+    LayerItem::touch(this);
+    prepareGeometryChange();
+    tiles.clear();
+    bounds = QRectF();
+}
+
+qint64 TileLayer::byteSize() const {
+    return qint64(tiles.size()) * TileSize * TileSize * 4;
+}
+
+void TileLayer::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) {
+    Q_UNUSED(widget);
+    painter->setRenderHint(QPainter::SmoothPixmapTransform);
+    foreach (TileKey key, tilesFor(option->exposedRect & bounds)) {
+        QHash<TileKey, QImage>::const_iterator it = tiles.constFind(key);
+        if (it == tiles.constEnd()) continue;
+        painter->drawImage(tileRect(key).topLeft(), it.value());
+    }
+}
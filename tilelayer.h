@@ -0,0 +1,49 @@
+#ifndef TILELAYER_H
+#define TILELAYER_H
+
+#include <QGraphicsItem>
+#include <QHash>
+#include <QImage>
+#include <QList>
+#include <QRect>
+#include <QPainterPath>
+
+// 瓦片键：高 32 位为列号，低 32 位为行号
+typedef quint64 TileKey;
+// 若干瓦片的局部像素（撤回擦除时贴回）
+typedef QHash<TileKey, QImage> TilePatches;
+
+// 栅格瓦片层：超出撤回深度的旧图形被画进固定大小的瓦片后释放，重绘只与可见瓦片数有关
+class TileLayer : public QGraphicsItem {
+public:
+    enum { Type = UserType + 3 };
+    enum { TileSize = 256 };
+
+    explicit TileLayer(QGraphicsItem *parent = nullptr);
+
+    void bakeItems(const QList<QGraphicsItem*> &items);      // 把图形按层叠次序画进瓦片
+    TilePatches clearArea(const QPainterPath &area);         // 清除区域内像素，返回被清除的内容
+    void restorePatches(const TilePatches &patches);         // 把清除的内容贴回
+    void removePatches(const TilePatches &patches);          // 再次清除贴回的内容（重做用）
+    void clear();                                            // 清空所有瓦片
+    bool isEmpty() const { return tiles.isEmpty(); }
+    int tileCount() const { return tiles.size(); }
+    qint64 byteSize() const;                                 // 瓦片占用的内存
+    static qint64 patchBytes(const TilePatches &patches);    // 若干局部像素占用的内存
+    TilePatches tileImages() const { return tiles; }         // 全部瓦片（隐式共享，保存文档用）
+    static QRect tileRect(TileKey key);                      // 瓦片的场景矩形
+    static TileKey keyOf(int column, int row);
+
+    int type() const override { return Type; }
+    QRectF boundingRect() const override { return bounds; }
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
+
+private:
+    QList<TileKey> tilesFor(const QRectF &rect) const;       // 与矩形相交的瓦片（含尚未创建的）
+    QImage &tileAt(TileKey key);                             // 取瓦片，不存在时创建透明瓦片
+
+    QHash<TileKey, QImage> tiles;    // 已创建的瓦片
+    QRectF bounds;                   // 所有瓦片的并集
+};
+
+#endif // TILELAYER_H
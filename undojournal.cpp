@@ -0,0 +1,317 @@
+#include "undojournal.h"
+#include "strokeitem.h"
+#include "shapeitem.h"
+#include "statictextitem.h"
+#include "brushstrokeitem.h"
+#include "layeritem.h"
+#include "selector.h"
+#include "eraser.h"
+#include <QGraphicsScene>
+#include <QGraphicsPathItem>
+#include <QSet>
+
+JournalEntry JournalEntry::drawn(QGraphicsItem *item, int primitive) {
+    JournalEntry entry;
+    entry.label = "绘制";
+    if (primitive >= 0) {
+        PrimitiveRef ref;
+        ref.batch = qgraphicsitem_cast<PrimitiveBatch*>(item);
+        ref.index = primitive;
+        entry.addedPrimitives.append(ref);
+    } else {
+        entry.added.append(item);
+    }
+    return entry;
+}
+
+JournalEntry JournalEntry::erased(const EraseResult &result) {
+    JournalEntry entry;
+    entry.label = "擦除";
+    entry.removed = result.removed;
+    entry.added = result.added;
+    entry.removedPrimitives = result.removedPrimitives;
+    entry.tilePatches = result.tilePatches;
+    entry.patchLayer = result.patchLayer;
+    return entry;
+}
+
+JournalEntry JournalEntry::textEdited(QGraphicsItem *before, QGraphicsItem *after) {
+    JournalEntry entry;
+    entry.label = "编辑文本";
+    entry.removed << before;
+    if (after) entry.added << after;
+    return entry;
+}
+
+JournalEntry JournalEntry::layerAdded(LayerItem *layer) {
+    JournalEntry entry;
+    entry.label = "新建图层";
+    entry.added.append(layer);
+    return entry;
+}
+
+JournalEntry JournalEntry::layerDeleted(LayerItem *layer) {
+    JournalEntry entry;
+    entry.label = "删除图层";
+    entry.removed.append(layer);
+    return entry;
+}
+
+UndoJournal::UndoJournal(QGraphicsScene *scene, QObject *parent)
+    : QObject(parent),
+      scene(scene),
+      maxDepth(100),
+      maxBytes(qint64(64) * 1024 * 1024),
+      undoBytes(0),
+      redoBytes(0) {
+}
+
+UndoJournal::~UndoJournal() {
+    clear();
+}
+
+// 估算单个图形占用的内存
+qint64 UndoJournal::estimateItemBytes(QGraphicsItem *item) {
+    if (StrokeItem *stroke = qgraphicsitem_cast<StrokeItem*>(item)) {
+        return stroke->byteSize();
+    }
+    if (qgraphicsitem_cast<ShapeItem*>(item)) {
+        return sizeof(ShapeItem);
+    }
+    if (PrimitiveBatch *batch = qgraphicsitem_cast<PrimitiveBatch*>(item)) {
+        return batch->byteSize();
+    }
+    if (LayerItem *layer = qgraphicsitem_cast<LayerItem*>(item)) {
+        qint64 bytes = sizeof(LayerItem) + layer->bakedTiles()->byteSize();
+        foreach (QGraphicsItem *child, layer->contentItems()) bytes += estimateItemBytes(child);
+        return bytes;
+    }
+    if (BrushStrokeItem *brush = qgraphicsitem_cast<BrushStrokeItem*>(item)) {
+        // 擦除前后的笔迹共享未改动的瓦片，这里按各自独占估算，宁多勿少
+        return brush->byteSize();
+    }
+    if (QGraphicsPathItem *pathItem = qgraphicsitem_cast<QGraphicsPathItem*>(item)) {
+        return sizeof(QGraphicsPathItem) + qint64(pathItem->path().elementCount()) * sizeof(QPainterPath::Element);
+    }
+    if (qgraphicsitem_cast<StaticTextItem*>(item)) {
+        // 排版由相同内容的文本共享，不计入单个图形
+        return sizeof(StaticTextItem);
+    }
+    return 256;
+}
+
+qint64 UndoJournal::estimateEntryBytes(const JournalEntry &entry) {
+    qint64 bytes = sizeof(JournalEntry) + TileLayer::patchBytes(entry.tilePatches);
+    foreach (QGraphicsItem *item, entry.added) bytes += estimateItemBytes(item);
+    foreach (QGraphicsItem *item, entry.removed) bytes += estimateItemBytes(item);
+    bytes += qint64(entry.addedPrimitives.size() + entry.removedPrimitives.size()) * sizeof(PrimitiveRef);
+    bytes += qint64(entry.edits.size()) * sizeof(ItemEdit);
+    return bytes;
+}
+
+// 记录一次已经生效的操作
+void UndoJournal::record(JournalEntry entry) {
+    if (entry.isEmpty()) return;
+
+    discardRedo();
+    entry.bytes = estimateEntryBytes(entry);
+    undoStack.append(entry);
+    undoBytes += entry.bytes;
+    emit applied(entry, true);
+    compact();
+    emit changed();
+}
+
+// 清空画布：图层连同内容和栅格整个移出场景，换上属性相同的空图层，撤回时原样换回
+void UndoJournal::recordClear() {
+    JournalEntry entry;
+    entry.label = "清空画布";
+    foreach (LayerItem *layer, LayerItem::layers(scene)) {
+        LayerItem *empty = layer->emptyCopy();
+        scene->removeItem(layer);
+        scene->addItem(empty);
+        entry.removed.append(layer);
+        entry.added.append(empty);
+    }
+    record(entry);
+}
+
+void UndoJournal::undo() {
+    if (undoStack.isEmpty()) return;
+    const JournalEntry entry = undoStack.takeLast();
+    undoBytes -= entry.bytes;
+    foreach (QGraphicsItem *item, entry.added) {
+        scene->removeItem(item);
+    }
+    foreach (QGraphicsItem *item, entry.removed) {
+        LayerItem::restore(scene, item);
+    }
+    foreach (const PrimitiveRef &ref, entry.addedPrimitives) {
+        ref.batch->setAlive(ref.index, false);
+    }
+    foreach (const PrimitiveRef &ref, entry.removedPrimitives) {
+        ref.batch->setAlive(ref.index, true);
+    }
+    if (entry.patchLayer) entry.patchLayer->restorePatches(entry.tilePatches);
+    applyEdits(entry, false);
+    emit applied(entry, false);
+    redoStack.append(entry);
+    redoBytes += entry.bytes;
+    emit changed();
+}
+
+void UndoJournal::redo() {
+    if (redoStack.isEmpty()) return;
+    const JournalEntry entry = redoStack.takeLast();
+    redoBytes -= entry.bytes;
+    foreach (QGraphicsItem *item, entry.removed) {
+        scene->removeItem(item);
+    }
+    foreach (QGraphicsItem *item, entry.added) {
+        LayerItem::restore(scene, item);
+    }
+    foreach (const PrimitiveRef &ref, entry.removedPrimitives) {
+        ref.batch->setAlive(ref.index, false);
+    }
+    foreach (const PrimitiveRef &ref, entry.addedPrimitives) {
+        ref.batch->setAlive(ref.index, true);
+    }
+    if (entry.patchLayer) entry.patchLayer->removePatches(entry.tilePatches);
+    applyEdits(entry, true);
+    emit applied(entry, true);
+    undoStack.append(entry);
+    undoBytes += entry.bytes;
+    compact();
+    emit changed();
+}
+
+void UndoJournal::clear() {
+    foreach (const JournalEntry &entry, undoStack) {
+        qDeleteAll(entry.removed);
+    }
+    foreach (const JournalEntry &entry, redoStack) {
+        qDeleteAll(entry.added);
+    }
+    undoStack.clear();
+    redoStack.clear();
+    undoBytes = redoBytes = 0;
+    emit changed();
+}
+
+// 外部（实时同步）要删除或替换某个图形前检查：被引用时撤回/重做会操作已释放的图形
+bool UndoJournal::references(QGraphicsItem *item, int primitive) const {
+    PrimitiveRef ref;
+    ref.batch = qgraphicsitem_cast<PrimitiveBatch*>(item);
+    ref.index = primitive;
+    foreach (const JournalEntry &entry, undoStack + redoStack) {
+        if (primitive >= 0) {
+            if (entry.addedPrimitives.contains(ref) || entry.removedPrimitives.contains(ref)) return true;
+            continue;
+        }
+        if (entry.added.contains(item) || entry.removed.contains(item)) return true;
+        foreach (const ItemEdit &edit, entry.edits) {
+            if (edit.item == item) return true;
+        }
+    }
+    return false;
+}
+
+void UndoJournal::discardRedo() {
+    foreach (const JournalEntry &entry, redoStack) {
+        releaseUndone(entry);
+    }
+    redoStack.clear();
+    redoBytes = 0;
+}
+
+// 先丢弃最远的重做记录，再把最旧的撤回记录烘焙进栅格层；最新一条始终保留
+void UndoJournal::compact() {
+    while (!redoStack.isEmpty() && undoBytes + redoBytes > maxBytes) {
+        const JournalEntry entry = redoStack.takeFirst();
+        redoBytes -= entry.bytes;
+        releaseUndone(entry);
+    }
+    const bool overLimit = undoStack.size() > maxDepth
+                           || (undoStack.size() > 1 && undoBytes > maxBytes);
+    // 重做记录可能引用即将被烘焙释放的图形，淘汰撤回记录前必须先整体丢弃
+    if (overLimit) discardRedo();
+    while (undoStack.size() > maxDepth
+           || (undoStack.size() > 1 && undoBytes + redoBytes > maxBytes)) {
+        const JournalEntry entry = undoStack.takeFirst();
+        undoBytes -= entry.bytes;
+        releaseApplied(entry);
+    }
+}
+
+void UndoJournal::releaseUndone(const JournalEntry &entry) {
+    qDeleteAll(entry.added);
+}
+
+// 撤回时按相反顺序恢复，同一图形在一条记录中多次修改时也能回到最初的状态
+void UndoJournal::applyEdits(const JournalEntry &entry, bool forward) {
+    for (int n = 0; n < entry.edits.size(); ++n) {
+        const ItemEdit &edit = entry.edits[forward ? n : entry.edits.size() - 1 - n];
+        if (edit.restyled) Selector::setStyle(edit.item, forward ? edit.styleAfter : edit.styleBefore);
+        if (edit.offset.isNull()) continue;
+        LayerItem::touch(edit.item);
+        edit.item->moveBy(forward ? edit.offset.x() : -edit.offset.x(), forward ? edit.offset.y() : -edit.offset.y());
+        LayerItem::touch(edit.item);
+    }
+}
+
+// 仍在场景中的新增图形画进所在图层的栅格后释放；不在场景中的已被更新的记录移除并由其保管，不能动。
+// 之后的记录还要原地修改的图形不烘焙，留在场景中由场景释放。新建的图层本身不烘焙，留在场景中
+void UndoJournal::releaseApplied(const JournalEntry &entry) {
+    QSet<QGraphicsItem*> edited;
+    foreach (const JournalEntry &later, undoStack + redoStack) {
+        foreach (const ItemEdit &edit, later.edits) edited.insert(edit.item);
+    }
+    QHash<LayerItem*, QList<QGraphicsItem*> > live;
+    foreach (QGraphicsItem *item, entry.added) {
+        if (item->scene() != scene || edited.contains(item)) continue;
+        LayerItem *layer = qgraphicsitem_cast<LayerItem*>(item->parentItem());
+        if (layer) live[layer].append(item);
+    }
+    for (QHash<LayerItem*, QList<QGraphicsItem*> >::const_iterator it = live.constBegin(); it != live.constEnd(); ++it) {
+        emit baking(it.key(), it.value());
+        it.key()->bakedTiles()->bakeItems(it.value());
+        foreach (QGraphicsItem *item, it.value()) {
+            scene->removeItem(item);
+            delete item;
+        }
+    }
+    qDeleteAll(entry.removed);
+}
+
+qint64 UndoJournal::totalBytes() const {
+    return undoBytes + redoBytes;
+}
+
+QVector<qint64> UndoJournal::entryBytes() const {
+    QVector<qint64> sizes;
+    sizes.reserve(undoStack.size());
+    foreach (const JournalEntry &entry, undoStack) {
+        sizes.append(entry.bytes);
+    }
+    return sizes;
+}
+
+QString UndoJournal::undoLabel() const {
+    return undoStack.isEmpty() ? QString() : undoStack.last().label;
+}
+
+QString UndoJournal::redoLabel() const {
+    return redoStack.isEmpty() ? QString() : redoStack.last().label;
+}
+
+void UndoJournal::setDepthLimit(int depth) {
+    maxDepth = qMax(1, depth);
+    compact();
+    emit changed();
+}
+
+void UndoJournal::setByteBudget(qint64 bytes) {
+    maxBytes = bytes;
+    compact();
+    emit changed();
+}
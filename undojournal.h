@@ -0,0 +1,109 @@
+#ifndef UNDOJOURNAL_H
+#define UNDOJOURNAL_H
+
+#include <QObject>
+#include <QList>
+#include <QString>
+#include <QVector>
+#include <QPointF>
+#include <QPen>
+#include "tilelayer.h"
+#include "primitivebatch.h"
+
+class QGraphicsItem;
+class QGraphicsScene;
+class LayerItem;
+struct EraseResult;
+
+// 原地修改的图形（选择工具的移动和改样式）：图形始终在场景中，记录本身不保管它
+struct ItemEdit {
+    QGraphicsItem *item = nullptr;
+    QPointF offset;                  // 位移
+    bool restyled = false;           // 是否改了样式（Selector::styleOf/setStyle）
+    QPen styleBefore;
+    QPen styleAfter;
+};
+
+// 一条历史记录：新增的图形（含图层）、移出场景的图形（含图层）、原地修改的图形，以及从某个图层的栅格中清除的像素
+// 在撤回栈中时 removed 不在场景中、由本记录保管；在重做栈中时 added 不在场景中、由本记录保管
+// 批量层中的图元不单独占有内存，撤回/重做只切换存活标记
+struct JournalEntry {
+    QString label;                   // 描述
+    QList<QGraphicsItem*> added;     // 新增的图形
+    QList<QGraphicsItem*> removed;   // 移除的图形
+    QVector<PrimitiveRef> addedPrimitives;   // 新增的批量图元
+    QVector<PrimitiveRef> removedPrimitives; // 移除的批量图元
+    QVector<ItemEdit> edits;         // 原地修改
+    TilePatches tilePatches;         // 清除的栅格像素
+    TileLayer *patchLayer = nullptr; // tilePatches 所属的栅格（图层的 bakedTiles）
+    qint64 bytes = 0;                // 估算占用的内存
+
+    bool isEmpty() const {
+        return added.isEmpty() && removed.isEmpty() && addedPrimitives.isEmpty()
+               && removedPrimitives.isEmpty() && tilePatches.isEmpty() && edits.isEmpty();
+    }
+
+    // 常用操作的记录（主窗口和轨迹回放共用，两边的历史完全相同）
+    static JournalEntry drawn(QGraphicsItem *item, int primitive = -1); // 绘制完成（primitive 不为 -1 时是批量层中的图元）
+    static JournalEntry erased(const EraseResult &result);            // 整次擦除
+    static JournalEntry textEdited(QGraphicsItem *before, QGraphicsItem *after); // 文本替换（after 为空表示删空）
+    static JournalEntry layerAdded(LayerItem *layer);                 // 新建图层（已在场景中）
+    static JournalEntry layerDeleted(LayerItem *layer);               // 删除图层（已移出场景）
+};
+
+// 撤回/重做日志：按深度和内存预算淘汰最旧的记录（仍在场景中的图形烘焙进所在图层的栅格）
+// 图形移出场景后记得原图层，撤回/重做时放回原图层
+class UndoJournal : public QObject {
+    Q_OBJECT
+public:
+    explicit UndoJournal(QGraphicsScene *scene, QObject *parent = nullptr);
+    ~UndoJournal();
+
+    void record(JournalEntry entry);             // 记录一次已经生效的操作
+    void recordClear();                          // 清空画布：每个图层换成同名的空图层（可撤回）
+
+    bool canUndo() const { return !undoStack.isEmpty(); }
+    bool canRedo() const { return !redoStack.isEmpty(); }
+    int undoCount() const { return undoStack.size(); }
+    int redoCount() const { return redoStack.size(); }
+    qint64 totalBytes() const;                   // 全部记录占用的内存
+    QVector<qint64> entryBytes() const;          // 撤回栈中每条记录占用的内存（从旧到新）
+    QString undoLabel() const;                   // 下一次撤回的描述
+    QString redoLabel() const;                   // 下一次重做的描述
+    bool references(QGraphicsItem *item, int primitive = -1) const; // 历史记录是否引用该图形（primitive 不为 -1 时是批量图元）
+
+    void setDepthLimit(int depth);               // 撤回深度
+    void setByteBudget(qint64 bytes);            // 内存预算
+    int depthLimit() const { return maxDepth; }
+    qint64 byteBudget() const { return maxBytes; }
+
+    static qint64 estimateItemBytes(QGraphicsItem *item); // 估算单个图形占用的内存
+
+public slots:
+    void undo();                                 // 撤回
+    void redo();                                 // 重做
+    void clear();                                // 丢弃全部历史（不影响场景内容）
+
+signals:
+    void changed();                              // 历史变化
+    void applied(const JournalEntry &entry, bool forward); // 一条记录已生效（新记录和重做为 forward，撤回为反向）
+    void baking(LayerItem *layer, const QList<QGraphicsItem*> &items); // 这些图形即将烘焙进图层的栅格并释放
+
+private:
+    static qint64 estimateEntryBytes(const JournalEntry &entry);
+    void discardRedo();                          // 新操作发生后丢弃重做栈
+    void compact();                              // 按深度和预算淘汰最旧的记录
+    void releaseUndone(const JournalEntry &entry);   // 释放重做栈记录保管的图形
+    void releaseApplied(const JournalEntry &entry);  // 释放撤回栈记录保管的图形
+    static void applyEdits(const JournalEntry &entry, bool forward); // 重做（forward）或撤回原地修改
+
+    QGraphicsScene *scene;
+    QList<JournalEntry> undoStack;               // 撤回栈（末尾最新）
+    QList<JournalEntry> redoStack;               // 重做栈（末尾最新）
+    int maxDepth;                                // 撤回深度
+    qint64 maxBytes;                             // 内存预算
+    qint64 undoBytes;                            // 撤回栈占用
+    qint64 redoBytes;                            // 重做栈占用
+};
+
+#endif // UNDOJOURNAL_H
@@ -0,0 +1,478 @@
+#include "vectorexporter.h"
+#include "strokeitem.h"
+#include "shapeitem.h"
+#include "tilelayer.h"
+#include "statictextitem.h"
+#include "primitivebatch.h"
+#include "brushstrokeitem.h"
+#include "layeritem.h"
+#include <QGraphicsPathItem>
+#include <QXmlStreamWriter>
+#include <QSaveFile>
+#include <QBuffer>
+#include <QImageWriter>
+#include <QPdfWriter>
+#include <QPageSize>
+#include <QPainter>
+#include <QFontMetricsF>
+#include <QTransform>
+
+namespace {
+
+const qreal PointsPerPixel = 72.0 / 96.0; // 96 DPI 下一个像素对应的 PDF 点数
+
+// 输出端：遍历场景的代码只调用这些基本图元，由 SVG 和 PDF 各自写出
+class VectorSink {
+public:
+    virtual ~VectorSink() {}
+    virtual void beginLayer(qreal opacity) = 0;
+    virtual void endLayer() = 0;
+    virtual void beginItem(const QTransform &transform) = 0; // 之后的图元使用该图形的本地坐标
+    virtual void endItem() = 0;
+    virtual void polyline(const QVector<QPointF> &points, const QPen &pen) = 0;
+    virtual void path(const QPainterPath &path, const QPen &pen, const QBrush &brush) = 0;
+    virtual void shape(ShapeItem::Kind kind, const QPointF *points, const QPen &pen) = 0;
+    virtual void text(const QPointF &baseline, const QString &text, const QFont &font, const QColor &color) = 0;
+    virtual void image(const QRectF &rect, const QImage &image) = 0;
+};
+
+// 顶点包围盒（与 ShapeItem::pointRect 一致）
+QRectF pointRect(const QPointF *points) {
+    return QRectF(points[0], points[1]).normalized();
+}
+
+// ---- SVG ----
+
+QString number(qreal value) {
+    return QString::number(value, 'g', 7);
+}
+
+class SvgSink : public VectorSink {
+public:
+    explicit SvgSink(QIODevice *device) : xml(device) {
+        xml.setAutoFormatting(false);    // 缩进会让十万个元素的文件明显变大
+    }
+
+    void begin(const QRectF &source, const QColor &background) {
+        xml.writeStartDocument();
+        xml.writeStartElement("svg");
+        xml.writeDefaultNamespace("http://www.w3.org/2000/svg");
+        xml.writeNamespace("http://www.w3.org/1999/xlink", "xlink");
+        xml.writeAttribute("version", "1.1");
+        xml.writeAttribute("width", number(source.width()));
+        xml.writeAttribute("height", number(source.height()));
+        xml.writeAttribute("viewBox", QString("%1 %2 %3 %4").arg(number(source.x()), number(source.y()),
+                                                                 number(source.width()), number(source.height())));
+        if (background.alpha() > 0) {
+            xml.writeStartElement("rect");
+            xml.writeAttribute("x", number(source.x()));
+            xml.writeAttribute("y", number(source.y()));
+            xml.writeAttribute("width", number(source.width()));
+            xml.writeAttribute("height", number(source.height()));
+            writeFill(background);
+            xml.writeEndElement();
+        }
+    }
+
+    void end() {
+        xml.writeEndElement();
+        xml.writeEndDocument();
+    }
+
+    bool hasError() const { return xml.hasError(); }
+
+    void beginLayer(qreal opacity) override {
+        xml.writeStartElement("g");
+        if (opacity < 1) xml.writeAttribute("opacity", number(opacity));
+    }
+
+    void endLayer() override {
+        xml.writeEndElement();
+    }
+
+    void beginItem(const QTransform &transform) override {
+        grouped = !transform.isIdentity();
+        if (!grouped) return;
+        xml.writeStartElement("g");
+        if (transform.type() == QTransform::TxTranslate) {
+            xml.writeAttribute("transform", QString("translate(%1 %2)").arg(number(transform.dx()), number(transform.dy())));
+        } else {
+            xml.writeAttribute("transform", QString("matrix(%1 %2 %3 %4 %5 %6)")
+                                                .arg(number(transform.m11()), number(transform.m12()),
+                                                     number(transform.m21()), number(transform.m22()),
+                                                     number(transform.dx()), number(transform.dy())));
+        }
+    }
+
+    void endItem() override {
+        if (grouped) xml.writeEndElement();
+        grouped = false;
+    }
+
+    void polyline(const QVector<QPointF> &points, const QPen &pen) override {
+        if (points.isEmpty()) return;
+        QString d;
+        d.reserve(points.size() * 16);
+        d += 'M';
+        appendPoint(&d, points.first());
+        if (points.size() == 1) {
+            d += 'L';           // 单点笔迹画成一个圆点，与 drawPolyline 的圆头一致
+            appendPoint(&d, points.first());
+        }
+        for (int i = 1; i < points.size(); ++i) {
+            d += 'L';
+            appendPoint(&d, points[i]);
+        }
+        xml.writeStartElement("path");
+        xml.writeAttribute("d", d);
+        writeStroke(pen);
+        xml.writeAttribute("fill", "none");
+        xml.writeEndElement();
+    }
+
+    void path(const QPainterPath &path, const QPen &pen, const QBrush &brush) override {
+        QString d;
+        d.reserve(path.elementCount() * 16);
+        for (int i = 0; i < path.elementCount(); ++i) {
+            const QPainterPath::Element element = path.elementAt(i);
+            switch (element.type) {
+            case QPainterPath::MoveToElement:
+                d += 'M';
+                break;
+            case QPainterPath::LineToElement:
+                d += 'L';
+                break;
+            case QPainterPath::CurveToElement:
+                d += 'C';
+                break;
+            case QPainterPath::CurveToDataElement:
+                d += ' ';
+                break;
+            }
+            appendPoint(&d, element);
+        }
+        xml.writeStartElement("path");
+        xml.writeAttribute("d", d);
+        if (pen.style() != Qt::NoPen) writeStroke(pen);
+        if (brush.style() != Qt::NoBrush) {
+            writeFill(brush.color());
+            xml.writeAttribute("fill-rule", path.fillRule() == Qt::WindingFill ? "nonzero" : "evenodd");
+        } else {
+            xml.writeAttribute("fill", "none");
+        }
+        xml.writeEndElement();
+    }
+
+    void shape(ShapeItem::Kind kind, const QPointF *points, const QPen &pen) override {
+        switch (kind) {
+        case ShapeItem::Line:
+            xml.writeStartElement("line");
+            xml.writeAttribute("x1", number(points[0].x()));
+            xml.writeAttribute("y1", number(points[0].y()));
+            xml.writeAttribute("x2", number(points[1].x()));
+            xml.writeAttribute("y2", number(points[1].y()));
+            break;
+        case ShapeItem::Rectangle: {
+            const QRectF rect = pointRect(points);
+            xml.writeStartElement("rect");
+            xml.writeAttribute("x", number(rect.x()));
+            xml.writeAttribute("y", number(rect.y()));
+            xml.writeAttribute("width", number(rect.width()));
+            xml.writeAttribute("height", number(rect.height()));
+            break;
+        }
+        case ShapeItem::Ellipse: {
+            const QRectF rect = pointRect(points);
+            xml.writeStartElement("ellipse");
+            xml.writeAttribute("cx", number(rect.center().x()));
+            xml.writeAttribute("cy", number(rect.center().y()));
+            xml.writeAttribute("rx", number(rect.width() / 2));
+            xml.writeAttribute("ry", number(rect.height() / 2));
+            break;
+        }
+        case ShapeItem::Triangle: {
+            QString list;
+            for (int i = 0; i < 3; ++i) {
+                if (i > 0) list += ' ';
+                appendPoint(&list, points[i]);
+            }
+            xml.writeStartElement("polygon");
+            xml.writeAttribute("points", list);
+            break;
+        }
+        }
+        writeStroke(pen);
+        xml.writeAttribute("fill", "none");
+        xml.writeEndElement();
+    }
+
+    void text(const QPointF &baseline, const QString &text, const QFont &font, const QColor &color) override {
+        xml.writeStartElement("text");
+        xml.writeAttribute("x", number(baseline.x()));
+        xml.writeAttribute("y", number(baseline.y()));
+        xml.writeAttribute("font-family", font.family());
+        // 字号换算成像素（96 DPI），与屏幕上的排版一致
+        const qreal pixels = font.pixelSize() > 0 ? font.pixelSize() : font.pointSizeF() / PointsPerPixel;
+        xml.writeAttribute("font-size", number(pixels));
+        if (font.bold()) xml.writeAttribute("font-weight", "bold");
+        if (font.italic()) xml.writeAttribute("font-style", "italic");
+        writeFill(color);
+        xml.writeAttribute("xml:space", "preserve");
+        xml.writeCharacters(text);
+        xml.writeEndElement();
+    }
+
+    void image(const QRectF &rect, const QImage &image) override {
+        QByteArray png;
+        QBuffer buffer(&png);
+        buffer.open(QIODevice::WriteOnly);
+        QImageWriter writer(&buffer, "png");
+        if (!writer.write(image)) return;
+        xml.writeStartElement("image");
+        xml.writeAttribute("x", number(rect.x()));
+        xml.writeAttribute("y", number(rect.y()));
+        xml.writeAttribute("width", number(rect.width()));
+        xml.writeAttribute("height", number(rect.height()));
+        xml.writeAttribute("http://www.w3.org/1999/xlink", "href",
+                           QString::fromLatin1("data:image/png;base64," + png.toBase64()));
+        xml.writeEndElement();
+    }
+
+private:
+    static void appendPoint(QString *out, const QPointF &point) {
+        *out += number(point.x());
+        *out += ' ';
+        *out += number(point.y());
+    }
+
+    void writeStroke(const QPen &pen) {
+        const QColor color = pen.color();
+        xml.writeAttribute("stroke", color.name());
+        if (color.alpha() < 255) xml.writeAttribute("stroke-opacity", number(color.alphaF()));
+        xml.writeAttribute("stroke-width", number(qMax<qreal>(1, pen.widthF())));   // 0 宽的画笔在屏幕上是 1 像素
+        switch (pen.capStyle()) {
+        case Qt::RoundCap: xml.writeAttribute("stroke-linecap", "round"); break;
+        case Qt::SquareCap: xml.writeAttribute("stroke-linecap", "square"); break;
+        default: break;
+        }
+        switch (pen.joinStyle()) {
+        case Qt::RoundJoin: xml.writeAttribute("stroke-linejoin", "round"); break;
+        case Qt::BevelJoin: xml.writeAttribute("stroke-linejoin", "bevel"); break;
+        default: break;
+        }
+    }
+
+    void writeFill(const QColor &color) {
+        xml.writeAttribute("fill", color.name());
+        if (color.alpha() < 255) xml.writeAttribute("fill-opacity", number(color.alphaF()));
+    }
+
+    QXmlStreamWriter xml;
+    bool grouped = false;      // 当前图形是否包在带变换的 <g> 中
+};
+
+// ---- PDF ----
+
+// PDF 没有图层组的透明度（需要透明度组），逐个图形乘上图层透明度；同一图层内互相重叠的半透明图形会比屏幕上深
+class PdfSink : public VectorSink {
+public:
+    PdfSink(QPainter *painter, const QRectF &source) : painter(painter) {
+        base.translate(-source.x(), -source.y());
+        painter->setRenderHint(QPainter::Antialiasing);
+        painter->setRenderHint(QPainter::SmoothPixmapTransform);
+    }
+
+    void beginLayer(qreal opacity) override { painter->setOpacity(opacity); }
+    void endLayer() override { painter->setOpacity(1); }
+    void beginItem(const QTransform &transform) override { painter->setTransform(transform * base); }
+    void endItem() override {}
+
+    void polyline(const QVector<QPointF> &points, const QPen &pen) override {
+        if (points.isEmpty()) return;
+        painter->setPen(pen);
+        painter->setBrush(Qt::NoBrush);
+        if (points.size() == 1) {
+            painter->drawPoint(points.first());
+        } else {
+            painter->drawPolyline(points.constData(), points.size());
+        }
+    }
+
+    void path(const QPainterPath &path, const QPen &pen, const QBrush &brush) override {
+        painter->setPen(pen);
+        painter->setBrush(brush);
+        painter->drawPath(path);
+    }
+
+    void shape(ShapeItem::Kind kind, const QPointF *points, const QPen &pen) override {
+        painter->setPen(pen);
+        painter->setBrush(Qt::NoBrush);
+        switch (kind) {
+        case ShapeItem::Line:
+            painter->drawLine(points[0], points[1]);
+            break;
+        case ShapeItem::Rectangle:
+            painter->drawRect(pointRect(points));
+            break;
+        case ShapeItem::Ellipse:
+            painter->drawEllipse(pointRect(points));
+            break;
+        case ShapeItem::Triangle:
+            painter->drawPolygon(points, 3);
+            break;
+        }
+    }
+
+    void text(const QPointF &baseline, const QString &text, const QFont &font, const QColor &color) override {
+        painter->setFont(font);
+        painter->setPen(color);
+        painter->drawText(baseline, text);    // PDF 引擎嵌入字体子集，文字可以选择和搜索
+    }
+
+    void image(const QRectF &rect, const QImage &image) override {
+        painter->drawImage(rect, image);
+    }
+
+private:
+    QPainter *painter;
+    QTransform base;           // 场景坐标到页面坐标
+};
+
+// ---- 场景遍历 ----
+
+// 写出一组瓦片（历史栅格或笔刷笔迹），只取与 source 相交的
+void writeTiles(VectorSink *sink, const TilePatches &tiles, const QTransform &transform, const QRectF &source) {
+    if (tiles.isEmpty()) return;
+    sink->beginItem(transform);
+    for (TilePatches::const_iterator it = tiles.constBegin(); it != tiles.constEnd(); ++it) {
+        const QRectF rect = TileLayer::tileRect(it.key());
+        if (!transform.mapRect(rect).intersects(source)) continue;
+        sink->image(rect, it.value());
+    }
+    sink->endItem();
+}
+
+// 写出一个图形，返回写出的图元数；无法表示的图形跳过
+int writeItem(VectorSink *sink, QGraphicsItem *item, const QRectF &source) {
+    if (PrimitiveBatch *batch = qgraphicsitem_cast<PrimitiveBatch*>(item)) {
+        // 批量层的顶点已是场景坐标
+        int count = 0;
+        QPointF points[3];
+        sink->beginItem(QTransform());
+        for (int i = 0; i < batch->count(); ++i) {
+            if (!batch->isAlive(i) || !batch->primitiveRect(i).intersects(source)) continue;
+            for (int k = 0; k < batch->pointCount(); ++k) points[k] = batch->vertex(i, k);
+            sink->shape(batch->kind(), points, batch->pen(i));
+            ++count;
+        }
+        sink->endItem();
+        return count;
+    }
+
+    if (!item->sceneBoundingRect().intersects(source)) return 0;
+    const QTransform transform = item->sceneTransform();
+    if (StrokeItem *stroke = qgraphicsitem_cast<StrokeItem*>(item)) {
+        sink->beginItem(transform);
+        if (stroke->isCubic()) {
+            sink->path(stroke->path(), stroke->pen(), Qt::NoBrush);
+        } else {
+            sink->polyline(stroke->points(), stroke->pen());
+        }
+        sink->endItem();
+    } else if (ShapeItem *shape = qgraphicsitem_cast<ShapeItem*>(item)) {
+        QPointF points[3];
+        for (int k = 0; k < shape->pointCount(); ++k) points[k] = shape->point(k);
+        sink->beginItem(transform);
+        sink->shape(shape->kind(), points, shape->pen());
+        sink->endItem();
+    } else if (StaticTextItem *text = qgraphicsitem_cast<StaticTextItem*>(item)) {
+        // 静态文本从 (Margin, Margin) 开始排版，换算成基线位置
+        const QFont font = text->font();
+        const QPointF baseline(StaticTextItem::Margin, StaticTextItem::Margin + QFontMetricsF(font).ascent());
+        sink->beginItem(transform);
+        sink->text(baseline, text->text(), font, text->color());
+        sink->endItem();
+    } else if (QGraphicsPathItem *pathItem = qgraphicsitem_cast<QGraphicsPathItem*>(item)) {
+        sink->beginItem(transform);
+        sink->path(pathItem->path(), pathItem->pen(), pathItem->brush());
+        sink->endItem();
+    } else if (BrushStrokeItem *brush = qgraphicsitem_cast<BrushStrokeItem*>(item)) {
+        writeTiles(sink, brush->tileImages(), transform, source);
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+int writeLayers(VectorSink *sink, const QList<LayerItem*> &layers, const QRectF &source) {
+    int count = 0;
+    foreach (LayerItem *layer, layers) {
+        if (!layer->isVisible()) continue;
+        sink->beginLayer(layer->opacity());
+        if (TileLayer *baked = layer->bakedTiles()) {
+            writeTiles(sink, baked->tileImages(), baked->sceneTransform(), source);
+        }
+        foreach (QGraphicsItem *item, layer->contentItems()) {
+            if (item->isVisible()) count += writeItem(sink, item, source);
+        }
+        sink->endLayer();
+    }
+    return count;
+}
+
+}
+
+namespace VectorExport {
+
+bool exportSvg(const QList<LayerItem*> &layers, const QRectF &source, const QString &filePath,
+               QString *error, int *written, const QColor &background) {
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+    SvgSink sink(&file);
+    sink.begin(source, background);
+    const int count = writeLayers(&sink, layers, source);
+    sink.end();
+    if (sink.hasError() || !file.commit()) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+    if (written) *written = count;
+    return true;
+}
+
+bool exportPdf(const QList<LayerItem*> &layers, const QRectF &source, const QString &filePath,
+               QString *error, int *written, const QColor &background) {
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+    int count = 0;
+    {
+        QPdfWriter pdf(&file);
+        pdf.setCreator("彩虹画板");
+        pdf.setResolution(96);
+        pdf.setPageSize(QPageSize(source.size() * PointsPerPixel, QPageSize::Point, QString(), QPageSize::ExactMatch));
+        pdf.setPageMargins(QMarginsF(0, 0, 0, 0));
+        QPainter painter;
+        if (!painter.begin(&pdf)) {
+            if (error) *error = "无法创建 PDF";
+            return false;
+        }
+        if (background.alpha() > 0) painter.fillRect(QRectF(QPointF(0, 0), source.size()), background);
+        PdfSink sink(&painter, source);
+        count = writeLayers(&sink, layers, source);
+        painter.end();          // 结束时写出页面内容和字体
+    }
+    if (!file.commit()) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+    if (written) *written = count;
+    return true;
+}
+
+}
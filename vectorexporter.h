@@ -0,0 +1,25 @@
+#ifndef VECTOREXPORTER_H
+#define VECTOREXPORTER_H
+
+#include <QList>
+#include <QRectF>
+#include <QColor>
+#include <QString>
+
+class LayerItem;
+
+// 矢量导出：按图层从下到上、图层内按层叠次序逐个图形写出，不把场景栅格化。
+// 笔迹写成路径，形状写成对应的原生元素，文字写成真正的文本；笔刷笔迹和图层的历史栅格本来就是像素，按瓦片嵌入图片。
+// 每次只转换一个图形，内存占用与文档大小无关；隐藏的图层跳过，与 source 不相交的图形跳过
+namespace VectorExport {
+
+// 导出为 SVG：坐标直接使用场景坐标，viewBox 为 source；图层写成带透明度的 <g>
+bool exportSvg(const QList<LayerItem*> &layers, const QRectF &source, const QString &filePath,
+               QString *error, int *written = nullptr, const QColor &background = Qt::white);
+// 导出为 PDF：单页，页面大小按 96 DPI 对应 source；图层透明度逐个图形应用
+bool exportPdf(const QList<LayerItem*> &layers, const QRectF &source, const QString &filePath,
+               QString *error, int *written = nullptr, const QColor &background = Qt::white);
+
+}
+
+#endif // VECTOREXPORTER_H